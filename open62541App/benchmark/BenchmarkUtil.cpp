@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <dbAccess.h>
+
+#include "BenchmarkUtil.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+CpuTime getCpuTime() {
+  struct rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return CpuTime{
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6,
+    usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6};
+}
+
+std::string getDefaultDbdFile(
+    const std::string &programPath, const std::string &dbdName) {
+  auto lastSlash = programPath.rfind('/');
+  std::string programDirectory = (lastSlash == std::string::npos)
+    ? std::string(".") : programPath.substr(0, lastSlash);
+  return programDirectory + "/../O.Common/" + dbdName;
+}
+
+long long getResidentSetSize() {
+  FILE *statm = std::fopen("/proc/self/statm", "r");
+  if (!statm) {
+    return -1;
+  }
+  long long size, resident;
+  bool success = std::fscanf(statm, "%lld %lld", &size, &resident) == 2;
+  std::fclose(statm);
+  return success ? resident * ::sysconf(_SC_PAGESIZE) : -1;
+}
+
+void loadDatabase(const std::string &database) {
+  char path[] = "/tmp/open62541BenchmarkXXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd < 0) {
+    throw std::runtime_error(
+      std::string("Could not create temporary file: ")
+      + std::strerror(errno));
+  }
+  bool success = ::write(fd, database.data(), database.size())
+    == static_cast<ssize_t>(database.size());
+  ::close(fd);
+  success = success && !::dbLoadRecords(path, nullptr);
+  ::unlink(path);
+  if (!success) {
+    throw std::runtime_error("Could not load the records.");
+  }
+}
+
+void parseArguments(int argc, char **argv,
+    const std::function<void(const std::string &name,
+      const std::string &value)> &setOption) {
+  for (int i = 1; i < argc; ++i) {
+    std::string argument(argv[i]);
+    auto separator = argument.find('=');
+    if (argument.compare(0, 2, "--") || separator == std::string::npos) {
+      throw std::invalid_argument("Invalid argument: " + argument);
+    }
+    setOption(argument.substr(2, separator - 2),
+      argument.substr(separator + 1));
+  }
+}
+
+void printUsage(const char *programName, const char *options) {
+  std::fprintf(stderr, "Usage: %s [options]\n\nOptions:\n%s", programName,
+    options);
+}
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_BENCHMARK_UTIL_H
+#define OPEN62541_EPICS_BENCHMARK_UTIL_H
+
+#include <functional>
+#include <string>
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+/**
+ * CPU time (in seconds) used by the whole process. This includes the time
+ * used by other threads of the process (e.g. the embedded server or the
+ * callback threads of the IOC).
+ */
+struct CpuTime {
+  double system;
+  double user;
+};
+
+/**
+ * Returns the CPU time that has been used by the process so far.
+ */
+CpuTime getCpuTime();
+
+/**
+ * Returns the default path of the DBD file of a benchmark program. The DBD
+ * file is generated in the O.Common directory, which is a sibling of the
+ * directory that contains the program. The program path is usually argv[0].
+ */
+std::string getDefaultDbdFile(
+  const std::string &programPath, const std::string &dbdName);
+
+/**
+ * Returns the resident set size of the process (in bytes) or -1 if it cannot
+ * be determined (it is only available on Linux).
+ */
+long long getResidentSetSize();
+
+/**
+ * Loads the records defined by the specified database into the IOC. The
+ * database is written to a temporary file, because dbLoadRecords can only
+ * read from files. Throws std::runtime_error if the records cannot be loaded.
+ */
+void loadDatabase(const std::string &database);
+
+/**
+ * Parses the command-line arguments of a benchmark program. Each argument
+ * must have the form "--<name>=<value>" and is passed to the specified
+ * function. Throws std::invalid_argument if an argument does not have this
+ * form. The function may throw as well (e.g. for an unknown option).
+ */
+void parseArguments(int argc, char **argv,
+  const std::function<void(const std::string &name, const std::string &value)>
+    &setOption);
+
+/**
+ * Prints the usage of a benchmark program to stderr. The options are printed
+ * after a heading and should end with a newline.
+ */
+void printUsage(const char *programName, const char *options);
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
+
+#endif // OPEN62541_EPICS_BENCHMARK_UTIL_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "UaException.h"
+
+#include "EmbeddedServer.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+EmbeddedServer::EmbeddedServer(std::uint16_t port, std::size_t numberOfNodes,
+    ValueType valueType, std::size_t arraySize)
+    : arraySize(arraySize), namespaceIndex(1), numberOfNodes(numberOfNodes),
+    port(port), running(false), server(nullptr), updateCount(0),
+    updateRate(0.0), valueType(valueType) {
+  // The node IDs are created once, so that updating the values does not
+  // have to allocate them again.
+  nodeIds.reserve(numberOfNodes);
+  for (std::size_t i = 0; i < numberOfNodes; ++i) {
+    std::string name = "benchmark." + std::to_string(i);
+    nodeIds.push_back(
+      UaNodeId(UA_NODEID_STRING_ALLOC(namespaceIndex, name.c_str())));
+  }
+}
+
+EmbeddedServer::~EmbeddedServer() {
+  stop();
+}
+
+std::string EmbeddedServer::getEndpointUrl() const {
+  return "opc.tcp://127.0.0.1:" + std::to_string(port);
+}
+
+
+UaVariant EmbeddedServer::makeValue(ValueType valueType,
+    std::size_t arraySize, std::uint64_t seed) {
+  UA_Variant variant;
+  UA_Variant_init(&variant);
+  std::size_t length = arraySize ? arraySize : 1;
+  const UA_DataType *type;
+  switch (valueType) {
+  case ValueType::doubleType:
+    type = &UA_TYPES[UA_TYPES_DOUBLE];
+    break;
+  case ValueType::int32Type:
+    type = &UA_TYPES[UA_TYPES_INT32];
+    break;
+  case ValueType::stringType:
+  default:
+    type = &UA_TYPES[UA_TYPES_STRING];
+    break;
+  }
+  void *data = UA_Array_new(length, type);
+  if (!data) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  for (std::size_t i = 0; i < length; ++i) {
+    switch (valueType) {
+    case ValueType::doubleType:
+      static_cast<UA_Double *>(data)[i] = static_cast<UA_Double>(seed + i);
+      break;
+    case ValueType::int32Type:
+      static_cast<UA_Int32 *>(data)[i] = static_cast<UA_Int32>(seed + i);
+      break;
+    case ValueType::stringType:
+      static_cast<UA_String *>(data)[i] =
+        UA_String_fromChars(("value " + std::to_string(seed + i)).c_str());
+      break;
+    }
+  }
+  if (arraySize) {
+    UA_Variant_setArray(&variant, data, length, type);
+  } else {
+    UA_Variant_setScalar(&variant, data, type);
+  }
+  return UaVariant(std::move(variant));
+}
+
+EmbeddedServer::ValueType EmbeddedServer::parseValueType(
+    const std::string &name) {
+  if (name == "double") {
+    return ValueType::doubleType;
+  } else if (name == "int32") {
+    return ValueType::int32Type;
+  } else if (name == "string") {
+    return ValueType::stringType;
+  }
+  throw std::invalid_argument("Unknown value type: " + name);
+}
+
+void EmbeddedServer::start() {
+  if (server) {
+    return;
+  }
+  server = UA_Server_new();
+  if (!server) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  try {
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    // The informational messages of the server would clutter the output of
+    // the benchmark.
+    if (config->logger.clear) {
+      config->logger.clear(config->logger.context);
+    }
+    config->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+    auto status = UA_ServerConfig_setMinimal(config, port, nullptr);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+    // The default limits are much too low for some of the benchmarks.
+    config->maxSecureChannels = 1000;
+    config->maxSessions = 1000;
+    config->publishingIntervalLimits.min = 5.0;
+    config->samplingIntervalLimits.min = 5.0;
+    // Zero does not mean "unlimited" here, so we use a limit that is high
+    // enough to fit a notification for each node into a single publish
+    // response.
+    config->maxNotificationsPerPublish = 1000000;
+    addNodes();
+    status = UA_Server_run_startup(server);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+    if (updateRate > 0.0) {
+      status = UA_Server_addRepeatedCallback(
+        server, updateCallback, this, 1000.0 / updateRate, nullptr);
+      if (status != UA_STATUSCODE_GOOD) {
+        UA_Server_run_shutdown(server);
+        throw UaException(status);
+      }
+    }
+  } catch (...) {
+    UA_Server_delete(server);
+    server = nullptr;
+    throw;
+  }
+  running.store(true, std::memory_order_release);
+  serverThread = std::thread([this]() {
+    while (running.load(std::memory_order_acquire)) {
+      UA_Server_run_iterate(server, true);
+    }
+  });
+}
+
+void EmbeddedServer::stop() {
+  if (!server) {
+    return;
+  }
+  running.store(false, std::memory_order_release);
+  if (serverThread.joinable()) {
+    serverThread.join();
+  }
+  UA_Server_run_shutdown(server);
+  UA_Server_delete(server);
+  server = nullptr;
+}
+
+const char *EmbeddedServer::valueTypeName(ValueType valueType) {
+  switch (valueType) {
+  case ValueType::doubleType:
+    return "double";
+  case ValueType::int32Type:
+    return "int32";
+  case ValueType::stringType:
+    return "string";
+  }
+  return "unknown";
+}
+
+void EmbeddedServer::addNodes() {
+  UaVariant initialValue = makeValue(0);
+  for (std::size_t i = 0; i < numberOfNodes; ++i) {
+    UA_VariableAttributes attributes = UA_VariableAttributes_default;
+    std::string name = "benchmark." + std::to_string(i);
+    attributes.displayName = UA_LOCALIZEDTEXT(
+      const_cast<char *>("en-US"), const_cast<char *>(name.c_str()));
+    attributes.accessLevel =
+      UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    attributes.dataType = initialValue.get().type->typeId;
+    UA_UInt32 arrayDimensions[1] = {static_cast<UA_UInt32>(arraySize)};
+    if (arraySize) {
+      attributes.valueRank = UA_VALUERANK_ONE_DIMENSION;
+      attributes.arrayDimensions = arrayDimensions;
+      attributes.arrayDimensionsSize = 1;
+    } else {
+      attributes.valueRank = UA_VALUERANK_SCALAR;
+    }
+    // The attributes are copied by the server, so we can pass the value
+    // without copying it first.
+    attributes.value = initialValue.get();
+    auto status = UA_Server_addVariableNode(server, nodeIds[i].get(),
+      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+      UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+      UA_QUALIFIEDNAME(namespaceIndex, const_cast<char *>(name.c_str())),
+      UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), attributes,
+      nullptr, nullptr);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+  }
+}
+
+void EmbeddedServer::updateValues() {
+  auto seed = updateCount.fetch_add(1, std::memory_order_relaxed) + 1;
+  UaVariant value = makeValue(seed);
+  UA_WriteValue writeValue;
+  UA_WriteValue_init(&writeValue);
+  writeValue.attributeId = UA_ATTRIBUTEID_VALUE;
+  writeValue.value.hasValue = true;
+  // The write value does not own the variant, so it must not be cleared.
+  writeValue.value.value = value.get();
+  // The source timestamp is used by the client for calculating the delivery
+  // latency of notifications.
+  writeValue.value.hasSourceTimestamp = true;
+  for (std::size_t i = 0; i < numberOfNodes; ++i) {
+    writeValue.nodeId = nodeIds[i].get();
+    writeValue.value.sourceTimestamp = UA_DateTime_now();
+    UA_Server_write(server, &writeValue);
+  }
+}
+
+void EmbeddedServer::updateCallback(UA_Server *, void *data) {
+  static_cast<EmbeddedServer *>(data)->updateValues();
+}
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
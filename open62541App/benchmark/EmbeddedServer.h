@@ -0,0 +1,184 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_EMBEDDED_SERVER_H
+#define OPEN62541_EPICS_EMBEDDED_SERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "open62541.h"
+}
+
+#include "UaNodeId.h"
+#include "UaVariant.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+/**
+ * OPC UA server that runs in its own thread inside the benchmark process and
+ * listens on the loopback interface. The server provides a configurable
+ * number of variable nodes that can optionally be updated periodically.
+ */
+class EmbeddedServer {
+
+public:
+
+  /**
+   * Type of the values of the variable nodes.
+   */
+  enum class ValueType {
+    doubleType, int32Type, stringType
+  };
+
+  /**
+   * Creates a server that listens on the specified port and provides the
+   * specified number of nodes. If the array size is zero, the nodes have
+   * scalar values. Otherwise, they have array values of the specified size.
+   * The server is not started until start() is called.
+   */
+  EmbeddedServer(std::uint16_t port, std::size_t numberOfNodes,
+      ValueType valueType, std::size_t arraySize);
+
+  /**
+   * Destructor. Stops the server if it is running.
+   */
+  ~EmbeddedServer();
+
+  /**
+   * Returns the endpoint URL that clients can use for connecting to this
+   * server.
+   */
+  std::string getEndpointUrl() const;
+
+  /**
+   * Returns the ID of the node with the specified index.
+   */
+  inline const UaNodeId &getNodeId(std::size_t index) const {
+    return nodeIds[index];
+  }
+
+  /**
+   * Returns the number of times that the values of the nodes have been
+   * updated since the server was started.
+   */
+  inline std::uint64_t getUpdateCount() const {
+    return updateCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Tells whether the server is running.
+   */
+  inline bool isRunning() const {
+    return server != nullptr;
+  }
+
+  /**
+   * Creates a value of the type used by the nodes of this server. All
+   * elements of the value are derived from the specified number.
+   */
+  inline UaVariant makeValue(std::uint64_t seed) const {
+    return makeValue(valueType, arraySize, seed);
+  }
+
+  /**
+   * Creates a value of the specified type. If the array size is zero, the
+   * value is a scalar. All elements of the value are derived from the
+   * specified number, like for makeValue(std::uint64_t).
+   */
+  static UaVariant makeValue(ValueType valueType, std::size_t arraySize,
+      std::uint64_t seed);
+
+  /**
+   * Parses the name of a value type ("double", "int32", or "string"). Throws
+   * an std::invalid_argument if the name is not valid.
+   */
+  static ValueType parseValueType(const std::string &name);
+
+  /**
+   * Sets the rate (in Hz) at which the values of all nodes are updated. Zero
+   * means that the values are never updated. This only has an effect if it is
+   * called before starting the server.
+   */
+  inline void setUpdateRate(double rate) {
+    updateRate = rate;
+  }
+
+  /**
+   * Creates the nodes and starts the server thread. Throws an exception if
+   * the server cannot be started. The server can be started again after it
+   * has been stopped, which is useful for simulating server restarts.
+   */
+  void start();
+
+  /**
+   * Stops the server thread and destroys the server and its nodes. Clients
+   * that are connected to the server lose their connection.
+   */
+  void stop();
+
+  /**
+   * Returns the name of a value type.
+   */
+  static const char *valueTypeName(ValueType valueType);
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  EmbeddedServer(const EmbeddedServer &) = delete;
+  EmbeddedServer(EmbeddedServer &&) = delete;
+  EmbeddedServer &operator=(const EmbeddedServer &) = delete;
+  EmbeddedServer &operator=(EmbeddedServer &&) = delete;
+
+  std::size_t arraySize;
+  UA_UInt16 namespaceIndex;
+  std::vector<UaNodeId> nodeIds;
+  std::size_t numberOfNodes;
+  std::uint16_t port;
+  std::atomic<bool> running;
+  UA_Server *server;
+  std::thread serverThread;
+  std::atomic<std::uint64_t> updateCount;
+  double updateRate;
+  ValueType valueType;
+
+  void addNodes();
+  void updateValues();
+
+  static void updateCallback(UA_Server *server, void *data);
+
+};
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
+
+#endif // OPEN62541_EPICS_EMBEDDED_SERVER_H
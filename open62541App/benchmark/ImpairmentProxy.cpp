@@ -0,0 +1,362 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ImpairmentProxy.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+namespace {
+
+// On Linux, we have to ask send not to raise SIGPIPE when the peer has closed
+// the connection. On macOS, this is done through a socket option instead.
+#ifdef MSG_NOSIGNAL
+const int sendFlags = MSG_NOSIGNAL;
+#else
+const int sendFlags = 0;
+#endif
+
+void configureSocket(int socket) {
+  int one = 1;
+  // Like the open62541 library, we do not want the kernel to delay small
+  // packets, because this would add latency that we did not ask for.
+  ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+  ::setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+::sockaddr_in makeLoopbackAddress(std::uint16_t port) {
+  ::sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  return address;
+}
+
+std::chrono::steady_clock::duration toDuration(double seconds) {
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(seconds));
+}
+
+} // anonymous namespace
+
+ImpairmentProxy::ImpairmentProxy(std::uint16_t listenPort,
+    std::uint16_t targetPort, const Impairments &impairments)
+    : droppedConnections(0), impairments(impairments), listenPort(listenPort),
+    listenSocket(-1), running(false), targetPort(targetPort) {
+}
+
+ImpairmentProxy::~ImpairmentProxy() {
+  stop();
+}
+
+std::size_t ImpairmentProxy::dropConnections() {
+  std::lock_guard<std::mutex> lock(connectionsMutex);
+  std::size_t dropped = 0;
+  for (auto &connection : connections) {
+    if (connection->closedPipes.load() == 2) {
+      continue;
+    }
+    // Data that is still in transit is lost when the link breaks.
+    for (auto pipe : {&connection->clientToServer,
+        &connection->serverToClient}) {
+      std::lock_guard<std::mutex> pipeLock(pipe->mutex);
+      pipe->queue.clear();
+    }
+    // Shutting the sockets down wakes up the threads of the connection, which
+    // then finish. The sockets are closed when the connection is reaped.
+    ::shutdown(connection->clientSocket, SHUT_RDWR);
+    ::shutdown(connection->serverSocket, SHUT_RDWR);
+    connection->clientToServer.cv.notify_all();
+    connection->serverToClient.cv.notify_all();
+    ++dropped;
+  }
+  droppedConnections.fetch_add(dropped, std::memory_order_relaxed);
+  return dropped;
+}
+
+std::string ImpairmentProxy::getEndpointUrl() const {
+  return "opc.tcp://127.0.0.1:" + std::to_string(listenPort);
+}
+
+void ImpairmentProxy::start() {
+  if (running.load()) {
+    return;
+  }
+  listenSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listenSocket < 0) {
+    throw std::runtime_error(
+      std::string("Could not create socket: ") + std::strerror(errno));
+  }
+  int one = 1;
+  ::setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  auto address = makeLoopbackAddress(listenPort);
+  if (::bind(listenSocket, reinterpret_cast<::sockaddr *>(&address),
+        sizeof(address))
+      || ::listen(listenSocket, 16)) {
+    auto error = errno;
+    ::close(listenSocket);
+    listenSocket = -1;
+    throw std::runtime_error("Could not listen on port "
+      + std::to_string(listenPort) + ": " + std::strerror(error));
+  }
+  running.store(true);
+  acceptThread = std::thread([this]() {acceptConnections();});
+}
+
+void ImpairmentProxy::stop() {
+  if (!running.load()) {
+    return;
+  }
+  running.store(false);
+  acceptThread.join();
+  reapConnections(true);
+  ::close(listenSocket);
+  listenSocket = -1;
+}
+
+void ImpairmentProxy::acceptConnections() {
+  std::exponential_distribution<double> dropDistribution(
+    impairments.dropInterval > 0.0 ? 1.0 / impairments.dropInterval : 1.0);
+  auto nextDropTime = std::chrono::steady_clock::now()
+    + toDuration(dropDistribution(random));
+  while (running.load()) {
+    reapConnections(false);
+    // We wake up regularly, so that we notice when the proxy is stopped and
+    // when connections have to be dropped.
+    auto timeout = std::chrono::milliseconds(100);
+    if (impairments.dropInterval > 0.0) {
+      // We round up, so that we do not spin while less than a millisecond is
+      // left.
+      timeout = std::max(std::chrono::milliseconds(0), std::min(timeout,
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+          nextDropTime - std::chrono::steady_clock::now())
+        + std::chrono::milliseconds(1)));
+    }
+    ::pollfd pollFd;
+    pollFd.fd = listenSocket;
+    pollFd.events = POLLIN;
+    pollFd.revents = 0;
+    int ready = ::poll(&pollFd, 1, static_cast<int>(timeout.count()));
+    if (impairments.dropInterval > 0.0
+        && std::chrono::steady_clock::now() >= nextDropTime) {
+      dropConnections();
+      nextDropTime = std::chrono::steady_clock::now()
+        + toDuration(dropDistribution(random));
+    }
+    if (ready > 0 && (pollFd.revents & POLLIN)) {
+      int clientSocket = ::accept(listenSocket, nullptr, nullptr);
+      if (clientSocket >= 0) {
+        forward(clientSocket);
+      }
+    }
+  }
+}
+
+void ImpairmentProxy::forward(int clientSocket) {
+  int serverSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+  auto address = makeLoopbackAddress(targetPort);
+  if (serverSocket < 0
+      || ::connect(serverSocket, reinterpret_cast<::sockaddr *>(&address),
+        sizeof(address))) {
+    // If the server is not available, the client sees the connection being
+    // closed right away, like it would when connecting to a proxy or load
+    // balancer in front of an unavailable server.
+    if (serverSocket >= 0) {
+      ::close(serverSocket);
+    }
+    ::close(clientSocket);
+    return;
+  }
+  configureSocket(clientSocket);
+  configureSocket(serverSocket);
+  std::unique_ptr<ForwardedConnection> connection(new ForwardedConnection);
+  connection->clientSocket = clientSocket;
+  connection->serverSocket = serverSocket;
+  connection->clientToServer.source = clientSocket;
+  connection->clientToServer.destination = serverSocket;
+  connection->clientToServer.random.seed(random());
+  connection->serverToClient.source = serverSocket;
+  connection->serverToClient.destination = clientSocket;
+  connection->serverToClient.random.seed(random());
+  auto &connectionRef = *connection;
+  for (auto pipe : {&connection->clientToServer,
+      &connection->serverToClient}) {
+    pipe->readerThread = std::thread([this, &connectionRef, pipe]() {
+      readPipe(connectionRef, *pipe);
+    });
+    pipe->writerThread = std::thread([this, &connectionRef, pipe]() {
+      writePipe(connectionRef, *pipe);
+    });
+  }
+  std::lock_guard<std::mutex> lock(connectionsMutex);
+  connections.push_back(std::move(connection));
+}
+
+void ImpairmentProxy::readPipe(ForwardedConnection &, Pipe &pipe) {
+  std::uniform_real_distribution<double> jitterDistribution(
+    0.0, impairments.jitter);
+  std::vector<char> buffer(65536);
+  while (true) {
+    auto received = ::recv(pipe.source, buffer.data(), buffer.size(), 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      break;
+    }
+    auto now = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(pipe.mutex);
+      // With a limited bandwidth, the data can only be sent when the data
+      // received earlier has been sent, and sending takes time.
+      auto deliveryTime = now;
+      if (impairments.bandwidth > 0.0) {
+        pipe.linkFreeTime = std::max(now, pipe.linkFreeTime)
+          + toDuration(received / impairments.bandwidth);
+        deliveryTime = pipe.linkFreeTime;
+      }
+      deliveryTime += toDuration(impairments.delay);
+      if (impairments.jitter > 0.0) {
+        deliveryTime += toDuration(jitterDistribution(pipe.random));
+      }
+      // TCP never reorders data, so data cannot overtake data that was
+      // received earlier, even if its jitter is smaller.
+      deliveryTime = std::max(deliveryTime, pipe.lastDeliveryTime);
+      pipe.lastDeliveryTime = deliveryTime;
+      pipe.queue.push_back(Chunk{
+        std::vector<char>(buffer.begin(), buffer.begin() + received),
+        deliveryTime});
+    }
+    pipe.cv.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(pipe.mutex);
+    pipe.sourceClosed = true;
+  }
+  pipe.cv.notify_all();
+}
+
+void ImpairmentProxy::reapConnections(bool all) {
+  std::vector<std::unique_ptr<ForwardedConnection>> finishedConnections;
+  {
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (auto i = connections.begin(); i != connections.end();) {
+      auto &connection = *i;
+      if (all) {
+        ::shutdown(connection->clientSocket, SHUT_RDWR);
+        ::shutdown(connection->serverSocket, SHUT_RDWR);
+        for (auto pipe : {&connection->clientToServer,
+            &connection->serverToClient}) {
+          std::lock_guard<std::mutex> pipeLock(pipe->mutex);
+          pipe->queue.clear();
+          pipe->cv.notify_all();
+        }
+      } else if (connection->closedPipes.load() < 2) {
+        ++i;
+        continue;
+      }
+      finishedConnections.push_back(std::move(connection));
+      i = connections.erase(i);
+    }
+  }
+  // The threads are joined without holding the mutex, because they might
+  // still be running for a short time.
+  for (auto &connection : finishedConnections) {
+    for (auto pipe : {&connection->clientToServer,
+        &connection->serverToClient}) {
+      pipe->readerThread.join();
+      pipe->writerThread.join();
+    }
+    ::close(connection->clientSocket);
+    ::close(connection->serverSocket);
+  }
+}
+
+void ImpairmentProxy::writePipe(ForwardedConnection &connection,
+    Pipe &pipe) {
+  bool failed = false;
+  while (!failed) {
+    Chunk chunk;
+    {
+      std::unique_lock<std::mutex> lock(pipe.mutex);
+      pipe.cv.wait(lock, [&pipe]() {
+        return !pipe.queue.empty() || pipe.sourceClosed;
+      });
+      if (pipe.queue.empty()) {
+        // The source has been closed and all data has been delivered.
+        break;
+      }
+      auto deliveryTime = pipe.queue.front().deliveryTime;
+      if (std::chrono::steady_clock::now() < deliveryTime) {
+        pipe.cv.wait_until(lock, deliveryTime);
+        continue;
+      }
+      chunk = std::move(pipe.queue.front());
+      pipe.queue.pop_front();
+    }
+    std::size_t sent = 0;
+    while (sent < chunk.data.size()) {
+      auto result = ::send(pipe.destination, chunk.data.data() + sent,
+        chunk.data.size() - sent, sendFlags);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        failed = true;
+        break;
+      }
+      sent += result;
+    }
+  }
+  if (failed) {
+    // If the destination is gone, there is no point in receiving more data
+    // from the source, so we wake up the reader.
+    ::shutdown(pipe.source, SHUT_RDWR);
+  } else {
+    // We forward the end of the stream, like the source did.
+    ::shutdown(pipe.destination, SHUT_WR);
+  }
+  connection.closedPipes.fetch_add(1);
+}
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
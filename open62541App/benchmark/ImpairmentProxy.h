@@ -0,0 +1,204 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_IMPAIRMENT_PROXY_H
+#define OPEN62541_EPICS_IMPAIRMENT_PROXY_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+/**
+ * TCP proxy that runs inside the benchmark process and forwards connections
+ * from the loopback interface to a server on the loopback interface, while
+ * impairing the traffic like a wide-area network would: the data is delayed
+ * (with optional jitter), the bandwidth is limited, and connections can be
+ * dropped at random. The impairments are applied to each direction
+ * separately, so the round-trip time is twice the configured delay. The random
+ * numbers are generated with a fixed seed, so that each run uses the same
+ * sequence of jitter values and drop intervals.
+ */
+class ImpairmentProxy {
+
+public:
+
+  /**
+   * Impairments applied by the proxy. Zero disables the respective
+   * impairment.
+   */
+  struct Impairments {
+    // Bandwidth of each direction (in bytes per second).
+    double bandwidth = 0.0;
+    // One-way delay (in seconds).
+    double delay = 0.0;
+    // Mean time (in seconds) between dropping all connections. The actual
+    // times are exponentially distributed.
+    double dropInterval = 0.0;
+    // Maximum additional one-way delay (in seconds). The actual additional
+    // delay is uniformly distributed between zero and this value. The order
+    // of the data is always preserved, like in a real TCP connection.
+    double jitter = 0.0;
+  };
+
+  /**
+   * Creates a proxy that listens on the specified port and forwards
+   * connections to the target port. The proxy is not started until start()
+   * is called.
+   */
+  ImpairmentProxy(std::uint16_t listenPort, std::uint16_t targetPort,
+      const Impairments &impairments);
+
+  /**
+   * Destructor. Stops the proxy if it is running.
+   */
+  ~ImpairmentProxy();
+
+  /**
+   * Drops all connections that are currently forwarded, like a broken network
+   * link would. Returns the number of connections that have been dropped.
+   */
+  std::size_t dropConnections();
+
+  /**
+   * Returns the number of connections that have been dropped since the proxy
+   * was created (both through dropConnections() and at random).
+   */
+  inline std::uint64_t getDroppedConnections() const {
+    return droppedConnections.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the endpoint URL that clients can use for connecting to the
+   * server through this proxy.
+   */
+  std::string getEndpointUrl() const;
+
+  /**
+   * Returns the impairments applied by this proxy.
+   */
+  inline const Impairments &getImpairments() const {
+    return impairments;
+  }
+
+  /**
+   * Starts listening and forwarding connections. Throws an exception if the
+   * listening socket cannot be created.
+   */
+  void start();
+
+  /**
+   * Stops the proxy and closes all connections.
+   */
+  void stop();
+
+private:
+
+  /**
+   * Chunk of data that is waiting to be delivered.
+   */
+  struct Chunk {
+    std::vector<char> data;
+    std::chrono::steady_clock::time_point deliveryTime;
+  };
+
+  /**
+   * One direction of a forwarded connection. The reader thread receives data
+   * from the source socket and queues it. The writer thread sends the data
+   * to the destination socket when it is due.
+   */
+  struct Pipe {
+    std::condition_variable cv;
+    int destination = -1;
+    std::deque<Chunk> queue;
+    std::chrono::steady_clock::time_point lastDeliveryTime;
+    std::chrono::steady_clock::time_point linkFreeTime;
+    std::mutex mutex;
+    std::mt19937 random;
+    std::thread readerThread;
+    bool sourceClosed = false;
+    int source = -1;
+    std::thread writerThread;
+  };
+
+  /**
+   * Connection that is forwarded by the proxy.
+   */
+  struct ForwardedConnection {
+    int clientSocket = -1;
+    std::atomic<int> closedPipes{0};
+    Pipe clientToServer;
+    Pipe serverToClient;
+    int serverSocket = -1;
+  };
+
+  // We do not want to allow copy or move construction or assignment.
+  ImpairmentProxy(const ImpairmentProxy &) = delete;
+  ImpairmentProxy(ImpairmentProxy &&) = delete;
+  ImpairmentProxy &operator=(const ImpairmentProxy &) = delete;
+  ImpairmentProxy &operator=(ImpairmentProxy &&) = delete;
+
+  std::thread acceptThread;
+  std::vector<std::unique_ptr<ForwardedConnection>> connections;
+  std::mutex connectionsMutex;
+  std::atomic<std::uint64_t> droppedConnections;
+  Impairments impairments;
+  std::uint16_t listenPort;
+  int listenSocket;
+  std::mt19937 random;
+  std::atomic<bool> running;
+  std::uint16_t targetPort;
+
+  void acceptConnections();
+  void forward(int clientSocket);
+  void readPipe(ForwardedConnection &connection, Pipe &pipe);
+  void reapConnections(bool all);
+  void writePipe(ForwardedConnection &connection, Pipe &pipe);
+
+};
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
+
+#endif // OPEN62541_EPICS_IMPAIRMENT_PROXY_H
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "UaException.h"
+
+#include "MockConnection.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+MockConnection::MockConnection(const std::string &name,
+    CompletionMode completionMode) : completionMode(completionMode),
+    endpointUrl("mock://" + name), idle(true), recordAllocations("records"),
+    shutdownRequested(false) {
+  // The connection is always connected, so that code checking the connection
+  // state behaves like it does for a healthy server connection.
+  statistics.setConnected(true);
+  if (completionMode == CompletionMode::thread) {
+    completionThread = std::thread([this]() {runCompletionThread();});
+  }
+}
+
+MockConnection::~MockConnection() {
+  if (completionThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(completionQueueMutex);
+      shutdownRequested = true;
+    }
+    completionQueueCv.notify_all();
+    completionThread.join();
+  }
+}
+
+void MockConnection::addMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback,
+    double samplingInterval, std::uint32_t queueSize, bool discardOldest) {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  auto &callbacks = monitoredItems[nodeId];
+  if (std::find(callbacks.begin(), callbacks.end(), callback)
+      == callbacks.end()) {
+    callbacks.push_back(callback);
+  }
+}
+
+void MockConnection::callAsync(const UaNodeId &objectId,
+    const UaNodeId &methodId, const std::vector<UaVariant> &inputArguments,
+    std::shared_ptr<CallCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::calls);
+  bool exists = static_cast<bool>(getValue(methodId));
+  if (!exists) {
+    statistics.increment(ConnectionStatistics::Counter::callFailures);
+  }
+  complete([callback, methodId, inputArguments, exists]() {
+    if (exists) {
+      callback->success(methodId, inputArguments);
+    } else {
+      callback->failure(methodId, UA_STATUSCODE_BADNODEIDUNKNOWN);
+    }
+  });
+}
+
+std::size_t MockConnection::getMonitoredItemCount() {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  std::size_t count = 0;
+  for (auto &entry : monitoredItems) {
+    count += entry.second.size();
+  }
+  return count;
+}
+
+std::shared_ptr<SubscriptionStatistics>
+    MockConnection::getSubscriptionStatistics(const std::string &name) {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  auto &result = subscriptionStatistics[name];
+  if (!result) {
+    result = std::make_shared<SubscriptionStatistics>();
+  }
+  return result;
+}
+
+UaVariant MockConnection::getValue(const UaNodeId &nodeId) {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  auto value = values.find(nodeId);
+  if (value == values.end()) {
+    return UaVariant();
+  }
+  return value->second;
+}
+
+void MockConnection::notify(const UaNodeId &nodeId, const UaVariant &value) {
+  std::vector<std::shared_ptr<MonitoredItemCallback>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(valuesMutex);
+    values[nodeId] = value;
+    auto entry = monitoredItems.find(nodeId);
+    if (entry != monitoredItems.end()) {
+      callbacks = entry->second;
+    }
+  }
+  // Like the server connection, we call the callbacks without holding the
+  // mutex, so that they may call methods of this connection.
+  for (auto &callback : callbacks) {
+    statistics.increment(ConnectionStatistics::Counter::notifications);
+    complete([callback, nodeId, value]() {
+      callback->success(nodeId, value);
+    });
+  }
+}
+
+MockConnection::CompletionMode MockConnection::parseCompletionMode(
+    const std::string &name) {
+  if (name == "synchronous") {
+    return CompletionMode::synchronous;
+  } else if (name == "thread") {
+    return CompletionMode::thread;
+  }
+  throw std::invalid_argument("Invalid completion mode: " + name);
+}
+
+UaVariant MockConnection::read(const UaNodeId &nodeId) {
+  statistics.increment(ConnectionStatistics::Counter::reads);
+  UaVariant value = getValue(nodeId);
+  if (!value) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+    throw UaException(UA_STATUSCODE_BADNODEIDUNKNOWN);
+  }
+  return value;
+}
+
+void MockConnection::readAsync(const UaNodeId &nodeId,
+    std::shared_ptr<ReadCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::reads);
+  UaVariant value = getValue(nodeId);
+  if (!value) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+  }
+  complete([callback, nodeId, value]() {
+    if (value) {
+      callback->success(nodeId, value);
+    } else {
+      callback->failure(nodeId, UA_STATUSCODE_BADNODEIDUNKNOWN);
+    }
+  });
+}
+
+void MockConnection::removeMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback) {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  auto entry = monitoredItems.find(nodeId);
+  if (entry == monitoredItems.end()) {
+    return;
+  }
+  auto &callbacks = entry->second;
+  callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), callback),
+    callbacks.end());
+  if (callbacks.empty()) {
+    monitoredItems.erase(entry);
+  }
+}
+
+void MockConnection::setValue(const UaNodeId &nodeId, const UaVariant &value) {
+  std::lock_guard<std::mutex> lock(valuesMutex);
+  values[nodeId] = value;
+}
+
+void MockConnection::waitUntilIdle() {
+  std::unique_lock<std::mutex> lock(completionQueueMutex);
+  idleCv.wait(lock, [this]() {return idle;});
+}
+
+void MockConnection::writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+    std::shared_ptr<WriteCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::writes);
+  bool exists;
+  {
+    std::lock_guard<std::mutex> lock(valuesMutex);
+    auto entry = values.find(nodeId);
+    exists = entry != values.end();
+    if (exists) {
+      entry->second = value;
+    }
+  }
+  if (!exists) {
+    statistics.increment(ConnectionStatistics::Counter::writeFailures);
+  }
+  complete([callback, nodeId, exists]() {
+    if (exists) {
+      callback->success(nodeId);
+    } else {
+      callback->failure(nodeId, UA_STATUSCODE_BADNODEIDUNKNOWN);
+    }
+  });
+}
+
+void MockConnection::complete(std::function<void()> &&function) {
+  if (completionMode == CompletionMode::synchronous) {
+    function();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(completionQueueMutex);
+    completionQueue.push_back(std::move(function));
+    idle = false;
+  }
+  completionQueueCv.notify_one();
+}
+
+void MockConnection::runCompletionThread() {
+  std::unique_lock<std::mutex> lock(completionQueueMutex);
+  while (true) {
+    completionQueueCv.wait(lock, [this]() {
+      return shutdownRequested || !completionQueue.empty();
+    });
+    if (completionQueue.empty()) {
+      // Shutdown has been requested and all callbacks have been called.
+      return;
+    }
+    auto function = std::move(completionQueue.front());
+    completionQueue.pop_front();
+    lock.unlock();
+    try {
+      function();
+    } catch (...) {
+      // Like the server connection, we never let an exception from a
+      // callback stop the thread.
+      statistics.increment(ConnectionStatistics::Counter::callbackExceptions);
+    }
+    lock.lock();
+    if (completionQueue.empty()) {
+      idle = true;
+      idleCv.notify_all();
+    }
+  }
+}
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
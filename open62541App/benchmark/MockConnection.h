@@ -0,0 +1,228 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_MOCK_CONNECTION_H
+#define OPEN62541_EPICS_MOCK_CONNECTION_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <condition_variable>. The workaround
+// for this is defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Connection.h"
+
+namespace open62541 {
+namespace epics {
+namespace benchmark {
+
+/**
+ * Connection that keeps the values of its nodes in memory instead of talking
+ * to an OPC UA server. It is used for benchmarking the device support for
+ * records in isolation.
+ *
+ * Reads and writes always succeed for nodes that have been created through
+ * setValue(...) and fail with BadNodeIdUnknown for all other nodes. The same
+ * applies to method calls, which return their input arguments as output
+ * arguments (the method ID identifies the node).
+ * Notifications are only sent when notify(...) is called.
+ */
+class MockConnection : public Connection {
+
+public:
+
+  /**
+   * Defines how requests and notifications are completed.
+   */
+  enum class CompletionMode {
+
+    /**
+     * Callbacks are called by the thread that queued the request (or called
+     * notify(...)) before the respective method returns.
+     */
+    synchronous,
+
+    /**
+     * Callbacks are called by a separate thread, like it is the case for a
+     * ServerConnection.
+     */
+    thread
+
+  };
+
+  /**
+   * Creates a connection using the specified completion mode. The name is
+   * used for building the endpoint URL ("mock://<name>").
+   */
+  MockConnection(const std::string &name, CompletionMode completionMode);
+
+  /**
+   * Destructor. Stops the completion thread (if any) after it has processed
+   * all queued callbacks.
+   */
+  virtual ~MockConnection();
+
+  virtual void addMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback,
+      double samplingInterval, std::uint32_t queueSize, bool discardOldest);
+
+  virtual void callAsync(const UaNodeId &objectId, const UaNodeId &methodId,
+      const std::vector<UaVariant> &inputArguments,
+      std::shared_ptr<CallCallback> callback);
+
+  /**
+   * Returns the completion mode of this connection.
+   */
+  inline CompletionMode getCompletionMode() const {
+    return completionMode;
+  }
+
+  virtual const std::string &getEndpointUrl() const {
+    return endpointUrl;
+  }
+
+  /**
+   * Returns the number of monitored items that are currently registered.
+   */
+  std::size_t getMonitoredItemCount();
+
+  virtual NodeStatistics &getNodeStatistics() {
+    return nodeStatistics;
+  }
+
+  virtual AllocationStatistics::Account &getRecordAllocations() {
+    return recordAllocations;
+  }
+
+  virtual StartupStatistics &getStartupStatistics() {
+    return startupStatistics;
+  }
+
+  virtual ConnectionStatistics &getStatistics() {
+    return statistics;
+  }
+
+  virtual double getSubscriptionPublishingInterval(const std::string &name) {
+    return 500.0;
+  }
+
+  virtual std::shared_ptr<SubscriptionStatistics> getSubscriptionStatistics(
+      const std::string &name);
+
+  /**
+   * Returns the value that has last been set or written for the specified
+   * node. Returns an empty variant if the node does not exist.
+   */
+  UaVariant getValue(const UaNodeId &nodeId);
+
+  /**
+   * Sets the value of the specified node and sends a notification with the
+   * new value to all monitored items that are registered for the node.
+   */
+  void notify(const UaNodeId &nodeId, const UaVariant &value);
+
+  /**
+   * Parses the name of a completion mode ("synchronous" or "thread"). Throws
+   * an std::invalid_argument if the name is not valid.
+   */
+  static CompletionMode parseCompletionMode(const std::string &name);
+
+  virtual UaVariant read(const UaNodeId &nodeId);
+
+  virtual void readAsync(const UaNodeId &nodeId,
+      std::shared_ptr<ReadCallback> callback);
+
+  virtual void removeMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback);
+
+  /**
+   * Sets the value of the specified node, creating the node if it does not
+   * exist yet. In contrast to notify(...), this does not send notifications.
+   */
+  void setValue(const UaNodeId &nodeId, const UaVariant &value);
+
+  /**
+   * Waits until all callbacks that have been queued so far have been called.
+   * When using the synchronous completion mode, this returns immediately.
+   */
+  void waitUntilIdle();
+
+  virtual void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+      std::shared_ptr<WriteCallback> callback);
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  MockConnection(const MockConnection &) = delete;
+  MockConnection(MockConnection &&) = delete;
+  MockConnection &operator=(const MockConnection &) = delete;
+  MockConnection &operator=(MockConnection &&) = delete;
+
+  CompletionMode completionMode;
+  std::thread completionThread;
+  std::deque<std::function<void()>> completionQueue;
+  std::condition_variable completionQueueCv;
+  std::mutex completionQueueMutex;
+  std::string endpointUrl;
+  bool idle;
+  std::condition_variable idleCv;
+  std::unordered_map<UaNodeId,
+    std::vector<std::shared_ptr<MonitoredItemCallback>>> monitoredItems;
+  NodeStatistics nodeStatistics;
+  AllocationStatistics::Account recordAllocations;
+  bool shutdownRequested;
+  StartupStatistics startupStatistics;
+  ConnectionStatistics statistics;
+  std::unordered_map<std::string, std::shared_ptr<SubscriptionStatistics>>
+    subscriptionStatistics;
+  // The values, monitored items, and subscription statistics are protected
+  // by this mutex.
+  std::mutex valuesMutex;
+  std::unordered_map<UaNodeId, UaVariant> values;
+
+  void complete(std::function<void()> &&function);
+  void runCompletionThread();
+
+};
+
+} // namespace benchmark
+} // namespace epics
+} // namespace open62541
+
+#endif // OPEN62541_EPICS_MOCK_CONNECTION_H
@@ -0,0 +1,1293 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+/*
+ * End-to-end benchmark for the ServerConnection class. The benchmark starts an
+ * OPC UA server inside the process (listening on the loopback interface) and
+ * runs read, write, and monitoring workloads against it. For each workload,
+ * one line with a JSON object is printed to stdout, so that the results can
+ * easily be processed by scripts.
+ *
+ * The reconnect workload repeatedly interrupts the connection to the server
+ * (by restarting the server or by dropping the client's socket) while the
+ * nodes are monitored and read, and measures how long it takes until the
+ * connection has recovered. It prints one line per interruption and a
+ * summary line.
+ *
+ * The pubsub workload does not use the embedded server. It publishes values
+ * with the writer group of a PubSubConnection and receives them with a second
+ * PubSubConnection over multicast on the loopback interface, checking that
+ * each field receives the value that has been written.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "AllocationStatistics.h"
+#include "LatencyHistogram.h"
+#include "PubSubConnection.h"
+#include "ServerConnection.h"
+#include "UaException.h"
+
+#include "BenchmarkUtil.h"
+#include "EmbeddedServer.h"
+#include "ImpairmentProxy.h"
+
+using namespace open62541::epics;
+using namespace open62541::epics::benchmark;
+
+namespace {
+
+const char *const subscriptionName = "benchmark";
+
+// Settings of the pubsub workload. Both connections use the loopback
+// interface, so that the network messages never leave the host. The nodes are
+// spread over several data sets, and a network message can contain at most
+// 255 of them.
+const char *const pubSubInterface = "127.0.0.1";
+constexpr std::size_t pubSubFieldsPerDataSet = 100;
+constexpr std::size_t pubSubMaxDataSetWriters = 255;
+constexpr UA_UInt16 pubSubPublisherId = 1;
+constexpr UA_UInt16 pubSubWriterGroupId = 1;
+
+/**
+ * Stream to which the results are written. The open62541 library writes its
+ * log messages to stdout, so the results are written to a duplicate of the
+ * original stdout, and stdout is redirected to stderr.
+ */
+FILE *results = stdout;
+
+/**
+ * Options controlling the workloads. They can be set on the command line.
+ */
+struct Options {
+  std::size_t arraySize = 0;
+  std::size_t cycles = 10;
+  double duration = 5.0;
+  std::string fault = "restart";
+  std::size_t nodes = 100;
+  std::size_t outstanding = 16;
+  double outage = 1.0;
+  std::uint16_t port = 48400;
+  double proxyBandwidth = 0.0;
+  double proxyDelay = 0.0;
+  double proxyDropInterval = 0.0;
+  double proxyJitter = 0.0;
+  double publishingInterval = 100.0;
+  std::string pubSubAddress = "239.255.0.1";
+  double readRate = 100.0;
+  double recoveryTimeout = 30.0;
+  double updateRate = 10.0;
+  EmbeddedServer::ValueType valueType = EmbeddedServer::ValueType::doubleType;
+  std::string workload = "all";
+};
+
+/**
+ * Allocation counters summed over all accounts, and the number of copies of
+ * node IDs and variants.
+ */
+struct AllocationCount {
+  std::uint64_t allocatedBytes;
+  std::uint64_t allocations;
+  std::int64_t netBytes;
+  std::uint64_t nodeIdCopies;
+  std::uint64_t variantCopies;
+};
+
+AllocationCount getAllocationCount(ServerConnection &connection) {
+  auto &allocationStatistics = AllocationStatistics::getInstance();
+  AllocationCount count{0, 0, 0, allocationStatistics.getNodeIdCopies(),
+    allocationStatistics.getVariantCopies()};
+  for (auto account : {&connection.getClientAllocations(),
+      &connection.getRecordAllocations(),
+      &allocationStatistics.getOtherAccount()}) {
+    count.allocatedBytes +=
+      account->allocatedBytes.load(std::memory_order_relaxed);
+    count.allocations += account->allocations.load(std::memory_order_relaxed);
+    count.netBytes += account->netBytes.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+/**
+ * Result of a single workload.
+ */
+struct Result {
+  AllocationCount allocationsAfter;
+  AllocationCount allocationsBefore;
+  CpuTime cpuAfter;
+  CpuTime cpuBefore;
+  double elapsed;
+  std::uint64_t failures;
+  LatencyHistogram::Summary latency;
+  std::uint64_t operations;
+  // Only used by the monitor workload.
+  double expectedRate = 0.0;
+};
+
+/**
+ * Prints the impairments applied by the proxy as a JSON field (followed by a
+ * comma and a space), or null if the proxy is not used.
+ */
+void printProxy(const ImpairmentProxy *proxy) {
+  if (!proxy) {
+    std::fprintf(results, "\"proxy\": null, ");
+    return;
+  }
+  auto &impairments = proxy->getImpairments();
+  std::fprintf(results, "\"proxy\": {\"delay_ms\": %.1f, "
+    "\"jitter_ms\": %.1f, \"bandwidth_kbps\": %.1f, "
+    "\"drop_interval\": %.1f, \"drops\": %llu}, ",
+    impairments.delay * 1e3, impairments.jitter * 1e3,
+    impairments.bandwidth / 125.0, impairments.dropInterval,
+    static_cast<unsigned long long>(proxy->getDroppedConnections()));
+}
+
+void printResult(const char *workload, const Options &options,
+    const ImpairmentProxy *proxy, const Result &result) {
+  double userTime = result.cpuAfter.user - result.cpuBefore.user;
+  double systemTime = result.cpuAfter.system - result.cpuBefore.system;
+  std::fprintf(results,
+    "{\"workload\": \"%s\", \"nodes\": %zu, \"type\": \"%s\", "
+    "\"array_size\": %zu, \"outstanding\": %zu, \"duration\": %.3f, "
+    "\"operations\": %llu, \"failures\": %llu, \"throughput\": %.1f, ",
+    workload, options.nodes,
+    EmbeddedServer::valueTypeName(options.valueType), options.arraySize,
+    options.outstanding, result.elapsed,
+    static_cast<unsigned long long>(result.operations),
+    static_cast<unsigned long long>(result.failures),
+    result.operations / result.elapsed);
+  printProxy(proxy);
+  if (result.expectedRate > 0.0) {
+    std::fprintf(results,
+      "\"expected_throughput\": %.1f, ", result.expectedRate);
+  }
+  std::fprintf(results, "\"latency_us\": {\"count\": %llu, \"mean\": %.1f, "
+    "\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+    "\"max\": %.1f}, ",
+    static_cast<unsigned long long>(result.latency.count),
+    result.latency.mean * 1e6, result.latency.p50 * 1e6,
+    result.latency.p90 * 1e6, result.latency.p99 * 1e6,
+    result.latency.p999 * 1e6, result.latency.max * 1e6);
+  std::fprintf(results, "\"cpu_seconds\": {\"user\": %.3f, \"system\": %.3f}, "
+    "\"cpu_utilization\": %.3f, ", userTime, systemTime,
+    (userTime + systemTime) / result.elapsed);
+  if (AllocationStatistics::isEnabled()) {
+    auto allocations = result.allocationsAfter.allocations
+      - result.allocationsBefore.allocations;
+    std::fprintf(results, "\"allocations\": %llu, \"allocated_bytes\": %llu, "
+      "\"allocations_per_operation\": %.2f, ",
+      static_cast<unsigned long long>(allocations),
+      static_cast<unsigned long long>(result.allocationsAfter.allocatedBytes
+        - result.allocationsBefore.allocatedBytes),
+      result.operations
+        ? static_cast<double>(allocations) / result.operations : 0.0);
+  } else {
+    std::fprintf(results, "\"allocations\": null, \"allocated_bytes\": null, "
+      "\"allocations_per_operation\": null, ");
+  }
+  std::fprintf(results, "\"node_id_copies\": %llu, \"variant_copies\": %llu}\n",
+    static_cast<unsigned long long>(result.allocationsAfter.nodeIdCopies
+      - result.allocationsBefore.nodeIdCopies),
+    static_cast<unsigned long long>(result.allocationsAfter.variantCopies
+      - result.allocationsBefore.variantCopies));
+  std::fflush(results);
+}
+
+/**
+ * Limits the number of outstanding requests and records the latency of the
+ * completed requests.
+ */
+class RequestWindow {
+
+public:
+
+  RequestWindow(std::size_t size) : failures(0), inFlight(0), operations(0),
+      size(size) {
+  }
+
+  void acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() {return inFlight < size;});
+    ++inFlight;
+  }
+
+  void complete(std::chrono::steady_clock::time_point startTime,
+      bool success) {
+    latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - startTime).count());
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --inFlight;
+      ++operations;
+      if (!success) {
+        ++failures;
+      }
+    }
+    cv.notify_all();
+  }
+
+  void drain() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [this]() {return inFlight == 0;});
+  }
+
+  std::uint64_t getFailures() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failures;
+  }
+
+  std::uint64_t getOperations() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return operations;
+  }
+
+  LatencyHistogram latency;
+
+private:
+
+  std::condition_variable cv;
+  std::uint64_t failures;
+  std::size_t inFlight;
+  std::mutex mutex;
+  std::uint64_t operations;
+  std::size_t size;
+
+};
+
+struct ReadCallbackImpl : ServerConnection::ReadCallback {
+
+  ReadCallbackImpl(RequestWindow &window)
+      : startTime(std::chrono::steady_clock::now()), window(window) {
+  }
+
+  void success(const UaNodeId &, const UaVariant &) override {
+    window.complete(startTime, true);
+  }
+
+  void failure(const UaNodeId &, UA_StatusCode) override {
+    window.complete(startTime, false);
+  }
+
+  std::chrono::steady_clock::time_point startTime;
+  RequestWindow &window;
+
+};
+
+struct WriteCallbackImpl : ServerConnection::WriteCallback {
+
+  WriteCallbackImpl(RequestWindow &window)
+      : startTime(std::chrono::steady_clock::now()), window(window) {
+  }
+
+  void success(const UaNodeId &) override {
+    window.complete(startTime, true);
+  }
+
+  void failure(const UaNodeId &, UA_StatusCode) override {
+    window.complete(startTime, false);
+  }
+
+  std::chrono::steady_clock::time_point startTime;
+  RequestWindow &window;
+
+};
+
+struct MonitoredItemCallbackImpl : ServerConnection::MonitoredItemCallback {
+
+  MonitoredItemCallbackImpl() : failures(0), notifications(0) {
+  }
+
+  void success(const UaNodeId &, const UaVariant &) override {
+    notifications.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void failure(const UaNodeId &, UA_StatusCode) override {
+    failures.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<std::uint64_t> failures;
+  std::atomic<std::uint64_t> notifications;
+
+};
+
+/**
+ * Starts a proxy in front of the server if any impairments have been
+ * requested. Returns null otherwise. The proxy listens on the port following
+ * the one of the server.
+ */
+std::unique_ptr<ImpairmentProxy> startProxy(const Options &options) {
+  ImpairmentProxy::Impairments impairments;
+  // The bandwidth is specified in kbit/s, but the proxy expects bytes/s.
+  impairments.bandwidth = options.proxyBandwidth * 125.0;
+  impairments.delay = options.proxyDelay * 1e-3;
+  impairments.dropInterval = options.proxyDropInterval;
+  impairments.jitter = options.proxyJitter * 1e-3;
+  if (impairments.bandwidth <= 0.0 && impairments.delay <= 0.0
+      && impairments.dropInterval <= 0.0 && impairments.jitter <= 0.0) {
+    return std::unique_ptr<ImpairmentProxy>();
+  }
+  std::unique_ptr<ImpairmentProxy> proxy(new ImpairmentProxy(
+    static_cast<std::uint16_t>(options.port + 1), options.port,
+    impairments));
+  proxy->start();
+  return proxy;
+}
+
+std::shared_ptr<ServerConnection> connect(const EmbeddedServer &server,
+    const ImpairmentProxy *proxy) {
+  auto connection = std::make_shared<ServerConnection>(
+    proxy ? proxy->getEndpointUrl() : server.getEndpointUrl());
+  // The probe would add a second node to some of the read requests.
+  connection->setProbeInterval(0.0);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!connection->getStatistics().isConnected()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      throw std::runtime_error("Could not connect to the embedded server.");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return connection;
+}
+
+/**
+ * Runs a workload that keeps a fixed number of read or write requests in
+ * flight for the configured duration.
+ */
+void runRequestWorkload(const Options &options, bool write) {
+  EmbeddedServer server(options.port, options.nodes, options.valueType,
+    options.arraySize);
+  server.start();
+  auto proxy = startProxy(options);
+  auto connection = connect(server, proxy.get());
+  UaVariant value = server.makeValue(1);
+  RequestWindow window(options.outstanding);
+  Result result;
+  result.allocationsBefore = getAllocationCount(*connection);
+  result.cpuBefore = getCpuTime();
+  auto startTime = std::chrono::steady_clock::now();
+  auto endTime = startTime + std::chrono::duration_cast<
+    std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(options.duration));
+  for (std::size_t i = 0; std::chrono::steady_clock::now() < endTime; ++i) {
+    window.acquire();
+    auto &nodeId = server.getNodeId(i % options.nodes);
+    if (write) {
+      connection->writeAsync(nodeId, value,
+        std::make_shared<WriteCallbackImpl>(window));
+    } else {
+      connection->readAsync(nodeId,
+        std::make_shared<ReadCallbackImpl>(window));
+    }
+  }
+  window.drain();
+  result.elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  result.cpuAfter = getCpuTime();
+  result.allocationsAfter = getAllocationCount(*connection);
+  result.operations = window.getOperations();
+  result.failures = window.getFailures();
+  result.latency = window.latency.getSummary();
+  printResult(write ? "write" : "read", options, proxy.get(), result);
+}
+
+/**
+ * Runs a workload that monitors all nodes while the server updates them at
+ * the configured rate. The latency is the delivery latency measured by the
+ * connection (from the source timestamp to the reception of the
+ * notification).
+ */
+void runMonitorWorkload(const Options &options) {
+  EmbeddedServer server(options.port, options.nodes, options.valueType,
+    options.arraySize);
+  server.setUpdateRate(options.updateRate);
+  server.start();
+  auto proxy = startProxy(options);
+  auto connection = connect(server, proxy.get());
+  // The delivery latency can only be measured with source timestamps.
+  connection->setSourceTimestamps(true);
+  connection->setSubscriptionPublishingInterval(
+    subscriptionName, options.publishingInterval);
+  auto callback = std::make_shared<MonitoredItemCallbackImpl>();
+  for (std::size_t i = 0; i < options.nodes; ++i) {
+    connection->addMonitoredItem(subscriptionName, server.getNodeId(i),
+      callback, options.publishingInterval, 1, true);
+  }
+  // The server sends the current value of each node when the monitored item
+  // is created, so we wait for these notifications before starting the
+  // measurement.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+  while (callback->notifications.load(std::memory_order_relaxed)
+      < options.nodes) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      throw std::runtime_error(
+        "Did not receive the initial values of the monitored items.");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  auto subscriptionStatistics =
+    connection->getSubscriptionStatistics(subscriptionName);
+  subscriptionStatistics->resetLatencyHistograms();
+  Result result;
+  result.allocationsBefore = getAllocationCount(*connection);
+  result.cpuBefore = getCpuTime();
+  auto notificationsBefore =
+    callback->notifications.load(std::memory_order_relaxed);
+  auto failuresBefore = callback->failures.load(std::memory_order_relaxed);
+  auto startTime = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+  result.elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  result.cpuAfter = getCpuTime();
+  result.allocationsAfter = getAllocationCount(*connection);
+  result.operations = callback->notifications.load(std::memory_order_relaxed)
+    - notificationsBefore;
+  result.failures = callback->failures.load(std::memory_order_relaxed)
+    - failuresBefore;
+  result.latency =
+    subscriptionStatistics->notificationDeliveryLatency.getSummary();
+  result.expectedRate = options.nodes * options.updateRate;
+  printResult("monitor", options, proxy.get(), result);
+}
+
+/**
+ * Shuts down all sockets of this process that are connected to the specified
+ * port, so that the client sees a broken connection while the server keeps
+ * running. The sockets are not closed, because the client still owns the file
+ * descriptors. Returns the number of sockets that have been shut down.
+ */
+std::size_t dropClientSockets(std::uint16_t port) {
+  int maxFd = 1024;
+  struct rlimit limit;
+  if (!::getrlimit(RLIMIT_NOFILE, &limit) && limit.rlim_cur != RLIM_INFINITY) {
+    maxFd = static_cast<int>(std::min<rlim_t>(limit.rlim_cur, 65536));
+  }
+  std::size_t dropped = 0;
+  for (int fd = 0; fd < maxFd; ++fd) {
+    ::sockaddr_storage peer;
+    ::socklen_t length = sizeof(peer);
+    if (::getpeername(fd, reinterpret_cast<::sockaddr *>(&peer), &length)) {
+      continue;
+    }
+    std::uint16_t peerPort;
+    if (peer.ss_family == AF_INET) {
+      peerPort = ntohs(reinterpret_cast<::sockaddr_in *>(&peer)->sin_port);
+    } else if (peer.ss_family == AF_INET6) {
+      peerPort = ntohs(reinterpret_cast<::sockaddr_in6 *>(&peer)->sin6_port);
+    } else {
+      continue;
+    }
+    // The sockets accepted by the server have the client's (ephemeral) port as
+    // their peer port, so only the client's sockets match.
+    if (peerPort == port && !::shutdown(fd, SHUT_RDWR)) {
+      ++dropped;
+    }
+  }
+  return dropped;
+}
+
+/**
+ * Polls the condition every millisecond until it is true or the timeout (in
+ * seconds) expires. Returns false if the timeout expired.
+ */
+bool waitUntil(double timeout, const std::function<bool()> &condition) {
+  auto deadline = std::chrono::steady_clock::now()
+    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(timeout));
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+/**
+ * Measurements for a single interruption of the connection. Times are in
+ * seconds and are -1 if the event did not happen before the timeout expired.
+ */
+struct ReconnectCycle {
+  // Time from the interruption until the client reset its connection or a
+  // request or monitored item failed.
+  double detectionTime;
+  // Time from the server becoming available again until the first
+  // notification was received.
+  double firstNotificationTime;
+  // Time from the server becoming available again until each monitored item
+  // had received a notification.
+  double recoveryTime;
+  std::uint64_t notificationFailures;
+  std::uint64_t readFailures;
+  long long residentSetSize;
+};
+
+/**
+ * Prints a time (in seconds) as milliseconds, or null if it is negative.
+ */
+void printMilliseconds(double seconds) {
+  if (seconds < 0.0) {
+    std::fprintf(results, "null");
+  } else {
+    std::fprintf(results, "%.1f", seconds * 1e3);
+  }
+}
+
+/**
+ * Prints the mean and the maximum of the times (in seconds) that are not
+ * negative as a JSON object (in milliseconds).
+ */
+void printTimeSummary(const std::vector<double> &times) {
+  double max = -1.0;
+  double sum = 0.0;
+  std::size_t count = 0;
+  for (auto time : times) {
+    if (time >= 0.0) {
+      max = std::max(max, time);
+      sum += time;
+      ++count;
+    }
+  }
+  std::fprintf(results, "{\"mean\": ");
+  printMilliseconds(count ? sum / count : -1.0);
+  std::fprintf(results, ", \"max\": ");
+  printMilliseconds(max);
+  std::fprintf(results, "}");
+}
+
+/**
+ * Runs a workload that monitors all nodes and reads them at a fixed rate,
+ * while the connection is interrupted repeatedly. The connection is
+ * interrupted either by stopping the server for the configured outage time
+ * ("restart") or by shutting down the client's socket while the server keeps
+ * running ("drop").
+ */
+void runReconnectWorkload(const Options &options) {
+  bool restart;
+  if (options.fault == "restart") {
+    restart = true;
+  } else if (options.fault == "drop") {
+    restart = false;
+  } else {
+    throw std::invalid_argument("Unknown fault: " + options.fault);
+  }
+  EmbeddedServer server(options.port, options.nodes, options.valueType,
+    options.arraySize);
+  server.setUpdateRate(options.updateRate);
+  server.start();
+  auto proxy = startProxy(options);
+  auto connection = connect(server, proxy.get());
+  connection->setSubscriptionPublishingInterval(
+    subscriptionName, options.publishingInterval);
+  // Each monitored item gets its own callback, so that we can tell when all
+  // of them have been re-established.
+  std::vector<std::shared_ptr<MonitoredItemCallbackImpl>> callbacks;
+  for (std::size_t i = 0; i < options.nodes; ++i) {
+    callbacks.push_back(std::make_shared<MonitoredItemCallbackImpl>());
+    connection->addMonitoredItem(subscriptionName, server.getNodeId(i),
+      callbacks.back(), options.publishingInterval, 1, true);
+  }
+  auto getNotificationCounts = [&callbacks]() {
+    std::vector<std::uint64_t> counts;
+    for (auto &callback : callbacks) {
+      counts.push_back(
+        callback->notifications.load(std::memory_order_relaxed));
+    }
+    return counts;
+  };
+  auto getNotificationFailures = [&callbacks]() {
+    std::uint64_t failures = 0;
+    for (auto &callback : callbacks) {
+      failures += callback->failures.load(std::memory_order_relaxed);
+    }
+    return failures;
+  };
+  // Returns a condition that is true when the number of monitored items that
+  // received a notification since the counts were taken reaches the minimum.
+  auto makeNotifiedCondition = [&callbacks](
+      const std::vector<std::uint64_t> &counts, std::size_t minimum)
+      -> std::function<bool()> {
+    return [&callbacks, counts, minimum]() {
+      std::size_t notified = 0;
+      for (std::size_t i = 0; i < callbacks.size(); ++i) {
+        if (callbacks[i]->notifications.load(std::memory_order_relaxed)
+            > counts[i]) {
+          ++notified;
+        }
+      }
+      return notified >= minimum;
+    };
+  };
+  if (!waitUntil(options.recoveryTimeout,
+      makeNotifiedCondition(std::vector<std::uint64_t>(options.nodes, 0),
+        options.nodes))) {
+    throw std::runtime_error(
+      "Did not receive the initial values of the monitored items.");
+  }
+  // The read load continues while the connection is interrupted, so that we
+  // can see how many requests fail and whether the connection recovers while
+  // requests are pending.
+  RequestWindow window(options.outstanding);
+  std::atomic<bool> stopReading(false);
+  std::thread readThread([&]() {
+    auto interval = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / options.readRate));
+    auto nextReadTime = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; !stopReading.load(std::memory_order_relaxed);
+        ++i) {
+      std::this_thread::sleep_until(nextReadTime);
+      nextReadTime += interval;
+      window.acquire();
+      connection->readAsync(server.getNodeId(i % options.nodes),
+        std::make_shared<ReadCallbackImpl>(window));
+    }
+  });
+  auto &statistics = connection->getStatistics();
+  auto allocationsBefore = getAllocationCount(*connection);
+  auto residentSetSizeBefore = getResidentSetSize();
+  std::vector<ReconnectCycle> cycles;
+  try {
+    for (std::size_t cycle = 0; cycle < options.cycles; ++cycle) {
+      // Before each interruption, the connection operates normally for the
+      // configured duration.
+      std::this_thread::sleep_for(
+        std::chrono::duration<double>(options.duration));
+      ReconnectCycle result;
+      auto reconnectsBefore =
+        statistics.get(ConnectionStatistics::Counter::reconnects);
+      auto readFailuresBefore = window.getFailures();
+      auto notificationFailuresBefore = getNotificationFailures();
+      auto faultTime = std::chrono::steady_clock::now();
+      auto restoreTime = faultTime;
+      if (restart) {
+        server.stop();
+        restoreTime += std::chrono::duration_cast<
+          std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(options.outage));
+      } else if (proxy) {
+        // When the proxy is used, the client is connected to the proxy, so
+        // the proxy has to drop the connection.
+        if (!proxy->dropConnections()) {
+          throw std::runtime_error("The proxy has no connection to drop.");
+        }
+      } else if (!dropClientSockets(options.port)) {
+        throw std::runtime_error("Could not find the client's socket.");
+      }
+      // The interruption is detected when the client resets the connection or
+      // when a request or monitored item fails. The open62541 library
+      // sometimes re-establishes a dropped connection on its own, so the
+      // interruption might not be visible at all.
+      auto detected = [&]() {
+        return statistics.get(ConnectionStatistics::Counter::reconnects)
+            > reconnectsBefore
+          || window.getFailures() > readFailuresBefore
+          || getNotificationFailures() > notificationFailuresBefore;
+      };
+      // When dropping the socket, the server is available the whole time, so
+      // notifications received after the drop already count as recovery.
+      auto counts = getNotificationCounts();
+      auto firstNotified = makeNotifiedCondition(counts, 1);
+      auto allNotified = makeNotifiedCondition(counts, options.nodes);
+      result.detectionTime = -1.0;
+      result.firstNotificationTime = -1.0;
+      result.recoveryTime = -1.0;
+      bool restored = !restart;
+      auto deadline = restoreTime
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(options.recoveryTimeout));
+      while (result.recoveryTime < 0.0
+          && std::chrono::steady_clock::now() <= deadline) {
+        auto now = std::chrono::steady_clock::now();
+        if (!restored && now >= restoreTime) {
+          server.start();
+          restoreTime = std::chrono::steady_clock::now();
+          counts = getNotificationCounts();
+          firstNotified = makeNotifiedCondition(counts, 1);
+          allNotified = makeNotifiedCondition(counts, options.nodes);
+          restored = true;
+          continue;
+        }
+        if (result.detectionTime < 0.0 && detected()) {
+          result.detectionTime =
+            std::chrono::duration<double>(now - faultTime).count();
+        }
+        if (restored && result.firstNotificationTime < 0.0
+            && firstNotified()) {
+          result.firstNotificationTime =
+            std::chrono::duration<double>(now - restoreTime).count();
+        }
+        if (restored && allNotified()) {
+          result.recoveryTime =
+            std::chrono::duration<double>(now - restoreTime).count();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      result.readFailures = window.getFailures() - readFailuresBefore;
+      result.notificationFailures =
+        getNotificationFailures() - notificationFailuresBefore;
+      result.residentSetSize = getResidentSetSize();
+      cycles.push_back(result);
+      std::fprintf(results, "{\"workload\": \"reconnect\", \"fault\": \"%s\", "
+        "\"cycle\": %zu, \"nodes\": %zu, ",
+        options.fault.c_str(), cycle + 1, options.nodes);
+      printProxy(proxy.get());
+      std::fprintf(results, "\"detection_ms\": ");
+      printMilliseconds(result.detectionTime);
+      std::fprintf(results, ", \"first_notification_ms\": ");
+      printMilliseconds(result.firstNotificationTime);
+      std::fprintf(results, ", \"recovery_ms\": ");
+      printMilliseconds(result.recoveryTime);
+      std::fprintf(results, ", \"read_failures\": %llu, "
+        "\"notification_failures\": %llu, \"rss_bytes\": %lld}\n",
+        static_cast<unsigned long long>(result.readFailures),
+        static_cast<unsigned long long>(result.notificationFailures),
+        result.residentSetSize);
+      std::fflush(results);
+    }
+  } catch (...) {
+    stopReading.store(true, std::memory_order_relaxed);
+    readThread.join();
+    throw;
+  }
+  stopReading.store(true, std::memory_order_relaxed);
+  readThread.join();
+  window.drain();
+  auto allocationsAfter = getAllocationCount(*connection);
+  auto residentSetSizeAfter = getResidentSetSize();
+  std::vector<double> detectionTimes, firstNotificationTimes, recoveryTimes;
+  std::size_t failedRecoveries = 0;
+  std::uint64_t notificationFailures = 0;
+  std::uint64_t readFailures = 0;
+  for (auto &cycle : cycles) {
+    detectionTimes.push_back(cycle.detectionTime);
+    firstNotificationTimes.push_back(cycle.firstNotificationTime);
+    recoveryTimes.push_back(cycle.recoveryTime);
+    if (cycle.recoveryTime < 0.0) {
+      ++failedRecoveries;
+    }
+    notificationFailures += cycle.notificationFailures;
+    readFailures += cycle.readFailures;
+  }
+  std::fprintf(results, "{\"workload\": \"reconnect\", \"fault\": \"%s\", "
+    "\"cycles\": %zu, \"nodes\": %zu, \"outage\": %.3f, ",
+    options.fault.c_str(), cycles.size(), options.nodes,
+    restart ? options.outage : 0.0);
+  printProxy(proxy.get());
+  std::fprintf(results, "\"detection_ms\": ");
+  printTimeSummary(detectionTimes);
+  std::fprintf(results, ", \"first_notification_ms\": ");
+  printTimeSummary(firstNotificationTimes);
+  std::fprintf(results, ", \"recovery_ms\": ");
+  printTimeSummary(recoveryTimes);
+  std::fprintf(results, ", \"failed_recoveries\": %zu, \"reconnects\": %llu, "
+    "\"reads\": %llu, \"read_failures\": %llu, "
+    "\"notification_failures\": %llu, ",
+    failedRecoveries,
+    static_cast<unsigned long long>(
+      statistics.get(ConnectionStatistics::Counter::reconnects)),
+    static_cast<unsigned long long>(window.getOperations()),
+    static_cast<unsigned long long>(readFailures),
+    static_cast<unsigned long long>(notificationFailures));
+  if (residentSetSizeBefore >= 0 && residentSetSizeAfter >= 0) {
+    std::fprintf(results, "\"rss_growth_bytes\": %lld, ",
+      residentSetSizeAfter - residentSetSizeBefore);
+  } else {
+    std::fprintf(results, "\"rss_growth_bytes\": null, ");
+  }
+  if (AllocationStatistics::isEnabled()) {
+    std::fprintf(results, "\"net_heap_growth_bytes\": %lld}\n",
+      static_cast<long long>(
+        allocationsAfter.netBytes - allocationsBefore.netBytes));
+  } else {
+    std::fprintf(results, "\"net_heap_growth_bytes\": null}\n");
+  }
+  std::fflush(results);
+}
+
+/**
+ * Expected values of the fields received by the pubsub workload. For each
+ * field, the value written in the current round and the one written in the
+ * previous round are stored: the writer group might send a network message
+ * while the values of a round are being written, so receiving the value of
+ * the previous round is not an error. Any other value is counted as a
+ * mismatch.
+ */
+class PubSubRound {
+
+public:
+
+  PubSubRound(std::size_t fields) : current(fields), failures(0),
+      lastFailureStatus(UA_STATUSCODE_GOOD), mismatches(0), operations(0),
+      previous(fields), received(fields, true), remaining(0) {
+  }
+
+  /**
+   * Starts a new round, in which the specified values are written.
+   */
+  void start(const std::vector<UaVariant> &values) {
+    std::lock_guard<std::mutex> lock(mutex);
+    previous.swap(current);
+    current = values;
+    received.assign(values.size(), false);
+    remaining = values.size();
+    startTime = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Waits until the values of the current round have been received for all
+   * fields. Returns false if the timeout (in seconds) expired.
+   */
+  bool wait(double timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return cv.wait_for(lock, std::chrono::duration<double>(timeout),
+      [this]() {return remaining == 0;});
+  }
+
+  void receive(std::size_t field, const UaVariant &value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (isEqual(value, current[field])) {
+      if (received[field]) {
+        return;
+      }
+      received[field] = true;
+      ++operations;
+      latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - startTime).count());
+      if (!--remaining) {
+        cv.notify_all();
+      }
+    } else if (!isEqual(value, previous[field])) {
+      ++mismatches;
+    }
+  }
+
+  void fail(UA_StatusCode status) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++failures;
+    lastFailureStatus = status;
+  }
+
+  std::uint64_t getFailures() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failures;
+  }
+
+  UA_StatusCode getLastFailureStatus() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastFailureStatus;
+  }
+
+  std::uint64_t getMismatches() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return mismatches;
+  }
+
+  std::uint64_t getOperations() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return operations;
+  }
+
+  LatencyHistogram latency;
+
+private:
+
+  std::vector<UaVariant> current;
+  std::condition_variable cv;
+  std::uint64_t failures;
+  UA_StatusCode lastFailureStatus;
+  std::uint64_t mismatches;
+  std::mutex mutex;
+  std::uint64_t operations;
+  std::vector<UaVariant> previous;
+  std::vector<bool> received;
+  std::size_t remaining;
+  std::chrono::steady_clock::time_point startTime;
+
+  static bool isEqual(const UaVariant &value, const UaVariant &expected) {
+    return value && expected && UA_order(&value.get(), &expected.get(),
+      &UA_TYPES[UA_TYPES_VARIANT]) == UA_ORDER_EQ;
+  }
+
+};
+
+struct PubSubFieldCallback : Connection::MonitoredItemCallback {
+
+  PubSubFieldCallback(PubSubRound &round, std::size_t field)
+      : field(field), round(round) {
+  }
+
+  void success(const UaNodeId &, const UaVariant &value) override {
+    round.receive(field, value);
+  }
+
+  void failure(const UaNodeId &, UA_StatusCode status) override {
+    round.fail(status);
+  }
+
+  std::size_t field;
+  PubSubRound &round;
+
+};
+
+struct PubSubWriteCallback : Connection::WriteCallback {
+
+  PubSubWriteCallback() : failures(0) {
+  }
+
+  void success(const UaNodeId &) override {
+  }
+
+  void failure(const UaNodeId &, UA_StatusCode) override {
+    failures.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<std::uint64_t> failures;
+
+};
+
+/**
+ * Runs a workload that publishes values with the writer group of one
+ * PubSubConnection and receives them with a second PubSubConnection that
+ * joined the same multicast group on the loopback interface. Each node is a
+ * field of a data set. In each round, a new value is written to every field,
+ * and the next round starts when the reader has received all of these values.
+ * The received values are compared with the written ones. The workload fails
+ * if a value does not match, if a write or notification fails, if the reader
+ * cannot decode a network message, or if reading a field does not fail with
+ * BadWaitingForInitialData before the first value has been published and
+ * return the last value afterwards. The latency is measured from the start of
+ * a round until the reception of each value, so it includes the wait for the
+ * next publishing cycle.
+ */
+void runPubSubWorkload(const Options &options) {
+  if (options.nodes > pubSubMaxDataSetWriters * pubSubFieldsPerDataSet) {
+    throw std::invalid_argument("The pubsub workload supports at most "
+      + std::to_string(pubSubMaxDataSetWriters * pubSubFieldsPerDataSet)
+      + " nodes.");
+  }
+  auto endpointUrl = "opc.udp://" + options.pubSubAddress + ":"
+    + std::to_string(options.port);
+  PubSubConnection reader(endpointUrl, pubSubInterface,
+    std::to_string(pubSubPublisherId));
+  PubSubConnection writer(endpointUrl, pubSubInterface, "");
+  writer.setupWriterGroup(
+    pubSubPublisherId, pubSubWriterGroupId, options.publishingInterval);
+  std::vector<UaNodeId> nodeIds;
+  for (std::size_t i = 0; i < options.nodes; ++i) {
+    nodeIds.push_back(UaNodeId(UA_NODEID_NUMERIC(
+      static_cast<UA_UInt16>(1 + i / pubSubFieldsPerDataSet),
+      static_cast<UA_UInt32>(i % pubSubFieldsPerDataSet))));
+  }
+  try {
+    reader.read(nodeIds[0]);
+    throw std::runtime_error(
+      "Reading a field succeeded before any value was published.");
+  } catch (const UaException &e) {
+    if (e.getStatusCode() != UA_STATUSCODE_BADWAITINGFORINITIALDATA) {
+      throw std::runtime_error(
+        std::string("Reading a field before any value was published failed "
+          "with an unexpected status: ") + e.what());
+    }
+  }
+  PubSubRound round(options.nodes);
+  std::vector<std::shared_ptr<PubSubFieldCallback>> callbacks;
+  for (std::size_t i = 0; i < options.nodes; ++i) {
+    callbacks.push_back(std::make_shared<PubSubFieldCallback>(round, i));
+    reader.addMonitoredItem(subscriptionName, nodeIds[i], callbacks.back(),
+      0.0, 1, true);
+  }
+  auto writeCallback = std::make_shared<PubSubWriteCallback>();
+  // A round normally completes within two publishing intervals, so ten
+  // publishing intervals (but at least ten seconds) are a generous margin.
+  double roundTimeout = std::max(10.0, options.publishingInterval * 1e-2);
+  std::vector<UaVariant> values(options.nodes);
+  std::uint64_t rounds = 0;
+  auto cpuBefore = getCpuTime();
+  auto startTime = std::chrono::steady_clock::now();
+  auto endTime = startTime + std::chrono::duration_cast<
+    std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(options.duration));
+  while (std::chrono::steady_clock::now() < endTime) {
+    for (std::size_t i = 0; i < options.nodes; ++i) {
+      values[i] = EmbeddedServer::makeValue(options.valueType,
+        options.arraySize, rounds * options.nodes + i);
+    }
+    round.start(values);
+    for (std::size_t i = 0; i < options.nodes; ++i) {
+      writer.writeAsync(nodeIds[i], values[i], writeCallback);
+    }
+    if (!round.wait(roundTimeout)) {
+      throw std::runtime_error("Did not receive all values of round "
+        + std::to_string(rounds + 1) + ".");
+    }
+    ++rounds;
+  }
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  auto cpuAfter = getCpuTime();
+  // After the last round, every field must hold the last value. The reader
+  // stores the received values after calling the callbacks, so we might have
+  // to wait a moment.
+  std::uint64_t readMismatches = 0;
+  auto countReadMismatches = [&]() {
+    readMismatches = 0;
+    for (std::size_t i = 0; i < options.nodes; ++i) {
+      auto value = reader.read(nodeIds[i]);
+      if (UA_order(&value.get(), &values[i].get(),
+          &UA_TYPES[UA_TYPES_VARIANT]) != UA_ORDER_EQ) {
+        ++readMismatches;
+      }
+    }
+    return readMismatches == 0;
+  };
+  waitUntil(roundTimeout, countReadMismatches);
+  auto operations = round.getOperations();
+  auto latency = round.latency.getSummary();
+  double userTime = cpuAfter.user - cpuBefore.user;
+  double systemTime = cpuAfter.system - cpuBefore.system;
+  std::fprintf(results,
+    "{\"workload\": \"pubsub\", \"nodes\": %zu, \"type\": \"%s\", "
+    "\"array_size\": %zu, \"publishing_interval\": %.3f, "
+    "\"duration\": %.3f, \"rounds\": %llu, \"operations\": %llu, "
+    "\"failures\": %llu, \"mismatches\": %llu, \"write_failures\": %llu, "
+    "\"throughput\": %.1f, ",
+    options.nodes, EmbeddedServer::valueTypeName(options.valueType),
+    options.arraySize, options.publishingInterval, elapsed,
+    static_cast<unsigned long long>(rounds),
+    static_cast<unsigned long long>(operations),
+    static_cast<unsigned long long>(round.getFailures()),
+    static_cast<unsigned long long>(round.getMismatches() + readMismatches),
+    static_cast<unsigned long long>(
+      writeCallback->failures.load(std::memory_order_relaxed)),
+    operations / elapsed);
+  std::fprintf(results, "\"latency_us\": {\"count\": %llu, \"mean\": %.1f, "
+    "\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+    "\"max\": %.1f}, ",
+    static_cast<unsigned long long>(latency.count), latency.mean * 1e6,
+    latency.p50 * 1e6, latency.p90 * 1e6, latency.p99 * 1e6,
+    latency.p999 * 1e6, latency.max * 1e6);
+  std::fprintf(results, "\"cpu_seconds\": {\"user\": %.3f, \"system\": %.3f}, "
+    "\"sent_messages\": %llu, \"send_errors\": %llu, "
+    "\"missed_cycles\": %llu, \"received_messages\": %llu, "
+    "\"decoding_errors\": %llu}\n", userTime, systemTime,
+    static_cast<unsigned long long>(writer.getSentMessages()),
+    static_cast<unsigned long long>(writer.getSendErrors()),
+    static_cast<unsigned long long>(writer.getMissedCycles()),
+    static_cast<unsigned long long>(reader.getReceivedMessages()),
+    static_cast<unsigned long long>(reader.getDecodingErrors()));
+  std::fflush(results);
+  if (round.getFailures()) {
+    throw std::runtime_error(
+      std::string("A notification failed with status ")
+      + UA_StatusCode_name(round.getLastFailureStatus()) + ".");
+  }
+  if (round.getMismatches() || readMismatches) {
+    throw std::runtime_error(
+      "The reader received values that had not been written.");
+  }
+  if (writeCallback->failures.load(std::memory_order_relaxed)) {
+    throw std::runtime_error("Writing a field failed.");
+  }
+  if (reader.getDecodingErrors()) {
+    throw std::runtime_error(
+      "The reader could not decode some of the network messages.");
+  }
+}
+
+const char *const usageOptions =
+  "  --workload=<name>             read, write, monitor, reconnect, pubsub,\n"
+  "                                or all (default, does not include\n"
+  "                                reconnect and pubsub)\n"
+  "  --nodes=<n>                   number of nodes (default: 100)\n"
+  "  --type=<type>                 double (default), int32, or string\n"
+  "  --array-size=<n>              0 (default) for scalar values\n"
+  "  --duration=<seconds>          duration of each workload, or time\n"
+  "                                between interruptions for reconnect\n"
+  "                                (default: 5)\n"
+  "  --outstanding=<n>             requests in flight (default: 16)\n"
+  "  --update-rate=<hz>            server updates per node (default: 10)\n"
+  "  --publishing-interval=<ms>    subscription or writer group interval\n"
+  "                                (default: 100)\n"
+  "  --pubsub-address=<address>    multicast group for pubsub (default:\n"
+  "                                239.255.0.1)\n"
+  "  --port=<port>                 port of the embedded server or UDP port\n"
+  "                                for pubsub (default: 48400)\n"
+  "  --cycles=<n>                  interruptions for reconnect (default: "
+  "10)\n"
+  "  --fault=<fault>               restart (default) or drop\n"
+  "  --outage=<seconds>            server downtime for restart (default: 1)\n"
+  "  --read-rate=<hz>              reads per second for reconnect (default: "
+  "100)\n"
+  "  --recovery-timeout=<seconds>  maximum wait for recovery (default: 30)\n"
+  "  --proxy-delay=<ms>            one-way delay added by the proxy\n"
+  "  --proxy-jitter=<ms>           maximum additional one-way delay\n"
+  "  --proxy-bandwidth=<kbit/s>    bandwidth of each direction\n"
+  "  --proxy-drop-interval=<s>     mean time between dropped connections\n";
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  parseArguments(argc, argv,
+    [&options](const std::string &name, const std::string &value) {
+      if (name == "array-size") {
+        options.arraySize = std::stoul(value);
+      } else if (name == "cycles") {
+        options.cycles = std::stoul(value);
+      } else if (name == "duration") {
+        options.duration = std::stod(value);
+      } else if (name == "fault") {
+        options.fault = value;
+      } else if (name == "nodes") {
+        options.nodes = std::stoul(value);
+      } else if (name == "outage") {
+        options.outage = std::stod(value);
+      } else if (name == "outstanding") {
+        options.outstanding = std::stoul(value);
+      } else if (name == "port") {
+        options.port = static_cast<std::uint16_t>(std::stoul(value));
+      } else if (name == "proxy-bandwidth") {
+        options.proxyBandwidth = std::stod(value);
+      } else if (name == "proxy-delay") {
+        options.proxyDelay = std::stod(value);
+      } else if (name == "proxy-drop-interval") {
+        options.proxyDropInterval = std::stod(value);
+      } else if (name == "proxy-jitter") {
+        options.proxyJitter = std::stod(value);
+      } else if (name == "publishing-interval") {
+        options.publishingInterval = std::stod(value);
+      } else if (name == "pubsub-address") {
+        options.pubSubAddress = value;
+      } else if (name == "read-rate") {
+        options.readRate = std::stod(value);
+      } else if (name == "recovery-timeout") {
+        options.recoveryTimeout = std::stod(value);
+      } else if (name == "type") {
+        options.valueType = EmbeddedServer::parseValueType(value);
+      } else if (name == "update-rate") {
+        options.updateRate = std::stod(value);
+      } else if (name == "workload") {
+        options.workload = value;
+      } else {
+        throw std::invalid_argument("Unknown option: " + name);
+      }
+    });
+  if (!options.nodes || !options.outstanding || !(options.duration > 0.0)) {
+    throw std::invalid_argument(
+      "The number of nodes, the number of outstanding requests, and the duration must be positive.");
+  }
+  if (!(options.readRate > 0.0) || !(options.recoveryTimeout > 0.0)
+      || options.outage < 0.0) {
+    throw std::invalid_argument(
+      "The read rate and the recovery timeout must be positive, and the outage must not be negative.");
+  }
+  if (options.proxyBandwidth < 0.0 || options.proxyDelay < 0.0
+      || options.proxyDropInterval < 0.0 || options.proxyJitter < 0.0) {
+    throw std::invalid_argument(
+      "The impairments of the proxy must not be negative.");
+  }
+  return options;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--help")) {
+      printUsage(argv[0], usageOptions);
+      return 0;
+    }
+  }
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n\n", e.what());
+    printUsage(argv[0], usageOptions);
+    return 2;
+  }
+  int resultsFd = ::dup(STDOUT_FILENO);
+  if (resultsFd < 0 || ::dup2(STDERR_FILENO, STDOUT_FILENO) < 0
+      || !(results = ::fdopen(resultsFd, "w"))) {
+    std::fprintf(stderr, "Could not redirect stdout: %s\n",
+      std::strerror(errno));
+    return 1;
+  }
+  try {
+    bool all = options.workload == "all";
+    bool found = false;
+    if (all || options.workload == "read") {
+      found = true;
+      runRequestWorkload(options, false);
+    }
+    if (all || options.workload == "write") {
+      found = true;
+      runRequestWorkload(options, true);
+    }
+    if (all || options.workload == "monitor") {
+      found = true;
+      runMonitorWorkload(options);
+    }
+    // The reconnect workload takes much longer than the other workloads, so
+    // it is only run when it is selected explicitly.
+    if (options.workload == "reconnect") {
+      found = true;
+      runReconnectWorkload(options);
+    }
+    // The pubsub workload needs multicast on the loopback interface, which
+    // is not available everywhere, so it is only run when it is selected
+    // explicitly.
+    if (options.workload == "pubsub") {
+      found = true;
+      runPubSubWorkload(options);
+    }
+    if (!found) {
+      std::fprintf(stderr, "Unknown workload: %s\n", options.workload.c_str());
+      return 2;
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,566 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+/*
+ * Microbenchmarks for the device support of the records. The benchmark runs
+ * an IOC inside the process, which uses a MockConnection instead of a
+ * connection to an OPC UA server, so that the cost of the record layer can be
+ * measured without any network communication. The following benchmarks are
+ * available:
+ *
+ * process: processes the records of each supported type, measuring the cost
+ * of a complete read or write cycle (including the asynchronous completion).
+ *
+ * notification: sends notifications to records in I/O Intr mode, measuring
+ * how quickly they are handed off to the records.
+ *
+ * array: processes aai and aao records with different combinations of OPC UA
+ * data types and FTVL, measuring the cost of converting arrays.
+ *
+ * For each measurement, one line with a JSON object is printed to stdout.
+ * Everything else (including the output of the IOC) is written to stderr.
+ */
+
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <dbAccess.h>
+#include <dbCommon.h>
+#include <epicsExit.h>
+#include <iocInit.h>
+#include <registryDeviceSupport.h>
+
+#include "ServerConnectionRegistry.h"
+#include "UaException.h"
+
+#include "BenchmarkUtil.h"
+#include "MockConnection.h"
+
+extern "C" int open62541RecordBenchmark_registerRecordDeviceDriver(
+  struct dbBase *pdbbase);
+
+using namespace open62541::epics;
+using namespace open62541::epics::benchmark;
+
+namespace {
+
+const char *const connectionId = "mock";
+
+/**
+ * Stream to which the results are written. iocInit and the device support
+ * write their messages to stdout, so the results are written to a duplicate
+ * of the original stdout, and stdout is redirected to stderr.
+ */
+FILE *results = stdout;
+
+/**
+ * Options controlling the benchmarks. They can be set on the command line.
+ */
+struct Options {
+  std::size_t arrayRecords = 10;
+  std::size_t arraySize = 1000;
+  std::string benchmark = "all";
+  MockConnection::CompletionMode completionMode =
+    MockConnection::CompletionMode::thread;
+  std::string dbdFile;
+  std::size_t iterations = 1000;
+  std::size_t records = 100;
+};
+
+/**
+ * Group of records that are processed together. All records in a group have
+ * the same type and configuration.
+ */
+struct RecordGroup {
+  // Benchmark to which the group belongs.
+  std::string benchmark;
+  // Additional JSON fields describing the group (without the surrounding
+  // braces, but with a trailing comma and space if not empty).
+  std::string description;
+  std::vector<::dbCommon *> records;
+  std::vector<std::string> recordNames;
+  std::string recordType;
+};
+
+/**
+ * Creates a scalar value of the specified OPC UA type.
+ */
+template<typename ValueType>
+UaVariant makeScalar(const ValueType &value, int typeIndex) {
+  UA_Variant variant;
+  UA_Variant_init(&variant);
+  auto status = UA_Variant_setScalarCopy(&variant, &value,
+    &UA_TYPES[typeIndex]);
+  if (status != UA_STATUSCODE_GOOD) {
+    throw UaException(status);
+  }
+  return UaVariant(std::move(variant));
+}
+
+UaVariant makeString(const std::string &value) {
+  UA_String string = UA_String_fromChars(value.c_str());
+  UaVariant result = makeScalar(string, UA_TYPES_STRING);
+  UA_String_clear(&string);
+  return result;
+}
+
+/**
+ * Creates an array value of the specified OPC UA type. Only numeric types
+ * are supported.
+ */
+UaVariant makeArray(int typeIndex, std::size_t size) {
+  const UA_DataType *type = &UA_TYPES[typeIndex];
+  void *data = UA_Array_new(size, type);
+  if (!data && size) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    // The values are kept small, so that they can be represented by all
+    // types.
+    auto value = i % 100;
+    switch (type->typeKind) {
+    case UA_DATATYPEKIND_BYTE:
+      static_cast<UA_Byte *>(data)[i] = static_cast<UA_Byte>(value);
+      break;
+    case UA_DATATYPEKIND_INT16:
+      static_cast<UA_Int16 *>(data)[i] = static_cast<UA_Int16>(value);
+      break;
+    case UA_DATATYPEKIND_INT32:
+      static_cast<UA_Int32 *>(data)[i] = static_cast<UA_Int32>(value);
+      break;
+    case UA_DATATYPEKIND_FLOAT:
+      static_cast<UA_Float *>(data)[i] = static_cast<UA_Float>(value);
+      break;
+    case UA_DATATYPEKIND_DOUBLE:
+      static_cast<UA_Double *>(data)[i] = static_cast<UA_Double>(value);
+      break;
+    default:
+      UA_Array_delete(data, size, type);
+      throw std::invalid_argument(
+        std::string("Unsupported array type: ") + type->typeName);
+    }
+  }
+  UA_Variant variant;
+  UA_Variant_init(&variant);
+  UA_Variant_setArray(&variant, data, size, type);
+  return UaVariant(std::move(variant));
+}
+
+/**
+ * Record types (and their device support) used by the process benchmark.
+ */
+struct RecordTypeSpec {
+  const char *recordType;
+  const char *deviceSupport;
+  bool output;
+  std::string extraFields;
+  std::function<UaVariant()> makeValue;
+};
+
+std::vector<RecordTypeSpec> getRecordTypeSpecs(const Options &options) {
+  auto arraySize = options.arraySize;
+  auto arrayFields = "  field(FTVL, \"DOUBLE\")\n  field(NELM, \""
+    + std::to_string(arraySize) + "\")\n";
+  auto doubleValue = []() {return makeScalar(UA_Double(42.0), UA_TYPES_DOUBLE);};
+  auto booleanValue = []() {return makeScalar(UA_Boolean(true),
+    UA_TYPES_BOOLEAN);};
+  auto int32Value = []() {return makeScalar(UA_Int32(42), UA_TYPES_INT32);};
+  auto int64Value = []() {return makeScalar(UA_Int64(42), UA_TYPES_INT64);};
+  auto uint32Value = []() {return makeScalar(UA_UInt32(3), UA_TYPES_UINT32);};
+  auto stringValue = []() {return makeString("benchmark value");};
+  auto arrayValue = [arraySize]() {
+    return makeArray(UA_TYPES_DOUBLE, arraySize);
+  };
+  return std::vector<RecordTypeSpec>{
+    {"aai", "devAaiOpen62541", false, arrayFields, arrayValue},
+    {"aao", "devAaoOpen62541", true, arrayFields, arrayValue},
+    {"ai", "devAiOpen62541", false, "", doubleValue},
+    {"ao", "devAoOpen62541", true, "", doubleValue},
+    {"bi", "devBiOpen62541", false, "", booleanValue},
+    {"bo", "devBoOpen62541", true, "", booleanValue},
+    {"int64in", "devInt64inOpen62541", false, "", int64Value},
+    {"int64out", "devInt64outOpen62541", true, "", int64Value},
+    {"longin", "devLonginOpen62541", false, "", int32Value},
+    {"longout", "devLongoutOpen62541", true, "", int32Value},
+    {"lsi", "devLsiOpen62541", false, "  field(SIZV, \"64\")\n", stringValue},
+    {"lso", "devLsoOpen62541", true, "  field(SIZV, \"64\")\n", stringValue},
+    {"mbbi", "devMbbiOpen62541", false, "", uint32Value},
+    {"mbbiDirect", "devMbbiDirectOpen62541", false, "", uint32Value},
+    {"mbbo", "devMbboOpen62541", true, "", uint32Value},
+    {"mbboDirect", "devMbboDirectOpen62541", true, "", uint32Value},
+    {"stringin", "devStringinOpen62541", false, "", stringValue},
+    {"stringout", "devStringoutOpen62541", true, "", stringValue},
+  };
+}
+
+/**
+ * OPC UA data types and FTVL values used by the array benchmark.
+ */
+struct ArrayTypeSpec {
+  const char *dataTypeName;
+  int typeIndex;
+  const char *ftvl;
+};
+
+const ArrayTypeSpec arrayTypeSpecs[] = {
+  {"Byte", UA_TYPES_BYTE, "UCHAR"},
+  {"Int16", UA_TYPES_INT16, "SHORT"},
+  {"Int32", UA_TYPES_INT32, "LONG"},
+  {"Float", UA_TYPES_FLOAT, "FLOAT"},
+  {"Double", UA_TYPES_DOUBLE, "DOUBLE"},
+};
+
+/**
+ * Builds the database and the values of the nodes in the mock connection.
+ * The records of each group are appended to the database string.
+ */
+class DatabaseBuilder {
+
+public:
+
+  DatabaseBuilder(MockConnection &connection) : connection(connection) {
+  }
+
+  void addRecords(RecordGroup &group, std::size_t count,
+      const std::string &recordType, bool output, const std::string &scan,
+      const std::string &extraFields, const std::string &addressSuffix,
+      const UaVariant &value) {
+    group.recordType = recordType;
+    for (std::size_t i = 0; i < count; ++i) {
+      std::string name = "bench:" + std::to_string(nextIndex++);
+      std::string nodeName = name;
+      UaNodeId nodeId(UA_NODEID_STRING_ALLOC(1, nodeName.c_str()));
+      connection.setValue(nodeId, value);
+      database += "record(" + recordType + ", \"" + name + "\") {\n"
+        + "  field(DTYP, \"open62541\")\n"
+        + "  field(" + (output ? "OUT" : "INP") + ", \"@" + connectionId
+        + " str:1," + nodeName + addressSuffix + "\")\n"
+        + "  field(SCAN, \"" + scan + "\")\n" + extraFields + "}\n";
+      group.recordNames.push_back(name);
+    }
+  }
+
+  const std::string &getDatabase() const {
+    return database;
+  }
+
+private:
+
+  MockConnection &connection;
+  std::string database;
+  std::size_t nextIndex = 0;
+
+};
+
+void resolveRecords(RecordGroup &group) {
+  for (auto &name : group.recordNames) {
+    ::DBADDR address;
+    if (::dbNameToAddr(name.c_str(), &address)) {
+      throw std::runtime_error("Could not find record " + name + ".");
+    }
+    group.records.push_back(address.precord);
+  }
+}
+
+/**
+ * Waits until the histogram has recorded the specified number of values.
+ */
+void waitForCount(const LatencyHistogram &histogram, std::uint64_t count) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (histogram.getCount() < count) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      throw std::runtime_error(
+        "Timeout while waiting for the records to be processed.");
+    }
+    std::this_thread::yield();
+  }
+}
+
+/**
+ * Runs the specified number of iterations. In each iteration, the action is
+ * run once for each record of the group and then we wait until the histogram
+ * has recorded one value for each record. The results are printed as a JSON
+ * object.
+ */
+void measure(const Options &options, const RecordGroup &group,
+    LatencyHistogram &histogram,
+    const std::function<void(::dbCommon *, std::size_t)> &action) {
+  histogram.reset();
+  auto cpuBefore = getCpuTime();
+  auto startTime = std::chrono::steady_clock::now();
+  std::uint64_t operations = 0;
+  for (std::size_t iteration = 0; iteration < options.iterations;
+      ++iteration) {
+    for (auto record : group.records) {
+      action(record, iteration);
+    }
+    operations += group.records.size();
+    waitForCount(histogram, operations);
+  }
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  auto cpuAfter = getCpuTime();
+  auto latency = histogram.getSummary();
+  double userTime = cpuAfter.user - cpuBefore.user;
+  double systemTime = cpuAfter.system - cpuBefore.system;
+  std::fprintf(results, "{\"benchmark\": \"%s\", \"record_type\": \"%s\", %s"
+    "\"records\": %zu, \"iterations\": %zu, \"completion\": \"%s\", "
+    "\"operations\": %llu, \"duration\": %.3f, \"throughput\": %.1f, "
+    "\"ns_per_operation\": %.1f, ",
+    group.benchmark.c_str(), group.recordType.c_str(),
+    group.description.c_str(), group.records.size(), options.iterations,
+    options.completionMode == MockConnection::CompletionMode::synchronous
+      ? "synchronous" : "thread",
+    static_cast<unsigned long long>(operations), elapsed,
+    operations / elapsed, elapsed * 1e9 / operations);
+  std::fprintf(results, "\"latency_us\": {\"count\": %llu, \"mean\": %.2f, "
+    "\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"p999\": %.2f, "
+    "\"max\": %.2f}, ",
+    static_cast<unsigned long long>(latency.count), latency.mean * 1e6,
+    latency.p50 * 1e6, latency.p90 * 1e6, latency.p99 * 1e6,
+    latency.p999 * 1e6, latency.max * 1e6);
+  std::fprintf(results, "\"cpu_seconds\": {\"user\": %.3f, \"system\": %.3f}, "
+    "\"cpu_ns_per_operation\": %.1f}\n", userTime, systemTime,
+    (userTime + systemTime) * 1e9 / operations);
+  std::fflush(results);
+}
+
+void processRecord(::dbCommon *record) {
+  ::dbScanLock(record);
+  ::dbProcess(record);
+  ::dbScanUnlock(record);
+}
+
+const char *const usageOptions =
+  "  --benchmark=<name>      process, notification, array, or all "
+  "(default)\n"
+  "  --records=<n>           records per type (default: 100)\n"
+  "  --iterations=<n>        times each record is processed (default: "
+  "1000)\n"
+  "  --array-size=<n>        elements of array records (default: 1000)\n"
+  "  --array-records=<n>     records per array type combination (default: "
+  "10)\n"
+  "  --completion=<mode>     thread (default) or synchronous\n"
+  "  --dbd=<path>            DBD file (default: "
+  "../O.Common/open62541RecordBenchmark.dbd,\n"
+  "                          relative to the directory of the program)\n";
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  parseArguments(argc, argv,
+    [&options](const std::string &name, const std::string &value) {
+      if (name == "array-records") {
+        options.arrayRecords = std::stoul(value);
+      } else if (name == "array-size") {
+        options.arraySize = std::stoul(value);
+      } else if (name == "benchmark") {
+        options.benchmark = value;
+      } else if (name == "completion") {
+        options.completionMode = MockConnection::parseCompletionMode(value);
+      } else if (name == "dbd") {
+        options.dbdFile = value;
+      } else if (name == "iterations") {
+        options.iterations = std::stoul(value);
+      } else if (name == "records") {
+        options.records = std::stoul(value);
+      } else {
+        throw std::invalid_argument("Unknown option: " + name);
+      }
+    });
+  if (options.dbdFile.empty()) {
+    options.dbdFile = getDefaultDbdFile(
+      argv[0], "open62541RecordBenchmark.dbd");
+  }
+  if (!options.records || !options.iterations || !options.arraySize
+      || !options.arrayRecords) {
+    throw std::invalid_argument("All numbers must be positive.");
+  }
+  if (options.benchmark != "all" && options.benchmark != "array"
+      && options.benchmark != "notification"
+      && options.benchmark != "process") {
+    throw std::invalid_argument("Unknown benchmark: " + options.benchmark);
+  }
+  return options;
+}
+
+int runBenchmarks(const Options &options) {
+  if (::dbLoadDatabase(options.dbdFile.c_str(), nullptr, nullptr)) {
+    throw std::runtime_error("Could not load " + options.dbdFile + ".");
+  }
+  ::open62541RecordBenchmark_registerRecordDeviceDriver(::pdbbase);
+  auto connection = std::make_shared<MockConnection>(
+    connectionId, options.completionMode);
+  ServerConnectionRegistry::getInstance().registerConnection(
+    connectionId, connection);
+  bool all = options.benchmark == "all";
+  DatabaseBuilder builder(*connection);
+  std::vector<RecordGroup> processGroups;
+  if (all || options.benchmark == "process") {
+    for (auto &spec : getRecordTypeSpecs(options)) {
+      // Some record types are only available with newer versions of EPICS
+      // Base.
+      if (!::registryDeviceSupportFind(spec.deviceSupport)) {
+        continue;
+      }
+      processGroups.emplace_back();
+      auto &group = processGroups.back();
+      group.benchmark = "process";
+      builder.addRecords(group, options.records, spec.recordType, spec.output,
+        "Passive", spec.extraFields, "", spec.makeValue());
+    }
+  }
+  std::vector<RecordGroup> arrayGroups;
+  if (all || options.benchmark == "array") {
+    for (auto &source : arrayTypeSpecs) {
+      for (auto &destination : arrayTypeSpecs) {
+        auto fields = std::string("  field(FTVL, \"") + destination.ftvl
+          + "\")\n  field(NELM, \"" + std::to_string(options.arraySize)
+          + "\")\n";
+        // For the aai record, the source is the OPC UA value and the
+        // destination is the record's value. For the aao record, it is the
+        // other way round, and the data type is specified in the address.
+        arrayGroups.emplace_back();
+        auto &inputGroup = arrayGroups.back();
+        inputGroup.benchmark = "array";
+        inputGroup.description = std::string("\"data_type\": \"")
+          + source.dataTypeName + "\", \"ftvl\": \"" + destination.ftvl
+          + "\", \"array_size\": " + std::to_string(options.arraySize) + ", ";
+        builder.addRecords(inputGroup, options.arrayRecords, "aai", false,
+          "Passive", fields, "", makeArray(source.typeIndex,
+            options.arraySize));
+        arrayGroups.emplace_back();
+        auto &outputGroup = arrayGroups.back();
+        outputGroup.benchmark = "array";
+        outputGroup.description = std::string("\"data_type\": \"")
+          + source.dataTypeName + "\", \"ftvl\": \"" + destination.ftvl
+          + "\", \"array_size\": " + std::to_string(options.arraySize) + ", ";
+        builder.addRecords(outputGroup, options.arrayRecords, "aao", true,
+          "Passive", fields, std::string(" ") + source.dataTypeName,
+          makeArray(source.typeIndex, options.arraySize));
+      }
+    }
+  }
+  RecordGroup notificationGroup;
+  bool notificationBenchmark = all || options.benchmark == "notification";
+  if (notificationBenchmark) {
+    notificationGroup.benchmark = "notification";
+    builder.addRecords(notificationGroup, options.records, "ai", false,
+      "I/O Intr", "", "", makeScalar(UA_Double(0.0), UA_TYPES_DOUBLE));
+  }
+  loadDatabase(builder.getDatabase());
+  if (::iocInit()) {
+    throw std::runtime_error("Could not initialize the IOC.");
+  }
+  for (auto &group : processGroups) {
+    resolveRecords(group);
+  }
+  for (auto &group : arrayGroups) {
+    resolveRecords(group);
+  }
+  if (notificationBenchmark) {
+    resolveRecords(notificationGroup);
+  }
+  // The total latency is recorded each time a record completes an
+  // asynchronous read or write, so it tells us when all records have been
+  // processed.
+  auto &totalLatency = connection->getStatistics().getLatencyHistogram(
+    ConnectionStatistics::Latency::total);
+  for (auto &group : processGroups) {
+    measure(options, group, totalLatency,
+      [](::dbCommon *record, std::size_t) {processRecord(record);});
+  }
+  for (auto &group : arrayGroups) {
+    measure(options, group, totalLatency,
+      [](::dbCommon *record, std::size_t) {processRecord(record);});
+  }
+  if (notificationBenchmark) {
+    // The processing latency is recorded each time a record is processed with
+    // the value from a new notification.
+    auto subscriptionStatistics =
+      connection->getSubscriptionStatistics("default");
+    std::vector<UaNodeId> nodeIds;
+    for (auto &name : notificationGroup.recordNames) {
+      nodeIds.push_back(UaNodeId(UA_NODEID_STRING_ALLOC(1, name.c_str())));
+    }
+    std::size_t index = 0;
+    measure(options, notificationGroup,
+      subscriptionStatistics->notificationProcessingLatency,
+      [&connection, &nodeIds, &index](::dbCommon *, std::size_t iteration) {
+        connection->notify(nodeIds[index], makeScalar(
+          static_cast<UA_Double>(iteration), UA_TYPES_DOUBLE));
+        index = (index + 1) % nodeIds.size();
+      });
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--help")) {
+      printUsage(argv[0], usageOptions);
+      return 0;
+    }
+  }
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n\n", e.what());
+    printUsage(argv[0], usageOptions);
+    return 2;
+  }
+  int resultsFd = ::dup(STDOUT_FILENO);
+  if (resultsFd < 0 || ::dup2(STDERR_FILENO, STDOUT_FILENO) < 0
+      || !(results = ::fdopen(resultsFd, "w"))) {
+    std::fprintf(stderr, "Could not redirect stdout: %s\n",
+      std::strerror(errno));
+    return 1;
+  }
+  int status;
+  try {
+    status = runBenchmarks(options);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+    status = 1;
+  }
+  // The IOC cannot be shut down cleanly in all versions of EPICS Base, so we
+  // let epicsExit take care of stopping its threads.
+  ::epicsExit(status);
+  return status;
+}
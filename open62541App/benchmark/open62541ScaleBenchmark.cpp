@@ -0,0 +1,517 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+/*
+ * Scale test for the device support. For each of the requested numbers of
+ * records, the benchmark starts an OPC UA server inside the process and boots
+ * an IOC with a generated database in a child process (an IOC can only be
+ * booted once per process). The database contains a mix of record types,
+ * polled and I/O Intr input records that are spread over several
+ * subscriptions, and output records. The child process measures the boot
+ * time, the memory usage, the number of threads, and the CPU usage in the
+ * steady state. For each number of records, one line with a JSON object is
+ * printed to stdout, so that the results can easily be turned into curves.
+ */
+
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dbAccess.h>
+#include <epicsExit.h>
+#include <iocInit.h>
+#include <iocsh.h>
+
+#include "ServerConnectionRegistry.h"
+#include "StartupProfiler.h"
+
+#include "BenchmarkUtil.h"
+#include "EmbeddedServer.h"
+
+extern "C" int open62541ScaleBenchmark_registerRecordDeviceDriver(
+  struct dbBase *pdbbase);
+
+using namespace open62541::epics;
+using namespace open62541::epics::benchmark;
+
+namespace {
+
+const char *const connectionId = "C0";
+
+/**
+ * Stream to which the results are written. iocInit, the device support, and
+ * the open62541 library write their messages to stdout, so the results are
+ * written to a duplicate of the original stdout, and stdout is redirected to
+ * stderr.
+ */
+FILE *results = stdout;
+
+/**
+ * Options controlling the benchmark. They can be set on the command line.
+ */
+struct Options {
+  std::string dbdFile;
+  double duration = 10.0;
+  bool ioc = false;
+  double monitoredFraction = 0.5;
+  double outputFraction = 0.1;
+  std::uint16_t port = 48500;
+  double publishingInterval = 100.0;
+  double readyTimeout = 300.0;
+  std::vector<std::size_t> records{1000, 10000, 100000};
+  std::string scan = "1 second";
+  double settleTime = 2.0;
+  std::size_t subscriptions = 4;
+  double updateRate = 1.0;
+};
+
+/**
+ * Returns the number of threads of the process or -1 if it cannot be
+ * determined (it is only available on Linux).
+ */
+long long getThreadCount() {
+  FILE *status = std::fopen("/proc/self/status", "r");
+  if (!status) {
+    return -1;
+  }
+  long long threads = -1;
+  char line[256];
+  while (std::fgets(line, sizeof(line), status)) {
+    if (!std::strncmp(line, "Threads:", 8)) {
+      threads = std::strtoll(line + 8, nullptr, 10);
+      break;
+    }
+  }
+  std::fclose(status);
+  return threads;
+}
+
+/**
+ * Prints a number, or null if it is negative (which means that the value is
+ * not available).
+ */
+void printOptional(const char *format, double value) {
+  if (value < 0.0) {
+    std::fprintf(results, "null");
+  } else {
+    std::fprintf(results, format, value);
+  }
+}
+
+/**
+ * Tells whether the element with the specified index belongs to the subset
+ * that makes up the specified fraction of all elements. The elements of the
+ * subset are spread evenly.
+ */
+bool isInFraction(std::size_t index, double fraction) {
+  return static_cast<std::size_t>((index + 1) * fraction)
+    > static_cast<std::size_t>(index * fraction);
+}
+
+/**
+ * Numbers of records of each kind in the generated database.
+ */
+struct DatabaseSummary {
+  std::size_t monitoredRecords = 0;
+  std::size_t outputRecords = 0;
+  std::size_t polledRecords = 0;
+};
+
+/**
+ * Generates the database. Each record uses its own node of the embedded
+ * server. The record types are chosen in a round-robin fashion.
+ */
+std::string generateDatabase(const Options &options,
+    std::size_t numberOfRecords, DatabaseSummary &summary) {
+  const char *const inputTypes[] = {"ai", "bi", "longin", "mbbi"};
+  const char *const outputTypes[] = {"ao", "longout"};
+  std::string database;
+  std::size_t inputIndex = 0;
+  std::size_t outputIndex = 0;
+  for (std::size_t i = 0; i < numberOfRecords; ++i) {
+    std::string address = std::string("@") + connectionId;
+    std::string recordType;
+    std::string scan = "Passive";
+    bool output = isInFraction(i, options.outputFraction);
+    if (output) {
+      recordType = outputTypes[outputIndex % 2];
+      ++summary.outputRecords;
+      ++outputIndex;
+    } else {
+      recordType = inputTypes[inputIndex % 4];
+      if (isInFraction(inputIndex, options.monitoredFraction)) {
+        scan = "I/O Intr";
+        address += " (subscription=sub"
+          + std::to_string(summary.monitoredRecords % options.subscriptions)
+          + ")";
+        ++summary.monitoredRecords;
+      } else {
+        scan = options.scan;
+        ++summary.polledRecords;
+      }
+      ++inputIndex;
+    }
+    address += " str:1,benchmark." + std::to_string(i);
+    database += "record(" + recordType + ", \"scale:" + std::to_string(i)
+      + "\") {\n"
+      + "  field(DTYP, \"open62541\")\n"
+      + "  field(" + (output ? "OUT" : "INP") + ", \"" + address + "\")\n"
+      + "  field(SCAN, \"" + scan + "\")\n"
+      + "}\n";
+  }
+  return database;
+}
+
+void runCommand(const std::string &command) {
+  if (::iocshCmd(command.c_str())) {
+    throw std::runtime_error("Command failed: " + command);
+  }
+}
+
+/**
+ * Boots the IOC with the specified number of records and measures it. This is
+ * run in the child process.
+ */
+void runIoc(const Options &options) {
+  auto startTime = std::chrono::steady_clock::now();
+  auto secondsSinceStart = [startTime]() {
+    return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - startTime).count();
+  };
+  std::size_t numberOfRecords = options.records.front();
+  if (::dbLoadDatabase(options.dbdFile.c_str(), nullptr, nullptr)) {
+    throw std::runtime_error("Could not load " + options.dbdFile + ".");
+  }
+  ::open62541ScaleBenchmark_registerRecordDeviceDriver(::pdbbase);
+  double dbdTime = secondsSinceStart();
+  // The connection and the subscriptions are configured in the same way as
+  // in the st.cmd of an IOC.
+  runCommand(std::string("open62541ConnectionSetup(\"") + connectionId
+    + "\", \"opc.tcp://127.0.0.1:" + std::to_string(options.port)
+    + "\", \"\", \"\")");
+  for (std::size_t i = 0; i < options.subscriptions; ++i) {
+    runCommand(std::string("open62541SetSubscriptionPublishingInterval(\"")
+      + connectionId + "\", \"sub" + std::to_string(i) + "\", "
+      + std::to_string(options.publishingInterval) + ")");
+  }
+  double connectionSetupTime = secondsSinceStart();
+  DatabaseSummary summary;
+  loadDatabase(generateDatabase(options, numberOfRecords, summary));
+  double loadRecordsTime = secondsSinceStart();
+  if (::iocInit()) {
+    throw std::runtime_error("Could not initialize the IOC.");
+  }
+  double iocInitTime = secondsSinceStart();
+  auto connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  auto &statistics = connection->getStatistics();
+  auto &startupStatistics = connection->getStartupStatistics();
+  // The IOC is ready when it is connected and each monitored record has
+  // received its first notification.
+  double connectedTime = -1.0;
+  double allValuesTime = -1.0;
+  auto deadline = startTime
+    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(options.readyTimeout));
+  while (allValuesTime < 0.0 && std::chrono::steady_clock::now() < deadline) {
+    if (connectedTime < 0.0 && statistics.isConnected()) {
+      connectedTime = secondsSinceStart();
+    }
+    if (connectedTime >= 0.0 && startupStatistics.getFirstNotificationCount()
+        >= summary.monitoredRecords) {
+      allValuesTime = secondsSinceStart();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto bootResidentSetSize = getResidentSetSize();
+  // We let the IOC settle before measuring the steady state, so that the
+  // measurement does not include the end of the startup.
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.settleTime));
+  auto notificationsBefore =
+    statistics.get(ConnectionStatistics::Counter::notifications);
+  auto readsBefore = statistics.get(ConnectionStatistics::Counter::reads);
+  auto cpuBefore = getCpuTime();
+  auto measurementStartTime = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(std::chrono::duration<double>(options.duration));
+  double elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - measurementStartTime).count();
+  auto cpuAfter = getCpuTime();
+  auto notifications =
+    statistics.get(ConnectionStatistics::Counter::notifications)
+    - notificationsBefore;
+  auto reads = statistics.get(ConnectionStatistics::Counter::reads)
+    - readsBefore;
+  double userTime = cpuAfter.user - cpuBefore.user;
+  double systemTime = cpuAfter.system - cpuBefore.system;
+  // The SCAN menu choices start with the period in seconds.
+  double scanPeriod = std::strtod(options.scan.c_str(), nullptr);
+  std::fprintf(results, "{\"records\": %zu, \"monitored_records\": %zu, "
+    "\"polled_records\": %zu, \"output_records\": %zu, "
+    "\"subscriptions\": %zu, \"update_rate\": %.3f, \"scan\": \"%s\", ",
+    numberOfRecords, summary.monitoredRecords, summary.polledRecords,
+    summary.outputRecords, options.subscriptions, options.updateRate,
+    options.scan.c_str());
+  std::fprintf(results, "\"boot_s\": {\"dbd\": %.3f, "
+    "\"connection_setup\": %.3f, \"load_records\": %.3f, "
+    "\"ioc_init\": %.3f, \"connected\": ", dbdTime, connectionSetupTime,
+    loadRecordsTime, iocInitTime);
+  printOptional("%.3f", connectedTime);
+  std::fprintf(results, ", \"all_values\": ");
+  printOptional("%.3f", allValuesTime);
+  std::fprintf(results, "}, \"startup_phases_s\": {");
+  auto &profiler = StartupProfiler::getInstance();
+  for (std::size_t i = 0;
+      i < static_cast<std::size_t>(StartupProfiler::Phase::numberOfPhases);
+      ++i) {
+    auto phase = static_cast<StartupProfiler::Phase>(i);
+    std::fprintf(results, "%s\"%s\": %.3f", i ? ", " : "",
+      StartupProfiler::getPhaseName(phase),
+      profiler.getPhaseTimings(phase).totalTime);
+  }
+  std::fprintf(results, "}, \"rss_bytes_after_boot\": ");
+  printOptional("%.0f", static_cast<double>(bootResidentSetSize));
+  std::fprintf(results, ", \"rss_bytes\": ");
+  printOptional("%.0f", static_cast<double>(getResidentSetSize()));
+  std::fprintf(results, ", \"threads\": ");
+  printOptional("%.0f", static_cast<double>(getThreadCount()));
+  std::fprintf(results, ", \"duration\": %.3f, "
+    "\"cpu_seconds\": {\"user\": %.3f, \"system\": %.3f}, "
+    "\"cpu_utilization\": %.3f, ", elapsed, userTime, systemTime,
+    (userTime + systemTime) / elapsed);
+  std::fprintf(results, "\"notifications_per_second\": %.1f, "
+    "\"expected_notifications_per_second\": %.1f, "
+    "\"reads_per_second\": %.1f, \"expected_reads_per_second\": %.1f}\n",
+    notifications / elapsed, summary.monitoredRecords * options.updateRate,
+    reads / elapsed,
+    scanPeriod > 0.0 ? summary.polledRecords / scanPeriod : 0.0);
+  std::fflush(results);
+}
+
+/**
+ * Runs the benchmark for a single number of records: starts the server in
+ * this process and the IOC in a child process, which writes its results to
+ * the results stream. Returns false if the child process failed.
+ */
+bool runChild(const Options &options, std::size_t numberOfRecords,
+    const std::vector<std::string> &arguments) {
+  EmbeddedServer server(options.port, numberOfRecords,
+    EmbeddedServer::ValueType::doubleType, 0);
+  server.setUpdateRate(options.updateRate);
+  server.start();
+  // The arguments have to be prepared before forking, because only a few
+  // functions may be called in the child process before calling exec.
+  std::vector<std::string> childArguments(arguments);
+  childArguments.push_back("--ioc=yes");
+  childArguments.push_back("--records=" + std::to_string(numberOfRecords));
+  std::vector<char *> childArgv;
+  for (auto &argument : childArguments) {
+    childArgv.push_back(const_cast<char *>(argument.c_str()));
+  }
+  childArgv.push_back(nullptr);
+  std::fflush(results);
+  std::fflush(stderr);
+  auto pid = ::fork();
+  if (pid < 0) {
+    throw std::runtime_error(
+      std::string("Could not start child process: ") + std::strerror(errno));
+  }
+  if (pid == 0) {
+    // The child process writes its results to our results stream.
+    ::dup2(::fileno(results), STDOUT_FILENO);
+    ::execvp(childArgv[0], childArgv.data());
+    ::_exit(127);
+  }
+  int status;
+  while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  server.stop();
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+const char *const usageOptions =
+  "  --records=<n>[,<n>...]        numbers of records (default: "
+  "1000,10000,100000)\n"
+  "  --monitored-fraction=<f>      fraction of input records in I/O Intr\n"
+  "                                mode (default: 0.5)\n"
+  "  --output-fraction=<f>         fraction of output records (default: "
+  "0.1)\n"
+  "  --scan=<scan>                 SCAN of polled records (default: "
+  "\"1 second\")\n"
+  "  --subscriptions=<n>           number of subscriptions (default: 4)\n"
+  "  --publishing-interval=<ms>    subscription interval (default: 100)\n"
+  "  --update-rate=<hz>            server updates per node (default: 1)\n"
+  "  --settle=<seconds>            wait after booting (default: 2)\n"
+  "  --duration=<seconds>          steady-state measurement (default: 10)\n"
+  "  --ready-timeout=<seconds>     maximum boot time (default: 300)\n"
+  "  --port=<port>                 port of the embedded server (default: "
+  "48500)\n"
+  "  --dbd=<path>                  DBD file (default: "
+  "../O.Common/open62541ScaleBenchmark.dbd,\n"
+  "                                relative to the directory of the "
+  "program)\n";
+
+std::vector<std::size_t> parseRecordCounts(const std::string &value) {
+  std::vector<std::size_t> counts;
+  std::size_t start = 0;
+  while (start <= value.size()) {
+    auto end = value.find(',', start);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    counts.push_back(std::stoul(value.substr(start, end - start)));
+    start = end + 1;
+  }
+  return counts;
+}
+
+Options parseOptions(int argc, char **argv) {
+  Options options;
+  parseArguments(argc, argv,
+    [&options](const std::string &name, const std::string &value) {
+      if (name == "dbd") {
+        options.dbdFile = value;
+      } else if (name == "duration") {
+        options.duration = std::stod(value);
+      } else if (name == "ioc") {
+        // This option is only used internally, for starting the child
+        // process.
+        options.ioc = value == "yes";
+      } else if (name == "monitored-fraction") {
+        options.monitoredFraction = std::stod(value);
+      } else if (name == "output-fraction") {
+        options.outputFraction = std::stod(value);
+      } else if (name == "port") {
+        options.port = static_cast<std::uint16_t>(std::stoul(value));
+      } else if (name == "publishing-interval") {
+        options.publishingInterval = std::stod(value);
+      } else if (name == "ready-timeout") {
+        options.readyTimeout = std::stod(value);
+      } else if (name == "records") {
+        options.records = parseRecordCounts(value);
+      } else if (name == "scan") {
+        options.scan = value;
+      } else if (name == "settle") {
+        options.settleTime = std::stod(value);
+      } else if (name == "subscriptions") {
+        options.subscriptions = std::stoul(value);
+      } else if (name == "update-rate") {
+        options.updateRate = std::stod(value);
+      } else {
+        throw std::invalid_argument("Unknown option: " + name);
+      }
+    });
+  if (options.dbdFile.empty()) {
+    options.dbdFile = getDefaultDbdFile(
+      argv[0], "open62541ScaleBenchmark.dbd");
+  }
+  for (auto count : options.records) {
+    if (!count) {
+      throw std::invalid_argument("The numbers of records must be positive.");
+    }
+  }
+  if (!options.subscriptions || !(options.duration > 0.0)
+      || !(options.readyTimeout > 0.0) || options.settleTime < 0.0
+      || options.updateRate < 0.0) {
+    throw std::invalid_argument(
+      "The number of subscriptions, the duration, and the ready timeout must be positive, and the settle time and update rate must not be negative.");
+  }
+  if (options.monitoredFraction < 0.0 || options.monitoredFraction > 1.0
+      || options.outputFraction < 0.0 || options.outputFraction > 1.0) {
+    throw std::invalid_argument("The fractions must be between 0 and 1.");
+  }
+  return options;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--help")) {
+      printUsage(argv[0], usageOptions);
+      return 0;
+    }
+  }
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "%s\n\n", e.what());
+    printUsage(argv[0], usageOptions);
+    return 2;
+  }
+  int resultsFd = ::dup(STDOUT_FILENO);
+  if (resultsFd < 0 || ::dup2(STDERR_FILENO, STDOUT_FILENO) < 0
+      || !(results = ::fdopen(resultsFd, "w"))) {
+    std::fprintf(stderr, "Could not redirect stdout: %s\n",
+      std::strerror(errno));
+    return 1;
+  }
+  if (options.ioc) {
+    int status = 0;
+    try {
+      runIoc(options);
+    } catch (const std::exception &e) {
+      std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+      status = 1;
+    }
+    // The IOC cannot be shut down cleanly in all versions of EPICS Base, so
+    // we let epicsExit take care of stopping its threads.
+    ::epicsExit(status);
+    return status;
+  }
+  // The child processes get the same options, except for the number of
+  // records, which is added for each child process.
+  std::vector<std::string> arguments{argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--records=", 10)) {
+      arguments.push_back(argv[i]);
+    }
+  }
+  arguments.push_back("--dbd=" + options.dbdFile);
+  try {
+    for (auto numberOfRecords : options.records) {
+      if (!runChild(options, numberOfRecords, arguments)) {
+        std::fprintf(stderr, "Benchmark failed for %zu records.\n",
+          numberOfRecords);
+        return 1;
+      }
+    }
+  } catch (const std::exception &e) {
+    std::fprintf(stderr, "Benchmark failed: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
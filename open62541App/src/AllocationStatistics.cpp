@@ -0,0 +1,171 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cstdlib>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+extern "C" {
+#include "open62541.h"
+}
+
+#include "AllocationStatistics.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// Account that is active in the current thread. If null, the "other" account
+// is used.
+thread_local AllocationStatistics::Account *currentAccount = nullptr;
+
+} // anonymous namespace
+
+// The hooks need access to the private members of AllocationStatistics, so
+// they are implemented as static members of a friend.
+struct AllocationHooks {
+
+  static inline AllocationStatistics::Account &account() {
+    return currentAccount ?
+      *currentAccount : AllocationStatistics::getInstance().otherAccount;
+  }
+
+  // The hooks do not add a header to the allocated memory, because memory
+  // allocated in a thread using the hooks might be freed in a thread that does
+  // not use them (and vice versa). Instead, we ask the allocator for the size
+  // of the block. On platforms where this is not possible, only the number of
+  // allocations is counted.
+  static inline std::size_t blockSize(void *ptr) {
+#if defined(__GLIBC__)
+    return ::malloc_usable_size(ptr);
+#elif defined(__APPLE__)
+    return ::malloc_size(ptr);
+#else
+    (void) ptr;
+    return 0;
+#endif
+  }
+
+  static inline void countAllocation(void *ptr) {
+    auto size = blockSize(ptr);
+    auto &acc = account();
+    acc.allocations.fetch_add(1, std::memory_order_relaxed);
+    acc.allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    std::int64_t net = acc.netBytes.fetch_add(
+      static_cast<std::int64_t>(size), std::memory_order_relaxed)
+      + static_cast<std::int64_t>(size);
+    auto peak = acc.peakNetBytes.load(std::memory_order_relaxed);
+    while (net > peak && !acc.peakNetBytes.compare_exchange_weak(
+        peak, net, std::memory_order_relaxed)) {
+    }
+  }
+
+  static inline void countFree(std::size_t size) {
+    auto &acc = account();
+    acc.frees.fetch_add(1, std::memory_order_relaxed);
+    acc.netBytes.fetch_sub(
+      static_cast<std::int64_t>(size), std::memory_order_relaxed);
+  }
+
+  static void *calloc(std::size_t count, std::size_t size) {
+    void *ptr = std::calloc(count, size);
+    if (ptr) {
+      countAllocation(ptr);
+    }
+    return ptr;
+  }
+
+  static void free(void *ptr) {
+    if (ptr) {
+      countFree(blockSize(ptr));
+      std::free(ptr);
+    }
+  }
+
+  static void *malloc(std::size_t size) {
+    void *ptr = std::malloc(size);
+    if (ptr) {
+      countAllocation(ptr);
+    }
+    return ptr;
+  }
+
+  static void *realloc(void *ptr, std::size_t size) {
+    std::size_t oldSize = ptr ? blockSize(ptr) : 0;
+    void *newPtr = std::realloc(ptr, size);
+    // If realloc fails, the old block is left untouched, unless the requested
+    // size is zero, in which case the old block may have been freed.
+    if (newPtr) {
+      if (ptr) {
+        countFree(oldSize);
+      }
+      countAllocation(newPtr);
+    } else if (ptr && size == 0) {
+      countFree(oldSize);
+    }
+    return newPtr;
+  }
+
+};
+
+AllocationStatistics::AllocationStatistics() : nodeIdCopies(0),
+    otherAccount("other"), variantCopies(0) {
+}
+
+AllocationStatistics::Scope::Scope(Account *account)
+    : previousAccount(currentAccount) {
+  installHooks();
+  currentAccount = account;
+}
+
+AllocationStatistics::Scope::~Scope() {
+  currentAccount = previousAccount;
+}
+
+bool AllocationStatistics::isEnabled() {
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+  return true;
+#else
+  return false;
+#endif
+}
+
+void AllocationStatistics::installHooks() {
+#ifdef UA_ENABLE_MALLOC_SINGLETON
+  if (UA_mallocSingleton != AllocationHooks::malloc) {
+    UA_mallocSingleton = AllocationHooks::malloc;
+    UA_freeSingleton = AllocationHooks::free;
+    UA_callocSingleton = AllocationHooks::calloc;
+    UA_reallocSingleton = AllocationHooks::realloc;
+  }
+#endif // UA_ENABLE_MALLOC_SINGLETON
+}
+
+}
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_ALLOCATION_STATISTICS_H
+#define OPEN62541_EPICS_ALLOCATION_STATISTICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Accounting of the heap allocations made by the open62541 library.
+ *
+ * When the device support is compiled with USE_ALLOCATION_STATS = YES, the
+ * open62541 library is built with UA_ENABLE_MALLOC_SINGLETON, and this class
+ * installs counting versions of UA_malloc, UA_calloc, UA_realloc, and UA_free.
+ * The library keeps these function pointers in thread-local variables, so the
+ * hooks have to be installed in each thread that uses the library. This
+ * happens automatically when a connection thread starts, when a record is
+ * processed, and when a UaNodeId or UaVariant is copied.
+ *
+ * Allocations are attributed to the account that is active in the calling
+ * thread (see {@link Scope}). If no account is active, the "other" account is
+ * used. Memory that is allocated by one account and freed by another one is
+ * counted as freed by the second account, so the net number of bytes of a
+ * single account can be negative. The sum over all accounts is the number of
+ * bytes that are currently allocated through the hooks.
+ *
+ * Independently of the hooks, this class counts how often UaNodeId and
+ * UaVariant objects are copied. These counters are always available.
+ *
+ * This class implements the singleton pattern and the only instance is
+ * returned by the {@link #getInstance()} function.
+ */
+class AllocationStatistics {
+
+public:
+
+  /**
+   * Counters for the allocations attributed to a single subsystem.
+   */
+  struct Account {
+
+    std::atomic<std::uint64_t> allocatedBytes;
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::uint64_t> frees;
+    const std::string name;
+    std::atomic<std::int64_t> netBytes;
+    std::atomic<std::int64_t> peakNetBytes;
+
+    inline Account(const std::string &name) : allocatedBytes(0),
+        allocations(0), frees(0), name(name), netBytes(0), peakNetBytes(0) {
+    }
+
+  };
+
+  /**
+   * Makes an account the active account of the calling thread for the
+   * lifetime of this object. When this object is destroyed, the previously
+   * active account is restored. This also installs the allocation hooks for
+   * the calling thread.
+   */
+  class Scope {
+
+  public:
+
+    /**
+     * Makes the specified account the active account of the calling thread.
+     */
+    Scope(Account *account);
+
+    /**
+     * Restores the account that was active before this object was created.
+     */
+    ~Scope();
+
+  private:
+
+    // We do not want to allow copy or move construction or assignment.
+    Scope(const Scope &) = delete;
+    Scope(Scope &&) = delete;
+    Scope &operator=(const Scope &) = delete;
+    Scope &operator=(Scope &&) = delete;
+
+    Account *previousAccount;
+
+  };
+
+  /**
+   * Returns the only instance of this class.
+   */
+  inline static AllocationStatistics &getInstance() {
+    // The instance is intentionally never destroyed. The hooks may still be
+    // called while other static objects (e.g. the server connections, which
+    // delete their clients) are destroyed at exit.
+    static AllocationStatistics *instance = new AllocationStatistics();
+    return *instance;
+  }
+
+  /**
+   * Tells whether the allocation hooks have been compiled in. If not, only
+   * the copy counters are available.
+   */
+  static bool isEnabled();
+
+  /**
+   * Installs the allocation hooks for the calling thread. This method is cheap
+   * when the hooks have already been installed and does nothing when the hooks
+   * have not been compiled in.
+   */
+  static void installHooks();
+
+  /**
+   * Returns the account that is used for allocations made while no other
+   * account is active.
+   */
+  inline Account &getOtherAccount() {
+    return otherAccount;
+  }
+
+  /**
+   * Returns the number of times a UaNodeId has been copied.
+   */
+  inline std::uint64_t getNodeIdCopies() const {
+    return nodeIdCopies.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of times a UaVariant has been copied.
+   */
+  inline std::uint64_t getVariantCopies() const {
+    return variantCopies.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Counts a copy of a UaNodeId. This also installs the allocation hooks for
+   * the calling thread.
+   */
+  inline void countNodeIdCopy() {
+    nodeIdCopies.fetch_add(1, std::memory_order_relaxed);
+    installHooks();
+  }
+
+  /**
+   * Counts a copy of a UaVariant. This also installs the allocation hooks for
+   * the calling thread.
+   */
+  inline void countVariantCopy() {
+    variantCopies.fetch_add(1, std::memory_order_relaxed);
+    installHooks();
+  }
+
+private:
+
+  std::atomic<std::uint64_t> nodeIdCopies;
+  Account otherAccount;
+  std::atomic<std::uint64_t> variantCopies;
+
+  AllocationStatistics();
+
+  // We do not want to allow copy or move construction or assignment.
+  AllocationStatistics(const AllocationStatistics &) = delete;
+  AllocationStatistics(AllocationStatistics &&) = delete;
+  AllocationStatistics &operator=(const AllocationStatistics &) = delete;
+  AllocationStatistics &operator=(AllocationStatistics &&) = delete;
+
+  friend struct AllocationHooks;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_ALLOCATION_STATISTICS_H
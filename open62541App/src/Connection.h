@@ -0,0 +1,357 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_CONNECTION_H
+#define OPEN62541_EPICS_CONNECTION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AllocationStatistics.h"
+#include "ConnectionStatistics.h"
+#include "NodeStatistics.h"
+#include "StartupProfiler.h"
+#include "UaNodeId.h"
+#include "UaVariant.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Interface of a connection, as used by the device support for records. The
+ * device support only uses the methods defined by this interface, so that
+ * records can be used with a connection that is not backed by an OPC UA
+ * client (e.g. for benchmarking the device support in isolation). The
+ * ServerConnection class provides the implementation that is backed by an
+ * actual connection to an OPC UA server.
+ *
+ * Implementations must be safe for concurrent use by multiple threads.
+ */
+class Connection {
+
+public:
+
+  /**
+   * Interface for a read callback. Read callbacks allow reading from a node in
+   * an asynchronous way, so that the calling code does not have to wait until
+   * the operation finishes.
+   */
+  class ReadCallback {
+
+  public:
+
+    /**
+     * Called when the operation succeeds. The node ID passed is the node ID
+     * specified in the read request. The value passed is the value read from
+     * the server.
+     */
+    virtual void success(const UaNodeId &nodeId, const UaVariant &value) = 0;
+
+    /**
+     * Called when a read operation fails. The node ID passed is the node ID
+     * specified in the read request. The status code  gives information about
+     * the cause of the failure.
+     */
+    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
+
+    /**
+     * Default constructor.
+     */
+    ReadCallback() {
+    }
+
+    /**
+     * Destructor. Virtual classes should have a virtual destructor.
+     */
+    virtual ~ReadCallback() {
+    }
+
+    // We do not want to allow copy or move construction or assignment.
+    ReadCallback(const ReadCallback &) = delete;
+    ReadCallback(ReadCallback &&) = delete;
+    ReadCallback &operator=(const ReadCallback &) = delete;
+    ReadCallback &operator=(ReadCallback &&) = delete;
+
+  };
+
+  /**
+   * Interface for a monitored item callback. Monitored utem callbacks are
+   * called when a notification about a data change is received for a monitored
+   * item.
+   */
+  class MonitoredItemCallback {
+
+  public:
+
+    /**
+     * Called when a successful notification is received. The node ID passed is
+     * the node ID specified in the read request. The value passed is the value
+     * received from the server.
+     */
+    virtual void success(const UaNodeId &nodeId, const UaVariant &value) = 0;
+
+    /**
+     * Called when there is a problem with the subscription (e.g. the connection
+     * is interrupted or the subscription cannot be registered with the server).
+     */
+    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
+
+    /**
+     * Called when a notification signals that the queue of the monitored item
+     * on the server has overflowed, so that values have been lost. This is
+     * called before success or failure is called for the same notification.
+     * The default implementation does nothing.
+     */
+    virtual void overflow(const UaNodeId &nodeId) {
+    }
+
+    /**
+     * Default constructor.
+     */
+    MonitoredItemCallback() {
+    }
+
+    /**
+     * Destructor. Virtual classes should have a virtual destructor.
+     */
+    virtual ~MonitoredItemCallback() {
+    }
+
+    // We do not want to allow copy or move construction or assignment.
+    MonitoredItemCallback(const MonitoredItemCallback &) = delete;
+    MonitoredItemCallback(MonitoredItemCallback &&) = delete;
+    MonitoredItemCallback &operator=(const MonitoredItemCallback &) = delete;
+    MonitoredItemCallback &operator=(MonitoredItemCallback &&) = delete;
+
+  };
+
+  /**
+   * Interface for a write callback. Write callbacks allow writing to a node
+   * in an asynchronous way, so that the calling code does not have to wait
+   * until the operation finishes.
+   */
+  class WriteCallback {
+
+  public:
+
+    /**
+     * Called when the operation succeeds. The node ID passed is the node ID
+     * specified in the write request.
+     */
+    virtual void success(const UaNodeId &nodeId) = 0;
+
+    /**
+     * Called when a write operation fails. The node ID passed is the node ID
+     * specified in the read request. The status code  gives information about
+     * the cause of the failure.
+     */
+    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
+
+    /**
+     * Default constructor.
+     */
+    WriteCallback() {
+    }
+
+    /**
+     * Destructor. Virtual classes should have a virtual destructor.
+     */
+    virtual ~WriteCallback() {
+    }
+
+    // We do not want to allow copy or move construction or assignment.
+    WriteCallback(const WriteCallback &) = delete;
+    WriteCallback(WriteCallback &&) = delete;
+    WriteCallback &operator=(const WriteCallback &) = delete;
+    WriteCallback &operator=(WriteCallback &&) = delete;
+
+  };
+
+  /**
+   * Interface for a call callback. Call callbacks allow calling a method in an
+   * asynchronous way, so that the calling code does not have to wait until
+   * the operation finishes.
+   */
+  class CallCallback {
+
+  public:
+
+    /**
+     * Called when the operation succeeds. The node ID passed is the method ID
+     * specified in the call request. The output arguments are the ones
+     * returned by the server.
+     */
+    virtual void success(const UaNodeId &methodId,
+        const std::vector<UaVariant> &outputArguments) = 0;
+
+    /**
+     * Called when a call operation fails. The node ID passed is the method ID
+     * specified in the call request. The status code gives information about
+     * the cause of the failure.
+     */
+    virtual void failure(const UaNodeId &methodId,
+        UA_StatusCode statusCode) = 0;
+
+    /**
+     * Default constructor.
+     */
+    CallCallback() {
+    }
+
+    /**
+     * Destructor. Virtual classes should have a virtual destructor.
+     */
+    virtual ~CallCallback() {
+    }
+
+    // We do not want to allow copy or move construction or assignment.
+    CallCallback(const CallCallback &) = delete;
+    CallCallback(CallCallback &&) = delete;
+    CallCallback &operator=(const CallCallback &) = delete;
+    CallCallback &operator=(CallCallback &&) = delete;
+
+  };
+
+  /**
+   * Destructor. Virtual classes should have a virtual destructor.
+   */
+  virtual ~Connection() {
+  }
+
+  /**
+   * Registers a monitored item for the specified node. The specified callback
+   * is called for each notification that is received for the node. See
+   * ServerConnection::addMonitoredItem for a description of the parameters.
+   */
+  virtual void addMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback,
+      double samplingInterval, std::uint32_t queueSize,
+      bool discardOldest) = 0;
+
+  /**
+   * Calls a method of an object asynchronously. When the operation completes,
+   * the passed callback is called. Implementations may call the callback
+   * before this method returns. Implementations that talk to a server may
+   * send calls that are queued at the same time in a single request.
+   */
+  virtual void callAsync(const UaNodeId &objectId, const UaNodeId &methodId,
+      const std::vector<UaVariant> &inputArguments,
+      std::shared_ptr<CallCallback> callback) = 0;
+
+  /**
+   * Returns the URL of the endpoint to which this connection is made.
+   */
+  virtual const std::string &getEndpointUrl() const = 0;
+
+  /**
+   * Returns the table of per-node counters for this connection.
+   */
+  virtual NodeStatistics &getNodeStatistics() = 0;
+
+  /**
+   * Returns the account for the allocations made while processing records that
+   * use this connection.
+   */
+  virtual AllocationStatistics::Account &getRecordAllocations() = 0;
+
+  /**
+   * Returns the startup statistics for this connection.
+   */
+  virtual StartupStatistics &getStartupStatistics() = 0;
+
+  /**
+   * Returns the statistics for this connection.
+   */
+  virtual ConnectionStatistics &getStatistics() = 0;
+
+  /**
+   * Returns the publishing interval (in milliseconds) for the specified
+   * subscription.
+   */
+  virtual double getSubscriptionPublishingInterval(
+      const std::string &name) = 0;
+
+  /**
+   * Returns the statistics for the specified subscription. If there are no
+   * statistics for the subscription yet, they are created.
+   */
+  virtual std::shared_ptr<SubscriptionStatistics> getSubscriptionStatistics(
+      const std::string &name) = 0;
+
+  /**
+   * Reads a node's value. Throws an UaException if there is a problem. This
+   * method may block, so it must not be called from one of the callbacks.
+   */
+  virtual UaVariant read(const UaNodeId &nodeId) = 0;
+
+  /**
+   * Reads a node's value asynchronously. When the operation completes, the
+   * passed callback is called. Implementations may call the callback before
+   * this method returns.
+   */
+  virtual void readAsync(const UaNodeId &nodeId,
+      std::shared_ptr<ReadCallback> callback) = 0;
+
+  /**
+   * Unregisters a monitored item. If the specified callback has not been
+   * previously registered for the specified subscription and node ID, this
+   * method does nothing.
+   */
+  virtual void removeMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback) = 0;
+
+  /**
+   * Writes a node's value asynchronously. When the operation completes, the
+   * passed callback is called. Implementations may call the callback before
+   * this method returns.
+   */
+  virtual void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+      std::shared_ptr<WriteCallback> callback) = 0;
+
+protected:
+
+  /**
+   * Default constructor.
+   */
+  Connection() {
+  }
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  Connection(const Connection &) = delete;
+  Connection(Connection &&) = delete;
+  Connection &operator=(const Connection &) = delete;
+  Connection &operator=(Connection &&) = delete;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_CONNECTION_H
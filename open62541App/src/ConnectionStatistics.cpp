@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#include <cstring>
+
+#include "ConnectionStatistics.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// The order of the names must match the order of the elements in the Counter
+// enum.
+const char *const counterNames[] = {
+  "call_failures",
+  "callback_exceptions",
+  "calls",
+  "connect_failures",
+  "deferred_requests",
+  "notification_failures",
+  "notifications",
+  "overflows",
+  "read_failures",
+  "reads",
+  "reconnects",
+  "service_calls",
+  "write_failures",
+  "writes"
+};
+
+static_assert(
+  sizeof(counterNames) / sizeof(counterNames[0])
+  == static_cast<std::size_t>(
+    ConnectionStatistics::Counter::numberOfCounters),
+  "The number of counter names does not match the number of counters.");
+
+// The order of the names must match the order of the elements in the Latency
+// enum.
+const char *const latencyNames[] = {
+  "queue",
+  "service",
+  "completion",
+  "total",
+  "probe"
+};
+
+static_assert(
+  sizeof(latencyNames) / sizeof(latencyNames[0])
+  == static_cast<std::size_t>(
+    ConnectionStatistics::Latency::numberOfLatencies),
+  "The number of latency names does not match the number of latencies.");
+
+} // anonymous namespace
+
+ConnectionStatistics::ConnectionStatistics() : clockOffsetNanoseconds(0),
+    clockOffsetUncertaintyNanoseconds(0), clockOffsetValid(false),
+    connected(false),
+    lastRoundTripTimeNanoseconds(0), queueDepth(0),
+    totalRoundTripTimeNanoseconds(0) {
+  for (auto &counter : counters) {
+    counter.store(0, std::memory_order_relaxed);
+  }
+}
+
+const char *ConnectionStatistics::getCounterName(Counter counter) {
+  return counterNames[static_cast<std::size_t>(counter)];
+}
+
+bool ConnectionStatistics::findCounter(const std::string &name,
+    Counter &counter) {
+  for (std::size_t i = 0;
+      i < static_cast<std::size_t>(Counter::numberOfCounters); ++i) {
+    if (name == counterNames[i]) {
+      counter = static_cast<Counter>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+double ConnectionStatistics::getAverageRoundTripTime() const {
+  auto serviceCalls = get(Counter::serviceCalls);
+  if (!serviceCalls) {
+    return 0.0;
+  }
+  return totalRoundTripTimeNanoseconds.load(std::memory_order_relaxed) * 1e-9
+    / serviceCalls;
+}
+
+const char *ConnectionStatistics::getLatencyName(Latency latency) {
+  return latencyNames[static_cast<std::size_t>(latency)];
+}
+
+void ConnectionStatistics::resetLatencyHistograms() {
+  for (auto &histogram : latencies) {
+    histogram.reset();
+  }
+}
+
+}
+}
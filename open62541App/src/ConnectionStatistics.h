@@ -0,0 +1,340 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_CONNECTION_STATISTICS_H
+#define OPEN62541_EPICS_CONNECTION_STATISTICS_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LatencyHistogram.h"
+#include "UaNodeId.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Statistics for a single subscription. The counters are updated by the
+ * connection thread and may be read by any thread.
+ */
+struct SubscriptionStatistics {
+
+  /**
+   * Number of notifications that signaled an error.
+   */
+  std::atomic<std::uint64_t> notificationFailures;
+
+  /**
+   * Number of notifications that carried a value.
+   */
+  std::atomic<std::uint64_t> notifications;
+
+  /**
+   * Time between the source timestamp of a notification and its reception by
+   * the client. This is only meaningful if the clocks of the server and the
+   * IOC are synchronized.
+   */
+  LatencyHistogram notificationDeliveryLatency;
+
+  /**
+   * Time between the reception of a notification and the processing of the
+   * record that uses its value.
+   */
+  LatencyHistogram notificationProcessingLatency;
+
+  /**
+   * Number of notifications that signaled that the queue of the monitored
+   * item on the server overflowed, so that values have been lost.
+   */
+  std::atomic<std::uint64_t> overflows;
+
+  inline SubscriptionStatistics() : notificationFailures(0), notifications(0),
+      overflows(0) {
+  }
+
+  /**
+   * Returns the number of overflows for each node that had at least one
+   * overflow.
+   */
+  inline std::vector<std::pair<UaNodeId, std::uint64_t>>
+      getNodeOverflows() const {
+    std::lock_guard<std::mutex> lock(nodeOverflowsMutex);
+    return std::vector<std::pair<UaNodeId, std::uint64_t>>(
+      nodeOverflows.begin(), nodeOverflows.end());
+  }
+
+  /**
+   * Records an overflow of the queue of the monitored item for the specified
+   * node.
+   */
+  inline void recordOverflow(const UaNodeId &nodeId) {
+    overflows.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(nodeOverflowsMutex);
+    ++nodeOverflows[nodeId];
+  }
+
+  /**
+   * Removes all values from the latency histograms.
+   */
+  inline void resetLatencyHistograms() {
+    notificationDeliveryLatency.reset();
+    notificationProcessingLatency.reset();
+  }
+
+private:
+
+  // Overflows are rare compared to regular notifications, so protecting the
+  // per-node counts with a mutex is not a performance problem.
+  std::map<UaNodeId, std::uint64_t> nodeOverflows;
+  mutable std::mutex nodeOverflowsMutex;
+
+};
+
+/**
+ * Statistics for a server connection. The counters are updated by the
+ * connection thread (and by the threads queuing requests) using relaxed atomic
+ * operations, so that updating them does not add any noticeable overhead. They
+ * may be read by any thread.
+ */
+class ConnectionStatistics {
+
+public:
+
+  /**
+   * Counters that only ever increase.
+   */
+  enum class Counter {
+    callFailures,
+    callbackExceptions,
+    calls,
+    connectFailures,
+    deferredRequests,
+    notificationFailures,
+    notifications,
+    overflows,
+    readFailures,
+    reads,
+    reconnects,
+    serviceCalls,
+    writeFailures,
+    writes,
+    // This must always be the last element.
+    numberOfCounters
+  };
+
+  /**
+   * Stages of a read or write request for which latency histograms are kept.
+   */
+  enum class Latency {
+    // Time from handing a request to the connection until it is sent.
+    queue,
+    // Time from sending a request until the response has been received.
+    service,
+    // Time from receiving the response until the record has been processed.
+    completion,
+    // Time from starting to process the record until it has been processed
+    // again with the result.
+    total,
+    // Round-trip time of the periodic probe of the server's clock.
+    probe,
+    // This must always be the last element.
+    numberOfLatencies
+  };
+
+  /**
+   * Creates statistics with all counters set to zero.
+   */
+  ConnectionStatistics();
+
+  /**
+   * Returns the name of a counter as used in reports and record addresses.
+   */
+  static const char *getCounterName(Counter counter);
+
+  /**
+   * Looks up a counter by its name. Returns true and sets the counter if a
+   * counter with the name exists. Otherwise, returns false.
+   */
+  static bool findCounter(const std::string &name, Counter &counter);
+
+  /**
+   * Returns the current value of a counter.
+   */
+  inline std::uint64_t get(Counter counter) const {
+    return counters[static_cast<std::size_t>(counter)].load(
+      std::memory_order_relaxed);
+  }
+
+  /**
+   * Retrieves the estimated offset (in seconds) of the server's clock relative
+   * to the local clock and the uncertainty of this estimate. A positive offset
+   * means that the server's clock is ahead. Returns false if no estimate is
+   * available yet.
+   */
+  inline bool getClockOffset(double &offset, double &uncertainty) const {
+    if (!clockOffsetValid.load(std::memory_order_acquire)) {
+      return false;
+    }
+    offset = clockOffsetNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    uncertainty =
+      clockOffsetUncertaintyNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+    return true;
+  }
+
+  /**
+   * Returns the name of a latency histogram as used in reports.
+   */
+  static const char *getLatencyName(Latency latency);
+
+  /**
+   * Returns the histogram for the specified stage of requests.
+   */
+  inline LatencyHistogram &getLatencyHistogram(Latency latency) {
+    return latencies[static_cast<std::size_t>(latency)];
+  }
+
+  /**
+   * Returns the average round-trip time (in seconds) of all service calls.
+   * Returns zero if no service call has been made yet.
+   */
+  double getAverageRoundTripTime() const;
+
+  /**
+   * Returns the round-trip time (in seconds) of the last service call.
+   */
+  inline double getLastRoundTripTime() const {
+    return lastRoundTripTimeNanoseconds.load(std::memory_order_relaxed) * 1e-9;
+  }
+
+  /**
+   * Returns the number of requests that are currently queued.
+   */
+  inline std::size_t getQueueDepth() const {
+    return queueDepth.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Increments a counter by one.
+   */
+  inline void increment(Counter counter) {
+    counters[static_cast<std::size_t>(counter)].fetch_add(
+      1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Tells whether the client is currently connected to the server.
+   */
+  inline bool isConnected() const {
+    return connected.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Records a value (in nanoseconds) in the histogram for the specified stage.
+   */
+  inline void recordLatency(Latency latency, std::uint64_t nanoseconds) {
+    latencies[static_cast<std::size_t>(latency)].record(nanoseconds);
+  }
+
+  /**
+   * Records the round-trip time of a service call. This also increments the
+   * serviceCalls counter and adds the time to the service latency histogram.
+   */
+  inline void recordServiceCall(std::uint64_t roundTripTimeNanoseconds) {
+    increment(Counter::serviceCalls);
+    recordLatency(Latency::service, roundTripTimeNanoseconds);
+    lastRoundTripTimeNanoseconds.store(
+      roundTripTimeNanoseconds, std::memory_order_relaxed);
+    totalRoundTripTimeNanoseconds.fetch_add(
+      roundTripTimeNanoseconds, std::memory_order_relaxed);
+  }
+
+  /**
+   * Removes all values from the latency histograms.
+   */
+  void resetLatencyHistograms();
+
+  /**
+   * Updates the estimated offset of the server's clock. Both values are in
+   * nanoseconds.
+   */
+  inline void setClockOffset(std::int64_t offset, std::uint64_t uncertainty) {
+    clockOffsetNanoseconds.store(offset, std::memory_order_relaxed);
+    clockOffsetUncertaintyNanoseconds.store(
+      uncertainty, std::memory_order_relaxed);
+    clockOffsetValid.store(true, std::memory_order_release);
+  }
+
+  /**
+   * Sets the flag indicating whether the client is connected.
+   */
+  inline void setConnected(bool connected) {
+    this->connected.store(connected, std::memory_order_relaxed);
+  }
+
+  /**
+   * Changes the number of queued requests by the specified (positive or
+   * negative) amount.
+   */
+  inline void updateQueueDepth(std::ptrdiff_t delta) {
+    queueDepth.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  ConnectionStatistics(const ConnectionStatistics &) = delete;
+  ConnectionStatistics(ConnectionStatistics &&) = delete;
+  ConnectionStatistics &operator=(const ConnectionStatistics &) = delete;
+  ConnectionStatistics &operator=(ConnectionStatistics &&) = delete;
+
+  std::atomic<std::int64_t> clockOffsetNanoseconds;
+  std::atomic<std::uint64_t> clockOffsetUncertaintyNanoseconds;
+  std::atomic<bool> clockOffsetValid;
+  std::atomic<bool> connected;
+  std::atomic<std::uint64_t> counters[
+    static_cast<std::size_t>(Counter::numberOfCounters)];
+  std::atomic<std::uint64_t> lastRoundTripTimeNanoseconds;
+  LatencyHistogram latencies[
+    static_cast<std::size_t>(Latency::numberOfLatencies)];
+  std::atomic<std::size_t> queueDepth;
+  std::atomic<std::uint64_t> totalRoundTripTimeNanoseconds;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_CONNECTION_STATISTICS_H
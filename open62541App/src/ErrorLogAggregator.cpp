@@ -0,0 +1,254 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <thread>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+
+#include "open62541Error.h"
+
+#include "ErrorLogAggregator.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// Max. number of record names that are remembered for each message, so that
+// they can be included in the summary.
+constexpr std::size_t maxSamples = 3;
+
+std::int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    time.time_since_epoch()).count();
+}
+
+} // anonymous namespace
+
+void ErrorLogAggregator::flush() noexcept {
+  auto now = std::chrono::steady_clock::now();
+  if (toNanoseconds(now)
+      < nextFlushNanoseconds.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // We assemble the lines while holding the mutex, but print them after
+  // releasing it, so that threads logging errors are not blocked while we
+  // write to stderr.
+  std::vector<std::string> lines;
+  try {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Another thread might have flushed while we were waiting for the mutex.
+    if (summaryInterval <= 0.0 || now - lastFlush
+        < std::chrono::duration<double>(summaryInterval)) {
+      return;
+    }
+    double elapsedSeconds =
+      std::chrono::duration<double>(now - lastFlush).count();
+    lastFlush = now;
+    nextFlushNanoseconds.store(
+      toNanoseconds(now) + static_cast<std::int64_t>(summaryInterval * 1e9),
+      std::memory_order_relaxed);
+    for (auto connectionIterator = connections.begin();
+        connectionIterator != connections.end();) {
+      auto &connection = connectionIterator->first;
+      auto &connectionState = connectionIterator->second;
+      connectionState.printedLines = 0;
+      for (auto messageIterator = connectionState.messages.begin();
+          messageIterator != connectionState.messages.end();) {
+        auto &messageKey = messageIterator->first;
+        auto &messageState = messageIterator->second;
+        // Messages that did not occur during the last interval are forgotten,
+        // so that the next occurrence is printed right away again.
+        if (!messageState.count) {
+          messageIterator = connectionState.messages.erase(messageIterator);
+          continue;
+        }
+        if (connectionState.printedLines < maxMessagesPerInterval) {
+          char buffer[256];
+          std::snprintf(buffer, sizeof(buffer),
+            " occurred %" PRIu64 " %s in the last %.0f seconds",
+            messageState.count, messageState.reported ? "more times" : "times",
+            elapsedSeconds);
+          std::string line = connection + " " + messageKey.message + ": "
+            + UA_StatusCode_name(messageKey.statusCode) + buffer;
+          if (!messageState.samples.empty()) {
+            line += " (e.g. ";
+            for (std::size_t i = 0; i < messageState.samples.size(); ++i) {
+              if (i) {
+                line += ", ";
+              }
+              line += messageState.samples[i];
+            }
+            line += ")";
+          }
+          lines.push_back(std::move(line));
+          ++connectionState.printedLines;
+          messageState.reported = true;
+        } else {
+          ++connectionState.suppressedLines;
+        }
+        messageState.count = 0;
+        messageState.samples.clear();
+        ++messageIterator;
+      }
+      if (connectionState.suppressedLines) {
+        lines.push_back(connection + " "
+          + std::to_string(connectionState.suppressedLines)
+          + " error messages have been suppressed because the limit of messages per interval has been reached.");
+        connectionState.suppressedLines = 0;
+      }
+      if (connectionState.messages.empty()) {
+        connectionIterator = connections.erase(connectionIterator);
+      } else {
+        ++connectionIterator;
+      }
+    }
+  } catch (...) {
+    // If we cannot allocate memory, we print what we have got so far.
+  }
+  for (auto const &line : lines) {
+    errorExtendedPrintf("%s", line.c_str());
+  }
+}
+
+std::uint32_t ErrorLogAggregator::getMaxMessagesPerInterval() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return maxMessagesPerInterval;
+}
+
+double ErrorLogAggregator::getSummaryInterval() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return summaryInterval;
+}
+
+void ErrorLogAggregator::logError(const std::string &connection,
+    const char *subject, const char *message, UA_StatusCode statusCode)
+    noexcept {
+  if (!subject) {
+    subject = connection.c_str();
+  }
+  bool print = true;
+  try {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (summaryInterval > 0.0) {
+      auto &connectionState = connections[connection];
+      auto result = connectionState.messages.emplace(
+        MessageKey{message, statusCode}, MessageState());
+      auto &messageState = result.first->second;
+      if (result.second
+          && connectionState.printedLines < maxMessagesPerInterval) {
+        // This is the first occurrence of this message, so we print it right
+        // away.
+        ++connectionState.printedLines;
+        messageState.reported = true;
+      } else {
+        print = false;
+        ++messageState.count;
+        // The summary has to be printed even if no further errors are logged,
+        // so we need a thread that flushes when the interval has passed.
+        if (!flushThreadStarted) {
+          std::thread(&ErrorLogAggregator::runFlushThread, this).detach();
+          flushThreadStarted = true;
+        }
+        if (messageState.samples.size() < maxSamples
+            && subject != connection.c_str()
+            && std::find(messageState.samples.begin(),
+              messageState.samples.end(), subject)
+              == messageState.samples.end()) {
+          messageState.samples.push_back(subject);
+        }
+      }
+    }
+  } catch (...) {
+    // If we cannot update the aggregation state (e.g. because we are out of
+    // memory), we rather print the message than losing it.
+  }
+  if (print) {
+    errorExtendedPrintf("%s %s: %s", subject, message,
+      UA_StatusCode_name(statusCode));
+  }
+}
+
+void ErrorLogAggregator::setOptions(double summaryInterval,
+    std::uint32_t maxMessagesPerInterval) {
+  if (!(summaryInterval >= 0.0)) {
+    throw std::invalid_argument(
+      "The summary interval must not be negative.");
+  }
+  if (!maxMessagesPerInterval) {
+    throw std::invalid_argument(
+      "The max. number of messages per interval must be positive.");
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->summaryInterval = summaryInterval;
+    this->maxMessagesPerInterval = maxMessagesPerInterval;
+    nextFlushNanoseconds.store(
+      toNanoseconds(lastFlush)
+      + static_cast<std::int64_t>(summaryInterval * 1e9),
+      std::memory_order_relaxed);
+  }
+  // The flush thread has to recalculate the time when it should wake up.
+  flushThreadCv.notify_all();
+}
+
+ErrorLogAggregator::ErrorLogAggregator() :
+    flushThreadStarted(false), lastFlush(std::chrono::steady_clock::now()),
+    maxMessagesPerInterval(20), summaryInterval(10.0) {
+  nextFlushNanoseconds.store(
+    toNanoseconds(lastFlush) + static_cast<std::int64_t>(summaryInterval * 1e9),
+    std::memory_order_relaxed);
+}
+
+void ErrorLogAggregator::runFlushThread() {
+  std::unique_lock<std::mutex> lock(mutex);
+  // The instance is never destroyed, so this thread simply runs until the
+  // process exits.
+  while (true) {
+    if (summaryInterval <= 0.0) {
+      // Aggregation is disabled, so there is nothing to flush until the
+      // options are changed.
+      flushThreadCv.wait(lock);
+    } else {
+      flushThreadCv.wait_until(lock, std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::nanoseconds(
+            nextFlushNanoseconds.load(std::memory_order_relaxed)))));
+    }
+    lock.unlock();
+    flush();
+    lock.lock();
+  }
+}
+
+}
+}
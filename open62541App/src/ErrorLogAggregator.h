@@ -0,0 +1,188 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_ERROR_LOG_AGGREGATOR_H
+#define OPEN62541_EPICS_ERROR_LOG_AGGREGATOR_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include "open62541.h"
+}
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Aggregates error messages that are caused by failing operations, so that an
+ * outage does not result in one message per record and operation.
+ *
+ * Messages are identified by the connection, the status code, and the
+ * message. The first occurrence of a message is printed right away. Further
+ * occurrences are only counted and printed as a single summary (including the
+ * number of occurrences and the names of some of the affected records) when
+ * the summary interval has passed. In addition to that, the number of lines
+ * printed for each connection within one summary interval is limited.
+ *
+ * Summaries are printed by {@link #flush()}, which is called by a background
+ * thread. This thread is only started when the first message is aggregated,
+ * so it does not exist as long as no errors occur.
+ *
+ * This class implements the singleton pattern and the only instance is
+ * returned by the {@link #getInstance()} function.
+ */
+class ErrorLogAggregator {
+
+public:
+
+  /**
+   * Returns the only instance of this class.
+   */
+  inline static ErrorLogAggregator &getInstance() {
+    // The instance is intentionally never destroyed, because connection
+    // threads and the flush thread may still log errors while static objects
+    // are destroyed at exit.
+    static ErrorLogAggregator *instance = new ErrorLogAggregator();
+    return *instance;
+  }
+
+  /**
+   * Prints the summaries for all messages that occurred more than once since
+   * the last summary, if the summary interval has passed. This method returns
+   * quickly if the summary interval has not passed yet, so it can be called
+   * frequently.
+   */
+  void flush() noexcept;
+
+  /**
+   * Returns the max. number of lines that are printed for each connection
+   * within one summary interval.
+   */
+  std::uint32_t getMaxMessagesPerInterval();
+
+  /**
+   * Returns the summary interval (in seconds). Zero means that aggregation is
+   * disabled and all messages are printed right away.
+   */
+  double getSummaryInterval();
+
+  /**
+   * Logs an error. The connection is typically identified by the endpoint URL.
+   * The subject is the name of the affected record or null if the error is
+   * not specific to a record. The message must be a string literal (the
+   * pointer is used for identifying the message).
+   *
+   * The printed line has the form "<subject> <message>: <status code name>".
+   */
+  void logError(const std::string &connection, const char *subject,
+      const char *message, UA_StatusCode statusCode) noexcept;
+
+  /**
+   * Sets the summary interval (in seconds) and the max. number of lines that
+   * may be printed for each connection within one summary interval. A summary
+   * interval of zero disables aggregation. Throws an std::invalid_argument if
+   * the summary interval is negative or the max. number of messages is zero.
+   */
+  void setOptions(double summaryInterval,
+      std::uint32_t maxMessagesPerInterval);
+
+private:
+
+  struct MessageKey {
+
+    const char *message;
+    UA_StatusCode statusCode;
+
+    inline bool operator==(const MessageKey &other) const {
+      return message == other.message && statusCode == other.statusCode;
+    }
+
+  };
+
+  struct MessageKeyHash {
+
+    inline std::size_t operator()(const MessageKey &key) const {
+      return std::hash<const void *>()(key.message) ^ key.statusCode;
+    }
+
+  };
+
+  struct MessageState {
+
+    std::uint64_t count = 0;
+    bool reported = false;
+    std::vector<std::string> samples;
+
+  };
+
+  struct ConnectionState {
+
+    std::unordered_map<MessageKey, MessageState, MessageKeyHash> messages;
+    std::uint32_t printedLines = 0;
+    std::uint64_t suppressedLines = 0;
+
+  };
+
+  // We do not want to allow copy or move construction or assignment.
+  ErrorLogAggregator(const ErrorLogAggregator &) = delete;
+  ErrorLogAggregator(ErrorLogAggregator &&) = delete;
+  ErrorLogAggregator &operator=(const ErrorLogAggregator &) = delete;
+  ErrorLogAggregator &operator=(ErrorLogAggregator &&) = delete;
+
+  std::unordered_map<std::string, ConnectionState> connections;
+  std::condition_variable flushThreadCv;
+  bool flushThreadStarted;
+  std::chrono::steady_clock::time_point lastFlush;
+  std::uint32_t maxMessagesPerInterval;
+  std::mutex mutex;
+  // The time of the next flush is kept in an atomic variable, so that flush()
+  // does not have to acquire the mutex when there is nothing to do.
+  std::atomic<std::int64_t> nextFlushNanoseconds;
+  double summaryInterval;
+
+  ErrorLogAggregator();
+
+  void runFlushThread();
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_ERROR_LOG_AGGREGATOR_H
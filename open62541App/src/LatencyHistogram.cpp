@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cmath>
+
+#include "LatencyHistogram.h"
+
+namespace open62541 {
+namespace epics {
+
+constexpr unsigned LatencyHistogram::subBucketBits;
+constexpr std::size_t LatencyHistogram::subBucketCount;
+constexpr std::size_t LatencyHistogram::numberOfBuckets;
+
+LatencyHistogram::LatencyHistogram() : count(0), max(0), sum(0) {
+  for (auto &bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+std::uint64_t LatencyHistogram::getPercentile(double fraction) const {
+  // We count the buckets instead of using the count field, so that the result
+  // is consistent even if values are recorded concurrently.
+  std::uint64_t total = 0;
+  for (auto &bucket : buckets) {
+    total += bucket.load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0;
+  }
+  if (fraction < 0.0) {
+    fraction = 0.0;
+  } else if (fraction > 1.0) {
+    fraction = 1.0;
+  }
+  auto rank = static_cast<std::uint64_t>(std::ceil(fraction * total));
+  if (rank == 0) {
+    rank = 1;
+  }
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < numberOfBuckets; ++i) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      // The upper bound of the last bucket might be greater than the greatest
+      // value that has actually been recorded.
+      auto upperBound = bucketUpperBound(i);
+      auto maxValue = max.load(std::memory_order_relaxed);
+      return (maxValue != 0 && maxValue < upperBound) ? maxValue : upperBound;
+    }
+  }
+  return bucketUpperBound(numberOfBuckets - 1);
+}
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const {
+  Summary summary;
+  summary.count = count.load(std::memory_order_relaxed);
+  summary.max = max.load(std::memory_order_relaxed) * 1e-9;
+  summary.mean = summary.count ?
+    sum.load(std::memory_order_relaxed) * 1e-9 / summary.count : 0.0;
+  summary.p50 = getPercentile(0.5) * 1e-9;
+  summary.p90 = getPercentile(0.9) * 1e-9;
+  summary.p99 = getPercentile(0.99) * 1e-9;
+  summary.p999 = getPercentile(0.999) * 1e-9;
+  return summary;
+}
+
+void LatencyHistogram::reset() {
+  for (auto &bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  count.store(0, std::memory_order_relaxed);
+  max.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(std::size_t index) {
+  if (index < subBucketCount) {
+    return index;
+  }
+  unsigned shift = static_cast<unsigned>(index / subBucketCount) - 1;
+  std::uint64_t subBucket = subBucketCount + index % subBucketCount;
+  // The upper bound of the bucket is the greatest value that is mapped to it.
+  std::uint64_t lowerBound = subBucket << shift;
+  std::uint64_t width = std::uint64_t(1) << shift;
+  return lowerBound + (width - 1);
+}
+
+}
+}
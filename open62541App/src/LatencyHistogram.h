@@ -0,0 +1,162 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_LATENCY_HISTOGRAM_H
+#define OPEN62541_EPICS_LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Histogram of latencies (in nanoseconds) with a constant relative precision.
+ *
+ * Like an HDR histogram, the range of values is split into powers of two, and
+ * each power of two is split into a fixed number of linear sub-buckets. This
+ * way, the relative error of a reported percentile is less than 1 / 16 for all
+ * values, while the whole range of a 64-bit value fits into less than one
+ * thousand buckets.
+ *
+ * Recording a value only needs a few relaxed atomic operations, so this class
+ * can be used from hot paths and from several threads at the same time.
+ * Reading the histogram while values are being recorded is safe, but the
+ * result might not reflect a single point in time.
+ */
+class LatencyHistogram {
+
+public:
+
+  /**
+   * Summary of the histogram's contents. All latencies are in seconds.
+   */
+  struct Summary {
+    std::uint64_t count;
+    double max;
+    double mean;
+    double p50;
+    double p90;
+    double p99;
+    double p999;
+  };
+
+  /**
+   * Creates an empty histogram.
+   */
+  LatencyHistogram();
+
+  /**
+   * Returns the number of recorded values.
+   */
+  inline std::uint64_t getCount() const {
+    return count.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the value (in nanoseconds) below which the specified fraction
+   * (between 0 and 1) of the recorded values lies. The returned value is the
+   * upper bound of the bucket containing the percentile, so it is never less
+   * than the exact percentile. Returns zero if no values have been recorded.
+   */
+  std::uint64_t getPercentile(double fraction) const;
+
+  /**
+   * Returns a summary of this histogram's contents.
+   */
+  Summary getSummary() const;
+
+  /**
+   * Records a single value (in nanoseconds).
+   */
+  inline void record(std::uint64_t nanoseconds) {
+    buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    auto currentMax = max.load(std::memory_order_relaxed);
+    while (nanoseconds > currentMax && !max.compare_exchange_weak(
+        currentMax, nanoseconds, std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * Removes all recorded values. Values that are recorded concurrently might
+   * or might not be removed.
+   */
+  void reset();
+
+private:
+
+  // Each power of two is split into 2^subBucketBits sub-buckets.
+  static constexpr unsigned subBucketBits = 4;
+  static constexpr std::size_t subBucketCount = 1u << subBucketBits;
+  // Values below subBucketCount have one bucket each. Each of the remaining
+  // powers of two (subBucketBits to 63) gets subBucketCount buckets.
+  static constexpr std::size_t numberOfBuckets =
+    subBucketCount * (64 - subBucketBits + 1);
+
+  // We do not want to allow copy or move construction or assignment.
+  LatencyHistogram(const LatencyHistogram &) = delete;
+  LatencyHistogram(LatencyHistogram &&) = delete;
+  LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+  LatencyHistogram &operator=(LatencyHistogram &&) = delete;
+
+  std::atomic<std::uint64_t> buckets[numberOfBuckets];
+  std::atomic<std::uint64_t> count;
+  std::atomic<std::uint64_t> max;
+  std::atomic<std::uint64_t> sum;
+
+  static std::uint64_t bucketUpperBound(std::size_t index);
+
+  static inline std::size_t bucketIndex(std::uint64_t value) {
+    if (value < subBucketCount) {
+      return static_cast<std::size_t>(value);
+    }
+    unsigned exponent = 63 - countLeadingZeros(value);
+    unsigned shift = exponent - subBucketBits;
+    return static_cast<std::size_t>(
+      (shift + 1) * subBucketCount
+      + ((value >> shift) & (subBucketCount - 1)));
+  }
+
+  static inline unsigned countLeadingZeros(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_clzll(value));
+#else
+    unsigned zeros = 0;
+    for (std::uint64_t mask = std::uint64_t(1) << 63; !(value & mask);
+        mask >>= 1) {
+      ++zeros;
+    }
+    return zeros;
+#endif
+  }
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_LATENCY_HISTOGRAM_H
@@ -0,0 +1,546 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "UaException.h"
+
+#include "LoopbackServer.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+const std::string loopbackUrlPrefix = "loopback://";
+
+constexpr double pi = 3.14159265358979323846;
+
+struct Registry {
+  std::mutex mutex;
+  std::map<std::string, std::shared_ptr<LoopbackServer>> servers;
+};
+
+Registry &getRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+const UA_DataType *getUaDataType(Open62541RecordAddress::DataType dataType) {
+  using DataType = Open62541RecordAddress::DataType;
+  switch (dataType) {
+  case DataType::boolean:
+    return &UA_TYPES[UA_TYPES_BOOLEAN];
+  case DataType::sbyte:
+    return &UA_TYPES[UA_TYPES_SBYTE];
+  case DataType::byte:
+    return &UA_TYPES[UA_TYPES_BYTE];
+  case DataType::int16:
+    return &UA_TYPES[UA_TYPES_INT16];
+  case DataType::uint16:
+    return &UA_TYPES[UA_TYPES_UINT16];
+  case DataType::int32:
+    return &UA_TYPES[UA_TYPES_INT32];
+  case DataType::uint32:
+    return &UA_TYPES[UA_TYPES_UINT32];
+  case DataType::int64:
+    return &UA_TYPES[UA_TYPES_INT64];
+  case DataType::uint64:
+    return &UA_TYPES[UA_TYPES_UINT64];
+  case DataType::floatType:
+    return &UA_TYPES[UA_TYPES_FLOAT];
+  case DataType::string:
+    return &UA_TYPES[UA_TYPES_STRING];
+  case DataType::byteString:
+    return &UA_TYPES[UA_TYPES_BYTESTRING];
+  default:
+    return &UA_TYPES[UA_TYPES_DOUBLE];
+  }
+}
+
+template<typename T>
+T toInteger(double value) {
+  if (std::isnan(value)) {
+    return 0;
+  }
+  // The maximum of the 64-bit types cannot be represented exactly as a
+  // double, so we compare with ">=" in order to avoid an overflow when
+  // converting.
+  if (value >= static_cast<double>(std::numeric_limits<T>::max())) {
+    return std::numeric_limits<T>::max();
+  }
+  if (value <= static_cast<double>(std::numeric_limits<T>::min())) {
+    return std::numeric_limits<T>::min();
+  }
+  return static_cast<T>(std::llround(value));
+}
+
+void setElement(void *data, std::size_t index,
+    Open62541RecordAddress::DataType dataType, double value) {
+  using DataType = Open62541RecordAddress::DataType;
+  switch (dataType) {
+  case DataType::boolean:
+    static_cast<UA_Boolean *>(data)[index] = value > 0.0;
+    break;
+  case DataType::sbyte:
+    static_cast<UA_SByte *>(data)[index] = toInteger<UA_SByte>(value);
+    break;
+  case DataType::byte:
+    static_cast<UA_Byte *>(data)[index] = toInteger<UA_Byte>(value);
+    break;
+  case DataType::int16:
+    static_cast<UA_Int16 *>(data)[index] = toInteger<UA_Int16>(value);
+    break;
+  case DataType::uint16:
+    static_cast<UA_UInt16 *>(data)[index] = toInteger<UA_UInt16>(value);
+    break;
+  case DataType::int32:
+    static_cast<UA_Int32 *>(data)[index] = toInteger<UA_Int32>(value);
+    break;
+  case DataType::uint32:
+    static_cast<UA_UInt32 *>(data)[index] = toInteger<UA_UInt32>(value);
+    break;
+  case DataType::int64:
+    static_cast<UA_Int64 *>(data)[index] = toInteger<UA_Int64>(value);
+    break;
+  case DataType::uint64:
+    static_cast<UA_UInt64 *>(data)[index] = toInteger<UA_UInt64>(value);
+    break;
+  case DataType::floatType:
+    static_cast<UA_Float *>(data)[index] = static_cast<UA_Float>(value);
+    break;
+  case DataType::string:
+  case DataType::byteString:
+    {
+      // UA_ByteString is just another name for UA_String, so we can handle
+      // both types in the same way.
+      char buffer[32];
+      std::snprintf(buffer, sizeof(buffer), "%g", value);
+      static_cast<UA_String *>(data)[index] = UA_String_fromChars(buffer);
+    }
+    break;
+  default:
+    static_cast<UA_Double *>(data)[index] = value;
+    break;
+  }
+}
+
+LoopbackServer::Waveform parseWaveform(const std::string &name) {
+  if (name == "constant") {
+    return LoopbackServer::Waveform::constant;
+  } else if (name == "noise") {
+    return LoopbackServer::Waveform::noise;
+  } else if (name == "ramp") {
+    return LoopbackServer::Waveform::ramp;
+  } else if (name == "sine") {
+    return LoopbackServer::Waveform::sine;
+  } else if (name == "square") {
+    return LoopbackServer::Waveform::square;
+  }
+  throw std::invalid_argument("Invalid waveform: " + name);
+}
+
+double parseDouble(const std::string &key, const std::string &value) {
+  char *end;
+  double result = std::strtod(value.c_str(), &end);
+  if (value.empty() || *end != '\0' || !std::isfinite(result)) {
+    throw std::invalid_argument(
+      "Invalid value for option \"" + key + "\": " + value);
+  }
+  return result;
+}
+
+} // anonymous namespace
+
+LoopbackServer::~LoopbackServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shutdownRequested = true;
+  }
+  serverCv.notify_all();
+  if (serverThread.joinable()) {
+    serverThread.join();
+  }
+  UA_Server_run_shutdown(server);
+  UA_Server_delete(server);
+}
+
+std::shared_ptr<LoopbackServer> LoopbackServer::create(
+    const std::string &name, const std::string &configFile,
+    double updateRate) {
+  auto &registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  if (registry.servers.count(name)) {
+    throw std::invalid_argument(
+      "Loopback server \"" + name + "\" already exists.");
+  }
+  // The constructor is private, so we cannot use std::make_shared.
+  std::shared_ptr<LoopbackServer> server(
+    new LoopbackServer(name, configFile, updateRate));
+  registry.servers.insert(std::make_pair(name, server));
+  return server;
+}
+
+void LoopbackServer::declareNode(const UaNodeId &nodeId,
+    Open62541RecordAddress::DataType dataType, std::size_t arraySize) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (nodes.count(nodeId)) {
+    return;
+  }
+  Node node;
+  node.arraySize = arraySize;
+  node.dataType = dataType;
+  node.nodeId = nodeId;
+  addNode(node);
+}
+
+std::shared_ptr<LoopbackServer> LoopbackServer::findByEndpointUrl(
+    const std::string &endpointUrl) {
+  auto &registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  for (auto &entry : registry.servers) {
+    if (entry.second->getEndpointUrl() == endpointUrl) {
+      return entry.second;
+    }
+  }
+  return std::shared_ptr<LoopbackServer>();
+}
+
+std::shared_ptr<LoopbackServer> LoopbackServer::getInstance(
+    const std::string &name) {
+  auto &registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto existing = registry.servers.find(name);
+  if (existing != registry.servers.end()) {
+    return existing->second;
+  }
+  std::shared_ptr<LoopbackServer> server(
+    new LoopbackServer(name, std::string(), 0.0));
+  registry.servers.insert(std::make_pair(name, server));
+  return server;
+}
+
+std::size_t LoopbackServer::getNodeCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nodes.size();
+}
+
+bool LoopbackServer::parseLoopbackUrl(const std::string &endpointUrl,
+    std::string &name) {
+  if (endpointUrl.compare(
+      0, loopbackUrlPrefix.size(), loopbackUrlPrefix) != 0) {
+    return false;
+  }
+  name = endpointUrl.substr(loopbackUrlPrefix.size());
+  return true;
+}
+
+LoopbackServer::LoopbackServer(const std::string &name,
+    const std::string &configFile, double updateRate) : name(name),
+    server(UA_Server_new()), shutdownRequested(false),
+    startTime(std::chrono::steady_clock::now()), updateCount(0),
+    updateRate(updateRate) {
+  if (!server) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  try {
+    UA_ServerConfig *config = UA_Server_getConfig(server);
+    // The informational messages of the server would clutter the IOC shell.
+    if (config->logger.clear) {
+      config->logger.clear(config->logger.context);
+    }
+    config->logger = UA_Log_Stdout_withLevel(UA_LOGLEVEL_WARNING);
+    // Port zero lets the operating system choose a free port, so that several
+    // IOCs using loopback servers can run on the same host.
+    auto status = UA_ServerConfig_setMinimal(config, 0, nullptr);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+    // The server only accepts connections from the same host.
+    UA_String_clear(&config->customHostname);
+    config->customHostname = UA_String_fromChars("127.0.0.1");
+    // An IOC might use a lot of nodes, and the default limits are too low for
+    // this.
+    config->maxSecureChannels = 1000;
+    config->maxSessions = 1000;
+    config->publishingIntervalLimits.min = 5.0;
+    config->samplingIntervalLimits.min = 5.0;
+    config->maxNotificationsPerPublish = 1000000;
+    if (!configFile.empty()) {
+      loadConfigFile(configFile);
+    }
+    status = UA_Server_run_startup(server);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+    if (config->networkLayersSize == 0) {
+      UA_Server_run_shutdown(server);
+      throw UaException(UA_STATUSCODE_BADINTERNALERROR);
+    }
+    const UA_String &discoveryUrl = config->networkLayers[0].discoveryUrl;
+    endpointUrl = std::string(
+      reinterpret_cast<const char *>(discoveryUrl.data), discoveryUrl.length);
+    if (updateRate > 0.0) {
+      status = UA_Server_addRepeatedCallback(
+        server, updateCallback, this, 1000.0 / updateRate, nullptr);
+      if (status != UA_STATUSCODE_GOOD) {
+        UA_Server_run_shutdown(server);
+        throw UaException(status);
+      }
+    }
+  } catch (...) {
+    UA_Server_delete(server);
+    throw;
+  }
+  serverThread = std::thread([this]() {
+    runServerThread();
+  });
+}
+
+void LoopbackServer::addNode(const Node &node) {
+  ensureNamespace(node.nodeId.get().namespaceIndex);
+  UA_String nodeIdString;
+  UA_String_init(&nodeIdString);
+  UA_NodeId_print(&node.nodeId.get(), &nodeIdString);
+  std::string nodeName(
+    reinterpret_cast<const char *>(nodeIdString.data), nodeIdString.length);
+  UA_String_clear(&nodeIdString);
+  double time = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  UaVariant initialValue = makeValue(node, time);
+  UA_VariableAttributes attributes = UA_VariableAttributes_default;
+  attributes.displayName = UA_LOCALIZEDTEXT(
+    const_cast<char *>("en-US"), const_cast<char *>(nodeName.c_str()));
+  attributes.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+  // The node accepts values of any type and dimension, so that writes do not
+  // fail when a record uses a different type than the one we guessed.
+  attributes.dataType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATATYPE);
+  attributes.valueRank = UA_VALUERANK_ANY;
+  // The attributes are copied by the server, so we can pass the value without
+  // copying it first.
+  attributes.value = initialValue.get();
+  auto status = UA_Server_addVariableNode(server, node.nodeId.get(),
+    UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+    UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+    UA_QUALIFIEDNAME(node.nodeId.get().namespaceIndex,
+      const_cast<char *>(nodeName.c_str())),
+    UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE), attributes,
+    nullptr, nullptr);
+  // Records might refer to one of the nodes that exist in every server (e.g.
+  // the current time), and we simply use the existing node in this case.
+  if (status == UA_STATUSCODE_BADNODEIDEXISTS) {
+    return;
+  }
+  if (status != UA_STATUSCODE_GOOD) {
+    throw UaException(status);
+  }
+  auto &storedNode = nodes.insert(
+    std::make_pair(node.nodeId, node)).first->second;
+  // References to the elements of an unordered_map stay valid when other
+  // elements are inserted, so we can keep a pointer to the node.
+  if (storedNode.waveform != Waveform::constant) {
+    waveformNodes.push_back(&storedNode);
+  }
+}
+
+void LoopbackServer::ensureNamespace(UA_UInt16 namespaceIndex) {
+  // Namespaces are numbered in the order in which they are added, so we have
+  // to add placeholder namespaces for all indices up to the requested one.
+  for (UA_UInt16 index = 0; index <= namespaceIndex; ++index) {
+    UA_String uri;
+    UA_String_init(&uri);
+    if (UA_Server_getNamespaceByIndex(server, index, &uri)
+        == UA_STATUSCODE_GOOD) {
+      UA_String_clear(&uri);
+      continue;
+    }
+    std::string newUri = "urn:open62541-epics:loopback:" + name + ":"
+      + std::to_string(index);
+    UA_Server_addNamespace(server, newUri.c_str());
+  }
+}
+
+void LoopbackServer::loadConfigFile(const std::string &fileName) {
+  std::ifstream file(fileName);
+  if (!file) {
+    throw std::invalid_argument("Could not open file: " + fileName);
+  }
+  std::string line;
+  std::size_t lineNumber = 0;
+  while (std::getline(file, line)) {
+    ++lineNumber;
+    std::istringstream tokens(line);
+    std::string nodeIdString;
+    std::string dataTypeString;
+    if (!(tokens >> nodeIdString) || nodeIdString[0] == '#') {
+      continue;
+    }
+    try {
+      if (!(tokens >> dataTypeString)) {
+        throw std::invalid_argument("Missing data type.");
+      }
+      Node node;
+      node.nodeId = Open62541RecordAddress::parseNodeId(nodeIdString);
+      node.dataType = Open62541RecordAddress::dataTypeForName(dataTypeString);
+      if (node.dataType == Open62541RecordAddress::DataType::unspecified) {
+        throw std::invalid_argument("Invalid data type: " + dataTypeString);
+      }
+      std::string option;
+      while (tokens >> option) {
+        auto separator = option.find('=');
+        if (separator == std::string::npos) {
+          throw std::invalid_argument("Invalid option: " + option);
+        }
+        std::string key = option.substr(0, separator);
+        std::string value = option.substr(separator + 1);
+        if (key == "amplitude") {
+          node.amplitude = parseDouble(key, value);
+        } else if (key == "offset") {
+          node.offset = parseDouble(key, value);
+        } else if (key == "period") {
+          node.period = parseDouble(key, value);
+          if (node.period <= 0.0) {
+            throw std::invalid_argument("The period must be positive.");
+          }
+        } else if (key == "size") {
+          double size = parseDouble(key, value);
+          if (size < 0.0 || size != std::floor(size)) {
+            throw std::invalid_argument("Invalid array size: " + value);
+          }
+          node.arraySize = static_cast<std::size_t>(size);
+        } else if (key == "waveform") {
+          node.waveform = parseWaveform(value);
+        } else {
+          throw std::invalid_argument("Unknown option: " + key);
+        }
+      }
+      if (nodes.count(node.nodeId)) {
+        throw std::invalid_argument("Duplicate node ID: " + nodeIdString);
+      }
+      addNode(node);
+    } catch (std::exception &e) {
+      throw std::invalid_argument(fileName + ":" + std::to_string(lineNumber)
+        + ": " + e.what());
+    }
+  }
+}
+
+UaVariant LoopbackServer::makeValue(const Node &node, double time) {
+  std::uniform_real_distribution<double> noiseDistribution(-1.0, 1.0);
+  const UA_DataType *type = getUaDataType(node.dataType);
+  std::size_t length = node.arraySize ? node.arraySize : 1;
+  void *data = UA_Array_new(length, type);
+  if (!data) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  for (std::size_t i = 0; i < length; ++i) {
+    // The elements of an array are shifted in phase, so that each period of
+    // the waveform is spread over the array.
+    double phase = time / node.period
+      + static_cast<double>(i) / static_cast<double>(length);
+    double fraction = phase - std::floor(phase);
+    double value;
+    switch (node.waveform) {
+    case Waveform::noise:
+      value = node.offset + node.amplitude * noiseDistribution(
+        randomGenerator);
+      break;
+    case Waveform::ramp:
+      value = node.offset + node.amplitude * fraction;
+      break;
+    case Waveform::sine:
+      value = node.offset + node.amplitude * std::sin(2.0 * pi * fraction);
+      break;
+    case Waveform::square:
+      value = node.offset
+        + (fraction < 0.5 ? node.amplitude : -node.amplitude);
+      break;
+    default:
+      value = node.offset;
+      break;
+    }
+    setElement(data, i, node.dataType, value);
+  }
+  UA_Variant variant;
+  UA_Variant_init(&variant);
+  if (node.arraySize) {
+    UA_Variant_setArray(&variant, data, length, type);
+  } else {
+    UA_Variant_setScalar(&variant, data, type);
+  }
+  return UaVariant(std::move(variant));
+}
+
+void LoopbackServer::runServerThread() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!shutdownRequested) {
+    UA_Server_run_iterate(server, false);
+    // Waiting releases the mutex, so that other threads can add nodes while
+    // the server thread is idle.
+    serverCv.wait_for(lock, std::chrono::milliseconds(1));
+  }
+}
+
+void LoopbackServer::updateValues() {
+  // This method is called from UA_Server_run_iterate, so the mutex is
+  // already held by the server thread.
+  if (waveformNodes.empty()) {
+    return;
+  }
+  updateCount.fetch_add(1, std::memory_order_relaxed);
+  double time = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - startTime).count();
+  UA_WriteValue writeValue;
+  UA_WriteValue_init(&writeValue);
+  writeValue.attributeId = UA_ATTRIBUTEID_VALUE;
+  writeValue.value.hasValue = true;
+  writeValue.value.hasSourceTimestamp = true;
+  for (auto node : waveformNodes) {
+    UaVariant value = makeValue(*node, time);
+    writeValue.nodeId = node->nodeId.get();
+    // The write value does not own the variant, so it must not be cleared.
+    writeValue.value.value = value.get();
+    writeValue.value.sourceTimestamp = UA_DateTime_now();
+    UA_Server_write(server, &writeValue);
+  }
+}
+
+void LoopbackServer::updateCallback(UA_Server *, void *data) {
+  // Exceptions must not propagate into the C code of the server.
+  try {
+    static_cast<LoopbackServer *>(data)->updateValues();
+  } catch (...) {
+  }
+}
+
+}
+}
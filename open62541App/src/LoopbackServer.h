@@ -0,0 +1,254 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_LOOPBACK_SERVER_H
+#define OPEN62541_EPICS_LOOPBACK_SERVER_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <condition_variable>. The workaround
+// for this is defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include "open62541.h"
+}
+
+#include "Open62541RecordAddress.h"
+#include "UaNodeId.h"
+#include "UaVariant.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * OPC UA server that runs inside the IOC process, so that IOC databases can be
+ * used without the real server (e.g. for commissioning and load tests).
+ *
+ * The server only listens on the loopback interface (using a port chosen by
+ * the operating system). Connections created with an endpoint URL of the form
+ * "loopback://<name>" are regular server connections to this server, so the
+ * full client code path is used.
+ *
+ * The nodes used by records are created when the records are initialized (see
+ * declareNode(...)). In addition to that, nodes can be defined in a
+ * configuration file. Each non-empty line of this file that does not start
+ * with "#" defines a node and has the form
+ *
+ * <node ID> <data type> [<option>=<value> ...]
+ *
+ * The node ID and the data type use the same format as in record addresses.
+ * The options are "waveform" (constant, noise, ramp, sine, or square),
+ * "amplitude" (default 1), "offset" (default 0), "period" (in seconds,
+ * default 10), and "size" (number of array elements, default 0 meaning a
+ * scalar value). The values of nodes that use a waveform other than constant
+ * are updated at the rate that has been specified when creating the server.
+ *
+ * The UA_Server is only used while holding a mutex. The server thread releases
+ * this mutex while it waits, and like the connection thread, it wakes up every
+ * millisecond in order to process network activity. This way, nodes can be
+ * created by other threads without having to wait for the server thread.
+ *
+ * This class is safe for concurrent use by multiple threads.
+ */
+class LoopbackServer {
+
+public:
+
+  /**
+   * Waveform that defines how the value of a node changes over time.
+   */
+  enum class Waveform {
+
+    /**
+     * The value is the offset and does not change.
+     */
+    constant,
+
+    /**
+     * The value is a random value between offset - amplitude and offset +
+     * amplitude.
+     */
+    noise,
+
+    /**
+     * The value rises linearly from offset to offset + amplitude during each
+     * period.
+     */
+    ramp,
+
+    /**
+     * The value is a sine wave around the offset.
+     */
+    sine,
+
+    /**
+     * The value is offset + amplitude during the first half of each period and
+     * offset - amplitude during the second half.
+     */
+    square
+
+  };
+
+  /**
+   * Destructor. Stops the server thread and destroys the server.
+   */
+  ~LoopbackServer();
+
+  /**
+   * Creates and starts the server with the specified name. If the name of the
+   * configuration file is empty, no nodes are created in advance. The update
+   * rate (in Hz) defines how often the values of the nodes that use a
+   * waveform are updated. Throws an std::invalid_argument if a server with the
+   * same name already exists or if the configuration file is invalid, and an
+   * UaException if the server cannot be started.
+   */
+  static std::shared_ptr<LoopbackServer> create(const std::string &name,
+      const std::string &configFile, double updateRate);
+
+  /**
+   * Creates the specified node if it does not exist yet. Existing nodes are
+   * not changed. New nodes accept values of any type, and their initial value
+   * is zero (or the text "0") of the specified type. If the array size is
+   * not zero, the initial value is an array with the specified number of
+   * elements. Throws an UaException if the node cannot be created.
+   */
+  void declareNode(const UaNodeId &nodeId,
+      Open62541RecordAddress::DataType dataType, std::size_t arraySize);
+
+  /**
+   * Returns the server that uses the specified endpoint URL. If no server
+   * uses this URL, a pointer to null is returned.
+   */
+  static std::shared_ptr<LoopbackServer> findByEndpointUrl(
+      const std::string &endpointUrl);
+
+  /**
+   * Returns the endpoint URL that is used for connecting to this server.
+   */
+  inline const std::string &getEndpointUrl() const {
+    return endpointUrl;
+  }
+
+  /**
+   * Returns the server with the specified name, creating and starting it
+   * (without a configuration file) if it does not exist yet. Throws an
+   * UaException if the server cannot be started.
+   */
+  static std::shared_ptr<LoopbackServer> getInstance(const std::string &name);
+
+  /**
+   * Returns the name of this server.
+   */
+  inline const std::string &getName() const {
+    return name;
+  }
+
+  /**
+   * Returns the number of nodes that have been created.
+   */
+  std::size_t getNodeCount();
+
+  /**
+   * Returns the number of times the values of the nodes using a waveform have
+   * been updated.
+   */
+  inline std::uint64_t getUpdateCount() const {
+    return updateCount.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Tells whether the specified endpoint URL refers to a loopback server
+   * ("loopback://<name>"). If it does, the name of the server is stored in
+   * the passed string.
+   */
+  static bool parseLoopbackUrl(const std::string &endpointUrl,
+      std::string &name);
+
+private:
+
+  struct Node {
+    double amplitude = 1.0;
+    std::size_t arraySize = 0;
+    Open62541RecordAddress::DataType dataType;
+    UaNodeId nodeId;
+    double offset = 0.0;
+    double period = 10.0;
+    Waveform waveform = Waveform::constant;
+  };
+
+  // We do not want to allow copy or move construction or assignment.
+  LoopbackServer(const LoopbackServer &) = delete;
+  LoopbackServer(LoopbackServer &&) = delete;
+  LoopbackServer &operator=(const LoopbackServer &) = delete;
+  LoopbackServer &operator=(LoopbackServer &&) = delete;
+
+  std::string endpointUrl;
+  std::string name;
+  // The server, the nodes, and the random number generator are protected by
+  // the mutex.
+  std::mutex mutex;
+  std::unordered_map<UaNodeId, Node> nodes;
+  std::mt19937 randomGenerator;
+  UA_Server *server;
+  std::condition_variable serverCv;
+  std::thread serverThread;
+  bool shutdownRequested;
+  std::chrono::steady_clock::time_point startTime;
+  std::atomic<std::uint64_t> updateCount;
+  double updateRate;
+  // Nodes using a waveform other than the constant one.
+  std::vector<const Node *> waveformNodes;
+
+  LoopbackServer(const std::string &name, const std::string &configFile,
+      double updateRate);
+
+  void addNode(const Node &node);
+  void ensureNamespace(UA_UInt16 namespaceIndex);
+  void loadConfigFile(const std::string &fileName);
+  UaVariant makeValue(const Node &node, double time);
+  void runServerThread();
+  void updateValues();
+
+  static void updateCallback(UA_Server *server, void *data);
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_LOOPBACK_SERVER_H
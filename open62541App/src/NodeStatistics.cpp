@@ -0,0 +1,57 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include "NodeStatistics.h"
+
+namespace open62541 {
+namespace epics {
+
+std::vector<std::pair<UaNodeId, NodeStatistics::Snapshot>>
+    NodeStatistics::getSnapshot() const {
+  std::vector<std::pair<UaNodeId, Snapshot>> result;
+  std::lock_guard<std::mutex> lock(mutex);
+  result.reserve(nodes.size());
+  for (auto &entry : nodes) {
+    auto &counters = *entry.second;
+    result.emplace_back(entry.first, Snapshot{
+      counters.bytes.load(std::memory_order_relaxed),
+      counters.notifications.load(std::memory_order_relaxed),
+      counters.processingTime.load(std::memory_order_relaxed),
+      counters.reads.load(std::memory_order_relaxed),
+      counters.writes.load(std::memory_order_relaxed)});
+  }
+  return result;
+}
+
+NodeStatistics::Counters &NodeStatistics::intern(const UaNodeId &nodeId) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &counters = nodes[nodeId];
+  if (!counters) {
+    counters.reset(new Counters());
+  }
+  return *counters;
+}
+
+}
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_NODE_STATISTICS_H
+#define OPEN62541_EPICS_NODE_STATISTICS_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "UaNodeId.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Table of per-node counters for a server connection. Each node ID is
+ * interned once (when a record is initialized or a monitored item is
+ * created), and the returned counters stay valid for the lifetime of the
+ * table, so updating them only needs relaxed atomic increments.
+ *
+ * Counting the bytes of notifications requires encoding the value, so this is
+ * only done while sampling is active (see {@link #startSampling()}).
+ */
+class NodeStatistics {
+
+public:
+
+  /**
+   * Counters for a single node.
+   */
+  struct Counters {
+
+    /**
+     * Bytes transferred (values read, written, or received in notifications).
+     * Bytes of notifications are only counted while sampling is active.
+     */
+    std::atomic<std::uint64_t> bytes;
+
+    /**
+     * Notifications received for monitored items of this node.
+     */
+    std::atomic<std::uint64_t> notifications;
+
+    /**
+     * Time (in nanoseconds) spent processing records that use this node.
+     */
+    std::atomic<std::uint64_t> processingTime;
+
+    /**
+     * Read requests sent for this node.
+     */
+    std::atomic<std::uint64_t> reads;
+
+    /**
+     * Write requests sent for this node.
+     */
+    std::atomic<std::uint64_t> writes;
+
+    inline Counters() : bytes(0), notifications(0), processingTime(0),
+        reads(0), writes(0) {
+    }
+
+    /**
+     * Adds a value to one of the counters.
+     */
+    inline static void add(std::atomic<std::uint64_t> &counter,
+        std::uint64_t value) {
+      counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+  };
+
+  /**
+   * Copy of the counters for a single node.
+   */
+  struct Snapshot {
+    std::uint64_t bytes;
+    std::uint64_t notifications;
+    std::uint64_t processingTime;
+    std::uint64_t reads;
+    std::uint64_t writes;
+  };
+
+  /**
+   * Creates an empty table.
+   */
+  inline NodeStatistics() : samplingCount(0) {
+  }
+
+  /**
+   * Returns a copy of the counters of all nodes in the table.
+   */
+  std::vector<std::pair<UaNodeId, Snapshot>> getSnapshot() const;
+
+  /**
+   * Returns the counters for the specified node, adding them to the table if
+   * they do not exist yet. The returned reference stays valid for the
+   * lifetime of this table.
+   */
+  Counters &intern(const UaNodeId &nodeId);
+
+  /**
+   * Tells whether sampling is active. Expensive counters (the bytes of
+   * notifications) are only updated while sampling is active.
+   */
+  inline bool isSampling() const {
+    return samplingCount.load(std::memory_order_relaxed) > 0;
+  }
+
+  /**
+   * Activates sampling. Calls to this method may be nested, and each call
+   * must be matched by a call to {@link #stopSampling()}.
+   */
+  inline void startSampling() {
+    samplingCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Deactivates sampling (if this call matches the outermost call to
+   * {@link #startSampling()}).
+   */
+  inline void stopSampling() {
+    samplingCount.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  NodeStatistics(const NodeStatistics &) = delete;
+  NodeStatistics(NodeStatistics &&) = delete;
+  NodeStatistics &operator=(const NodeStatistics &) = delete;
+  NodeStatistics &operator=(NodeStatistics &&) = delete;
+
+  mutable std::mutex mutex;
+  // The counters are allocated separately so that references to them stay
+  // valid when the map is rehashed.
+  std::unordered_map<UaNodeId, std::unique_ptr<Counters>> nodes;
+  std::atomic<int> samplingCount;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_NODE_STATISTICS_H
@@ -135,6 +135,15 @@ public:
 
 protected:
 
+  /**
+   * Returns an array of doubles with NELM elements.
+   */
+  virtual std::pair<Open62541RecordAddress::DataType, std::size_t>
+      getDefaultNodeType() const {
+    return std::make_pair(Open62541RecordAddress::DataType::doubleType,
+      static_cast<std::size_t>(this->getRecord()->nelm));
+  }
+
   virtual void writeRecordValue(const UaVariant &value) {
     ::aaiRecord *record = getRecord();
     if (!value) {
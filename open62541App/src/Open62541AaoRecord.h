@@ -204,6 +204,15 @@ public:
 
 protected:
 
+  /**
+   * Returns an array of doubles with NELM elements.
+   */
+  virtual std::pair<Open62541RecordAddress::DataType, std::size_t>
+      getDefaultNodeType() const {
+    return std::make_pair(Open62541RecordAddress::DataType::doubleType,
+      static_cast<std::size_t>(this->getRecord()->nelm));
+  }
+
   UaVariant readRecordValue() {
     const Open62541RecordAddress &address = getRecordAddress();
     ::aaoRecord *record = getRecord();
@@ -62,7 +62,11 @@ public:
    */
   long processAiRecord() {
     skipConversion = false;
-    processRecord();
+    // If processing failed, RVAL has not been updated, so we must not let the
+    // record run the conversion.
+    if (!processRecord()) {
+      return -1;
+    }
     if (skipConversion) {
       return 2;
     } else {
@@ -83,6 +87,15 @@ protected:
       throw std::invalid_argument(
           "The no_read_on_init flag is not supported for input records.");
     }
+    if (address.isMethodCall()) {
+      throw std::invalid_argument(
+          "The object option is not supported for input records.");
+    }
+    if (address.getArgumentsMode()
+        != Open62541RecordAddress::ArgumentsMode::value) {
+      throw std::invalid_argument(
+          "The arguments option is not supported for input records.");
+    }
   }
 
   virtual void writeRecordValue(const UaVariant &value) {
@@ -251,6 +251,11 @@ protected:
       throw std::invalid_argument(
           "The subscription option is not supported for output records.");
     }
+    if (!address.isMethodCall() && address.getArgumentsMode()
+        != Open62541RecordAddress::ArgumentsMode::value) {
+      throw std::invalid_argument(
+          "The arguments option is only supported together with the object option.");
+    }
   }
 
   void writeRecordValue(const UaVariant &value) {
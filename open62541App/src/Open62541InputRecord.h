@@ -30,11 +30,20 @@
 #ifndef OPEN62541_EPICS_INPUT_RECORD_H
 #define OPEN62541_EPICS_INPUT_RECORD_H
 
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <chrono>
 #include <cmath>
 #include <mutex>
 #include <string>
 
 #include <alarm.h>
+#include <callback.h>
 #include <recGbl.h>
 
 #include "Open62541Record.h"
@@ -69,6 +78,18 @@ public:
     // by the monitor callback. Note that we do this before adding or removing
     // the monitored item. If we did it later, we might receive a callback with
     // the flag still being in the wrong state.
+    // For the startup statistics, we count each record that uses a monitored
+    // item only once, even if I/O Intr mode is enabled repeatedly.
+    if (command == 0 && !monitoringStartupCounted) {
+      monitoringStartupCounted = true;
+      this->getConnection()->getStartupStatistics()
+        .countMonitoredRecord();
+    }
+    if (command == 0 && !subscriptionStatistics) {
+      subscriptionStatistics =
+        this->getConnection()->getSubscriptionStatistics(
+          this->getRecordAddress().getSubscription());
+    }
     {
       std::lock_guard<std::mutex> lock(monitoringMutex);
       monitoringEnabled = !command;
@@ -77,6 +98,7 @@ public:
       // previously, but we do not want these events to count when checking
       // whether an event has already been received for the current monitor.
       monitoringFirstEventReceived = false;
+      readOverflow = false;
     }
     std::string const &subscriptionName =
       this->getRecordAddress().getSubscription();
@@ -84,20 +106,22 @@ public:
       double samplingInterval = this->getRecordAddress().getSamplingInterval();
       if (std::isnan(samplingInterval)) {
         samplingInterval =
-          this->getServerConnection()->getSubscriptionPublishingInterval(
+          this->getConnection()->getSubscriptionPublishingInterval(
             subscriptionName);
       }
-      // We use a fixed queue size of one and set the discard-oldest flag. As we
-      // do not use a queue for the record and notifications are delivered in
-      // bursts, we would most likely discard any additional items delivered by
-      // the server anyway.
-      std::uint32_t queueSize = 1;
+      // By default, we use a queue size of one and set the discard-oldest
+      // flag. As we do not use a queue for the record and notifications are
+      // delivered in bursts, we would most likely discard any additional items
+      // delivered by the server anyway. A larger queue can still be useful,
+      // because the server only signals an overflow (lost values) when the
+      // queue size is greater than one.
+      std::uint32_t queueSize = this->getRecordAddress().getQueueSize();
       bool discardOldest = true;
-      this->getServerConnection()->addMonitoredItem(
+      this->getConnection()->addMonitoredItem(
         subscriptionName, this->getRecordAddress().getNodeId(),
         monitoredItemCallback, samplingInterval, queueSize, discardOldest);
     } else {
-      this->getServerConnection()->removeMonitoredItem(
+      this->getConnection()->removeMonitoredItem(
         subscriptionName, this->getRecordAddress().getNodeId(),
         monitoredItemCallback);
     }
@@ -114,8 +138,15 @@ protected:
       Open62541Record<RecordType>(record, record->inp),
       monitoredItemCallback(std::make_shared<MonitoredItemCallbackImpl>(*this)),
       monitoringEnabled(false), monitoringFirstEventReceived(false),
+      monitoringFirstEventEver(false), monitoringStartupCounted(false),
+      rateLimitCallback(), rateLimitPending(false),
+      readErrorOperation(nullptr), readOverflow(false),
+      readStatusCode(UA_STATUSCODE_GOOD),
       readSuccessful(false) {
     ::scanIoInit(&this->ioIntrModeScanPvt);
+    callbackSetCallback(rateLimitCallbackFunc, &this->rateLimitCallback);
+    callbackSetPriority(priorityMedium, &this->rateLimitCallback);
+    callbackSetUser(this, &this->rateLimitCallback);
   }
 
   /**
@@ -130,8 +161,9 @@ protected:
 
   /**
    * Validates the record address. In addition to the checks made by the base
-   * class, this method also checks that the no_read_on_init flag is not set.
-   * This flag is only allowed for output records.
+   * class, this method also checks that neither the no_read_on_init flag nor
+   * the object or arguments options are set. These settings are only allowed
+   * for output records.
    */
   virtual void validateRecordAddress() {
     Open62541Record<RecordType>::validateRecordAddress();
@@ -140,21 +172,31 @@ protected:
       throw std::invalid_argument(
           "The no_read_on_init flag is not supported for input records.");
     }
+    if (address.isMethodCall()) {
+      throw std::invalid_argument(
+          "The object option is not supported for input records.");
+    }
+    if (address.getArgumentsMode()
+        != Open62541RecordAddress::ArgumentsMode::value) {
+      throw std::invalid_argument(
+          "The arguments option is not supported for input records.");
+    }
   }
 
 private:
 
-  struct MonitoredItemCallbackImpl : ServerConnection::MonitoredItemCallback {
+  struct MonitoredItemCallbackImpl : Connection::MonitoredItemCallback {
     MonitoredItemCallbackImpl(Open62541InputRecord &record);
     void success(const UaNodeId &nodeId, const UaVariant &value);
     void failure(const UaNodeId &nodeId, UA_StatusCode statusCode);
+    void overflow(const UaNodeId &nodeId);
 
     // In EPICS, records are never destroyed. Therefore, we can safely keep a
     // reference to the device support object.
     Open62541InputRecord &record;
   };
 
-  struct ReadCallbackImpl: ServerConnection::ReadCallback {
+  struct ReadCallbackImpl: Connection::ReadCallback {
     ReadCallbackImpl(Open62541InputRecord &record);
     void success(const UaNodeId &nodeId, const UaVariant &value);
     void failure(const UaNodeId &nodeId, UA_StatusCode statusCode);
@@ -171,13 +213,40 @@ private:
   Open62541InputRecord &operator=(Open62541InputRecord &&) = delete;
 
   ::IOSCANPVT ioIntrModeScanPvt;
+  std::chrono::steady_clock::time_point lastTriggerTime;
   std::shared_ptr<MonitoredItemCallbackImpl> monitoredItemCallback;
   bool monitoringEnabled;
   bool monitoringFirstEventReceived;
+  bool monitoringFirstEventEver;
   std::mutex monitoringMutex;
-  std::string readErrorMessage;
+  bool monitoringStartupCounted;
+  std::chrono::steady_clock::time_point notificationReceiveTime;
+  ::CALLBACK rateLimitCallback;
+  bool rateLimitPending;
+  const char *readErrorOperation;
+  bool readOverflow;
+  UA_StatusCode readStatusCode;
   bool readSuccessful;
   UaVariant readValue;
+  std::shared_ptr<SubscriptionStatistics> subscriptionStatistics;
+
+  inline void markNotificationReceived() {
+    if (!monitoringFirstEventEver) {
+      monitoringFirstEventEver = true;
+      this->getConnection()->getStartupStatistics()
+        .markFirstNotification();
+    }
+    // If several notifications are merged into a single processing of the
+    // record, we keep the time of the first one.
+    if (notificationReceiveTime == std::chrono::steady_clock::time_point()) {
+      notificationReceiveTime = std::chrono::steady_clock::now();
+    }
+  }
+
+  void mergeValue(const UaVariant &value);
+  void triggerProcessing();
+
+  static void rateLimitCallbackFunc(::CALLBACK *callback);
 
 };
 
@@ -209,10 +278,21 @@ bool Open62541InputRecord<RecordType>::processPrepare() {
     if (monitoringFirstEventReceived) {
       processComplete();
     }
+    // The receive time is reset after recording it, so that processing the
+    // record again without a new notification does not distort the histogram.
+    if (notificationReceiveTime
+        != std::chrono::steady_clock::time_point()) {
+      subscriptionStatistics->notificationProcessingLatency.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now()
+          - notificationReceiveTime).count());
+      notificationReceiveTime = std::chrono::steady_clock::time_point();
+    }
     return false;
   }
   auto callback = std::make_shared<ReadCallbackImpl>(*this);
-  this->getServerConnection()->readAsync(this->getRecordAddress().getNodeId(),
+  NodeStatistics::Counters::add(this->getNodeCounters().reads, 1);
+  this->getConnection()->readAsync(this->getRecordAddress().getNodeId(),
       callback);
   return true;
 }
@@ -225,11 +305,79 @@ void Open62541InputRecord<RecordType>::processComplete() {
     this->getRecord()->udf = 0;
     this->writeRecordValue(readValue);
   } else {
-    recGblSetSevr(this->getRecord(), READ_ALARM, INVALID_ALARM);
-    throw std::runtime_error(readErrorMessage);
+    this->setProcessingError(readErrorOperation, readStatusCode, false);
+  }
+  // Values have been lost since the record was last processed. This is not
+  // as severe as an error, so we only raise a minor alarm.
+  if (readOverflow) {
+    readOverflow = false;
+    recGblSetSevr(this->getRecord(), READ_ALARM, MINOR_ALARM);
+  }
+}
+
+template<typename RecordType>
+void Open62541InputRecord<RecordType>::mergeValue(const UaVariant &value) {
+  // This method is called while holding a lock on monitoringMutex.
+  auto mergeMode = this->getRecordAddress().getMergeMode();
+  // Only scalar numbers can be compared, so for all other values (and when
+  // the last notification signaled an error), the latest value always wins.
+  auto const &newValue = value.get();
+  auto const &oldValue = readValue.get();
+  if (mergeMode == Open62541RecordAddress::MergeMode::latest
+      || !readSuccessful || !newValue.type || newValue.type != oldValue.type
+      || newValue.type->typeKind > UA_DATATYPEKIND_DOUBLE
+      || !UA_Variant_isScalar(&newValue) || !UA_Variant_isScalar(&oldValue)) {
+    readSuccessful = true;
+    readValue = value;
+    return;
+  }
+  auto order = UA_order(newValue.data, oldValue.data, newValue.type);
+  if ((mergeMode == Open62541RecordAddress::MergeMode::min
+      && order == UA_ORDER_LESS)
+      || (mergeMode == Open62541RecordAddress::MergeMode::max
+      && order == UA_ORDER_MORE)) {
+    readValue = value;
+  }
+}
+
+template<typename RecordType>
+void Open62541InputRecord<RecordType>::triggerProcessing() {
+  // There is a small chance that scanIoRequest will fail because the queues are
+  // already full (it will return zero in that case).
+  // The most likely case when scanIoRequest will fail is when the IOC has not
+  // been fully initialized yet. In this case, calling scheduleProcessing will
+  // usually work. If this does not work either, we print an error message.
+  if (!::scanIoRequest(ioIntrModeScanPvt)) {
+    if (!this->scheduleProcessing()) {
+      errorExtendedPrintf(
+        "%s Could not schedule asynchronous processing of record. Monitored item notification is not going to be processed.",
+        this->getRecord()->name);
+    }
   }
 }
 
+template<typename RecordType>
+void Open62541InputRecord<RecordType>::rateLimitCallbackFunc(
+    ::CALLBACK *callback) {
+  void *user;
+  callbackGetUser(user, callback);
+  auto &record = *static_cast<Open62541InputRecord *>(user);
+  std::lock_guard<std::mutex> lock(record.monitoringMutex);
+  // If an error notification has been processed while processing was
+  // deferred, the deferred value has been discarded and there is nothing left
+  // to process.
+  if (!record.rateLimitPending) {
+    return;
+  }
+  record.rateLimitPending = false;
+  // Monitoring might have been disabled while processing was deferred.
+  if (!record.monitoringEnabled) {
+    return;
+  }
+  record.lastTriggerTime = std::chrono::steady_clock::now();
+  record.triggerProcessing();
+}
+
 template<typename RecordType>
 Open62541InputRecord<RecordType>::MonitoredItemCallbackImpl::MonitoredItemCallbackImpl(
     Open62541InputRecord &record) :
@@ -250,21 +398,43 @@ void Open62541InputRecord<RecordType>::MonitoredItemCallbackImpl::success(
   if (!record.monitoringEnabled) {
     return;
   }
+  const Open62541RecordAddress &address = record.getRecordAddress();
+  // If the value is the same as the one that the record already has (or is
+  // about to get), processing the record would not change anything, so we
+  // can skip it. This commonly happens when the server also sends
+  // notifications when only the timestamp has changed.
+  if (address.isSuppressDuplicates() && record.monitoringFirstEventReceived
+      && record.readSuccessful
+      && UA_order(&value.get(), &record.readValue.get(),
+        &UA_TYPES[UA_TYPES_VARIANT]) == UA_ORDER_EQ) {
+    return;
+  }
   record.monitoringFirstEventReceived = true;
-  record.readSuccessful = true;
-  record.readValue = value;
-  // There is a small chance that scanIoRequest will fail because the queues are
-  // already full (it will return zero in that case).
-  // The most likely case when scanIoRequest will fail is when the IOC has not
-  // been fully initialized yet. In this case, calling scheduleProcessing will
-  // usually work. If this does not work either, we print an error message.
-  if (!::scanIoRequest(record.ioIntrModeScanPvt)) {
-    if (!record.scheduleProcessing()) {
-      errorExtendedPrintf(
-        "%s Could not schedule asynchronous processing of record. Monitored item notification is not going to be processed.",
-        record.getRecord()->name);
+  record.markNotificationReceived();
+  double maxRate = address.getMaxRate();
+  if (maxRate > 0.0) {
+    // If processing has already been deferred, we only have to merge the new
+    // value. The record is going to be processed when the delay expires.
+    if (record.rateLimitPending) {
+      record.mergeValue(value);
+      return;
     }
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> minInterval(1.0 / maxRate);
+    auto elapsed = now - record.lastTriggerTime;
+    if (elapsed < minInterval) {
+      record.readSuccessful = true;
+      record.readValue = value;
+      record.rateLimitPending = true;
+      ::callbackRequestDelayed(&record.rateLimitCallback,
+        std::chrono::duration<double>(minInterval - elapsed).count());
+      return;
+    }
+    record.lastTriggerTime = now;
   }
+  record.readSuccessful = true;
+  record.readValue = value;
+  record.triggerProcessing();
 }
 
 template<typename RecordType>
@@ -282,26 +452,33 @@ void Open62541InputRecord<RecordType>::MonitoredItemCallbackImpl::failure(
     return;
   }
   record.monitoringFirstEventReceived = true;
+  record.markNotificationReceived();
   record.readSuccessful = false;
-  try {
-    record.readErrorMessage = std::string("Error monitoring node: ")
-        + UA_StatusCode_name(statusCode);
-  } catch (...) {
-    // We want to schedule processing of the record even if we cannot assemble
-    // the error message for some obscure reason.
+  record.readErrorOperation = "Error monitoring node";
+  record.readStatusCode = statusCode;
+  // Errors are never delayed by the rate limit, because the alarm state of the
+  // record should be updated as quickly as possible. A value that is still
+  // deferred is superseded by the error, so the delayed callback must not
+  // process the record again.
+  record.rateLimitPending = false;
+  record.lastTriggerTime = std::chrono::steady_clock::now();
+  record.triggerProcessing();
+}
+
+template<typename RecordType>
+void Open62541InputRecord<RecordType>::MonitoredItemCallbackImpl::overflow(
+    const UaNodeId &nodeId) {
+  if (!record.getRecordAddress().isOverflowAlarm()) {
+    return;
   }
-  // There is a small chance that scanIoRequest will fail because the queues are
-  // already full (it will return zero in that case).
-  // The most likely case when scanIoRequest will fail is when the IOC has not
-  // been fully initialized yet. In this case, calling scheduleProcessing will
-  // usually work. If this does not work either, we print an error message.
-  if (!::scanIoRequest(record.ioIntrModeScanPvt)) {
-    if (!record.scheduleProcessing()) {
-      errorExtendedPrintf(
-        "%s Could not schedule asynchronous processing of record. Monitored item notification is not going to be processed.",
-        record.getRecord()->name);
-    }
+  std::lock_guard<std::mutex> lock(record.monitoringMutex);
+  if (!record.monitoringEnabled) {
+    return;
   }
+  // The flag is not cleared until the record is processed, so the alarm is
+  // raised even if the notification itself does not cause processing (e.g.
+  // because it is suppressed as a duplicate).
+  record.readOverflow = true;
 }
 
 template<typename RecordType>
@@ -315,6 +492,7 @@ void Open62541InputRecord<RecordType>::ReadCallbackImpl::success(
     const UaNodeId &nodeId, const UaVariant &value) {
   record.readSuccessful = true;
   record.readValue = value;
+  record.markResponseReceived();
   record.scheduleProcessing();
 }
 
@@ -322,13 +500,9 @@ template<typename RecordType>
 void Open62541InputRecord<RecordType>::ReadCallbackImpl::failure(
     const UaNodeId &nodeId, UA_StatusCode statusCode) {
   record.readSuccessful = false;
-  try {
-    record.readErrorMessage = std::string("Error reading from node: ")
-        + UA_StatusCode_name(statusCode);
-  } catch (...) {
-    // We want to schedule processing of the record even if we cannot assemble
-    // the error message for some obscure reason.
-  }
+  record.readErrorOperation = "Error reading from node";
+  record.readStatusCode = statusCode;
+  record.markResponseReceived();
   record.scheduleProcessing();
 }
 
@@ -31,6 +31,7 @@
 #define OPEN62541_EPICS_OUTPUT_RECORD_H
 
 #include <cmath>
+#include <vector>
 
 #include <alarm.h>
 #include <recGbl.h>
@@ -52,9 +53,9 @@ public:
 
   /**
    * Initializes the records value with the current value read from the OPC UA
-   * server. If the record address specifies that no initialization is desired,
-   * the initialization is skipped. This method is called right after creating
-   * the instance of this class.
+   * server. If the record address specifies that no initialization is desired
+   * or that the record calls a method, the initialization is skipped. This
+   * method is called right after creating the instance of this class.
    */
   virtual void initializeRecord();
 
@@ -115,11 +116,28 @@ protected:
       throw std::invalid_argument(
           "The subscription option is not supported for output records.");
     }
+    if (address.getMaxRate() != 0.0) {
+      throw std::invalid_argument(
+          "The max_rate option is not supported for output records.");
+    }
+    if (address.getMergeMode() != Open62541RecordAddress::MergeMode::latest) {
+      throw std::invalid_argument(
+          "The merge option is not supported for output records.");
+    }
+    if (address.isSuppressDuplicates()) {
+      throw std::invalid_argument(
+          "The suppress_duplicates option is not supported for output records.");
+    }
+    if (!address.isMethodCall() && address.getArgumentsMode()
+        != Open62541RecordAddress::ArgumentsMode::value) {
+      throw std::invalid_argument(
+          "The arguments option is only supported together with the object option.");
+    }
   }
 
 private:
 
-  struct CallbackImpl: ServerConnection::WriteCallback {
+  struct CallbackImpl: Connection::WriteCallback {
     CallbackImpl(Open62541OutputRecord &record);
     void success(const UaNodeId &nodeId);
     void failure(const UaNodeId &nodeId, UA_StatusCode statusCode);
@@ -129,29 +147,63 @@ private:
     Open62541OutputRecord &record;
   };
 
+  struct CallCallbackImpl: Connection::CallCallback {
+    CallCallbackImpl(Open62541OutputRecord &record);
+    void success(const UaNodeId &methodId,
+        const std::vector<UaVariant> &outputArguments);
+    void failure(const UaNodeId &methodId, UA_StatusCode statusCode);
+
+    // In EPICS, records are never destroyed. Therefore, we can safely keep a
+    // reference to the device support object.
+    Open62541OutputRecord &record;
+  };
+
   // We do not want to allow copy or move construction or assignment.
   Open62541OutputRecord(const Open62541OutputRecord &) = delete;
   Open62541OutputRecord(Open62541OutputRecord &&) = delete;
   Open62541OutputRecord &operator=(const Open62541OutputRecord &) = delete;
   Open62541OutputRecord &operator=(Open62541OutputRecord &&) = delete;
 
+  // Output arguments returned by the last method call. They are set by the
+  // call callback and used by processComplete().
+  std::vector<UaVariant> callOutputArguments;
+  UA_StatusCode writeStatusCode;
   bool writeSuccessful;
-  std::string writeErrorMessage;
+
+  /**
+   * Combines several output arguments into a single array value. Returns an
+   * empty variant if the output arguments are not all scalars of the same
+   * type.
+   */
+  static UaVariant combineOutputArguments(
+      const std::vector<UaVariant> &outputArguments);
+
+  /**
+   * Converts the record's value to the input arguments of a method call,
+   * according to the arguments mode specified by the record address.
+   */
+  std::vector<UaVariant> getInputArguments(UaVariant &&value);
 
 };
 
 template<typename RecordType>
 Open62541OutputRecord<RecordType>::Open62541OutputRecord(RecordType *record) :
-    Open62541Record<RecordType>(record, record->out), writeSuccessful(false) {
+    Open62541Record<RecordType>(record, record->out),
+    writeStatusCode(UA_STATUSCODE_GOOD), writeSuccessful(false) {
 }
 
 template<typename RecordType>
 void Open62541OutputRecord<RecordType>::initializeRecord() {
   Open62541Record<RecordType>::initializeRecord();
-  if (this->getRecordAddress().isReadOnInit()) {
+  // A method does not have a value that could be read, so records that call
+  // a method are never initialized.
+  if (this->getRecordAddress().isReadOnInit()
+      && !this->getRecordAddress().isMethodCall()) {
     UaVariant value;
     try {
-      value = this->getServerConnection()->read(
+      StartupProfiler::PhaseTimer phaseTimer(
+        StartupProfiler::Phase::readOnInit);
+      value = this->getConnection()->read(
         this->getRecordAddress().getNodeId());
     } catch (const UaException &e) {
       errorExtendedPrintf("%s Could not initialize record value: %s",
@@ -267,18 +319,121 @@ UaVariant Open62541OutputRecord<RecordType>::readRecordValueGeneric(
 template<typename RecordType>
 bool Open62541OutputRecord<RecordType>::processPrepare() {
   UaVariant value = this->readRecordValue();
+  const Open62541RecordAddress &address = this->getRecordAddress();
+  if (address.isMethodCall()) {
+    auto callback = std::make_shared<CallCallbackImpl>(*this);
+    this->getConnection()->callAsync(address.getObjectId(),
+        address.getNodeId(), getInputArguments(std::move(value)), callback);
+    return true;
+  }
   auto callback = std::make_shared<CallbackImpl>(*this);
-  this->getServerConnection()->writeAsync(
+  NodeStatistics::Counters::add(this->getNodeCounters().writes, 1);
+  this->getConnection()->writeAsync(
       this->getRecordAddress().getNodeId(), value, callback);
   return true;
 }
 
 template<typename RecordType>
 void Open62541OutputRecord<RecordType>::processComplete() {
+  if (!this->getRecordAddress().isMethodCall()) {
+    if (!writeSuccessful) {
+      this->setProcessingError("Error writing to node", writeStatusCode, true);
+    }
+    return;
+  }
   if (!writeSuccessful) {
-    recGblSetSevr(this->getRecord(), WRITE_ALARM, INVALID_ALARM);
-    throw std::runtime_error(writeErrorMessage);
+    this->setProcessingError("Error calling method", writeStatusCode, true);
+    return;
+  }
+  // The output arguments of the method replace the record's value, so that
+  // they can be passed on to other records through the record's links. A
+  // single output argument is used as is, several output arguments are
+  // passed on as an array, and the value is not changed if there are no
+  // output arguments.
+  auto outputArguments = std::move(callOutputArguments);
+  callOutputArguments.clear();
+  if (outputArguments.empty()) {
+    return;
+  }
+  // PACT has already been reset, so an exception would not put the record
+  // into an alarm state. Therefore, output arguments that cannot be stored in
+  // the record (e.g. several output arguments for a scalar record or output
+  // arguments of different types) are reported as a processing error.
+  try {
+    UaVariant combinedValue;
+    if (outputArguments.size() > 1) {
+      combinedValue = combineOutputArguments(outputArguments);
+      if (!combinedValue) {
+        this->setProcessingError(
+          "Error calling method", UA_STATUSCODE_BADTYPEMISMATCH, true);
+        return;
+      }
+    }
+    this->writeRecordValue(
+      combinedValue ? combinedValue : outputArguments.front());
+  } catch (const UaException &e) {
+    this->setProcessingError("Error calling method", e.getStatusCode(), true);
+  } catch (const std::exception &) {
+    this->setProcessingError(
+      "Error calling method", UA_STATUSCODE_BADTYPEMISMATCH, true);
+  }
+}
+
+template<typename RecordType>
+UaVariant Open62541OutputRecord<RecordType>::combineOutputArguments(
+    const std::vector<UaVariant> &outputArguments) {
+  auto type = outputArguments.front().get().type;
+  for (auto &outputArgument : outputArguments) {
+    if (!outputArgument.isScalar() || outputArgument.get().type != type) {
+      return UaVariant();
+    }
+  }
+  auto size = outputArguments.size();
+  auto data = static_cast<char *>(UA_Array_new(size, type));
+  if (!data) {
+    throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
+  }
+  for (std::size_t i = 0; i < size; ++i) {
+    auto status = UA_copy(outputArguments[i].get().data,
+        data + i * type->memSize, type);
+    if (status != UA_STATUSCODE_GOOD) {
+      UA_Array_delete(data, size, type);
+      throw UaException(status);
+    }
+  }
+  UA_Variant value;
+  UA_Variant_init(&value);
+  UA_Variant_setArray(&value, data, size, type);
+  return UaVariant(std::move(value));
+}
+
+template<typename RecordType>
+std::vector<UaVariant> Open62541OutputRecord<RecordType>::getInputArguments(
+    UaVariant &&value) {
+  std::vector<UaVariant> inputArguments;
+  auto argumentsMode = this->getRecordAddress().getArgumentsMode();
+  if (argumentsMode == Open62541RecordAddress::ArgumentsMode::none) {
+    return inputArguments;
+  }
+  if (argumentsMode == Open62541RecordAddress::ArgumentsMode::value
+      || value.isScalar()) {
+    inputArguments.push_back(std::move(value));
+    return inputArguments;
   }
+  auto &array = value.get();
+  auto data = static_cast<const char *>(array.data);
+  inputArguments.reserve(array.arrayLength);
+  for (std::size_t i = 0; i < array.arrayLength; ++i) {
+    UA_Variant element;
+    UA_Variant_init(&element);
+    auto status = UA_Variant_setScalarCopy(&element,
+        data + i * array.type->memSize, array.type);
+    if (status != UA_STATUSCODE_GOOD) {
+      throw UaException(status);
+    }
+    inputArguments.emplace_back(std::move(element));
+  }
+  return inputArguments;
 }
 
 template<typename RecordType>
@@ -291,6 +446,7 @@ template<typename RecordType>
 void Open62541OutputRecord<RecordType>::CallbackImpl::success(
     const UaNodeId &nodeId) {
   record.writeSuccessful = true;
+  record.markResponseReceived();
   record.scheduleProcessing();
 }
 
@@ -298,13 +454,32 @@ template<typename RecordType>
 void Open62541OutputRecord<RecordType>::CallbackImpl::failure(
     const UaNodeId &nodeId, UA_StatusCode statusCode) {
   record.writeSuccessful = false;
-  try {
-    record.writeErrorMessage = std::string("Error write to node: ")
-        + UA_StatusCode_name(statusCode);
-  } catch (...) {
-    // We want to schedule processing of the record even if we cannot assemble
-    // the error message for some obscure reason.
-  }
+  record.writeStatusCode = statusCode;
+  record.markResponseReceived();
+  record.scheduleProcessing();
+}
+
+template<typename RecordType>
+Open62541OutputRecord<RecordType>::CallCallbackImpl::CallCallbackImpl(
+    Open62541OutputRecord &record) :
+    record(record) {
+}
+
+template<typename RecordType>
+void Open62541OutputRecord<RecordType>::CallCallbackImpl::success(
+    const UaNodeId &methodId, const std::vector<UaVariant> &outputArguments) {
+  record.callOutputArguments = outputArguments;
+  record.writeSuccessful = true;
+  record.markResponseReceived();
+  record.scheduleProcessing();
+}
+
+template<typename RecordType>
+void Open62541OutputRecord<RecordType>::CallCallbackImpl::failure(
+    const UaNodeId &methodId, UA_StatusCode statusCode) {
+  record.writeSuccessful = false;
+  record.writeStatusCode = statusCode;
+  record.markResponseReceived();
   record.scheduleProcessing();
 }
 
@@ -30,15 +30,25 @@
 #ifndef OPEN62541_EPICS_RECORD_H
 #define OPEN62541_EPICS_RECORD_H
 
+#include <chrono>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <utility>
 
 #include <callback.h>
 #include <dbCommon.h>
 #include <dbScan.h>
+#include <errlog.h>
+#include <recGbl.h>
 
+#include "ErrorLogAggregator.h"
+#include "LoopbackServer.h"
+#include "open62541AlarmMapping.h"
 #include "Open62541RecordAddress.h"
+#include "open62541Trace.h"
 #include "ServerConnectionRegistry.h"
+#include "StartupProfiler.h"
 
 namespace open62541 {
 namespace epics {
@@ -59,10 +69,11 @@ public:
    * All logic that is critical (so that the record cannot be used if it fails)
    * must be in the constructor.
    *
-   * The default implementation does nothing.
+   * The default implementation creates the node used by this record if the
+   * connection refers to a loopback server (see LoopbackServer). Child classes
+   * overriding this method must call it.
    */
-  virtual void initializeRecord() {
-  }
+  virtual void initializeRecord();
 
   /**
    * Called each time the record is processed. Used for reading (input
@@ -71,8 +82,13 @@ public:
    * calling the {@link #processPrepare()} method and setting the PACT field to
    * one before returning. When it is called again later, PACT is reset to zero
    * and the {@link #processComplete} is called.
+   *
+   * Returns false if processing failed because of an error reported by the
+   * server. In this case, the alarm status and severity of the record have
+   * already been set and the error has been logged. Other errors are still
+   * signaled by throwing an exception.
    */
-  virtual void processRecord();
+  virtual bool processRecord();
 
 protected:
 
@@ -88,10 +104,29 @@ protected:
   virtual ~Open62541Record() {
   }
 
+  /**
+   * Returns the data type and the array size (zero for scalar values) of the
+   * node that is created for this record when using a loopback server and the
+   * record address does not specify a data type. The default implementation
+   * returns a scalar double. Child classes should override this method if a
+   * different type fits the record better.
+   */
+  virtual std::pair<Open62541RecordAddress::DataType, std::size_t>
+      getDefaultNodeType() const {
+    return std::make_pair(Open62541RecordAddress::DataType::doubleType, 0);
+  }
+
+  /**
+   * Returns the counters for the node that this record is mapped to.
+   */
+  inline NodeStatistics::Counters &getNodeCounters() const {
+    return *nodeCounters;
+  }
+
   /**
    * Returns the connection associated with this record.
    */
-  inline std::shared_ptr<ServerConnection> getServerConnection() const {
+  inline std::shared_ptr<Connection> getConnection() const {
     return connection;
   }
 
@@ -127,6 +162,32 @@ protected:
    */
   virtual void processComplete() = 0;
 
+  /**
+   * Notes the time when the response for an asynchronous request has been
+   * received. This method should be called by the callbacks registered by
+   * {@link #processPrepare()} right before calling
+   * {@link #scheduleProcessing()}, so that the time needed for completing the
+   * request can be added to the latency histograms of the connection.
+   */
+  inline void markResponseReceived() {
+    responseTime = std::chrono::steady_clock::now();
+  }
+
+  /**
+   * Marks the current processing of the record as failed. This sets the alarm
+   * status and severity of the record according to the status code, logs the
+   * error through the ErrorLogAggregator, and causes
+   * {@link #processRecord()} to return false. The operation must be a string
+   * literal describing the operation that failed. The write flag specifies
+   * whether the operation was a write operation.
+   *
+   * This method does not allocate memory, so it is cheap enough to be called
+   * for every failed operation, even if the server is unavailable and all
+   * records fail at the same time.
+   */
+  void setProcessingError(const char *operation, UA_StatusCode statusCode,
+      bool write);
+
   /**
    * Schedules processing of the record. This method should only be called from
    * an asynchronous callback that has been scheduled by the
@@ -175,15 +236,38 @@ private:
   Open62541RecordAddress address;
 
   /**
-   * Pointer to the server connection.
+   * Pointer to the connection.
+   */
+  std::shared_ptr<Connection> connection;
+
+  /**
+   * Counters for the node that this record is mapped to. They are owned by
+   * the connection's node statistics.
    */
-  std::shared_ptr<ServerConnection> connection;
+  NodeStatistics::Counters *nodeCounters;
+
+  /**
+   * Flag indicating whether the current processing failed.
+   */
+  bool processingFailed;
 
   /**
    * Record this device support has been instantiated for.
    */
   RecordType *record;
 
+  /**
+   * Time when processing of the record started the current asynchronous
+   * request.
+   */
+  std::chrono::steady_clock::time_point requestTime;
+
+  /**
+   * Time when the response for the current asynchronous request has been
+   * received.
+   */
+  std::chrono::steady_clock::time_point responseTime;
+
   /**
    * Callback needed to queue a request for processRecord to be run again.
    */
@@ -199,27 +283,75 @@ private:
 template<typename RecordType>
 Open62541Record<RecordType>::Open62541Record(RecordType *record,
     const ::DBLINK &addressField) :
-    address(readRecordAddress(addressField)), record(record) {
+    address(readRecordAddress(addressField)), nodeCounters(nullptr),
+    processingFailed(false), record(record) {
   this->connection =
-      ServerConnectionRegistry::getInstance().getServerConnection(
+      ServerConnectionRegistry::getInstance().getConnection(
           this->address.getConnectionId());
   if (!this->connection) {
     throw std::runtime_error(
         std::string("Could not find connection ")
             + this->address.getConnectionId() + ".");
   }
+  this->connection->getStartupStatistics().countRecordInitialized();
+  this->nodeCounters = &this->connection->getNodeStatistics().intern(
+    this->address.getNodeId());
 }
 
 template<typename RecordType>
-void Open62541Record<RecordType>::processRecord() {
+void Open62541Record<RecordType>::initializeRecord() {
+  auto loopbackServer = LoopbackServer::findByEndpointUrl(
+    connection->getEndpointUrl());
+  if (!loopbackServer) {
+    return;
+  }
+  auto nodeType = getDefaultNodeType();
+  if (address.getDataType() != Open62541RecordAddress::DataType::unspecified) {
+    nodeType.first = address.getDataType();
+  }
+  try {
+    loopbackServer->declareNode(
+      address.getNodeId(), nodeType.first, nodeType.second);
+  } catch (const std::exception &e) {
+    errorExtendedPrintf("%s Could not create node in loopback server: %s",
+        record->name, e.what());
+  }
+}
+
+template<typename RecordType>
+bool Open62541Record<RecordType>::processRecord() {
+  OPEN62541_TRACE_PROCESS_START(this->record->name, this->record->pact);
+  AllocationStatistics::Scope allocationScope(
+    &connection->getRecordAllocations());
+  auto startTime = std::chrono::steady_clock::now();
+  processingFailed = false;
   if (this->record->pact) {
     this->record->pact = false;
     processComplete();
+    // The response time is only set if the callback called
+    // markResponseReceived(), so we only record the latencies in this case.
+    if (responseTime > requestTime) {
+      auto now = std::chrono::steady_clock::now();
+      auto &statistics = connection->getStatistics();
+      statistics.recordLatency(ConnectionStatistics::Latency::completion,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now - responseTime).count());
+      statistics.recordLatency(ConnectionStatistics::Latency::total,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          now - requestTime).count());
+    }
   } else {
     if (processPrepare()) {
       this->record->pact = true;
+      requestTime = startTime;
     }
   }
+  NodeStatistics::Counters::add(nodeCounters->processingTime,
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - startTime).count());
+  OPEN62541_TRACE_PROCESS_END(this->record->name, this->record->pact,
+    !processingFailed);
+  return !processingFailed;
 }
 
 template<typename RecordType>
@@ -229,8 +361,23 @@ bool Open62541Record<RecordType>::scheduleProcessing() {
   // is seen by the callback function.
   // The callbackRequestProcessCallback function returns zero to indicate
   // success, so we have to invert the return value.
-  return !::callbackRequestProcessCallback(&this->processCallback,
+  bool success = !::callbackRequestProcessCallback(&this->processCallback,
       priorityMedium, this->record);
+  OPEN62541_TRACE_SCHEDULE_PROCESSING(this->record->name, success);
+  return success;
+}
+
+template<typename RecordType>
+void Open62541Record<RecordType>::setProcessingError(const char *operation,
+    UA_StatusCode statusCode, bool write) {
+  epicsEnum16 alarmStatus, alarmSeverity;
+  alarmForStatusCode(statusCode, write, alarmStatus, alarmSeverity);
+  recGblSetSevr(this->record, alarmStatus, alarmSeverity);
+  // When a server is not available, many records fail at the same time, so we
+  // do not print the message directly but let the aggregator decide.
+  ErrorLogAggregator::getInstance().logError(connection->getEndpointUrl(),
+    this->record->name, operation, statusCode);
+  processingFailed = true;
 }
 
 template<typename RecordType>
@@ -380,6 +527,8 @@ void Open62541Record<RecordType>::writeRecordValueGeneric(
 template<typename RecordType>
 Open62541RecordAddress Open62541Record<RecordType>::readRecordAddress(
     const ::DBLINK &addressField) {
+  StartupProfiler::PhaseTimer phaseTimer(
+    StartupProfiler::Phase::addressParsing);
   if (addressField.type != INST_IO) {
     throw std::runtime_error(
         "Invalid device address. Maybe mixed up INP/OUT or forgot '@'?");
@@ -31,6 +31,7 @@
 #include <cctype>
 #include <cinttypes>
 #include <climits>
+#include <cmath>
 #include <cstdio>
 #include <limits>
 #include <regex>
@@ -94,7 +95,42 @@ namespace {
     "[0-9A-Fa-f]{8}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{4}-[0-9A-Fa-f]{12}");
 } // anonymous namespace
 
-UaNodeId parseNodeId(const std::string &nodeIdString) {
+}
+
+Open62541RecordAddress::DataType Open62541RecordAddress::dataTypeForName(
+    const std::string &name) {
+  if (compareStringsIgnoreCase(name, "boolean")) {
+    return DataType::boolean;
+  } else if (compareStringsIgnoreCase(name, "sbyte")) {
+    return DataType::sbyte;
+  } else if (compareStringsIgnoreCase(name, "byte")) {
+    return DataType::byte;
+  } else if (compareStringsIgnoreCase(name, "int16")) {
+    return DataType::int16;
+  } else if (compareStringsIgnoreCase(name, "uint16")) {
+    return DataType::uint16;
+  } else if (compareStringsIgnoreCase(name, "int32")) {
+    return DataType::int32;
+  } else if (compareStringsIgnoreCase(name, "uint32")) {
+    return DataType::uint32;
+  } else if (compareStringsIgnoreCase(name, "int64")) {
+    return DataType::int64;
+  } else if (compareStringsIgnoreCase(name, "uint64")) {
+    return DataType::uint64;
+  } else if (compareStringsIgnoreCase(name, "float")) {
+    return DataType::floatType;
+  } else if (compareStringsIgnoreCase(name, "double")) {
+    return DataType::doubleType;
+  } else if (compareStringsIgnoreCase(name, "string")) {
+    return DataType::string;
+  } else if (compareStringsIgnoreCase(name, "byteString")) {
+    return DataType::byteString;
+  }
+  return DataType::unspecified;
+}
+
+UaNodeId Open62541RecordAddress::parseNodeId(
+    const std::string &nodeIdString) {
   if (startsWithIgnoreCase(nodeIdString, "guid:")) {
     auto commaPos = nodeIdString.find(',');
     if (commaPos == std::string::npos) {
@@ -217,14 +253,14 @@ UaNodeId parseNodeId(const std::string &nodeIdString) {
   }
 }
 
-}
-
 Open62541RecordAddress::Open62541RecordAddress(
     const std::string &addressString) :
+    argumentsMode(ArgumentsMode::value),
     conversionMode(ConversionMode::automatic), dataType(DataType::unspecified),
-    readOnInit(true),
+    maxRate(0.0), mergeMode(MergeMode::latest), overflowAlarm(false),
+    queueSize(1), readOnInit(true),
     samplingInterval(std::numeric_limits<double>::quiet_NaN()),
-    subscription("default") {
+    subscription("default"), suppressDuplicates(false) {
   const std::string delimiters(" \t\n\v\f\r");
   std::size_t tokenStart, tokenLength;
   // First, read the device name.
@@ -255,14 +291,36 @@ Open62541RecordAddress::Open62541RecordAddress(
   }
   // The optional options string starts with an opening parenthesis, a node ID
   // never does.
+  std::string objectIdString;
   if (addressString[tokenStart] == '(') {
     bool optionsStringComplete = false;
     std::string optionToken;
     for (auto i = tokenStart + 1; i < addressString.size(); ++i) {
       char c = addressString[i];
+      // The value of the object option is a node ID, which contains a comma
+      // between the namespace index and the identifier. This comma does not
+      // end the option.
+      if (c == ',' && startsWithIgnoreCase(trim(optionToken, delimiters),
+            "object=")
+          && optionToken.find(',') == std::string::npos) {
+        optionToken += c;
+        continue;
+      }
       if (c == ',' || c == ')') {
         optionToken = trim(optionToken, delimiters);
-        if (compareStringsIgnoreCase(optionToken, "no_read_on_init")) {
+        if (startsWithIgnoreCase(optionToken, "arguments=")) {
+          std::string optionValue = optionToken.substr(10);
+          if (compareStringsIgnoreCase(optionValue, "value")) {
+            argumentsMode = ArgumentsMode::value;
+          } else if (compareStringsIgnoreCase(optionValue, "elements")) {
+            argumentsMode = ArgumentsMode::elements;
+          } else if (compareStringsIgnoreCase(optionValue, "none")) {
+            argumentsMode = ArgumentsMode::none;
+          } else {
+            throw std::invalid_argument(
+                std::string("Invalid arguments mode: ") + optionValue);
+          }
+        } else if (compareStringsIgnoreCase(optionToken, "no_read_on_init")) {
           readOnInit = false;
         } else if (startsWithIgnoreCase(optionToken, "conversion_mode=")) {
           std::string optionValue = optionToken.substr(16);
@@ -275,6 +333,59 @@ Open62541RecordAddress::Open62541RecordAddress(
                 std::string("Unrecognized conversion mode in record address: ")
                     + optionValue);
           }
+        } else if (startsWithIgnoreCase(optionToken, "max_rate=")) {
+          std::string optionValue = optionToken.substr(9);
+          try {
+            std::size_t convertedLength;
+            this->maxRate = std::stod(optionValue, &convertedLength);
+            if (convertedLength != optionValue.length()) {
+              throw std::invalid_argument("Only partial string has been converted.");
+            }
+          } catch (std::invalid_argument&) {
+            throw std::invalid_argument(
+              std::string("Invalid max_rate: ") + optionValue);
+          }
+          if (!(this->maxRate >= 0.0) || std::isinf(this->maxRate)) {
+            throw std::invalid_argument(
+              std::string("Invalid max_rate: ") + optionValue);
+          }
+        } else if (startsWithIgnoreCase(optionToken, "merge=")) {
+          std::string optionValue = optionToken.substr(6);
+          if (compareStringsIgnoreCase(optionValue, "latest")) {
+            this->mergeMode = MergeMode::latest;
+          } else if (compareStringsIgnoreCase(optionValue, "min")) {
+            this->mergeMode = MergeMode::min;
+          } else if (compareStringsIgnoreCase(optionValue, "max")) {
+            this->mergeMode = MergeMode::max;
+          } else {
+            throw std::invalid_argument(
+                std::string("Unrecognized merge mode in record address: ")
+                    + optionValue);
+          }
+        } else if (startsWithIgnoreCase(optionToken, "object=")) {
+          objectIdString = optionToken.substr(7);
+        } else if (compareStringsIgnoreCase(optionToken, "overflow_alarm")) {
+          overflowAlarm = true;
+        } else if (startsWithIgnoreCase(optionToken, "queue_size=")) {
+          std::string optionValue = optionToken.substr(11);
+          unsigned long parsedQueueSize;
+          try {
+            std::size_t convertedLength;
+            parsedQueueSize = std::stoul(optionValue, &convertedLength);
+            if (convertedLength != optionValue.length()) {
+              throw std::invalid_argument("Only partial string has been converted.");
+            }
+          } catch (std::logic_error&) {
+            throw std::invalid_argument(
+              std::string("Invalid queue_size: ") + optionValue);
+          }
+          if (parsedQueueSize < 1 || parsedQueueSize
+              > std::numeric_limits<std::uint32_t>::max()
+              || optionValue[0] == '-') {
+            throw std::invalid_argument(
+              std::string("Invalid queue_size: ") + optionValue);
+          }
+          this->queueSize = static_cast<std::uint32_t>(parsedQueueSize);
         } else if (startsWithIgnoreCase(optionToken, "sampling_interval=")) {
           std::string optionValue = optionToken.substr(18);
           try {
@@ -290,6 +401,9 @@ Open62541RecordAddress::Open62541RecordAddress(
         } else if (startsWithIgnoreCase(optionToken, "subscription=")) {
           std::string optionValue = optionToken.substr(13);
           this->subscription = optionValue;
+        } else if (compareStringsIgnoreCase(optionToken,
+            "suppress_duplicates")) {
+          suppressDuplicates = true;
         } else if (i != tokenStart + 1) {
           // An empty options token is only allowed if the whole options string
           // is empty.
@@ -377,33 +491,8 @@ Open62541RecordAddress::Open62541RecordAddress(
       tokenStart + tokenLength);
   if (tokenStart != std::string::npos) {
     std::string dataTypeString = addressString.substr(tokenStart, tokenLength);
-    if (compareStringsIgnoreCase(dataTypeString, "boolean")) {
-      dataType = DataType::boolean;
-    } else if (compareStringsIgnoreCase(dataTypeString, "sbyte")) {
-      dataType = DataType::sbyte;
-    } else if (compareStringsIgnoreCase(dataTypeString, "byte")) {
-      dataType = DataType::byte;
-    } else if (compareStringsIgnoreCase(dataTypeString, "int16")) {
-      dataType = DataType::int16;
-    } else if (compareStringsIgnoreCase(dataTypeString, "uint16")) {
-      dataType = DataType::uint16;
-    } else if (compareStringsIgnoreCase(dataTypeString, "int32")) {
-      dataType = DataType::int32;
-    } else if (compareStringsIgnoreCase(dataTypeString, "uint32")) {
-      dataType = DataType::uint32;
-    } else if (compareStringsIgnoreCase(dataTypeString, "int64")) {
-      dataType = DataType::int64;
-    } else if (compareStringsIgnoreCase(dataTypeString, "uint64")) {
-      dataType = DataType::uint64;
-    } else if (compareStringsIgnoreCase(dataTypeString, "float")) {
-      dataType = DataType::floatType;
-    } else if (compareStringsIgnoreCase(dataTypeString, "double")) {
-      dataType = DataType::doubleType;
-    } else if (compareStringsIgnoreCase(dataTypeString, "string")) {
-      dataType = DataType::string;
-    } else if (compareStringsIgnoreCase(dataTypeString, "byteString")) {
-      dataType = DataType::byteString;
-    } else {
+    dataType = dataTypeForName(dataTypeString);
+    if (dataType == DataType::unspecified) {
       throw std::invalid_argument(
           "Invalid data type in record address: " + dataTypeString);
     }
@@ -416,8 +505,11 @@ Open62541RecordAddress::Open62541RecordAddress(
         "Invalid trailing data at end of record address: "
             + addressString.substr(tokenStart, tokenLength));
   }
-  // Finally, we parse the node ID.
+  // Finally, we parse the node ID (and the object ID if there is one).
   this->nodeId = parseNodeId(nodeIdString);
+  if (!objectIdString.empty()) {
+    this->objectId = parseNodeId(objectIdString);
+  }
 }
 
 }
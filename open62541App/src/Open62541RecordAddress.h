@@ -49,6 +49,30 @@ class Open62541RecordAddress {
 
 public:
 
+  /**
+   * Mode that defines how the value of an output record is passed to a method
+   * when the record calls a method.
+   */
+  enum class ArgumentsMode {
+
+    /**
+     * The value is passed as the only input argument.
+     */
+    value,
+
+    /**
+     * Each element of an array value is passed as a separate input argument
+     * (a scalar value is passed as the only input argument).
+     */
+    elements,
+
+    /**
+     * The method is called without input arguments.
+     */
+    none
+
+  };
+
   /**
    * Conversion mode for ai / ao records.
    */
@@ -149,6 +173,36 @@ public:
 
   };
 
+  /**
+   * Merge mode for notifications that arrive faster than the max. update rate
+   * of a record.
+   */
+  enum class MergeMode {
+
+    /**
+     * Use the value from the latest notification.
+     */
+    latest,
+
+    /**
+     * Use the smallest value received since the record was last processed.
+     */
+    min,
+
+    /**
+     * Use the largest value received since the record was last processed.
+     */
+    max
+
+  };
+
+  /**
+   * Returns the data type with the specified name, as it is used in record
+   * addresses (e.g. "int32"). The comparison is case insensitive. If the name
+   * does not specify a data type, DataType::unspecified is returned.
+   */
+  static DataType dataTypeForName(const std::string &name);
+
   /**
    * Returns the name of a data type.
    */
@@ -185,12 +239,28 @@ public:
     }
   }
 
+  /**
+   * Parses a node ID in the format used by record addresses (e.g.
+   * "str:1,my.node" or "num:2,1234"). Throws an std::invalid_argument if the
+   * string does not specify a valid node ID.
+   */
+  static UaNodeId parseNodeId(const std::string &nodeIdString);
+
   /**
    * Creates a record address from a string. Throws an std::invalid_argument
    * exception if the address string does not specify a valid address.
    */
   Open62541RecordAddress(const std::string &addressString);
 
+  /**
+   * Returns the mode that defines how the record's value is passed to the
+   * method when the record calls a method. If the address does not specify
+   * this mode, ArgumentsMode::value is returned.
+   */
+  inline ArgumentsMode getArgumentsMode() const {
+    return argumentsMode;
+  }
+
   /**
    * Returns the string identifying the connection.
    */
@@ -212,6 +282,24 @@ public:
     return dataType;
   }
 
+  /**
+   * Returns the max. rate (in Hz) at which a record operating in monitoring
+   * mode is processed. Notifications that arrive more quickly are merged
+   * according to the merge mode. Zero means that the rate is not limited.
+   */
+  inline double getMaxRate() const {
+    return maxRate;
+  }
+
+  /**
+   * Returns the mode used for merging notifications that arrive more quickly
+   * than allowed by the max. rate. If the address does not specify a merge
+   * mode, MergeMode::latest is returned.
+   */
+  inline MergeMode getMergeMode() const {
+    return mergeMode;
+  }
+
   /**
    * Returns the node ID of the node to which the record is mapped..
    */
@@ -219,6 +307,27 @@ public:
     return nodeId;
   }
 
+  /**
+   * Returns the node ID of the object on which the method identified by the
+   * node ID is called. If the address does not specify an object, a null node
+   * ID is returned, and the record reads or writes the node instead of calling
+   * a method.
+   */
+  inline const UaNodeId &getObjectId() const {
+    return objectId;
+  }
+
+  /**
+   * Returns the size of the queue that the server shall use for the monitored
+   * item. For output records or input records that do not operate in
+   * monitoring mode, this setting does not have any effects.
+   *
+   * If the address does not specify a queue size, one is returned.
+   */
+  inline std::uint32_t getQueueSize() const {
+    return queueSize;
+  }
+
   /**
    * Returns the sampling interval (in millisecond) that shall be used when
    * monitoring the node. For output records or input records that do not
@@ -244,6 +353,35 @@ public:
     return subscription;
   }
 
+  /**
+   * Tells whether the record calls a method instead of writing to a node.
+   * This is the case when the address specifies an object.
+   */
+  inline bool isMethodCall() const {
+    return static_cast<bool>(objectId);
+  }
+
+  /**
+   * Tells whether the record shall be put into a minor alarm state when a
+   * notification signals that values have been lost because the queue of the
+   * monitored item on the server overflowed. For output records or input
+   * records that do not operate in monitoring mode, this setting does not have
+   * any effects.
+   */
+  inline bool isOverflowAlarm() const {
+    return overflowAlarm;
+  }
+
+  /**
+   * Tells whether notifications that carry the same value as the last one
+   * shall be discarded without processing the record. For output records or
+   * input records that do not operate in monitoring mode, this setting does
+   * not have any effects.
+   */
+  inline bool isSuppressDuplicates() const {
+    return suppressDuplicates;
+  }
+
   /**
    * Tells whether the record should be initialized with the value read from the
    * device. If <code>true</code>, the current value is read once during record
@@ -255,13 +393,20 @@ public:
 
 private:
 
+  ArgumentsMode argumentsMode;
   std::string connectionId;
   ConversionMode conversionMode;
   DataType dataType;
+  double maxRate;
+  MergeMode mergeMode;
   UaNodeId nodeId;
+  UaNodeId objectId;
+  bool overflowAlarm;
+  std::uint32_t queueSize;
   bool readOnInit;
   double samplingInterval;
   std::string subscription;
+  bool suppressDuplicates;
 
 };
 
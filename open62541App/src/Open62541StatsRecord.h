@@ -0,0 +1,111 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_STATS_RECORD_H
+#define OPEN62541_EPICS_STATS_RECORD_H
+
+#include <stdexcept>
+
+#include <aiRecord.h>
+#include <dbCommon.h>
+#include <link.h>
+#include <longinRecord.h>
+
+#include "StatisticSource.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Device support class for records that publish the statistics of a server
+ * connection ("open62541 stats" device type). In contrast to the other device
+ * support classes, processing is always synchronous.
+ */
+template<typename RecordType>
+class Open62541StatsRecord {
+
+public:
+
+  /**
+   * Creates an instance of the device support for the specified record.
+   */
+  Open62541StatsRecord(RecordType *record) : record(record),
+      source(readAddress(record->inp)) {
+  }
+
+  /**
+   * Called once when the record is initialized. Does nothing, because there
+   * is nothing to be initialized.
+   */
+  void initializeRecord() {
+  }
+
+  /**
+   * Updates the record's value with the current value of the statistic.
+   * Returns the value that shall be returned by the read function of the
+   * device support.
+   */
+  long processStatsRecord() {
+    long result = writeValue(record, source.read());
+    record->udf = 0;
+    return result;
+  }
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  Open62541StatsRecord(const Open62541StatsRecord &) = delete;
+  Open62541StatsRecord(Open62541StatsRecord &&) = delete;
+  Open62541StatsRecord &operator=(const Open62541StatsRecord &) = delete;
+  Open62541StatsRecord &operator=(Open62541StatsRecord &&) = delete;
+
+  RecordType *record;
+  StatisticSource source;
+
+  static std::string readAddress(const ::DBLINK &addressField) {
+    if (addressField.type != INST_IO) {
+      throw std::runtime_error(
+          "Invalid device address. Maybe mixed up INP/OUT or forgot '@'?");
+    }
+    return addressField.value.instio.string == nullptr ?
+      "" : addressField.value.instio.string;
+  }
+
+  // For the ai record, we write to the VAL field directly and return 2, so
+  // that the record does not apply any conversion.
+  static long writeValue(::aiRecord *record, double value) {
+    record->val = value;
+    return 2;
+  }
+
+  static long writeValue(::longinRecord *record, double value) {
+    record->val = static_cast<epicsInt32>(value);
+    return 0;
+  }
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_STATS_RECORD_H
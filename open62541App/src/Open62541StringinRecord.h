@@ -58,6 +58,14 @@ public:
 
 protected:
 
+  /**
+   * Returns a scalar string, because this record cannot use numeric values.
+   */
+  virtual std::pair<Open62541RecordAddress::DataType, std::size_t>
+      getDefaultNodeType() const {
+    return std::make_pair(Open62541RecordAddress::DataType::string, 0);
+  }
+
   /**
    * Validates the record address. In contrast to the implementation in the
    * parent class, this implementation checks that a data type supported by this
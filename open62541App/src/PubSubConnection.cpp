@@ -0,0 +1,1024 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "ErrorLogAggregator.h"
+#include "UaException.h"
+
+#include "PubSubConnection.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+const std::string endpointUrlPrefix = "opc.udp://";
+
+// Port that is used if the endpoint URL does not specify a port. This is the
+// port registered for OPC UA by IANA.
+constexpr unsigned short defaultPort = 4840;
+
+// A UDP datagram cannot be larger than this, so the receive buffer never has
+// to grow.
+constexpr std::size_t maxMessageSize = 65536;
+
+// Maximum payload of a UDP datagram sent over IPv4.
+constexpr std::size_t maxSendSize = 65507;
+
+// Maximum number of data set messages in a network message (the count in the
+// payload header is a single byte).
+constexpr std::size_t maxDataSetWriters = 255;
+
+// Binary encoding of an empty variant. It is sent for the fields that have not
+// been written yet.
+constexpr unsigned char emptyVariantEncoding = 0;
+
+// We ask for a large socket receive buffer, so that bursts of messages are
+// not lost while the receive thread is busy dispatching notifications. The
+// operating system may limit the size to a smaller value.
+constexpr int socketReceiveBufferSize = 4 * 1024 * 1024;
+
+// The receive thread waits at most this long for a message before checking
+// whether it should stop.
+constexpr long receiveTimeoutMicroseconds = 100000;
+
+// Bits of the flags in the network message header and in the data set message
+// header, as defined by the UADP message mapping (OPC UA part 14).
+constexpr UA_Byte uadpVersionMask = 0x0F;
+constexpr UA_Byte uadpFlagPublisherId = 0x10;
+constexpr UA_Byte uadpFlagGroupHeader = 0x20;
+constexpr UA_Byte uadpFlagPayloadHeader = 0x40;
+constexpr UA_Byte uadpFlagExtendedFlags1 = 0x80;
+constexpr UA_Byte extendedFlags1PublisherIdTypeMask = 0x07;
+constexpr UA_Byte extendedFlags1DataSetClassId = 0x08;
+constexpr UA_Byte extendedFlags1Security = 0x10;
+constexpr UA_Byte extendedFlags1Timestamp = 0x20;
+constexpr UA_Byte extendedFlags1PicoSeconds = 0x40;
+constexpr UA_Byte extendedFlags1ExtendedFlags2 = 0x80;
+constexpr UA_Byte extendedFlags2Chunk = 0x01;
+constexpr UA_Byte extendedFlags2PromotedFields = 0x02;
+constexpr UA_Byte extendedFlags2MessageTypeMask = 0x1C;
+constexpr UA_Byte groupFlagWriterGroupId = 0x01;
+constexpr UA_Byte groupFlagGroupVersion = 0x02;
+constexpr UA_Byte groupFlagNetworkMessageNumber = 0x04;
+constexpr UA_Byte groupFlagSequenceNumber = 0x08;
+constexpr UA_Byte dataSetFlags1Valid = 0x01;
+constexpr UA_Byte dataSetFlags1FieldEncodingMask = 0x06;
+constexpr UA_Byte dataSetFlags1SequenceNumber = 0x08;
+constexpr UA_Byte dataSetFlags1Status = 0x10;
+constexpr UA_Byte dataSetFlags1MajorVersion = 0x20;
+constexpr UA_Byte dataSetFlags1MinorVersion = 0x40;
+constexpr UA_Byte dataSetFlags1DataSetFlags2 = 0x80;
+constexpr UA_Byte dataSetFlags2MessageTypeMask = 0x0F;
+constexpr UA_Byte dataSetFlags2Timestamp = 0x10;
+constexpr UA_Byte dataSetFlags2PicoSeconds = 0x20;
+
+enum class FieldEncoding {
+  variant = 0,
+  rawData = 1,
+  dataValue = 2
+};
+
+enum class DataSetMessageType {
+  keyFrame = 0,
+  deltaFrame = 1,
+  event = 2,
+  keepAlive = 3
+};
+
+/**
+ * Reads the little-endian encoded values of a UADP message. Throws an
+ * std::runtime_error if the message is shorter than expected.
+ */
+class UadpReader {
+
+public:
+
+  UadpReader(const unsigned char *data, std::size_t length) :
+      data(data), length(length), offset(0) {
+  }
+
+  inline std::size_t getRemaining() const {
+    return length - offset;
+  }
+
+  UA_Byte readByte() {
+    require(1);
+    return data[offset++];
+  }
+
+  template<typename T>
+  void readEncoded(T &value, const UA_DataType &type) {
+    UA_ByteString buffer;
+    buffer.data = const_cast<UA_Byte *>(data + offset);
+    buffer.length = length - offset;
+    if (UA_decodeBinary(&buffer, &value, &type, nullptr)
+        != UA_STATUSCODE_GOOD) {
+      throw std::runtime_error(
+        std::string("Could not decode ") + type.typeName + ".");
+    }
+    // UA_decodeBinary does not tell how many bytes it has consumed, but the
+    // encoded size of the decoded value is the same.
+    offset += UA_calcSizeBinary(&value, &type);
+  }
+
+  std::string readString() {
+    auto stringLength = static_cast<UA_Int32>(readUInt32());
+    if (stringLength <= 0) {
+      return std::string();
+    }
+    require(stringLength);
+    std::string result(
+      reinterpret_cast<const char *>(data + offset), stringLength);
+    offset += stringLength;
+    return result;
+  }
+
+  UA_UInt16 readUInt16() {
+    return static_cast<UA_UInt16>(readUnsigned(2));
+  }
+
+  UA_UInt32 readUInt32() {
+    return static_cast<UA_UInt32>(readUnsigned(4));
+  }
+
+  UA_UInt64 readUInt64() {
+    return readUnsigned(8);
+  }
+
+  void skip(std::size_t bytes) {
+    require(bytes);
+    offset += bytes;
+  }
+
+private:
+
+  const unsigned char *data;
+  std::size_t length;
+  std::size_t offset;
+
+  UA_UInt64 readUnsigned(std::size_t bytes) {
+    require(bytes);
+    UA_UInt64 value = 0;
+    for (std::size_t i = 0; i < bytes; ++i) {
+      value |= static_cast<UA_UInt64>(data[offset + i]) << (8 * i);
+    }
+    offset += bytes;
+    return value;
+  }
+
+  inline void require(std::size_t bytes) {
+    if (length - offset < bytes) {
+      throw std::runtime_error("Message is truncated.");
+    }
+  }
+
+};
+
+void appendUInt16(std::vector<unsigned char> &buffer, UA_UInt16 value) {
+  buffer.push_back(static_cast<unsigned char>(value));
+  buffer.push_back(static_cast<unsigned char>(value >> 8));
+}
+
+void storeUInt16(unsigned char *destination, UA_UInt16 value) {
+  destination[0] = static_cast<unsigned char>(value);
+  destination[1] = static_cast<unsigned char>(value >> 8);
+}
+
+void storeUInt64(unsigned char *destination, UA_UInt64 value) {
+  for (int i = 0; i < 8; ++i) {
+    destination[i] = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+std::string getSocketErrorString() {
+  char buffer[128];
+  epicsSocketConvertErrnoToString(buffer, sizeof(buffer));
+  return buffer;
+}
+
+} // anonymous namespace
+
+PubSubConnection::PubSubConnection(const std::string &endpointUrl,
+    const std::string &networkInterface, const std::string &publisherId) :
+    decodingErrors(0), endpointUrl(endpointUrl), ignoredMessages(0),
+    missedCycles(0), networkMessageValid(false),
+    networkMessageSequenceNumberOffset(0), networkMessageTimestampOffset(0),
+    publisherId(publisherId), receivedBytes(0), receivedDataSetMessages(0),
+    receivedMessages(0), recordAllocations("records"), sendErrors(0),
+    sentBytes(0), sentMessages(0), shutdownRequested(false),
+    socket(INVALID_SOCKET), usedDataSetWriters(65536, false),
+    writerGroupId(0), writerGroupPublisherId(0),
+    writerGroupPublishingInterval(0.0), writerGroupSequenceNumber(0) {
+  if (endpointUrl.compare(
+      0, endpointUrlPrefix.size(), endpointUrlPrefix) != 0) {
+    throw std::invalid_argument(
+      "The endpoint URL must start with \"" + endpointUrlPrefix + "\".");
+  }
+  auto address = endpointUrl.substr(endpointUrlPrefix.size());
+  if (!address.empty() && address.back() == '/') {
+    address.pop_back();
+  }
+  openSocket(address, networkInterface);
+  // There is no session that could be lost, so code checking the connection
+  // state should behave like it does for a healthy server connection.
+  statistics.setConnected(true);
+  receiveThread = std::thread([this]() {runReceiveThread();});
+}
+
+PubSubConnection::~PubSubConnection() {
+  {
+    // We set the flag while holding the mutex, so that the writer group thread
+    // cannot miss the notification.
+    std::lock_guard<std::mutex> lock(writerGroupMutex);
+    shutdownRequested.store(true, std::memory_order_relaxed);
+  }
+  writerGroupCv.notify_all();
+  if (writerGroupThread.joinable()) {
+    writerGroupThread.join();
+  }
+  if (receiveThread.joinable()) {
+    receiveThread.join();
+  }
+  epicsSocketDestroy(socket);
+  osiSockRelease();
+}
+
+void PubSubConnection::addMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback,
+    double samplingInterval, std::uint32_t queueSize, bool discardOldest) {
+  Notification initialNotification;
+  initialNotification.field = nullptr;
+  UA_StatusCode failureStatus = UA_STATUSCODE_GOOD;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &subscriptionStatisticsEntry =
+      subscriptionStatistics[subscriptionName];
+    if (!subscriptionStatisticsEntry) {
+      subscriptionStatisticsEntry = std::make_shared<SubscriptionStatistics>();
+    }
+    Field *field;
+    try {
+      field = &getField(nodeId);
+    } catch (const UaException &e) {
+      startupStatistics.countMonitoredItemFailed();
+      failureStatus = e.getStatusCode();
+      field = nullptr;
+    }
+    if (field) {
+      for (auto &existingItem : *field->monitoredItems) {
+        if (existingItem.callback == callback
+            && existingItem.subscriptionName == subscriptionName) {
+          return;
+        }
+      }
+      MonitoredItem monitoredItem = {
+        callback, subscriptionStatisticsEntry, subscriptionName};
+      auto monitoredItems =
+        std::make_shared<MonitoredItemList>(*field->monitoredItems);
+      monitoredItems->push_back(monitoredItem);
+      field->monitoredItems = std::move(monitoredItems);
+      startupStatistics.countMonitoredItemCreated();
+      // Like a monitored item created on a server, the new monitored item
+      // receives the current value right away (if there is one).
+      if (field->status == UA_STATUSCODE_GOOD) {
+        initialNotification.field = field;
+        initialNotification.monitoredItems =
+          std::make_shared<const MonitoredItemList>(1, monitoredItem);
+        initialNotification.status = UA_STATUSCODE_GOOD;
+        initialNotification.value = field->value;
+      }
+    }
+  }
+  if (failureStatus != UA_STATUSCODE_GOOD) {
+    callback->failure(nodeId, failureStatus);
+  } else if (initialNotification.field) {
+    dispatchNotification(initialNotification);
+  }
+}
+
+std::shared_ptr<SubscriptionStatistics>
+    PubSubConnection::getSubscriptionStatistics(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &result = subscriptionStatistics[name];
+  if (!result) {
+    result = std::make_shared<SubscriptionStatistics>();
+  }
+  return result;
+}
+
+void PubSubConnection::callAsync(const UaNodeId &objectId,
+    const UaNodeId &methodId, const std::vector<UaVariant> &inputArguments,
+    std::shared_ptr<CallCallback> callback) {
+  // PubSub does not have a way of calling methods.
+  statistics.increment(ConnectionStatistics::Counter::calls);
+  statistics.increment(ConnectionStatistics::Counter::callFailures);
+  callback->failure(methodId, UA_STATUSCODE_BADNOTSUPPORTED);
+}
+
+UaVariant PubSubConnection::read(const UaNodeId &nodeId) {
+  statistics.increment(ConnectionStatistics::Counter::reads);
+  std::lock_guard<std::mutex> lock(mutex);
+  Field *field;
+  try {
+    field = &getField(nodeId);
+  } catch (const UaException &) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+    throw;
+  }
+  NodeStatistics::Counters::add(field->counters->reads, 1);
+  if (field->status != UA_STATUSCODE_GOOD) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+    throw UaException(field->status);
+  }
+  return field->value;
+}
+
+void PubSubConnection::readAsync(const UaNodeId &nodeId,
+    std::shared_ptr<ReadCallback> callback) {
+  UaVariant value;
+  UA_StatusCode status;
+  try {
+    value = read(nodeId);
+    status = UA_STATUSCODE_GOOD;
+  } catch (const UaException &e) {
+    status = e.getStatusCode();
+  }
+  if (status == UA_STATUSCODE_GOOD) {
+    callback->success(nodeId, value);
+  } else {
+    callback->failure(nodeId, status);
+  }
+}
+
+void PubSubConnection::removeMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Field *field;
+  try {
+    field = &getField(nodeId);
+  } catch (const UaException &) {
+    return;
+  }
+  auto monitoredItems = std::make_shared<MonitoredItemList>();
+  for (auto &monitoredItem : *field->monitoredItems) {
+    if (monitoredItem.callback != callback
+        || monitoredItem.subscriptionName != subscriptionName) {
+      monitoredItems->push_back(monitoredItem);
+    }
+  }
+  field->monitoredItems = std::move(monitoredItems);
+}
+
+double PubSubConnection::getWriterGroupPublishingInterval() {
+  std::lock_guard<std::mutex> lock(writerGroupMutex);
+  return writerGroupPublishingInterval;
+}
+
+void PubSubConnection::setupWriterGroup(UA_UInt16 publisherId,
+    UA_UInt16 writerGroupId, double publishingInterval) {
+  if (!(publishingInterval > 0.0)) {
+    throw std::invalid_argument("The publishing interval must be positive.");
+  }
+  std::lock_guard<std::mutex> lock(writerGroupMutex);
+  if (writerGroupPublishingInterval > 0.0) {
+    throw std::logic_error("The writer group has already been set up.");
+  }
+  this->writerGroupId = writerGroupId;
+  writerGroupPublisherId = publisherId;
+  writerGroupPublishingInterval = publishingInterval;
+  // The network message never grows beyond this size, so its memory is only
+  // allocated once.
+  networkMessage.reserve(maxMessageSize);
+  writerGroupThread = std::thread([this]() {runWriterGroupThread();});
+}
+
+void PubSubConnection::writeAsync(const UaNodeId &nodeId,
+    const UaVariant &value, std::shared_ptr<WriteCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::writes);
+  const UA_NodeId &id = nodeId.get();
+  UA_StatusCode status = UA_STATUSCODE_GOOD;
+  {
+    std::lock_guard<std::mutex> lock(writerGroupMutex);
+    DataSetWriter *dataSetWriter = nullptr;
+    if (writerGroupPublishingInterval <= 0.0) {
+      status = UA_STATUSCODE_BADNOTWRITABLE;
+    } else if (id.identifierType != UA_NODEIDTYPE_NUMERIC
+        || id.identifier.numeric > 0xFFFF) {
+      status = UA_STATUSCODE_BADNODEIDINVALID;
+    } else {
+      for (auto &existingWriter : dataSetWriters) {
+        if (existingWriter.dataSetWriterId == id.namespaceIndex) {
+          dataSetWriter = &existingWriter;
+          break;
+        }
+      }
+      if (!dataSetWriter && dataSetWriters.size() == maxDataSetWriters) {
+        status = UA_STATUSCODE_BADTOOMANYOPERATIONS;
+      } else if (!dataSetWriter) {
+        dataSetWriters.emplace_back();
+        dataSetWriter = &dataSetWriters.back();
+        dataSetWriter->dataSetWriterId = id.namespaceIndex;
+        dataSetWriter->sequenceNumberOffset = 0;
+      }
+    }
+    if (dataSetWriter) {
+      auto &fields = dataSetWriter->fields;
+      std::size_t fieldIndex = id.identifier.numeric;
+      // Adding a field changes the layout of the network message.
+      if (fields.size() <= fieldIndex) {
+        PublishedField emptyField;
+        emptyField.counters = nullptr;
+        emptyField.encodedValue.assign(1, emptyVariantEncoding);
+        emptyField.offset = 0;
+        fields.resize(fieldIndex + 1, emptyField);
+        networkMessageValid = false;
+      }
+      auto &field = fields[fieldIndex];
+      if (!field.counters) {
+        field.counters = &nodeStatistics.intern(nodeId);
+      }
+      auto &encodedValue = field.encodedValue;
+      auto size = UA_calcSizeBinary(&value.get(), &UA_TYPES[UA_TYPES_VARIANT]);
+      bool sizeChanged = size != encodedValue.size();
+      encodedValue.resize(size);
+      UA_ByteString buffer;
+      buffer.data = encodedValue.data();
+      buffer.length = size;
+      status = UA_encodeBinary(
+        &value.get(), &UA_TYPES[UA_TYPES_VARIANT], &buffer);
+      if (status != UA_STATUSCODE_GOOD) {
+        encodedValue.assign(1, emptyVariantEncoding);
+        networkMessageValid = false;
+      } else if (sizeChanged) {
+        networkMessageValid = false;
+      } else if (networkMessageValid) {
+        // The layout has not changed, so the value can be copied into the
+        // network message directly.
+        std::memcpy(networkMessage.data() + field.offset,
+          encodedValue.data(), size);
+      }
+      if (status == UA_STATUSCODE_GOOD) {
+        NodeStatistics::Counters::add(field.counters->writes, 1);
+        NodeStatistics::Counters::add(field.counters->bytes, size);
+      }
+    }
+  }
+  if (status == UA_STATUSCODE_GOOD) {
+    callback->success(nodeId);
+  } else {
+    statistics.increment(ConnectionStatistics::Counter::writeFailures);
+    callback->failure(nodeId, status);
+  }
+}
+
+void PubSubConnection::buildNetworkMessage() {
+  auto &message = networkMessage;
+  message.clear();
+  message.push_back(1 | uadpFlagPublisherId | uadpFlagGroupHeader
+    | uadpFlagPayloadHeader | uadpFlagExtendedFlags1);
+  // The publisher ID type 1 means UInt16.
+  message.push_back(1 | extendedFlags1Timestamp);
+  appendUInt16(message, writerGroupPublisherId);
+  message.push_back(groupFlagWriterGroupId | groupFlagSequenceNumber);
+  appendUInt16(message, writerGroupId);
+  networkMessageSequenceNumberOffset = message.size();
+  appendUInt16(message, 0);
+  auto count = dataSetWriters.size();
+  message.push_back(static_cast<unsigned char>(count));
+  for (auto &dataSetWriter : dataSetWriters) {
+    appendUInt16(message, dataSetWriter.dataSetWriterId);
+  }
+  networkMessageTimestampOffset = message.size();
+  message.resize(message.size() + 8);
+  // The sizes of the data set messages are only present if there is more than
+  // one data set message. We fill them in when we know the sizes.
+  auto sizesOffset = message.size();
+  if (count > 1) {
+    message.resize(message.size() + 2 * count);
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    auto &dataSetWriter = dataSetWriters[i];
+    auto dataSetMessageOffset = message.size();
+    // A valid key frame with variant field encoding and a sequence number.
+    message.push_back(dataSetFlags1Valid | dataSetFlags1SequenceNumber);
+    dataSetWriter.sequenceNumberOffset = message.size();
+    appendUInt16(message, 0);
+    appendUInt16(message,
+      static_cast<UA_UInt16>(dataSetWriter.fields.size()));
+    for (auto &field : dataSetWriter.fields) {
+      field.offset = message.size();
+      message.insert(message.end(), field.encodedValue.begin(),
+        field.encodedValue.end());
+    }
+    if (count > 1) {
+      storeUInt16(message.data() + sizesOffset + 2 * i,
+        static_cast<UA_UInt16>(message.size() - dataSetMessageOffset));
+    }
+  }
+  networkMessageValid = true;
+}
+
+void PubSubConnection::decodeNetworkMessage(const unsigned char *data,
+    std::size_t length, std::vector<Notification> &notifications) {
+  UadpReader reader(data, length);
+  auto flags = reader.readByte();
+  if ((flags & uadpVersionMask) != 1) {
+    throw std::runtime_error("Unsupported UADP version.");
+  }
+  UA_Byte extendedFlags1 = 0;
+  UA_Byte extendedFlags2 = 0;
+  if (flags & uadpFlagExtendedFlags1) {
+    extendedFlags1 = reader.readByte();
+  }
+  if (extendedFlags1 & extendedFlags1ExtendedFlags2) {
+    extendedFlags2 = reader.readByte();
+  }
+  if (extendedFlags2 & extendedFlags2Chunk) {
+    throw std::runtime_error("Chunked messages are not supported.");
+  }
+  // Discovery requests and responses do not carry any data.
+  if (extendedFlags2 & extendedFlags2MessageTypeMask) {
+    ignoredMessages.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (flags & uadpFlagPublisherId) {
+    std::string messagePublisherId;
+    switch (extendedFlags1 & extendedFlags1PublisherIdTypeMask) {
+    case 0:
+      messagePublisherId = std::to_string(reader.readByte());
+      break;
+    case 1:
+      messagePublisherId = std::to_string(reader.readUInt16());
+      break;
+    case 2:
+      messagePublisherId = std::to_string(reader.readUInt32());
+      break;
+    case 3:
+      messagePublisherId = std::to_string(reader.readUInt64());
+      break;
+    case 4:
+      messagePublisherId = reader.readString();
+      break;
+    default:
+      throw std::runtime_error("Invalid publisher ID type.");
+    }
+    if (!publisherId.empty() && messagePublisherId != publisherId) {
+      ignoredMessages.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } else if (!publisherId.empty()) {
+    ignoredMessages.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (extendedFlags1 & extendedFlags1DataSetClassId) {
+    reader.skip(16);
+  }
+  if (flags & uadpFlagGroupHeader) {
+    auto groupFlags = reader.readByte();
+    if (groupFlags & groupFlagWriterGroupId) {
+      reader.skip(2);
+    }
+    if (groupFlags & groupFlagGroupVersion) {
+      reader.skip(4);
+    }
+    if (groupFlags & groupFlagNetworkMessageNumber) {
+      reader.skip(2);
+    }
+    if (groupFlags & groupFlagSequenceNumber) {
+      reader.skip(2);
+    }
+  }
+  if (!(flags & uadpFlagPayloadHeader)) {
+    throw std::runtime_error(
+      "Messages without a payload header are not supported.");
+  }
+  std::size_t count = reader.readByte();
+  UA_UInt16 dataSetWriterIds[255];
+  for (std::size_t i = 0; i < count; ++i) {
+    dataSetWriterIds[i] = reader.readUInt16();
+  }
+  if (extendedFlags1 & extendedFlags1Timestamp) {
+    reader.skip(8);
+  }
+  if (extendedFlags1 & extendedFlags1PicoSeconds) {
+    reader.skip(2);
+  }
+  if (extendedFlags2 & extendedFlags2PromotedFields) {
+    reader.skip(reader.readUInt16());
+  }
+  if (extendedFlags1 & extendedFlags1Security) {
+    throw std::runtime_error(
+      "Signed or encrypted messages are not supported.");
+  }
+  // The sizes are only present if there is more than one data set message. A
+  // single data set message fills the rest of the network message.
+  UA_UInt16 sizes[255];
+  for (std::size_t i = 0; count > 1 && i < count; ++i) {
+    sizes[i] = reader.readUInt16();
+  }
+  if (count == 1) {
+    if (reader.getRemaining() > 0xFFFF) {
+      throw std::runtime_error("Data set message is too large.");
+    }
+    sizes[0] = static_cast<UA_UInt16>(reader.getRemaining());
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    auto dataSetMessageOffset = length - reader.getRemaining();
+    // Skipping the data set message first ensures that it is complete.
+    reader.skip(sizes[i]);
+    auto dataSetWriterId = dataSetWriterIds[i];
+    if (!usedDataSetWriters[dataSetWriterId]) {
+      continue;
+    }
+    receivedDataSetMessages.fetch_add(1, std::memory_order_relaxed);
+    // The fields of a data set message that cannot be decoded completely are
+    // not used, so that records never see a mix of old and new values.
+    auto firstNotification = notifications.size();
+    try {
+      decodeDataSetMessage(data + dataSetMessageOffset, sizes[i],
+        dataSetWriterId, notifications);
+    } catch (...) {
+      notifications.erase(
+        notifications.begin() + firstNotification, notifications.end());
+      throw;
+    }
+  }
+}
+
+void PubSubConnection::decodeDataSetMessage(const unsigned char *data,
+    std::size_t length, UA_UInt16 dataSetWriterId,
+    std::vector<Notification> &notifications) {
+  UadpReader dataSetReader(data, length);
+  auto dataSetFlags1 = dataSetReader.readByte();
+  if (!(dataSetFlags1 & dataSetFlags1Valid)) {
+    return;
+  }
+  auto fieldEncoding = static_cast<FieldEncoding>(
+    (dataSetFlags1 & dataSetFlags1FieldEncodingMask) >> 1);
+  UA_Byte dataSetFlags2 = 0;
+  if (dataSetFlags1 & dataSetFlags1DataSetFlags2) {
+    dataSetFlags2 = dataSetReader.readByte();
+  }
+  auto messageType = static_cast<DataSetMessageType>(
+    dataSetFlags2 & dataSetFlags2MessageTypeMask);
+  if (dataSetFlags1 & dataSetFlags1SequenceNumber) {
+    dataSetReader.skip(2);
+  }
+  if (dataSetFlags2 & dataSetFlags2Timestamp) {
+    dataSetReader.skip(8);
+  }
+  if (dataSetFlags2 & dataSetFlags2PicoSeconds) {
+    dataSetReader.skip(2);
+  }
+  // The status only contains the upper 16 bits of the status code.
+  UA_StatusCode dataSetStatus = UA_STATUSCODE_GOOD;
+  if (dataSetFlags1 & dataSetFlags1Status) {
+    dataSetStatus =
+      static_cast<UA_StatusCode>(dataSetReader.readUInt16()) << 16;
+  }
+  if (dataSetFlags1 & dataSetFlags1MajorVersion) {
+    dataSetReader.skip(4);
+  }
+  if (dataSetFlags1 & dataSetFlags1MinorVersion) {
+    dataSetReader.skip(4);
+  }
+  if (messageType == DataSetMessageType::keepAlive) {
+    return;
+  }
+  if (messageType != DataSetMessageType::keyFrame
+      && messageType != DataSetMessageType::deltaFrame
+      && messageType != DataSetMessageType::event) {
+    throw std::runtime_error("Unsupported data set message type.");
+  }
+  if (fieldEncoding != FieldEncoding::variant
+      && fieldEncoding != FieldEncoding::dataValue) {
+    // The caller knows the size of the data set message, so it can continue
+    // with the next one.
+    decodingErrors.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  auto fieldCount = dataSetReader.readUInt16();
+  for (UA_UInt16 i = 0; i < fieldCount; ++i) {
+    UA_UInt16 fieldIndex = i;
+    if (messageType == DataSetMessageType::deltaFrame) {
+      fieldIndex = dataSetReader.readUInt16();
+    }
+    // Fields are encoded with a variable length, so we have to decode
+    // fields that are not used in order to find the next one.
+    Notification notification;
+    notification.status = dataSetStatus;
+    if (fieldEncoding == FieldEncoding::variant) {
+      UA_Variant value;
+      dataSetReader.readEncoded(value, UA_TYPES[UA_TYPES_VARIANT]);
+      notification.value = UaVariant(std::move(value));
+    } else {
+      UA_DataValue dataValue;
+      dataSetReader.readEncoded(dataValue, UA_TYPES[UA_TYPES_DATAVALUE]);
+      if (dataValue.hasStatus) {
+        notification.status = dataValue.status;
+      }
+      if (dataValue.hasValue) {
+        notification.value = UaVariant(std::move(dataValue.value));
+      }
+      UA_DataValue_clear(&dataValue);
+    }
+    auto field = fields.find(
+      (static_cast<std::uint32_t>(dataSetWriterId) << 16) | fieldIndex);
+    if (field == fields.end()) {
+      continue;
+    }
+    notification.field = &field->second;
+    notification.monitoredItems = field->second.monitoredItems;
+    notifications.push_back(std::move(notification));
+  }
+}
+
+void PubSubConnection::dispatchNotification(Notification &notification) {
+  auto &field = *notification.field;
+  auto status = notification.status & 0xFFFF0000;
+  bool failed = UA_StatusCode_isBad(status);
+  for (auto &monitoredItem : *notification.monitoredItems) {
+    // We catch all exceptions because an exception in a callback should never
+    // stop the receive thread.
+    try {
+      if (notification.value && !failed) {
+        NodeStatistics::Counters::add(field.counters->notifications, 1);
+        statistics.increment(ConnectionStatistics::Counter::notifications);
+        monitoredItem.statistics->notifications.fetch_add(
+          1, std::memory_order_relaxed);
+        monitoredItem.callback->success(field.nodeId, notification.value);
+      }
+      if (failed) {
+        statistics.increment(
+          ConnectionStatistics::Counter::notificationFailures);
+        monitoredItem.statistics->notificationFailures.fetch_add(
+          1, std::memory_order_relaxed);
+        monitoredItem.callback->failure(field.nodeId, status);
+      }
+    } catch (...) {
+      // An exception usually happens for many notifications, so we let the
+      // aggregator decide whether to print the message.
+      ErrorLogAggregator::getInstance().logError(endpointUrl, nullptr,
+        "Exception from notification callback caught",
+        UA_STATUSCODE_BADINTERNALERROR);
+      statistics.increment(ConnectionStatistics::Counter::callbackExceptions);
+    }
+  }
+}
+
+PubSubConnection::Field &PubSubConnection::getField(const UaNodeId &nodeId) {
+  const UA_NodeId &id = nodeId.get();
+  if (id.identifierType != UA_NODEIDTYPE_NUMERIC
+      || id.identifier.numeric > 0xFFFF) {
+    throw UaException(UA_STATUSCODE_BADNODEIDINVALID);
+  }
+  auto key = (static_cast<std::uint32_t>(id.namespaceIndex) << 16)
+    | id.identifier.numeric;
+  auto field = fields.find(key);
+  if (field == fields.end()) {
+    Field newField;
+    newField.counters = &nodeStatistics.intern(nodeId);
+    newField.monitoredItems = std::make_shared<const MonitoredItemList>();
+    newField.nodeId = nodeId;
+    newField.status = UA_STATUSCODE_BADWAITINGFORINITIALDATA;
+    field = fields.emplace(key, std::move(newField)).first;
+    usedDataSetWriters[id.namespaceIndex] = true;
+  }
+  return field->second;
+}
+
+void PubSubConnection::openSocket(const std::string &address,
+    const std::string &networkInterface) {
+  struct sockaddr_in groupAddress;
+  if (aToIPAddr(address.c_str(), defaultPort, &groupAddress)) {
+    throw std::invalid_argument(
+      "Invalid address in endpoint URL: " + address);
+  }
+  struct in_addr interfaceAddress;
+  interfaceAddress.s_addr = htonl(INADDR_ANY);
+  if (!networkInterface.empty()) {
+    struct sockaddr_in interfaceSocketAddress;
+    if (aToIPAddr(networkInterface.c_str(), 0, &interfaceSocketAddress)) {
+      throw std::invalid_argument(
+        "Invalid network interface address: " + networkInterface);
+    }
+    interfaceAddress = interfaceSocketAddress.sin_addr;
+  }
+  osiSockAttach();
+  socket = epicsSocketCreate(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket == INVALID_SOCKET) {
+    auto error = getSocketErrorString();
+    osiSockRelease();
+    throw std::runtime_error("Could not create socket: " + error);
+  }
+  try {
+    // Several IOCs on the same host might want to receive the same messages.
+    epicsSocketEnableAddressUseForDatagramFanout(socket);
+    // Failing to increase the buffer size is not fatal, so we ignore errors.
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF,
+      reinterpret_cast<const char *>(&socketReceiveBufferSize),
+      sizeof(socketReceiveBufferSize));
+    bool multicast = IN_MULTICAST(ntohl(groupAddress.sin_addr.s_addr));
+    struct sockaddr_in bindAddress = groupAddress;
+    // Binding to a multicast address does not work on all platforms, so we
+    // bind to the wildcard address and join the group instead.
+    if (multicast) {
+      bindAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (bind(socket, reinterpret_cast<struct sockaddr *>(&bindAddress),
+        sizeof(bindAddress))) {
+      throw std::runtime_error(
+        "Could not bind socket: " + getSocketErrorString());
+    }
+    destinationAddress = groupAddress;
+    if (multicast) {
+      // Messages sent by the writer group use the same interface.
+      if (!networkInterface.empty() && setsockopt(socket, IPPROTO_IP,
+          IP_MULTICAST_IF, reinterpret_cast<const char *>(&interfaceAddress),
+          sizeof(interfaceAddress))) {
+        throw std::runtime_error(
+          "Could not select multicast interface: " + getSocketErrorString());
+      }
+      struct ip_mreq request;
+      request.imr_multiaddr = groupAddress.sin_addr;
+      request.imr_interface = interfaceAddress;
+      if (setsockopt(socket, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+          reinterpret_cast<const char *>(&request), sizeof(request))) {
+        throw std::runtime_error(
+          "Could not join multicast group: " + getSocketErrorString());
+      }
+    }
+  } catch (...) {
+    epicsSocketDestroy(socket);
+    osiSockRelease();
+    throw;
+  }
+}
+
+void PubSubConnection::runReceiveThread() {
+  // The buffer and the list of notifications are only used by this thread,
+  // and we keep them, so that their memory can be reused.
+  std::vector<unsigned char> buffer(maxMessageSize);
+  std::vector<Notification> notifications;
+  while (!shutdownRequested.load(std::memory_order_relaxed)) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket, &readSet);
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = receiveTimeoutMicroseconds;
+    if (select(static_cast<int>(socket + 1), &readSet, nullptr, nullptr,
+        &timeout) <= 0) {
+      continue;
+    }
+    auto received = recvfrom(socket, reinterpret_cast<char *>(buffer.data()),
+      static_cast<int>(buffer.size()), 0, nullptr, nullptr);
+    if (received <= 0) {
+      continue;
+    }
+    receivedMessages.fetch_add(1, std::memory_order_relaxed);
+    receivedBytes.fetch_add(received, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      try {
+        decodeNetworkMessage(buffer.data(), received, notifications);
+      } catch (const std::exception &) {
+        // The notifications for the data set messages that have been decoded
+        // before the error are still valid, so we dispatch them anyway.
+        decodingErrors.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    if (notifications.empty()) {
+      continue;
+    }
+    // The callbacks are called without holding the mutex, so that they can
+    // use this connection. The fields are never removed, so the pointers to
+    // them stay valid.
+    for (auto &notification : notifications) {
+      if (!notification.monitoredItems->empty()) {
+        dispatchNotification(notification);
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto &notification : notifications) {
+        auto &field = *notification.field;
+        auto status = notification.status & 0xFFFF0000;
+        if (UA_StatusCode_isBad(status)) {
+          field.status = status;
+        } else if (notification.value) {
+          field.status = UA_STATUSCODE_GOOD;
+          field.value = std::move(notification.value);
+        }
+      }
+    }
+    notifications.clear();
+  }
+}
+
+void PubSubConnection::runWriterGroupThread() {
+  // The send buffer is only used by this thread, and we keep it, so that its
+  // memory can be reused.
+  std::vector<unsigned char> sendBuffer;
+  sendBuffer.reserve(maxMessageSize);
+  std::unique_lock<std::mutex> lock(writerGroupMutex);
+  auto interval =
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(
+        writerGroupPublishingInterval));
+  auto nextCycle = std::chrono::steady_clock::now() + interval;
+  std::chrono::steady_clock::time_point lastSendTime;
+  bool sentBefore = false;
+  while (true) {
+    if (writerGroupCv.wait_until(lock, nextCycle, [this]() {
+          return shutdownRequested.load(std::memory_order_relaxed);
+        })) {
+      break;
+    }
+    auto scheduledTime = nextCycle;
+    auto now = std::chrono::steady_clock::now();
+    nextCycle += interval;
+    // If we are late by more than a whole cycle, we skip the cycles that we
+    // missed instead of sending a burst of messages.
+    if (now >= nextCycle) {
+      auto missed = (now - nextCycle) / interval + 1;
+      missedCycles.fetch_add(missed, std::memory_order_relaxed);
+      nextCycle += missed * interval;
+    }
+    if (dataSetWriters.empty()) {
+      continue;
+    }
+    if (!networkMessageValid) {
+      buildNetworkMessage();
+    }
+    ++writerGroupSequenceNumber;
+    storeUInt16(networkMessage.data() + networkMessageSequenceNumberOffset,
+      writerGroupSequenceNumber);
+    for (auto &dataSetWriter : dataSetWriters) {
+      storeUInt16(networkMessage.data() + dataSetWriter.sequenceNumberOffset,
+        writerGroupSequenceNumber);
+    }
+    storeUInt64(networkMessage.data() + networkMessageTimestampOffset,
+      static_cast<UA_UInt64>(UA_DateTime_now()));
+    // We send a copy, so that writes do not have to wait for the socket.
+    sendBuffer.assign(networkMessage.begin(), networkMessage.end());
+    lock.unlock();
+    auto sendTime = std::chrono::steady_clock::now();
+    cycleLatenessHistogram.record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        sendTime - scheduledTime).count());
+    if (sentBefore) {
+      cycleTimeHistogram.record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          sendTime - lastSendTime).count());
+    }
+    lastSendTime = sendTime;
+    sentBefore = true;
+    if (sendBuffer.size() > maxSendSize) {
+      sendErrors.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      auto sent = sendto(socket,
+        reinterpret_cast<const char *>(sendBuffer.data()),
+        static_cast<int>(sendBuffer.size()), 0,
+        reinterpret_cast<const struct sockaddr *>(&destinationAddress),
+        sizeof(destinationAddress));
+      if (sent != static_cast<decltype(sent)>(sendBuffer.size())) {
+        sendErrors.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        sentMessages.fetch_add(1, std::memory_order_relaxed);
+        sentBytes.fetch_add(sent, std::memory_order_relaxed);
+      }
+    }
+    lock.lock();
+  }
+}
+
+}
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_PUB_SUB_CONNECTION_H
+#define OPEN62541_EPICS_PUB_SUB_CONNECTION_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <condition_variable>. The workaround
+// for this is defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <osiSock.h>
+
+#include "Connection.h"
+#include "LatencyHistogram.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Connection that receives OPC UA PubSub network messages (using the UADP
+ * message mapping over UDP, usually multicast) instead of connecting to a
+ * server. This allows records to receive data from publishers at rates that
+ * cannot be reached with client-server subscriptions.
+ *
+ * The open62541 library bundled with the device support is built without
+ * PubSub support, so this class decodes the UADP messages itself. It supports
+ * network messages that are neither signed nor encrypted, that are not
+ * chunked, and that have a payload header (which lists the DataSetWriterIds of
+ * the contained data set messages). The fields of a data set message must use
+ * the variant or the data value encoding. Raw encoded fields cannot be decoded
+ * without the data set meta data, so data set messages using this encoding are
+ * ignored.
+ *
+ * Records address a field through a numeric node ID: The namespace index is
+ * the DataSetWriterId and the numeric identifier is the index of the field in
+ * the data set (e.g. "num:12,3" for the fourth field of the data set written
+ * by the DataSetWriter with the ID 12). If a publisher ID has been specified,
+ * network messages from other publishers are ignored.
+ *
+ * Network messages are received and decoded by a dedicated thread. Only the
+ * data set messages and fields that are used by a record are decoded, and the
+ * callbacks of the monitored items are called directly by the receive thread,
+ * so there is no queue between the socket and the records. Reads return the
+ * last value that has been received for the field (and fail with
+ * BadWaitingForInitialData if no value has been received yet).
+ *
+ * Writes are only supported after a writer group has been set up (see
+ * setupWriterGroup(...)). The writer group sends one network message per
+ * publishing interval to the address of the endpoint URL. This message
+ * contains a key frame data set message for each DataSetWriterId that has been
+ * written to, and each of these data set messages contains the fields up to
+ * the highest field index that has been written to (fields that have not been
+ * written yet are sent as empty variants). A write encodes the value right
+ * away and copies it into the prepared network message, so the publishing
+ * thread only has to update the sequence numbers and the timestamp before
+ * sending the message. The message is only rebuilt when a field is added or
+ * the encoded size of a value changes.
+ *
+ * Method calls are not supported and always fail with BadNotSupported.
+ */
+class PubSubConnection : public Connection {
+
+public:
+
+  /**
+   * Creates a connection that receives the network messages sent to the
+   * specified address (and sends to the same address if a writer group is set
+   * up). The endpoint URL has the form "opc.udp://<address>[:<port>]" (the
+   * default port is 4840). If the address is a multicast address, the group
+   * is joined (and messages are sent) on the specified network interface
+   * (identified by its IP address, an empty string selects the default
+   * interface). If the publisher ID is not empty, only network messages from
+   * the publisher with this ID (as a number or a string) are used. Throws an
+   * std::invalid_argument if the endpoint URL is invalid and an
+   * std::runtime_error if the socket cannot be created.
+   */
+  PubSubConnection(const std::string &endpointUrl,
+      const std::string &networkInterface, const std::string &publisherId);
+
+  /**
+   * Destructor. Stops the receive thread and the writer group and closes the
+   * socket.
+   */
+  virtual ~PubSubConnection();
+
+  virtual void addMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback,
+      double samplingInterval, std::uint32_t queueSize, bool discardOldest);
+
+  virtual void callAsync(const UaNodeId &objectId, const UaNodeId &methodId,
+      const std::vector<UaVariant> &inputArguments,
+      std::shared_ptr<CallCallback> callback);
+
+  /**
+   * Returns the histogram of the delay between the scheduled time of a
+   * publishing cycle and the time at which the writer group sent the network
+   * message.
+   */
+  inline LatencyHistogram &getCycleLatenessHistogram() {
+    return cycleLatenessHistogram;
+  }
+
+  /**
+   * Returns the histogram of the time between two network messages sent by
+   * the writer group.
+   */
+  inline LatencyHistogram &getCycleTimeHistogram() {
+    return cycleTimeHistogram;
+  }
+
+  /**
+   * Returns the number of network messages that could not be decoded (e.g.
+   * because they are truncated or use a feature that is not supported).
+   */
+  inline std::uint64_t getDecodingErrors() const {
+    return decodingErrors.load(std::memory_order_relaxed);
+  }
+
+  virtual const std::string &getEndpointUrl() const {
+    return endpointUrl;
+  }
+
+  /**
+   * Returns the number of network messages that have been ignored because
+   * they were sent by a different publisher or do not carry data set
+   * messages.
+   */
+  inline std::uint64_t getIgnoredMessages() const {
+    return ignoredMessages.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of publishing cycles that have been skipped because the
+   * publishing thread was late by more than a whole publishing interval.
+   */
+  inline std::uint64_t getMissedCycles() const {
+    return missedCycles.load(std::memory_order_relaxed);
+  }
+
+  virtual NodeStatistics &getNodeStatistics() {
+    return nodeStatistics;
+  }
+
+  /**
+   * Returns the number of bytes that have been received.
+   */
+  inline std::uint64_t getReceivedBytes() const {
+    return receivedBytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of data set messages that have been decoded.
+   */
+  inline std::uint64_t getReceivedDataSetMessages() const {
+    return receivedDataSetMessages.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of network messages that have been received.
+   */
+  inline std::uint64_t getReceivedMessages() const {
+    return receivedMessages.load(std::memory_order_relaxed);
+  }
+
+  virtual AllocationStatistics::Account &getRecordAllocations() {
+    return recordAllocations;
+  }
+
+  /**
+   * Returns the number of network messages that the writer group could not
+   * send (e.g. because the message was too large).
+   */
+  inline std::uint64_t getSendErrors() const {
+    return sendErrors.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of bytes sent by the writer group.
+   */
+  inline std::uint64_t getSentBytes() const {
+    return sentBytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of network messages sent by the writer group.
+   */
+  inline std::uint64_t getSentMessages() const {
+    return sentMessages.load(std::memory_order_relaxed);
+  }
+
+  virtual StartupStatistics &getStartupStatistics() {
+    return startupStatistics;
+  }
+
+  virtual ConnectionStatistics &getStatistics() {
+    return statistics;
+  }
+
+  virtual double getSubscriptionPublishingInterval(const std::string &name) {
+    return 0.0;
+  }
+
+  /**
+   * Returns the publishing interval (in milliseconds) of the writer group.
+   * Returns zero if no writer group has been set up.
+   */
+  double getWriterGroupPublishingInterval();
+
+  virtual std::shared_ptr<SubscriptionStatistics> getSubscriptionStatistics(
+      const std::string &name);
+
+  virtual UaVariant read(const UaNodeId &nodeId);
+
+  virtual void readAsync(const UaNodeId &nodeId,
+      std::shared_ptr<ReadCallback> callback);
+
+  virtual void removeMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback);
+
+  /**
+   * Sets up the writer group that publishes the values written to this
+   * connection. The publisher ID and the writer group ID are included in each
+   * network message. The publishing interval is specified in milliseconds.
+   * Throws an std::invalid_argument if the publishing interval is not
+   * positive and an std::logic_error if a writer group has already been set
+   * up.
+   */
+  void setupWriterGroup(UA_UInt16 publisherId, UA_UInt16 writerGroupId,
+      double publishingInterval);
+
+  virtual void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+      std::shared_ptr<WriteCallback> callback);
+
+private:
+
+  struct PublishedField {
+    NodeStatistics::Counters *counters;
+    // Binary encoding of the variant that is sent for this field.
+    std::vector<unsigned char> encodedValue;
+    // Offset of the encoded value in the network message.
+    std::size_t offset;
+  };
+
+  struct DataSetWriter {
+    UA_UInt16 dataSetWriterId;
+    std::vector<PublishedField> fields;
+    // Offset of the sequence number in the network message.
+    std::size_t sequenceNumberOffset;
+  };
+
+  struct MonitoredItem {
+    std::shared_ptr<MonitoredItemCallback> callback;
+    std::shared_ptr<SubscriptionStatistics> statistics;
+    std::string subscriptionName;
+  };
+
+  // The list of monitored items is replaced (instead of being modified) when
+  // a monitored item is added or removed, so that the receive thread can
+  // dispatch a notification without copying the list.
+  using MonitoredItemList = std::vector<MonitoredItem>;
+
+  struct Field {
+    NodeStatistics::Counters *counters;
+    std::shared_ptr<const MonitoredItemList> monitoredItems;
+    UaNodeId nodeId;
+    UA_StatusCode status;
+    UaVariant value;
+  };
+
+  struct Notification {
+    Field *field;
+    std::shared_ptr<const MonitoredItemList> monitoredItems;
+    UA_StatusCode status;
+    UaVariant value;
+  };
+
+  // We do not want to allow copy or move construction or assignment.
+  PubSubConnection(const PubSubConnection &) = delete;
+  PubSubConnection(PubSubConnection &&) = delete;
+  PubSubConnection &operator=(const PubSubConnection &) = delete;
+  PubSubConnection &operator=(PubSubConnection &&) = delete;
+
+  LatencyHistogram cycleLatenessHistogram;
+  LatencyHistogram cycleTimeHistogram;
+  std::vector<DataSetWriter> dataSetWriters;
+  std::atomic<std::uint64_t> decodingErrors;
+  struct sockaddr_in destinationAddress;
+  std::string endpointUrl;
+  // Fields are identified by the DataSetWriterId (upper 16 bits) and the
+  // field index (lower 16 bits).
+  std::unordered_map<std::uint32_t, Field> fields;
+  std::atomic<std::uint64_t> ignoredMessages;
+  // The fields, the subscription statistics, and the list of used
+  // DataSetWriterIds are protected by this mutex.
+  std::atomic<std::uint64_t> missedCycles;
+  std::mutex mutex;
+  // The network message is rebuilt from the encoded values when the layout
+  // has become invalid.
+  std::vector<unsigned char> networkMessage;
+  bool networkMessageValid;
+  std::size_t networkMessageSequenceNumberOffset;
+  std::size_t networkMessageTimestampOffset;
+  NodeStatistics nodeStatistics;
+  std::string publisherId;
+  std::atomic<std::uint64_t> receivedBytes;
+  std::atomic<std::uint64_t> receivedDataSetMessages;
+  std::atomic<std::uint64_t> receivedMessages;
+  std::thread receiveThread;
+  AllocationStatistics::Account recordAllocations;
+  std::atomic<std::uint64_t> sendErrors;
+  std::atomic<std::uint64_t> sentBytes;
+  std::atomic<std::uint64_t> sentMessages;
+  std::atomic<bool> shutdownRequested;
+  SOCKET socket;
+  StartupStatistics startupStatistics;
+  ConnectionStatistics statistics;
+  std::unordered_map<std::string, std::shared_ptr<SubscriptionStatistics>>
+    subscriptionStatistics;
+  // Tells for each DataSetWriterId whether a record uses one of its fields.
+  std::vector<bool> usedDataSetWriters;
+  // The data set writers, the network message, and the writer group settings
+  // are protected by this mutex, so that writes do not compete with the
+  // receive thread.
+  std::condition_variable writerGroupCv;
+  UA_UInt16 writerGroupId;
+  std::mutex writerGroupMutex;
+  UA_UInt16 writerGroupPublisherId;
+  double writerGroupPublishingInterval;
+  UA_UInt16 writerGroupSequenceNumber;
+  std::thread writerGroupThread;
+
+  void decodeDataSetMessage(const unsigned char *data, std::size_t length,
+      UA_UInt16 dataSetWriterId, std::vector<Notification> &notifications);
+  void decodeNetworkMessage(const unsigned char *data, std::size_t length,
+      std::vector<Notification> &notifications);
+  void dispatchNotification(Notification &notification);
+  Field &getField(const UaNodeId &nodeId);
+  void buildNetworkMessage();
+  void openSocket(const std::string &address,
+      const std::string &networkInterface);
+  void runReceiveThread();
+  void runWriterGroupThread();
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_PUB_SUB_CONNECTION_H
@@ -0,0 +1,465 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "ErrorLogAggregator.h"
+#include "UaException.h"
+
+#include "ReplayConnection.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+std::uint32_t getUInt32(const unsigned char *src) {
+  std::uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= static_cast<std::uint32_t>(src[i]) << (8 * i);
+  }
+  return value;
+}
+
+std::uint64_t getUInt64(const unsigned char *src) {
+  std::uint64_t value = 0;
+  for (int i = 0; i < 8; ++i) {
+    value |= static_cast<std::uint64_t>(src[i]) << (8 * i);
+  }
+  return value;
+}
+
+} // anonymous namespace
+
+ReplayConnection::ReplayConnection(const std::string &fileName, double speed,
+    bool loop) : endpointUrl("replay://" + fileName), loop(loop),
+    recordAllocations("records"), replayPasses(0), replayedEvents(0),
+    shutdownRequested(false), speed(speed), started(false) {
+  if (!(speed >= 0.0)) {
+    throw std::invalid_argument("The replay speed must not be negative.");
+  }
+  loadCaptureFile(fileName);
+  // There is no server that could be disconnected, so code checking the
+  // connection state should behave like it does for a healthy server
+  // connection.
+  statistics.setConnected(true);
+}
+
+ReplayConnection::~ReplayConnection() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shutdownRequested = true;
+  }
+  replayCv.notify_all();
+  if (replayThread.joinable()) {
+    replayThread.join();
+  }
+}
+
+void ReplayConnection::addMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback,
+    double samplingInterval, std::uint32_t queueSize, bool discardOldest) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &subscriptionStatisticsEntry =
+      subscriptionStatistics[subscriptionName];
+    if (!subscriptionStatisticsEntry) {
+      subscriptionStatisticsEntry = std::make_shared<SubscriptionStatistics>();
+    }
+    MonitoredItem monitoredItem = {
+      callback, subscriptionStatisticsEntry, subscriptionName};
+    auto handle = nodeHandles.find(nodeId);
+    if (handle == nodeHandles.end()) {
+      startupStatistics.countMonitoredItemFailed();
+    } else {
+      auto &monitoredItems = nodes[handle->second].monitoredItems;
+      for (auto &existingItem : monitoredItems) {
+        if (existingItem.callback == callback
+            && existingItem.subscriptionName == subscriptionName) {
+          return;
+        }
+      }
+      monitoredItems.push_back(monitoredItem);
+      startupStatistics.countMonitoredItemCreated();
+    }
+    pendingInitialNotifications.emplace_back(nodeId, std::move(monitoredItem));
+  }
+  replayCv.notify_all();
+}
+
+std::shared_ptr<SubscriptionStatistics>
+    ReplayConnection::getSubscriptionStatistics(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &result = subscriptionStatistics[name];
+  if (!result) {
+    result = std::make_shared<SubscriptionStatistics>();
+  }
+  return result;
+}
+
+void ReplayConnection::callAsync(const UaNodeId &objectId,
+    const UaNodeId &methodId, const std::vector<UaVariant> &inputArguments,
+    std::shared_ptr<CallCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::calls);
+  statistics.increment(ConnectionStatistics::Counter::callFailures);
+  callback->failure(methodId, UA_STATUSCODE_BADNOTSUPPORTED);
+}
+
+UaVariant ReplayConnection::read(const UaNodeId &nodeId) {
+  statistics.increment(ConnectionStatistics::Counter::reads);
+  std::lock_guard<std::mutex> lock(mutex);
+  auto handle = nodeHandles.find(nodeId);
+  if (handle == nodeHandles.end()) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+    throw UaException(UA_STATUSCODE_BADNODEIDUNKNOWN);
+  }
+  auto &node = nodes[handle->second];
+  NodeStatistics::Counters::add(node.counters->reads, 1);
+  if (node.status != UA_STATUSCODE_GOOD) {
+    statistics.increment(ConnectionStatistics::Counter::readFailures);
+    throw UaException(node.status);
+  }
+  return *node.value;
+}
+
+void ReplayConnection::readAsync(const UaNodeId &nodeId,
+    std::shared_ptr<ReadCallback> callback) {
+  UaVariant value;
+  UA_StatusCode status;
+  try {
+    value = read(nodeId);
+    status = UA_STATUSCODE_GOOD;
+  } catch (const UaException &e) {
+    status = e.getStatusCode();
+  }
+  if (status == UA_STATUSCODE_GOOD) {
+    callback->success(nodeId, value);
+  } else {
+    callback->failure(nodeId, status);
+  }
+}
+
+void ReplayConnection::removeMonitoredItem(const std::string &subscriptionName,
+    const UaNodeId &nodeId,
+    std::shared_ptr<MonitoredItemCallback> const &callback) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto isItem = [&callback, &subscriptionName](
+      const MonitoredItem &monitoredItem) {
+    return monitoredItem.callback == callback
+      && monitoredItem.subscriptionName == subscriptionName;
+  };
+  pendingInitialNotifications.erase(
+    std::remove_if(pendingInitialNotifications.begin(),
+      pendingInitialNotifications.end(),
+      [&nodeId, &isItem](const std::pair<UaNodeId, MonitoredItem> &entry) {
+        return entry.first == nodeId && isItem(entry.second);
+      }),
+    pendingInitialNotifications.end());
+  auto handle = nodeHandles.find(nodeId);
+  if (handle == nodeHandles.end()) {
+    return;
+  }
+  auto &monitoredItems = nodes[handle->second].monitoredItems;
+  monitoredItems.erase(
+    std::remove_if(monitoredItems.begin(), monitoredItems.end(), isItem),
+    monitoredItems.end());
+}
+
+void ReplayConnection::start() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (started) {
+    return;
+  }
+  started = true;
+  replayThread = std::thread([this]() {runReplayThread();});
+}
+
+void ReplayConnection::writeAsync(const UaNodeId &nodeId,
+    const UaVariant &value, std::shared_ptr<WriteCallback> callback) {
+  statistics.increment(ConnectionStatistics::Counter::writes);
+  bool exists;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto handle = nodeHandles.find(nodeId);
+    exists = handle != nodeHandles.end();
+    if (exists) {
+      auto &node = nodes[handle->second];
+      NodeStatistics::Counters::add(node.counters->writes, 1);
+      node.writtenValue = value;
+      node.value = &node.writtenValue;
+      node.status = UA_STATUSCODE_GOOD;
+    }
+  }
+  if (exists) {
+    callback->success(nodeId);
+  } else {
+    statistics.increment(ConnectionStatistics::Counter::writeFailures);
+    callback->failure(nodeId, UA_STATUSCODE_BADNODEIDUNKNOWN);
+  }
+}
+
+void ReplayConnection::dispatchNotification(const UaNodeId &nodeId,
+    NodeStatistics::Counters *counters,
+    const std::vector<MonitoredItem> &monitoredItems,
+    const UaVariant *value, UA_StatusCode statusCode) {
+  // Like for a notification received from a server, the lower 16 bits of the
+  // status code tell whether the queue of the monitored item has overflowed.
+  UA_StatusCode status = statusCode & 0xFFFF0000;
+  bool overflow = (statusCode & 0x00000C00) == UA_STATUSCODE_INFOTYPE_DATAVALUE
+    && (statusCode & UA_STATUSCODE_INFOBITS_OVERFLOW);
+  for (auto &monitoredItem : monitoredItems) {
+    // We catch all exceptions because an exception in a callback should
+    // never stop the replay thread.
+    try {
+      if (overflow) {
+        statistics.increment(ConnectionStatistics::Counter::overflows);
+        monitoredItem.statistics->recordOverflow(nodeId);
+        monitoredItem.callback->overflow(nodeId);
+      }
+      if (value) {
+        if (counters) {
+          NodeStatistics::Counters::add(counters->notifications, 1);
+        }
+        statistics.increment(ConnectionStatistics::Counter::notifications);
+        monitoredItem.statistics->notifications.fetch_add(
+          1, std::memory_order_relaxed);
+        monitoredItem.callback->success(nodeId, *value);
+      }
+      if (status != UA_STATUSCODE_GOOD) {
+        statistics.increment(
+          ConnectionStatistics::Counter::notificationFailures);
+        monitoredItem.statistics->notificationFailures.fetch_add(
+          1, std::memory_order_relaxed);
+        monitoredItem.callback->failure(nodeId, status);
+      }
+    } catch (...) {
+      // An exception usually happens for many notifications, so we let the
+      // aggregator decide whether to print the message.
+      ErrorLogAggregator::getInstance().logError(endpointUrl, nullptr,
+        "Exception from callback caught in replay thread",
+        UA_STATUSCODE_BADINTERNALERROR);
+      statistics.increment(ConnectionStatistics::Counter::callbackExceptions);
+    }
+  }
+}
+
+void ReplayConnection::loadCaptureFile(const std::string &fileName) {
+  std::ifstream stream(fileName, std::ios::binary);
+  if (!stream) {
+    throw std::runtime_error("Could not open \"" + fileName + "\".");
+  }
+  std::vector<unsigned char> data{std::istreambuf_iterator<char>(stream),
+    std::istreambuf_iterator<char>()};
+  if (stream.bad()) {
+    throw std::runtime_error("Could not read \"" + fileName + "\".");
+  }
+  if (data.size() < TrafficRecorder::fileHeaderSize
+      || std::memcmp(data.data(), TrafficRecorder::magic, 8)) {
+    throw std::runtime_error(
+      "\"" + fileName + "\" is not a valid capture file.");
+  }
+  if (getUInt32(data.data() + 8) != TrafficRecorder::version) {
+    throw std::runtime_error(
+      "\"" + fileName + "\" uses an unsupported file format version.");
+  }
+  std::size_t offset = TrafficRecorder::fileHeaderSize;
+  // If the IOC that captured the traffic did not exit cleanly, the last record
+  // may be incomplete. We simply ignore such a record.
+  while (data.size() - offset >= TrafficRecorder::recordHeaderSize) {
+    auto header = data.data() + offset;
+    auto type = static_cast<TrafficRecorder::RecordType>(header[0]);
+    auto handle = getUInt32(header + 1);
+    auto time = getUInt64(header + 5);
+    std::size_t length = getUInt32(header + 13);
+    if (data.size() - offset - TrafficRecorder::recordHeaderSize < length) {
+      break;
+    }
+    UA_ByteString payload;
+    payload.data = header + TrafficRecorder::recordHeaderSize;
+    payload.length = length;
+    switch (type) {
+    case TrafficRecorder::RecordType::node: {
+      if (handle != nodes.size()) {
+        throw std::runtime_error("\"" + fileName
+          + "\" contains an unexpected node handle.");
+      }
+      UA_NodeId nodeId;
+      if (UA_decodeBinary(&payload, &nodeId, &UA_TYPES[UA_TYPES_NODEID],
+          nullptr) != UA_STATUSCODE_GOOD) {
+        throw std::runtime_error("\"" + fileName
+          + "\" contains a node ID that cannot be decoded.");
+      }
+      Node node;
+      node.nodeId = UaNodeId(std::move(nodeId));
+      node.counters = &nodeStatistics.intern(node.nodeId);
+      node.status = UA_STATUSCODE_BADNODEIDUNKNOWN;
+      node.value = nullptr;
+      nodeHandles.emplace(node.nodeId, handle);
+      nodes.push_back(std::move(node));
+      break;
+    }
+    case TrafficRecorder::RecordType::notification:
+    case TrafficRecorder::RecordType::read:
+    case TrafficRecorder::RecordType::write: {
+      if (handle >= nodes.size()) {
+        throw std::runtime_error("\"" + fileName
+          + "\" contains an unknown node handle.");
+      }
+      UA_DataValue dataValue;
+      if (UA_decodeBinary(&payload, &dataValue, &UA_TYPES[UA_TYPES_DATAVALUE],
+          nullptr) != UA_STATUSCODE_GOOD) {
+        throw std::runtime_error("\"" + fileName
+          + "\" contains a value that cannot be decoded.");
+      }
+      Event event;
+      event.handle = handle;
+      event.hasValue = dataValue.hasValue;
+      event.status =
+        dataValue.hasStatus ? dataValue.status : UA_STATUSCODE_GOOD;
+      event.time = time;
+      event.type = type;
+      event.value = UaVariant(std::move(dataValue.value));
+      UA_DataValue_clear(&dataValue);
+      events.push_back(std::move(event));
+      break;
+    }
+    default:
+      throw std::runtime_error("\"" + fileName
+        + "\" contains a record of unknown type.");
+    }
+    offset += TrafficRecorder::recordHeaderSize + length;
+  }
+  // The events do not move any longer, so we can now initialize each node
+  // with the first value (or read error) that has been captured for it.
+  std::vector<bool> initialized(nodes.size(), false);
+  for (auto &event : events) {
+    auto &node = nodes[event.handle];
+    if (initialized[event.handle]) {
+      continue;
+    }
+    auto status = event.status & 0xFFFF0000;
+    if (event.hasValue && status == UA_STATUSCODE_GOOD) {
+      node.status = UA_STATUSCODE_GOOD;
+      node.value = &event.value;
+      initialized[event.handle] = true;
+    } else if (event.type == TrafficRecorder::RecordType::read) {
+      node.status = status;
+      initialized[event.handle] = true;
+    }
+  }
+}
+
+void ReplayConnection::runReplayThread() {
+  // These vectors are only used by this thread, and we keep them, so that
+  // their memory can be reused.
+  std::vector<std::pair<UaNodeId, MonitoredItem>> initialNotifications;
+  std::vector<MonitoredItem> monitoredItems;
+  std::size_t index = 0;
+  auto passStartTime = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!shutdownRequested) {
+    // Monitored items that have been added receive the current value of their
+    // node first. We copy the value because a write might replace it while we
+    // do not hold the mutex.
+    if (!pendingInitialNotifications.empty()) {
+      initialNotifications.swap(pendingInitialNotifications);
+      for (auto &entry : initialNotifications) {
+        auto handle = nodeHandles.find(entry.first);
+        NodeStatistics::Counters *counters = nullptr;
+        UaVariant value;
+        bool hasValue = false;
+        UA_StatusCode status = UA_STATUSCODE_BADNODEIDUNKNOWN;
+        if (handle != nodeHandles.end()) {
+          auto &node = nodes[handle->second];
+          counters = node.counters;
+          status = node.status;
+          if (status == UA_STATUSCODE_GOOD) {
+            value = *node.value;
+            hasValue = true;
+          }
+        }
+        monitoredItems.assign(1, entry.second);
+        lock.unlock();
+        dispatchNotification(entry.first, counters, monitoredItems,
+          hasValue ? &value : nullptr, status);
+        lock.lock();
+      }
+      initialNotifications.clear();
+      continue;
+    }
+    if (index == events.size()) {
+      if (!loop || events.empty()) {
+        replayCv.wait(lock, [this]() {
+          return shutdownRequested || !pendingInitialNotifications.empty();
+        });
+        continue;
+      }
+      index = 0;
+      passStartTime = std::chrono::steady_clock::now();
+    }
+    auto &event = events[index];
+    if (speed > 0.0) {
+      auto dueTime = passStartTime
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double, std::nano>(
+            (event.time - events.front().time) / speed));
+      if (std::chrono::steady_clock::now() < dueTime) {
+        replayCv.wait_until(lock, dueTime);
+        continue;
+      }
+    }
+    ++index;
+    auto &node = nodes[event.handle];
+    auto status = event.status & 0xFFFF0000;
+    if (event.hasValue && status == UA_STATUSCODE_GOOD) {
+      node.status = UA_STATUSCODE_GOOD;
+      node.value = &event.value;
+    } else if (event.type == TrafficRecorder::RecordType::read) {
+      node.status = status;
+    }
+    if (event.type == TrafficRecorder::RecordType::notification
+        && !node.monitoredItems.empty()) {
+      monitoredItems.assign(
+        node.monitoredItems.begin(), node.monitoredItems.end());
+      lock.unlock();
+      // The events are never modified, so we can pass the value without
+      // holding the mutex.
+      dispatchNotification(node.nodeId, node.counters, monitoredItems,
+        event.hasValue ? &event.value : nullptr, event.status);
+      lock.lock();
+    }
+    replayedEvents.fetch_add(1, std::memory_order_relaxed);
+    if (index == events.size()) {
+      replayPasses.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+}
+}
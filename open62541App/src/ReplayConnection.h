@@ -0,0 +1,251 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_REPLAY_CONNECTION_H
+#define OPEN62541_EPICS_REPLAY_CONNECTION_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <condition_variable>. The workaround
+// for this is defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Connection.h"
+#include "TrafficRecorder.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Connection that feeds the traffic captured by a TrafficRecorder back into
+ * the records, without any server. This allows reproducing the load of a
+ * production IOC offline, e.g. for profiling the device support.
+ *
+ * The whole capture file is read and decoded when the connection is created,
+ * so that decoding does not distort the timing of the replay. The replay
+ * starts when start() is called (usually when the IOC has finished iocInit).
+ * Notifications are sent to the monitored items of the respective node at
+ * their original times, scaled by the speed factor. When a monitored item is
+ * added, it receives the current value of the node (like it would when
+ * creating the monitored item on a server). Reads return the current value of
+ * the node, which is the value of the last notification or read operation that
+ * has been replayed for the node (or the first value in the capture if the
+ * replay has not reached that node yet). Writes always succeed for nodes that
+ * are present in the capture and change the current value of the node. Nodes
+ * that are not present in the capture cause BadNodeIdUnknown errors. Method
+ * calls are not captured, so they always fail with BadNotSupported.
+ *
+ * Read and write operations are completed before readAsync and writeAsync
+ * return. Notifications are sent by a separate thread, like it is the case
+ * for a ServerConnection.
+ */
+class ReplayConnection : public Connection {
+
+public:
+
+  /**
+   * Creates a connection that replays the specified capture file. The speed
+   * is the factor by which the replay is accelerated (1.0 means original
+   * speed, 0.0 means as fast as possible). If loop is true, the replay starts
+   * over when the end of the capture has been reached. Throws an
+   * std::runtime_error if the file cannot be read or is not a valid capture
+   * file, and an std::invalid_argument if the speed is negative.
+   */
+  ReplayConnection(const std::string &fileName, double speed, bool loop);
+
+  /**
+   * Destructor. Stops the replay.
+   */
+  virtual ~ReplayConnection();
+
+  virtual void addMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback,
+      double samplingInterval, std::uint32_t queueSize, bool discardOldest);
+
+  virtual void callAsync(const UaNodeId &objectId, const UaNodeId &methodId,
+      const std::vector<UaVariant> &inputArguments,
+      std::shared_ptr<CallCallback> callback);
+
+  virtual const std::string &getEndpointUrl() const {
+    return endpointUrl;
+  }
+
+  /**
+   * Returns the number of events (notifications, reads, and writes) in the
+   * capture file.
+   */
+  inline std::size_t getEvents() const {
+    return events.size();
+  }
+
+  /**
+   * Returns the number of nodes in the capture file.
+   */
+  inline std::size_t getNodes() const {
+    return nodes.size();
+  }
+
+  virtual NodeStatistics &getNodeStatistics() {
+    return nodeStatistics;
+  }
+
+  virtual AllocationStatistics::Account &getRecordAllocations() {
+    return recordAllocations;
+  }
+
+  /**
+   * Returns the number of times the replay has reached the end of the
+   * capture.
+   */
+  inline std::uint64_t getReplayPasses() const {
+    return replayPasses.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of events that have been replayed so far.
+   */
+  inline std::uint64_t getReplayedEvents() const {
+    return replayedEvents.load(std::memory_order_relaxed);
+  }
+
+  virtual StartupStatistics &getStartupStatistics() {
+    return startupStatistics;
+  }
+
+  virtual ConnectionStatistics &getStatistics() {
+    return statistics;
+  }
+
+  virtual double getSubscriptionPublishingInterval(const std::string &name) {
+    return 0.0;
+  }
+
+  virtual std::shared_ptr<SubscriptionStatistics> getSubscriptionStatistics(
+      const std::string &name);
+
+  virtual UaVariant read(const UaNodeId &nodeId);
+
+  virtual void readAsync(const UaNodeId &nodeId,
+      std::shared_ptr<ReadCallback> callback);
+
+  virtual void removeMonitoredItem(const std::string &subscriptionName,
+      const UaNodeId &nodeId,
+      std::shared_ptr<MonitoredItemCallback> const &callback);
+
+  /**
+   * Starts the replay. Calling this method more than once has no effect.
+   */
+  void start();
+
+  virtual void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+      std::shared_ptr<WriteCallback> callback);
+
+private:
+
+  struct Event {
+    bool hasValue;
+    std::uint32_t handle;
+    // Status code of the event, including the lower 16 bits that carry
+    // additional information (e.g. about an overflow).
+    UA_StatusCode status;
+    std::uint64_t time;
+    TrafficRecorder::RecordType type;
+    UaVariant value;
+  };
+
+  struct MonitoredItem {
+    std::shared_ptr<MonitoredItemCallback> callback;
+    std::shared_ptr<SubscriptionStatistics> statistics;
+    std::string subscriptionName;
+  };
+
+  struct Node {
+    NodeStatistics::Counters *counters;
+    std::vector<MonitoredItem> monitoredItems;
+    UaNodeId nodeId;
+    // Status that is returned by reads, if it is not good.
+    UA_StatusCode status;
+    // The current value points to the value of an event or to the written
+    // value, so that replaying an event does not have to copy the value.
+    const UaVariant *value;
+    UaVariant writtenValue;
+  };
+
+  // We do not want to allow copy or move construction or assignment.
+  ReplayConnection(const ReplayConnection &) = delete;
+  ReplayConnection(ReplayConnection &&) = delete;
+  ReplayConnection &operator=(const ReplayConnection &) = delete;
+  ReplayConnection &operator=(ReplayConnection &&) = delete;
+
+  std::string endpointUrl;
+  std::vector<Event> events;
+  bool loop;
+  // The nodes, the pending initial notifications, the subscription
+  // statistics, and the flags are protected by this mutex.
+  std::mutex mutex;
+  std::unordered_map<UaNodeId, std::uint32_t> nodeHandles;
+  std::vector<Node> nodes;
+  NodeStatistics nodeStatistics;
+  // Monitored items that have been added, but not received their initial
+  // notification yet.
+  std::vector<std::pair<UaNodeId, MonitoredItem>> pendingInitialNotifications;
+  AllocationStatistics::Account recordAllocations;
+  std::atomic<std::uint64_t> replayPasses;
+  std::condition_variable replayCv;
+  std::atomic<std::uint64_t> replayedEvents;
+  std::thread replayThread;
+  bool shutdownRequested;
+  double speed;
+  bool started;
+  StartupStatistics startupStatistics;
+  ConnectionStatistics statistics;
+  std::unordered_map<std::string, std::shared_ptr<SubscriptionStatistics>>
+    subscriptionStatistics;
+
+  void dispatchNotification(const UaNodeId &nodeId,
+      NodeStatistics::Counters *counters,
+      const std::vector<MonitoredItem> &monitoredItems,
+      const UaVariant *value, UA_StatusCode status);
+  void loadCaptureFile(const std::string &fileName);
+  void runReplayThread();
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_REPLAY_CONNECTION_H
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "RequestBudget.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// Shares that have not requested any tokens within this time are considered
+// idle and do not take part in the distribution of the budget.
+constexpr std::chrono::seconds idleTimeout(1);
+
+// Shares can accumulate tokens for up to this many seconds. This allows for
+// short bursts while still keeping the average rate within the budget.
+constexpr double burstSeconds = 1.0;
+
+} // anonymous namespace
+
+RequestBudget::Share::Share(RequestBudget &budget) : budget(budget),
+    totalBytes(0), totalRequests(0) {
+}
+
+RequestBudget::Share::~Share() {
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  budget.shares.erase(
+    std::remove(budget.shares.begin(), budget.shares.end(), this),
+    budget.shares.end());
+}
+
+std::chrono::nanoseconds RequestBudget::Share::acquire(std::size_t bytes) {
+  if (!budget.enabled.load(std::memory_order_acquire)) {
+    totalRequests.fetch_add(1, std::memory_order_relaxed);
+    totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    return std::chrono::nanoseconds::zero();
+  }
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  // We update the time of the last demand before refilling, so that this share
+  // is considered active when distributing the budget.
+  lastDemand = now;
+  budget.refill(now);
+  double totalWeight = 0.0;
+  for (auto share : budget.shares) {
+    if (now - share->lastDemand < idleTimeout) {
+      totalWeight += share->weight;
+    }
+  }
+  double fraction = weight / totalWeight;
+  double waitSeconds = 0.0;
+  if (budget.requestsPerSecond > 0.0 && requestTokens < 1.0) {
+    waitSeconds = std::max(waitSeconds,
+      (1.0 - requestTokens) / (budget.requestsPerSecond * fraction));
+  }
+  // The size of a request might exceed what can be accumulated in the bucket,
+  // so we allow sending a request as long as the byte tokens are not
+  // exhausted and let the share go into debt.
+  if (budget.bytesPerSecond > 0.0 && byteTokens <= 0.0) {
+    waitSeconds = std::max(waitSeconds,
+      (1.0 - byteTokens) / (budget.bytesPerSecond * fraction));
+  }
+  if (waitSeconds > 0.0) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::duration<double>(waitSeconds));
+  }
+  if (budget.requestsPerSecond > 0.0) {
+    requestTokens -= 1.0;
+  }
+  if (budget.bytesPerSecond > 0.0) {
+    byteTokens -= bytes;
+  }
+  totalRequests.fetch_add(1, std::memory_order_relaxed);
+  totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+  return std::chrono::nanoseconds::zero();
+}
+
+void RequestBudget::Share::charge(std::size_t bytes) {
+  totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+  if (!budget.enabled.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  if (budget.bytesPerSecond > 0.0) {
+    byteTokens -= bytes;
+  }
+}
+
+double RequestBudget::Share::getWeight() const {
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  return weight;
+}
+
+void RequestBudget::Share::setWeight(double weight) {
+  if (!(weight > 0.0)) {
+    throw std::invalid_argument("The weight must be positive.");
+  }
+  std::lock_guard<std::mutex> lock(budget.mutex);
+  this->weight = weight;
+}
+
+std::shared_ptr<RequestBudget::Share> RequestBudget::createShare() {
+  // The constructor of Share is private, so we cannot use std::make_shared.
+  std::shared_ptr<Share> share(new Share(*this));
+  std::lock_guard<std::mutex> lock(mutex);
+  shares.push_back(share.get());
+  return share;
+}
+
+double RequestBudget::getBytesPerSecond() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return bytesPerSecond;
+}
+
+double RequestBudget::getRequestsPerSecond() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return requestsPerSecond;
+}
+
+void RequestBudget::setLimits(double requestsPerSecond, double bytesPerSecond) {
+  if (requestsPerSecond < 0.0 || bytesPerSecond < 0.0) {
+    throw std::invalid_argument("The limits must not be negative.");
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  this->requestsPerSecond = requestsPerSecond;
+  this->bytesPerSecond = bytesPerSecond;
+  // We start with empty buckets, so that changing the limits does not result
+  // in a burst of requests.
+  lastRefill = std::chrono::steady_clock::now();
+  for (auto share : shares) {
+    share->requestTokens = 0.0;
+    share->byteTokens = 0.0;
+  }
+  enabled.store(requestsPerSecond > 0.0 || bytesPerSecond > 0.0,
+    std::memory_order_release);
+}
+
+RequestBudget::RequestBudget() : bytesPerSecond(0.0), enabled(false),
+    lastRefill(std::chrono::steady_clock::now()), requestsPerSecond(0.0) {
+}
+
+void RequestBudget::refill(std::chrono::steady_clock::time_point now) {
+  double elapsedSeconds =
+    std::chrono::duration<double>(now - lastRefill).count();
+  lastRefill = now;
+  // Only shares that are currently active get a part of the budget. This way,
+  // the budget of idle connections is redistributed to the active ones.
+  double totalWeight = 0.0;
+  for (auto share : shares) {
+    if (now - share->lastDemand < idleTimeout) {
+      totalWeight += share->weight;
+    }
+  }
+  if (totalWeight <= 0.0) {
+    return;
+  }
+  for (auto share : shares) {
+    if (now - share->lastDemand >= idleTimeout) {
+      continue;
+    }
+    double fraction = share->weight / totalWeight;
+    if (requestsPerSecond > 0.0) {
+      double rate = requestsPerSecond * fraction;
+      // A share must always be able to accumulate at least one token, even if
+      // its rate is very low.
+      double maxTokens = std::max(rate * burstSeconds, 1.0);
+      share->requestTokens = std::min(
+        share->requestTokens + rate * elapsedSeconds, maxTokens);
+    }
+    if (bytesPerSecond > 0.0) {
+      double rate = bytesPerSecond * fraction;
+      double maxTokens = std::max(rate * burstSeconds, 1.0);
+      share->byteTokens = std::min(
+        share->byteTokens + rate * elapsedSeconds, maxTokens);
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_REQUEST_BUDGET_H
+#define OPEN62541_EPICS_REQUEST_BUDGET_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * IOC-wide budget for the requests sent to OPC UA servers. The budget limits
+ * the number of requests and the number of bytes that may be sent per second
+ * by all connections together. It is implemented as a token bucket, where
+ * each connection gets a share of the budget that is proportional to its
+ * weight. Connections that do not currently send any requests do not take
+ * part in the distribution, so that the budget is only split between the
+ * connections that actually need it.
+ *
+ * This class implements the singleton pattern and the only instance is
+ * returned by the {@link #getInstance()} function.
+ */
+class RequestBudget {
+
+public:
+
+  /**
+   * Share of the budget that is used by a single connection. Instances of this
+   * class are created through {@link RequestBudget#createShare()}.
+   */
+  class Share {
+
+  public:
+
+    /**
+     * Destructor. Removes this share from the budget.
+     */
+    ~Share();
+
+    /**
+     * Tries to take the tokens needed for sending a request with the specified
+     * (estimated) size. If there are sufficient tokens, they are taken and
+     * zero is returned. Otherwise, no tokens are taken and the time that the
+     * caller should wait before trying again is returned.
+     */
+    std::chrono::nanoseconds acquire(std::size_t bytes);
+
+    /**
+     * Takes tokens for bytes that have been received. As the size of a
+     * response is not known before the request is sent, the bytes are taken
+     * after the fact, even if this means that the share has to go into debt.
+     */
+    void charge(std::size_t bytes);
+
+    /**
+     * Returns the total number of bytes that have been accounted for this
+     * share.
+     */
+    inline std::uint64_t getTotalBytes() const {
+      return totalBytes.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the total number of requests that have been accounted for this
+     * share.
+     */
+    inline std::uint64_t getTotalRequests() const {
+      return totalRequests.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Returns the weight of this share.
+     */
+    double getWeight() const;
+
+    /**
+     * Sets the weight of this share. The weight must be positive. The default
+     * weight is 1.
+     */
+    void setWeight(double weight);
+
+  private:
+
+    friend class RequestBudget;
+
+    RequestBudget &budget;
+    double byteTokens = 0.0;
+    std::chrono::steady_clock::time_point lastDemand;
+    double requestTokens = 0.0;
+    std::atomic<std::uint64_t> totalBytes;
+    std::atomic<std::uint64_t> totalRequests;
+    double weight = 1.0;
+
+    Share(RequestBudget &budget);
+
+    // We do not want to allow copy or move construction or assignment.
+    Share(const Share &) = delete;
+    Share(Share &&) = delete;
+    Share &operator=(const Share &) = delete;
+    Share &operator=(Share &&) = delete;
+
+  };
+
+  /**
+   * Returns the only instance of this class.
+   */
+  inline static RequestBudget &getInstance() {
+    // The instance is intentionally never destroyed. The shares belong to the
+    // server connections, which may be destroyed during static destruction,
+    // and a share accesses the budget when it is destroyed.
+    static RequestBudget *instance = new RequestBudget();
+    return *instance;
+  }
+
+  /**
+   * Creates a new share of this budget. The share is removed from the budget
+   * when it is destroyed.
+   */
+  std::shared_ptr<Share> createShare();
+
+  /**
+   * Returns the max. number of bytes per second. Zero means that the number
+   * of bytes is not limited.
+   */
+  double getBytesPerSecond();
+
+  /**
+   * Returns the max. number of requests per second. Zero means that the
+   * number of requests is not limited.
+   */
+  double getRequestsPerSecond();
+
+  /**
+   * Sets the max. number of requests and bytes per second that may be sent by
+   * all connections together. Zero means that the respective quantity is not
+   * limited. Throws an std::invalid_argument if one of the limits is negative.
+   */
+  void setLimits(double requestsPerSecond, double bytesPerSecond);
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  RequestBudget(const RequestBudget &) = delete;
+  RequestBudget(RequestBudget &&) = delete;
+  RequestBudget &operator=(const RequestBudget &) = delete;
+  RequestBudget &operator=(RequestBudget &&) = delete;
+
+  double bytesPerSecond;
+  // The enabled flag allows us to skip acquiring the mutex when no limits
+  // have been set, which is the default.
+  std::atomic<bool> enabled;
+  std::chrono::steady_clock::time_point lastRefill;
+  std::mutex mutex;
+  double requestsPerSecond;
+  std::vector<Share *> shares;
+
+  RequestBudget();
+
+  void refill(std::chrono::steady_clock::time_point now);
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_REQUEST_BUDGET_H
@@ -27,11 +27,25 @@
  * of the GNU LGPL version 3 or newer.
  */
 
+#include <cerrno>
 #include <chrono>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <iterator>
+#include <map>
 
+#ifdef __linux__
+extern "C" {
+#include <pthread.h>
+#include <sched.h>
+}
+#endif // __linux__
+
+#include "ErrorLogAggregator.h"
 #include "open62541Error.h"
+#include "open62541Trace.h"
 #include "UaException.h"
 
 #include "ServerConnection.h"
@@ -39,6 +53,100 @@
 namespace open62541 {
 namespace epics {
 
+namespace {
+
+#ifdef __linux__
+cpu_set_t parseCpuList(std::string const &cpuList) {
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  std::size_t tokenStart = 0;
+  while (tokenStart <= cpuList.size()) {
+    auto tokenEnd = cpuList.find(',', tokenStart);
+    if (tokenEnd == std::string::npos) {
+      tokenEnd = cpuList.size();
+    }
+    auto token = cpuList.substr(tokenStart, tokenEnd - tokenStart);
+    auto dashPos = token.find('-');
+    unsigned long first, last;
+    try {
+      std::size_t convertedLength;
+      auto firstString = token.substr(0, dashPos);
+      first = std::stoul(firstString, &convertedLength);
+      if (convertedLength != firstString.length()) {
+        throw std::invalid_argument("Only partial string has been converted.");
+      }
+      if (dashPos == std::string::npos) {
+        last = first;
+      } else {
+        auto lastString = token.substr(dashPos + 1);
+        last = std::stoul(lastString, &convertedLength);
+        if (convertedLength != lastString.length()) {
+          throw std::invalid_argument(
+            "Only partial string has been converted.");
+        }
+      }
+    } catch (std::logic_error&) {
+      // std::invalid_argument and std::out_of_range are both derived from
+      // std::logic_error.
+      throw std::invalid_argument(
+        std::string("Invalid CPU list: ") + cpuList);
+    }
+    if (first > last || last >= CPU_SETSIZE) {
+      throw std::invalid_argument(
+        std::string("Invalid CPU range in CPU list: ") + token);
+    }
+    for (auto cpu = first; cpu <= last; ++cpu) {
+      CPU_SET(cpu, &cpuSet);
+    }
+    tokenStart = tokenEnd + 1;
+  }
+  return cpuSet;
+}
+#endif // __linux__
+
+// Maximum number of method calls that are sent in a single Call service
+// request. Servers may announce a lower limit (MaxNodesPerMethodCall), but
+// most servers do not limit the number of calls at all.
+constexpr std::size_t maxCallsPerRequest = 64;
+
+// Read callback used by the synchronous read method. It simply passes the
+// result to the waiting thread.
+class SyncReadCallback : public ServerConnection::ReadCallback {
+
+public:
+
+  std::promise<UaVariant> promise;
+
+  void success(const UaNodeId &nodeId, const UaVariant &value) override {
+    promise.set_value(value);
+  }
+
+  void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) override {
+    promise.set_exception(std::make_exception_ptr(UaException(statusCode)));
+  }
+
+};
+
+// Write callback used by the synchronous write method. It simply passes the
+// result to the waiting thread.
+class SyncWriteCallback : public ServerConnection::WriteCallback {
+
+public:
+
+  std::promise<void> promise;
+
+  void success(const UaNodeId &nodeId) override {
+    promise.set_value();
+  }
+
+  void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) override {
+    promise.set_exception(std::make_exception_ptr(UaException(statusCode)));
+  }
+
+};
+
+} // anonymous namespace
+
 ServerConnection::ServerConnection(const std::string &endpointUrl) :
     ServerConnection(endpointUrl, std::string(), std::string(), false,
       SecurityMode::invalid, std::string(), std::string(), std::string(),
@@ -78,14 +186,12 @@ ServerConnection::~ServerConnection() {
   if (connectionThread.joinable()) {
     connectionThread.join();
   }
-  // Most likely the lock guard is not needed here, but taking the mutex should
-  // not cost us much and we do not have to worry about any side effects.
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    UA_Client_disconnect(client);
-    UA_Client_delete(client);
-    client = nullptr;
-  }
+  // Now that the connection thread has finished, we are the only ones using
+  // the client, so we can safely destroy it.
+  AllocationStatistics::Scope allocationScope(&clientAllocations);
+  UA_Client_disconnect(client);
+  UA_Client_delete(client);
+  client = nullptr;
 }
 
 void ServerConnection::addMonitoredItem(const std::string &subscriptionName,
@@ -98,30 +204,83 @@ void ServerConnection::addMonitoredItem(const std::string &subscriptionName,
     std::lock_guard<std::mutex> lock(requestQueueMutex);
     requestQueue.push_back(std::move(request));
   }
+  statistics.updateQueueDepth(1);
+  requestQueueCv.notify_all();
+}
+
+void ServerConnection::callAsync(const UaNodeId &objectId,
+    const UaNodeId &methodId, const std::vector<UaVariant> &inputArguments,
+    std::shared_ptr<CallCallback> callback) {
+  std::unique_ptr<Request> request(new CallRequest(
+    callback, objectId, methodId, inputArguments));
+  {
+    std::lock_guard<std::mutex> lock(requestQueueMutex);
+    requestQueue.push_back(std::move(request));
+  }
+  statistics.updateQueueDepth(1);
   requestQueueCv.notify_all();
 }
 
+std::vector<std::pair<std::string, std::shared_ptr<SubscriptionStatistics>>>
+    ServerConnection::getAllSubscriptionStatistics() {
+  std::vector<std::pair<std::string, std::shared_ptr<SubscriptionStatistics>>>
+    result;
+  {
+    std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+    result.assign(
+      subscriptionStatistics.begin(), subscriptionStatistics.end());
+  }
+  std::sort(result.begin(), result.end(),
+    [](
+      std::pair<std::string, std::shared_ptr<SubscriptionStatistics>> const &a,
+      std::pair<std::string, std::shared_ptr<SubscriptionStatistics>> const &b) {
+      return a.first < b.first;
+    });
+  return result;
+}
+
+ServerDiagnostics ServerConnection::getServerDiagnostics() const {
+  std::lock_guard<std::mutex> lock(serverDiagnosticsMutex);
+  return serverDiagnostics;
+}
+
 std::uint32_t ServerConnection::getSubscriptionLifetimeCount(
     const std::string &name) {
-  std::lock_guard<std::mutex> lock(mutex);
-  return subscriptions[name].lifetimeCount;
+  return getSubscriptionConfig(name).lifetimeCount;
 }
 
 std::uint32_t ServerConnection::getSubscriptionMaxKeepAliveCount(
     const std::string &name) {
-  std::lock_guard<std::mutex> lock(mutex);
-  return subscriptions[name].maxKeepAliveCount;
+  return getSubscriptionConfig(name).maxKeepAliveCount;
 }
 
 double ServerConnection::getSubscriptionPublishingInterval(
     const std::string &name) {
-  std::lock_guard<std::mutex> lock(mutex);
-  return subscriptions[name].publishingInterval;
+  return getSubscriptionConfig(name).publishingInterval;
+}
+
+std::shared_ptr<SubscriptionStatistics>
+    ServerConnection::getSubscriptionStatistics(const std::string &name) {
+  std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+  auto &statistics = subscriptionStatistics[name];
+  if (!statistics) {
+    statistics = std::make_shared<SubscriptionStatistics>();
+  }
+  return statistics;
+}
+
+std::shared_ptr<TrafficRecorder> ServerConnection::getTrafficRecorder() {
+  std::lock_guard<std::mutex> lock(trafficRecorderMutex);
+  return trafficRecorder;
 }
 
 UaVariant ServerConnection::read(const UaNodeId &nodeId) {
-  std::lock_guard<std::mutex> lock(mutex);
-  return readInternal(nodeId);
+  // The read operation is executed by the connection thread, because this is
+  // the only thread that may use the client. We simply wait for the result.
+  auto callback = std::make_shared<SyncReadCallback>();
+  auto future = callback->promise.get_future();
+  readAsync(nodeId, callback);
+  return future.get();
 }
 
 void ServerConnection::readAsync(const UaNodeId &nodeId,
@@ -131,6 +290,7 @@ void ServerConnection::readAsync(const UaNodeId &nodeId,
     std::lock_guard<std::mutex> lock(requestQueueMutex);
     requestQueue.push_back(std::move(request));
   }
+  statistics.updateQueueDepth(1);
   requestQueueCv.notify_all();
 }
 
@@ -143,30 +303,148 @@ void ServerConnection::removeMonitoredItem(const std::string &subscriptionName,
     std::lock_guard<std::mutex> lock(requestQueueMutex);
     requestQueue.push_back(std::move(request));
   }
+  statistics.updateQueueDepth(1);
   requestQueueCv.notify_all();
 }
 
+void ServerConnection::setConnectionThreadOptions(const std::string &name,
+    ThreadSchedulingPolicy schedulingPolicy, int priority,
+    const std::string &cpuAffinity) {
+#ifdef __linux__
+  // We parse the CPU list before changing anything, so that an invalid list
+  // does not result in the options only being applied partially.
+  // An empty list means that the affinity is not changed, so that an affinity
+  // inherited from the process (e.g. set through taskset or a cgroup) is kept.
+  cpu_set_t cpuSet;
+  if (!cpuAffinity.empty()) {
+    cpuSet = parseCpuList(cpuAffinity);
+  }
+  int policy;
+  switch (schedulingPolicy) {
+  case ThreadSchedulingPolicy::fifo:
+    policy = SCHED_FIFO;
+    break;
+  case ThreadSchedulingPolicy::roundRobin:
+    policy = SCHED_RR;
+    break;
+  default:
+    policy = SCHED_OTHER;
+    // SCHED_OTHER only supports a static priority of zero.
+    priority = 0;
+    break;
+  }
+  if (priority < ::sched_get_priority_min(policy)
+      || priority > ::sched_get_priority_max(policy)) {
+    throw std::invalid_argument(
+      std::string("The priority must be between ")
+      + std::to_string(::sched_get_priority_min(policy)) + " and "
+      + std::to_string(::sched_get_priority_max(policy))
+      + " for the selected scheduling policy.");
+  }
+  auto threadHandle = connectionThread.native_handle();
+  // We remember the current settings, so that we can restore them if one of
+  // the later steps fails. The name is applied last because (with the length
+  // limited to 15 characters) it is the step that is least likely to fail.
+  int oldPolicy;
+  ::sched_param oldSchedParam;
+  auto status = ::pthread_getschedparam(
+    threadHandle, &oldPolicy, &oldSchedParam);
+  if (status) {
+    throw std::runtime_error(
+      std::string("Could not get the scheduling policy: ")
+      + std::strerror(status));
+  }
+  cpu_set_t oldCpuSet;
+  status = ::pthread_getaffinity_np(
+    threadHandle, sizeof(oldCpuSet), &oldCpuSet);
+  if (status) {
+    throw std::runtime_error(
+      std::string("Could not get the CPU affinity: ")
+      + std::strerror(status));
+  }
+  ::sched_param schedParam;
+  std::memset(&schedParam, 0, sizeof(schedParam));
+  schedParam.sched_priority = priority;
+  status = ::pthread_setschedparam(threadHandle, policy, &schedParam);
+  if (status) {
+    throw std::runtime_error(
+      std::string("Could not set the scheduling policy: ")
+      + std::strerror(status));
+  }
+  if (!cpuAffinity.empty()) {
+    status = ::pthread_setaffinity_np(threadHandle, sizeof(cpuSet), &cpuSet);
+    if (status) {
+      ::pthread_setschedparam(threadHandle, oldPolicy, &oldSchedParam);
+      throw std::runtime_error(
+        std::string("Could not set the CPU affinity: ")
+        + std::strerror(status));
+    }
+  }
+  if (!name.empty()) {
+    // Linux limits thread names to 15 characters (plus the terminating null
+    // byte) and pthread_setname_np fails for longer names.
+    status = ::pthread_setname_np(threadHandle, name.substr(0, 15).c_str());
+    if (status) {
+      ::pthread_setaffinity_np(threadHandle, sizeof(oldCpuSet), &oldCpuSet);
+      ::pthread_setschedparam(threadHandle, oldPolicy, &oldSchedParam);
+      throw std::runtime_error(
+        std::string("Could not set the thread name: ")
+        + std::strerror(status));
+    }
+  }
+#else // __linux__
+  throw std::logic_error(
+    "Connection thread options are only supported on Linux.");
+#endif // __linux__
+}
+
+void ServerConnection::setProbeInterval(double interval) {
+  if (!(interval >= 0.0)) {
+    throw std::invalid_argument("The probe interval must not be negative.");
+  }
+  probeInterval.store(interval, std::memory_order_relaxed);
+}
+
+void ServerConnection::setServerDiagnosticsInterval(double interval) {
+  if (!(interval >= 0.0)) {
+    throw std::invalid_argument(
+      "The server diagnostics interval must not be negative.");
+  }
+  serverDiagnosticsInterval.store(interval, std::memory_order_relaxed);
+}
+
 void ServerConnection::setSubscriptionLifetimeCount(
     const std::string &name, std::uint32_t lifetimeCount) {
-  std::lock_guard<std::mutex> lock(mutex);
-  subscriptions[name].lifetimeCount = lifetimeCount;
+  std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+  subscriptionConfigs[name].lifetimeCount = lifetimeCount;
 }
 
 void ServerConnection::setSubscriptionMaxKeepAliveCount(
     const std::string &name, std::uint32_t maxKeepAliveCount) {
-  std::lock_guard<std::mutex> lock(mutex);
-  subscriptions[name].maxKeepAliveCount = maxKeepAliveCount;
+  std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+  subscriptionConfigs[name].maxKeepAliveCount = maxKeepAliveCount;
 }
 
 void ServerConnection::setSubscriptionPublishingInterval(
     const std::string &name, double publishingInterval) {
-  std::lock_guard<std::mutex> lock(mutex);
-  subscriptions[name].publishingInterval = publishingInterval;
+  std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+  subscriptionConfigs[name].publishingInterval = publishingInterval;
+}
+
+void ServerConnection::setTrafficRecorder(
+    std::shared_ptr<TrafficRecorder> recorder) {
+  std::lock_guard<std::mutex> lock(trafficRecorderMutex);
+  trafficRecorderSet = static_cast<bool>(recorder);
+  trafficRecorder = std::move(recorder);
 }
 
 void ServerConnection::write(const UaNodeId &nodeId, const UaVariant &value) {
-  std::lock_guard<std::mutex> lock(mutex);
-  writeInternal(nodeId, value);
+  // The write operation is executed by the connection thread, because this is
+  // the only thread that may use the client. We simply wait for the result.
+  auto callback = std::make_shared<SyncWriteCallback>();
+  auto future = callback->promise.get_future();
+  writeAsync(nodeId, value, callback);
+  future.get();
 }
 
 void ServerConnection::writeAsync(const UaNodeId &nodeId,
@@ -176,6 +454,7 @@ void ServerConnection::writeAsync(const UaNodeId &nodeId,
     std::lock_guard<std::mutex> lock(requestQueueMutex);
     requestQueue.push_back(std::move(request));
   }
+  statistics.updateQueueDepth(1);
   requestQueueCv.notify_all();
 }
 
@@ -209,10 +488,17 @@ ServerConnection::ServerConnection(const std::string &endpointUrl,
     const std::string &clientCertPath, const std::string &clientKeyPath,
     const std::string &serverCertPath, const std::string &applicationUri,
     bool useEncryption) :
-    applicationUri(applicationUri), endpointUrl(endpointUrl),
-    password(password), securityMode(securityMode), shutdownRequested(false),
+    applicationUri(applicationUri), clientAllocations("client"),
+    endpointUrl(endpointUrl), password(password), probeInterval(10.0),
+    recordAllocations("records"),
+    requestBudgetShare(RequestBudget::getInstance().createShare()),
+    securityMode(securityMode), serverDiagnosticsInterval(0.0),
+    shutdownRequested(false), sourceTimestamps(false),
+    trafficRecorderSet(false),
     useAuthentication(useAuthentication), useEncryption(useEncryption),
     username(username) {
+  StartupProfiler::PhaseTimer phaseTimer(
+    StartupProfiler::Phase::connectionSetup);
   // If encryption is enabled, we first have to read the client certificate and
   // key from their respective files. If a server certificate has been
   // specified, we load it as well.
@@ -228,7 +514,10 @@ ServerConnection::ServerConnection(const std::string &endpointUrl,
       "The encryption features are not available because the EPICS device support has been compiled without them. Please set USE_MBEDTLS to YES in configure/CONFIG_SITE.local and recompile the device support to enable them.");
 #endif
   }
-  // Now we can construct the client.
+  // Now we can construct the client. The memory allocated for the client is
+  // attributed to this connection, like the allocations made later by the
+  // connection thread.
+  AllocationStatistics::Scope allocationScope(&clientAllocations);
   this->client = UA_Client_new();
   if (!this->client) {
     throw UaException(UA_STATUSCODE_BADOUTOFMEMORY);
@@ -244,12 +533,6 @@ ServerConnection::ServerConnection(const std::string &endpointUrl,
     this->client = nullptr;
     throw;
   }
-  // Try to establish the connection so that read or write operations can
-  // proceed without an unnecessary delay.
-  {
-    std::lock_guard<std::mutex> lock(mutex);
-    connect();
-  }
 }
 
 void ServerConnection::activateMonitoredItem(Subscription &subscription,
@@ -279,10 +562,18 @@ void ServerConnection::activateMonitoredItem(Subscription &subscription,
     monitoredItem.samplingInterval;
   void *context = &monitoredItem;
   UA_Client_DeleteMonitoredItemCallback deleteCallback = nullptr;
+  // Timestamps are only requested if they are needed for the delivery latency,
+  // so that they are not sent with every notification otherwise.
+  auto timestampsToReturn = sourceTimestamps.load(std::memory_order_relaxed) ?
+    UA_TIMESTAMPSTORETURN_SOURCE : UA_TIMESTAMPSTORETURN_NEITHER;
+  auto startTime = std::chrono::steady_clock::now();
   auto monitoredItemCreateResult = UA_Client_MonitoredItems_createDataChange(
-    client, subscription.subscriptionId, UA_TIMESTAMPSTORETURN_NEITHER,
+    client, subscription.subscriptionId, timestampsToReturn,
     monitoredItemCreateRequest, context,
     monitoredItemDataChangeNotificationCallback, deleteCallback);
+  StartupProfiler::getInstance().addPhaseTime(
+    StartupProfiler::Phase::monitoredItemCreation, startTime,
+    std::chrono::steady_clock::now());
   auto status = monitoredItemCreateResult.statusCode;
   auto monitoredItemId = monitoredItemCreateResult.monitoredItemId;
   UA_MonitoredItemCreateRequest_clear(&monitoredItemCreateRequest);
@@ -290,22 +581,31 @@ void ServerConnection::activateMonitoredItem(Subscription &subscription,
   if (status == UA_STATUSCODE_GOOD) {
     monitoredItem.monitoredItemId = monitoredItemId;
     monitoredItem.active = true;
+    startupStatistics.countMonitoredItemCreated();
   } else {
+    startupStatistics.countMonitoredItemFailed();
     if (!maybeResetConnection(status) || !monitoredItem.active) {
       throw UaException(status);
     }
   }
 }
 
-void ServerConnection::activateSubscription(Subscription &subscription) {
+void ServerConnection::activateSubscription(
+    const std::string &subscriptionName, Subscription &subscription) {
   assert (!subscription.active);
+  auto config = getSubscriptionConfig(subscriptionName);
   auto createSubscriptionRequest = UA_CreateSubscriptionRequest_default();
-  createSubscriptionRequest.requestedLifetimeCount = subscription.lifetimeCount;
+  createSubscriptionRequest.requestedLifetimeCount = config.lifetimeCount;
   createSubscriptionRequest.requestedMaxKeepAliveCount =
-    subscription.maxKeepAliveCount;
+    config.maxKeepAliveCount;
   createSubscriptionRequest.requestedPublishingInterval =
-    subscription.publishingInterval;
-  void *context = nullptr;
+    config.publishingInterval;
+  if (!subscription.statistics) {
+    subscription.statistics = getSubscriptionStatistics(subscriptionName);
+  }
+  // Elements of an unordered_map are never moved, so we can safely use a
+  // pointer to the subscription as the context.
+  void *context = &subscription;
   auto createSubscriptionResponse = UA_Client_Subscriptions_create(
     client, createSubscriptionRequest, context, nullptr, nullptr);
   auto subscriptionId = createSubscriptionResponse.subscriptionId;
@@ -343,6 +643,7 @@ void ServerConnection::addMonitoredItemInternal(
   monitoredItems.emplace_back(
     callback, discardOldest, nodeId, queueSize, samplingInterval);
   auto &monitoredItem = monitoredItems.back();
+  monitoredItem.nodeCounters = &nodeStatistics.intern(nodeId);
   // The following actions might result in a UaException (e.g. because the
   // server is offline or does not support a certain option). For this reason,
   // we wrap it in a try-catch block and notifiy the callback of the problem if
@@ -351,7 +652,7 @@ void ServerConnection::addMonitoredItemInternal(
     // If the subscription has not been created on the server yet, we have to do
     // this first, before we can add the monitored item to it.
     if (!subscription.active) {
-      activateSubscription(subscription);
+      activateSubscription(subscriptionName, subscription);
     }
     // Now that we have an active subscription, we can register the monitored
     // item with the server.
@@ -363,12 +664,124 @@ void ServerConnection::addMonitoredItemInternal(
     } catch (...) {
       // We catch all exceptions because an exception in a callback should never
       // stop the connection thread.
-      errorExtendedPrintf(
-          "Exception from callback caught in connection thread.");
+      handleCallbackException();
     }
   }
 }
 
+void ServerConnection::callInternal(
+    std::vector<std::unique_ptr<Request>> &requests) {
+  // The node IDs and input arguments are not copied into the service request,
+  // so we must not clear it. The input arguments of all calls are kept in a
+  // single array, so that building the request only needs one allocation.
+  std::size_t numberOfInputArguments = 0;
+  for (auto &request : requests) {
+    numberOfInputArguments +=
+      dynamic_cast<CallRequest &>(*request).inputArguments.size();
+  }
+  std::vector<UA_Variant> inputArguments(numberOfInputArguments);
+  std::vector<UA_CallMethodRequest> methodsToCall(requests.size());
+  std::size_t inputArgumentIndex = 0;
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    auto &callRequest = dynamic_cast<CallRequest &>(*requests[i]);
+    auto &methodToCall = methodsToCall[i];
+    UA_CallMethodRequest_init(&methodToCall);
+    methodToCall.objectId = callRequest.objectId.get();
+    methodToCall.methodId = callRequest.methodId.get();
+    if (!callRequest.inputArguments.empty()) {
+      methodToCall.inputArguments = inputArguments.data() + inputArgumentIndex;
+      methodToCall.inputArgumentsSize = callRequest.inputArguments.size();
+    }
+    for (auto &inputArgument : callRequest.inputArguments) {
+      inputArguments[inputArgumentIndex++] = inputArgument.get();
+    }
+  }
+  UA_CallRequest request;
+  UA_CallRequest_init(&request);
+  request.methodsToCall = methodsToCall.data();
+  request.methodsToCallSize = methodsToCall.size();
+  // The trace only shows the first method, because all calls share a single
+  // service call. The node ID is computed inside the macro arguments, so that
+  // nothing is computed when tracing is disabled.
+  OPEN62541_TRACE_SERVICE_START(endpointUrl.c_str(),
+    static_cast<int>(RequestType::call),
+    &dynamic_cast<CallRequest &>(*requests.front()).methodId.get());
+  auto startTime = std::chrono::steady_clock::now();
+  auto response = UA_Client_Service_call(client, request);
+  recordServiceCall(startTime);
+  auto status = response.responseHeader.serviceResult;
+  OPEN62541_TRACE_SERVICE_END(endpointUrl.c_str(),
+    static_cast<int>(RequestType::call),
+    &dynamic_cast<CallRequest &>(*requests.front()).methodId.get(), status);
+  if (status != UA_STATUSCODE_GOOD && maybeResetConnectionNoThrow(status)) {
+    UA_CallResponse_clear(&response);
+    OPEN62541_TRACE_SERVICE_START(endpointUrl.c_str(),
+      static_cast<int>(RequestType::call),
+      &dynamic_cast<CallRequest &>(*requests.front()).methodId.get());
+    startTime = std::chrono::steady_clock::now();
+    response = UA_Client_Service_call(client, request);
+    recordServiceCall(startTime);
+    status = response.responseHeader.serviceResult;
+    OPEN62541_TRACE_SERVICE_END(endpointUrl.c_str(),
+      static_cast<int>(RequestType::call),
+      &dynamic_cast<CallRequest &>(*requests.front()).methodId.get(), status);
+  }
+  if (status == UA_STATUSCODE_GOOD && response.resultsSize != requests.size()) {
+    status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+  }
+  std::vector<UaVariant> outputArguments;
+  for (std::size_t i = 0; i < requests.size(); ++i) {
+    auto &callRequest = dynamic_cast<CallRequest &>(*requests[i]);
+    auto callStatus = status;
+    outputArguments.clear();
+    if (callStatus == UA_STATUSCODE_GOOD) {
+      auto &result = response.results[i];
+      // Uncertain results still carry output arguments, so we only treat bad
+      // status codes as a failure.
+      if (UA_StatusCode_isBad(result.statusCode)) {
+        callStatus = result.statusCode;
+      } else {
+        std::size_t size = 0;
+        for (std::size_t j = 0; j < result.outputArgumentsSize; ++j) {
+          size += UA_calcSizeBinary(
+            &result.outputArguments[j], &UA_TYPES[UA_TYPES_VARIANT]);
+          outputArguments.emplace_back(
+            std::move(result.outputArguments[j]));
+        }
+        // The size of the response is only known now, so we charge it to the
+        // request budget after the fact.
+        requestBudgetShare->charge(size);
+      }
+    }
+    statistics.increment(ConnectionStatistics::Counter::calls);
+    if (callStatus != UA_STATUSCODE_GOOD) {
+      statistics.increment(ConnectionStatistics::Counter::callFailures);
+    }
+    if (nodeStatistics.isSampling()) {
+      std::size_t size = 0;
+      for (auto &inputArgument : callRequest.inputArguments) {
+        size += UA_calcSizeBinary(
+          &inputArgument.get(), &UA_TYPES[UA_TYPES_VARIANT]);
+      }
+      NodeStatistics::Counters::add(
+        nodeStatistics.intern(callRequest.methodId).bytes, size);
+    }
+    try {
+      if (callStatus == UA_STATUSCODE_GOOD) {
+        callRequest.callback->success(
+          callRequest.methodId, outputArguments);
+      } else {
+        callRequest.callback->failure(callRequest.methodId, callStatus);
+      }
+    } catch (...) {
+      // We catch all exceptions because an exception in a callback should
+      // never stop the connection thread.
+      handleCallbackException();
+    }
+  }
+  UA_CallResponse_clear(&response);
+}
+
 void ServerConnection::configureClient() {
   auto config = UA_Client_getConfig(this->client);
   // The useEncryption flag can only be set to true if encryption is enabled at
@@ -438,17 +851,30 @@ void ServerConnection::configureClient() {
       throw UaException(statusCode);
     }
   }
+  // The notification callback needs access to the connection in order to
+  // update the statistics. UA_ClientConfig_setDefault resets the context, so
+  // we can only set it after the rest of the configuration is done.
+  config->clientContext = this;
 }
 
 bool ServerConnection::connect() {
   UA_StatusCode status;
+  auto startTime = std::chrono::steady_clock::now();
   if (useAuthentication) {
     status = UA_Client_connectUsername(client, endpointUrl.c_str(),
         username.c_str(), password.c_str());
   } else {
     status = UA_Client_connect(client, endpointUrl.c_str());
   }
+  statistics.setConnected(status == UA_STATUSCODE_GOOD);
   if (status == UA_STATUSCODE_GOOD) {
+    // For the startup profile, only the first successful attempt matters.
+    if (startupStatistics.getConnectTime() < 0.0) {
+      StartupProfiler::getInstance().addPhaseTime(
+        StartupProfiler::Phase::connect, startTime,
+        std::chrono::steady_clock::now());
+      startupStatistics.markConnected();
+    }
     // When the connection has been (re-)established, we also want to reactivate
     // all monitored items.
     for (auto &subscriptionEntry : subscriptions) {
@@ -461,7 +887,7 @@ bool ServerConnection::connect() {
       // Problems when activating a subscription should not keep us from trying
       // to activate other subscriptions.
       try  {
-        activateSubscription(subscription);
+        activateSubscription(subscriptionEntry.first, subscription);
         for (auto &monitoredItemsEntry : subscription.monitoredItems) {
           auto &monitoredItems = monitoredItemsEntry.second;
           for (auto &monitoredItem : monitoredItems) {
@@ -476,8 +902,7 @@ bool ServerConnection::connect() {
               } catch (...) {
                 // We catch all exceptions because an exception in a callback
                 // should never stop the connection thread.
-                errorExtendedPrintf(
-                    "Exception from callback caught in connection thread.");
+                handleCallbackException();
               }
             }
           }
@@ -494,8 +919,7 @@ bool ServerConnection::connect() {
             } catch (...) {
               // We catch all exceptions because an exception in a callback
               // should never stop the connection thread.
-              errorExtendedPrintf(
-                  "Exception from callback caught in connection thread.");
+              handleCallbackException();
             }
           }
         }
@@ -503,8 +927,11 @@ bool ServerConnection::connect() {
     }
     return true;
   } else {
-    errorExtendedPrintf("Could not connect to OPC UA server: %s",
-        UA_StatusCode_name(status));
+    statistics.increment(ConnectionStatistics::Counter::connectFailures);
+    // While the server is unavailable, this error occurs for every request
+    // that is sent, so we let the aggregator decide whether to print it.
+    ErrorLogAggregator::getInstance().logError(endpointUrl, nullptr,
+        "Could not connect to OPC UA server", status);
     return false;
   }
 }
@@ -529,6 +956,65 @@ void ServerConnection::deactivateSubscription(Subscription &subscription) {
   subscription.active = false;
 }
 
+std::size_t ServerConnection::estimateRequestSize(const Request &request) {
+  // The size of the headers is roughly the same for all requests, so we use a
+  // fixed value. For the payload, we only take the node ID and the value into
+  // account, which are the only parts that can be large.
+  constexpr std::size_t requestOverhead = 64;
+  switch (request.type) {
+  case RequestType::addMonitoredItem:
+    return requestOverhead + UA_calcSizeBinary(
+      &dynamic_cast<const AddMonitoredItemRequest &>(request).nodeId.get(),
+      &UA_TYPES[UA_TYPES_NODEID]);
+  case RequestType::read:
+    return requestOverhead + UA_calcSizeBinary(
+      &dynamic_cast<const ReadRequest &>(request).nodeId.get(),
+      &UA_TYPES[UA_TYPES_NODEID]);
+  case RequestType::removeMonitoredItem:
+    return requestOverhead + UA_calcSizeBinary(
+      &dynamic_cast<const RemoveMonitoredItemRequest &>(request).nodeId.get(),
+      &UA_TYPES[UA_TYPES_NODEID]);
+  case RequestType::write: {
+    auto &writeRequest = dynamic_cast<const WriteRequest &>(request);
+    return requestOverhead
+      + UA_calcSizeBinary(
+        &writeRequest.nodeId.get(), &UA_TYPES[UA_TYPES_NODEID])
+      + UA_calcSizeBinary(
+        &writeRequest.value.get(), &UA_TYPES[UA_TYPES_VARIANT]);
+  }
+  case RequestType::call: {
+    auto &callRequest = dynamic_cast<const CallRequest &>(request);
+    auto size = requestOverhead
+      + UA_calcSizeBinary(
+        &callRequest.objectId.get(), &UA_TYPES[UA_TYPES_NODEID])
+      + UA_calcSizeBinary(
+        &callRequest.methodId.get(), &UA_TYPES[UA_TYPES_NODEID]);
+    for (auto &inputArgument : callRequest.inputArguments) {
+      size += UA_calcSizeBinary(
+        &inputArgument.get(), &UA_TYPES[UA_TYPES_VARIANT]);
+    }
+    return size;
+  }
+  }
+  return requestOverhead;
+}
+
+ServerConnection::SubscriptionConfig ServerConnection::getSubscriptionConfig(
+    const std::string &name) {
+  std::lock_guard<std::mutex> lock(subscriptionConfigsMutex);
+  return subscriptionConfigs[name];
+}
+
+void ServerConnection::handleCallbackException() {
+  // A callback that throws usually does so for many requests (e.g. for all
+  // calls in a batch or for all monitored items when the connection is lost),
+  // so we let the aggregator decide whether to print the message.
+  ErrorLogAggregator::getInstance().logError(endpointUrl, nullptr,
+    "Exception from callback caught in connection thread",
+    UA_STATUSCODE_BADINTERNALERROR);
+  statistics.increment(ConnectionStatistics::Counter::callbackExceptions);
+}
+
 bool ServerConnection::maybeResetConnection(UA_StatusCode statusCode) {
   // We only try to reset the connection for specific status codes. For other
   // status codes resetting the connection is most likely not going to help
@@ -552,6 +1038,8 @@ bool ServerConnection::maybeResetConnection(UA_StatusCode statusCode) {
   // object, we first allocate the new client and only destroy the old client
   // if the allocation was successful. In the unlikely event that the
   // allocation fails, we continue using the old client object.
+  statistics.increment(ConnectionStatistics::Counter::reconnects);
+  statistics.setConnected(false);
   UA_Client *newClient = UA_Client_new();
   if (newClient) {
     UA_Client_delete(client);
@@ -576,8 +1064,7 @@ bool ServerConnection::maybeResetConnection(UA_StatusCode statusCode) {
           } catch (...) {
             // We catch all exceptions because an exception in a callback should
             // never stop the connection thread.
-            errorExtendedPrintf(
-                "Exception from callback caught in connection thread.");
+            handleCallbackException();
           }
         }
       }
@@ -586,27 +1073,264 @@ bool ServerConnection::maybeResetConnection(UA_StatusCode statusCode) {
   return connect();
 }
 
-UaVariant ServerConnection::readInternal(const UaNodeId &nodeId) {
-  UA_StatusCode status;
-  UA_Variant targetValue;
-  UA_Variant_init(&targetValue);
-  status = UA_Client_readValueAttribute(client, nodeId.get(), &targetValue);
+bool ServerConnection::maybeResetConnectionNoThrow(UA_StatusCode statusCode) {
+  // Configuring the new client only fails in rare cases (e.g. when running out
+  // of memory). We log these cases, so that they can be diagnosed, but we do
+  // not want to handle an exception for every failed operation.
+  try {
+    return maybeResetConnection(statusCode);
+  } catch (UaException const &e) {
+    errorExtendedPrintf("Could not configure the OPC UA client: %s",
+      UA_StatusCode_name(e.getStatusCode()));
+    return false;
+  }
+}
+
+void ServerConnection::recordServiceCall(
+    std::chrono::steady_clock::time_point startTime) {
+  statistics.recordServiceCall(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - startTime).count());
+}
+
+void ServerConnection::probeServer() {
+  readService(nullptr, nullptr, true);
+}
+
+void ServerConnection::processProbeResult(const UA_DataValue &result,
+    UA_DateTime sendTime, UA_DateTime receiveTime,
+    std::uint64_t roundTripTime) {
+  statistics.recordLatency(ConnectionStatistics::Latency::probe,
+    roundTripTime);
+  if (!result.hasValue
+      || (result.hasStatus && result.status != UA_STATUSCODE_GOOD)
+      || !UA_Variant_hasScalarType(
+        &result.value, &UA_TYPES[UA_TYPES_DATETIME])) {
+    return;
+  }
+  // We assume that the server read its clock halfway between sending and
+  // receiving the request, so the offset has an uncertainty of half the
+  // round-trip time. Like NTP, we use the sample with the shortest round-trip
+  // time from the most recent samples, because it has the least uncertainty.
+  auto serverTime = *static_cast<const UA_DateTime *>(result.value.data);
+  auto localTime = sendTime + (receiveTime - sendTime) / 2;
+  ClockSample sample{
+    (serverTime - localTime) * (1000 / UA_DATETIME_USEC), roundTripTime};
+  const std::size_t maxClockSamples = 8;
+  if (clockSamples.size() >= maxClockSamples) {
+    clockSamples.erase(clockSamples.begin());
+  }
+  clockSamples.push_back(sample);
+  auto best = std::min_element(clockSamples.begin(), clockSamples.end(),
+    [](const ClockSample &a, const ClockSample &b) {
+      return a.roundTripTime < b.roundTripTime;
+    });
+  statistics.setClockOffset(best->offset, best->roundTripTime / 2);
+}
+
+UA_StatusCode ServerConnection::readInternal(const UaNodeId &nodeId,
+    UaVariant &value, bool probe) {
+  // When the server is unavailable, every queued read fails, so we return the
+  // status code instead of throwing an exception, which would be much more
+  // expensive.
+  auto status = readService(&nodeId.get(), &value, probe);
+  // The probe is not repeated, because it has already been sent with the
+  // first attempt.
+  if (status != UA_STATUSCODE_GOOD && maybeResetConnectionNoThrow(status)) {
+    status = readService(&nodeId.get(), &value, false);
+  }
+  return status;
+}
+
+void ServerConnection::readServerDiagnostics() {
+  nextServerDiagnosticsTime = std::chrono::steady_clock::now()
+    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(
+        serverDiagnosticsInterval.load(std::memory_order_relaxed)));
+  // Both arrays are read with a single service call.
+  UA_ReadValueId items[2];
+  UA_ReadValueId_init(&items[0]);
+  items[0].nodeId = UA_NODEID_NUMERIC(0,
+    UA_NS0ID_SERVER_SERVERDIAGNOSTICS_SESSIONSDIAGNOSTICSSUMMARY_SESSIONDIAGNOSTICSARRAY);
+  items[0].attributeId = UA_ATTRIBUTEID_VALUE;
+  UA_ReadValueId_init(&items[1]);
+  items[1].nodeId = UA_NODEID_NUMERIC(0,
+    UA_NS0ID_SERVER_SERVERDIAGNOSTICS_SUBSCRIPTIONDIAGNOSTICSARRAY);
+  items[1].attributeId = UA_ATTRIBUTEID_VALUE;
+  UA_ReadRequest request;
+  UA_ReadRequest_init(&request);
+  request.nodesToRead = items;
+  request.nodesToReadSize = 2;
+  auto response = UA_Client_Service_read(client, request);
+  ServerDiagnostics diagnostics;
+  diagnostics.readTime = std::chrono::system_clock::now();
+  auto status = response.responseHeader.serviceResult;
+  if (status == UA_STATUSCODE_GOOD && response.resultsSize != 2) {
+    status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+  }
+  auto getArray = [&response, &status](std::size_t index,
+      const UA_ExtensionObject *&array, std::size_t &size) {
+    auto &result = response.results[index];
+    if (result.hasStatus && result.status != UA_STATUSCODE_GOOD) {
+      status = result.status;
+      return;
+    }
+    if (!result.hasValue || !UA_Variant_hasArrayType(&result.value,
+        &UA_TYPES[UA_TYPES_EXTENSIONOBJECT])) {
+      status = UA_STATUSCODE_BADTYPEMISMATCH;
+      return;
+    }
+    array = static_cast<const UA_ExtensionObject *>(result.value.data);
+    size = result.value.arrayLength;
+  };
+  const UA_ExtensionObject *sessionArray = nullptr;
+  std::size_t sessionArraySize = 0;
+  const UA_ExtensionObject *subscriptionArray = nullptr;
+  std::size_t subscriptionArraySize = 0;
+  if (status == UA_STATUSCODE_GOOD) {
+    getArray(1, subscriptionArray, subscriptionArraySize);
+  }
   if (status == UA_STATUSCODE_GOOD) {
-    return UaVariant(std::move(targetValue));
+    // Many servers only provide the subscription diagnostics, so we do not
+    // treat a missing session array as an error.
+    UA_StatusCode subscriptionStatus = status;
+    getArray(0, sessionArray, sessionArraySize);
+    status = subscriptionStatus;
+  }
+  if (status != UA_STATUSCODE_GOOD) {
+    diagnostics.error = UA_StatusCode_name(status);
   } else {
-    if (maybeResetConnection(status)) {
-      status = UA_Client_readValueAttribute(client, nodeId.get(), &targetValue);
-      if (status == UA_STATUSCODE_GOOD) {
-        return UaVariant(std::move(targetValue));
+    diagnostics.available = true;
+    // The client does not know the ID of its session, so we find it through
+    // the subscriptions: Subscription IDs are only unique within a session on
+    // some servers, so we use the session that has the most subscriptions
+    // with IDs that match the IDs of our subscriptions.
+    std::unordered_map<std::uint32_t, std::string> subscriptionNames;
+    for (auto &entry : subscriptions) {
+      if (entry.second.active) {
+        subscriptionNames[entry.second.subscriptionId] = entry.first;
+      }
+    }
+    std::vector<SubscriptionServerDiagnostics> candidates;
+    std::map<std::string, std::size_t> matchesPerSession;
+    for (std::size_t i = 0; i < subscriptionArraySize; ++i) {
+      SubscriptionServerDiagnostics subscriptionDiagnostics;
+      if (decodeSubscriptionDiagnostics(
+          subscriptionArray[i], subscriptionDiagnostics)
+          && subscriptionNames.count(subscriptionDiagnostics.subscriptionId)) {
+        ++matchesPerSession[subscriptionDiagnostics.sessionId];
+        candidates.push_back(std::move(subscriptionDiagnostics));
+      }
+    }
+    std::string sessionId;
+    std::size_t maxMatches = 0;
+    bool ambiguous = false;
+    for (auto &entry : matchesPerSession) {
+      if (entry.second > maxMatches) {
+        sessionId = entry.first;
+        maxMatches = entry.second;
+        ambiguous = false;
+      } else if (entry.second == maxMatches) {
+        ambiguous = true;
+      }
+    }
+    if (ambiguous) {
+      diagnostics.error = "The session cannot be identified.";
+    } else if (maxMatches) {
+      for (auto &candidate : candidates) {
+        if (candidate.sessionId == sessionId) {
+          diagnostics.subscriptions[
+            subscriptionNames[candidate.subscriptionId]] = candidate;
+        }
+      }
+      for (std::size_t i = 0; i < sessionArraySize; ++i) {
+        SessionServerDiagnostics sessionDiagnostics;
+        if (decodeSessionDiagnostics(sessionArray[i], sessionDiagnostics)
+            && sessionDiagnostics.sessionId == sessionId) {
+          diagnostics.session = std::move(sessionDiagnostics);
+          diagnostics.sessionAvailable = true;
+          break;
+        }
+      }
+    }
+  }
+  UA_ReadResponse_clear(&response);
+  std::lock_guard<std::mutex> lock(serverDiagnosticsMutex);
+  serverDiagnostics = std::move(diagnostics);
+}
+
+UA_StatusCode ServerConnection::readService(const UA_NodeId *nodeId,
+    UaVariant *value, bool probe) {
+  // The value of a node and the server's current time (for the probe) can be
+  // read with a single service call, so that the probe does not cause an
+  // extra round trip when there are read requests anyway.
+  static const UA_NodeId currentTimeNodeId = UA_NODEID_NUMERIC(
+    0, UA_NS0ID_SERVER_SERVERSTATUS_CURRENTTIME);
+  UA_ReadValueId items[2];
+  std::size_t numberOfItems = 0;
+  if (nodeId) {
+    UA_ReadValueId_init(&items[numberOfItems]);
+    // The node ID is not copied, so we must not clear the request.
+    items[numberOfItems].nodeId = *nodeId;
+    items[numberOfItems].attributeId = UA_ATTRIBUTEID_VALUE;
+    ++numberOfItems;
+  }
+  if (probe) {
+    UA_ReadValueId_init(&items[numberOfItems]);
+    items[numberOfItems].nodeId = currentTimeNodeId;
+    items[numberOfItems].attributeId = UA_ATTRIBUTEID_VALUE;
+    ++numberOfItems;
+    nextProbeTime = std::chrono::steady_clock::now()
+      + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(
+          probeInterval.load(std::memory_order_relaxed)));
+  }
+  UA_ReadRequest request;
+  UA_ReadRequest_init(&request);
+  request.nodesToRead = items;
+  request.nodesToReadSize = numberOfItems;
+  // The node ID for the trace is computed inside the macro arguments, so that
+  // nothing is computed when tracing is disabled.
+  OPEN62541_TRACE_SERVICE_START(endpointUrl.c_str(),
+    static_cast<int>(RequestType::read),
+    nodeId ? nodeId : &currentTimeNodeId);
+  auto startTime = std::chrono::steady_clock::now();
+  auto sendTime = UA_DateTime_now();
+  auto response = UA_Client_Service_read(client, request);
+  auto receiveTime = UA_DateTime_now();
+  auto roundTripTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - startTime).count();
+  if (nodeId) {
+    statistics.recordServiceCall(roundTripTime);
+  }
+  auto status = response.responseHeader.serviceResult;
+  if (status == UA_STATUSCODE_GOOD && response.resultsSize != numberOfItems) {
+    status = UA_STATUSCODE_BADUNEXPECTEDERROR;
+  }
+  if (status == UA_STATUSCODE_GOOD && probe) {
+    processProbeResult(response.results[numberOfItems - 1], sendTime,
+      receiveTime, roundTripTime);
+  }
+  // We use the same rules as UA_Client_readValueAttribute: The status of the
+  // result is used if present, and a result without a value is an error.
+  if (status == UA_STATUSCODE_GOOD && nodeId) {
+    auto &result = response.results[0];
+    if (result.hasStatus) {
+      status = result.status;
+    }
+    if (status == UA_STATUSCODE_GOOD) {
+      if (result.hasValue) {
+        *value = UaVariant(std::move(result.value));
       } else {
-        UA_Variant_clear(&targetValue);
-        throw UaException(status);
+        status = UA_STATUSCODE_BADUNEXPECTEDERROR;
       }
-    } else {
-      UA_Variant_clear(&targetValue);
-      throw UaException(status);
     }
   }
+  UA_ReadResponse_clear(&response);
+  OPEN62541_TRACE_SERVICE_END(endpointUrl.c_str(),
+    static_cast<int>(RequestType::read),
+    nodeId ? nodeId : &currentTimeNodeId, status);
+  return status;
 }
 
 void ServerConnection::removeMonitoredItemInternal(
@@ -650,14 +1374,27 @@ void ServerConnection::removeMonitoredItemInternal(
 }
 
 void ServerConnection::runConnectionThread() {
+#ifdef __linux__
+  // We give the thread a default name so that it can be identified in tools
+  // like top. The name can be changed through setConnectionThreadOptions.
+  ::pthread_setname_np(::pthread_self(), "open62541");
+#endif // __linux__
+  // All allocations made by the client in this thread are attributed to this
+  // connection.
+  AllocationStatistics::Scope allocationScope(&clientAllocations);
+  // Try to establish the connection right away, so that queued read or write
+  // operations can proceed without an unnecessary delay.
+  connect();
+  Request *lastDeferredRequest = nullptr;
+  // Calls that are taken from the queue together with the first one. The
+  // vector is kept, so that its memory can be reused.
+  std::vector<std::unique_ptr<Request>> callRequests;
   while (!shutdownRequested.load(std::memory_order_acquire)) {
     {
       // On each iteration, we have the client do some background activity, like
-      // processing notifications and calling callbacks. We need to hold the
-      // mutex while doing this because no other calls should be made to the
-      // client while doing this and our callbacks also depend on the mutex
-      // being held.
-      std::lock_guard<std::mutex> lock(mutex);
+      // processing notifications and calling callbacks. The client is only
+      // used by this thread, so we do not need to hold a mutex while doing
+      // this.
       auto status = UA_Client_run_iterate(client, 0);
       // If there is an error, we reset the connection for certain status codes.
       if (status != UA_STATUSCODE_GOOD) {
@@ -674,11 +1411,30 @@ void ServerConnection::runConnectionThread() {
         }
       }
     }
+    // The diagnostics are read from the server independently of any requests,
+    // because they are read much less frequently than the server is probed.
+    auto diagnosticsInterval =
+      serverDiagnosticsInterval.load(std::memory_order_relaxed);
+    if (diagnosticsInterval > 0.0 && statistics.isConnected()
+        && std::chrono::steady_clock::now() >= nextServerDiagnosticsTime) {
+      readServerDiagnostics();
+    }
+    // The server's clock is probed periodically. If the next request is a
+    // read request, the probe is sent together with it. Otherwise, it is sent
+    // on its own.
+    auto interval = probeInterval.load(std::memory_order_relaxed);
+    bool probeDue = interval > 0.0 && statistics.isConnected()
+      && std::chrono::steady_clock::now() >= nextProbeTime;
     // We need to hold a lock on the mutex protecting access to the request
     // queue while trying to retrieve the next request.
     std::unique_ptr<Request> request;
     {
       std::unique_lock<std::mutex> requestQueueLock(requestQueueMutex);
+      if (requestQueue.empty() && probeDue) {
+        requestQueueLock.unlock();
+        probeServer();
+        continue;
+      }
       if (requestQueue.empty()) {
         // If the request queue is empty, we sleep for one millisecond. After that
         // time, we wake up in order to have the client process background
@@ -686,12 +1442,61 @@ void ServerConnection::runConnectionThread() {
         requestQueueCv.wait_for(requestQueueLock, std::chrono::milliseconds(1));
         continue;
       }
+      // Before sending the next request, we have to check whether there is
+      // enough room in the IOC-wide request budget. If not, we leave the
+      // request in the queue and try again later. We do not wait for the full
+      // time, because we still have to process background activity.
+      auto waitTime = requestBudgetShare->acquire(
+        estimateRequestSize(*requestQueue.front()));
+      if (waitTime > std::chrono::nanoseconds::zero()) {
+        // We only count each deferred request once, even though we check the
+        // budget again on every iteration.
+        if (requestQueue.front().get() != lastDeferredRequest) {
+          lastDeferredRequest = requestQueue.front().get();
+          statistics.increment(ConnectionStatistics::Counter::deferredRequests);
+        }
+        requestQueueLock.unlock();
+        std::this_thread::sleep_for(
+          std::min<std::chrono::nanoseconds>(
+            waitTime, std::chrono::milliseconds(1)));
+        continue;
+      }
       request = std::move(requestQueue.front());
       requestQueue.pop_front();
+      // Calls that directly follow a call in the queue are sent in the same
+      // service request. Each of them still needs room in the request budget,
+      // and we stop at the first request that is not a call or does not fit,
+      // so that the order of the requests is preserved.
+      if (request->type == RequestType::call) {
+        while (callRequests.size() + 1 < maxCallsPerRequest
+            && !requestQueue.empty()
+            && requestQueue.front()->type == RequestType::call
+            && requestBudgetShare->acquire(
+              estimateRequestSize(*requestQueue.front()))
+              == std::chrono::nanoseconds::zero()) {
+          callRequests.push_back(std::move(requestQueue.front()));
+          requestQueue.pop_front();
+        }
+      }
+    }
+    statistics.updateQueueDepth(
+      -1 - static_cast<std::ptrdiff_t>(callRequests.size()));
+    auto dequeueTime = std::chrono::steady_clock::now();
+    OPEN62541_TRACE_REQUEST_DEQUEUE(endpointUrl.c_str(),
+      static_cast<int>(request->type), statistics.getQueueDepth());
+    statistics.recordLatency(ConnectionStatistics::Latency::queue,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        dequeueTime - request->enqueueTime).count());
+    for (auto &callRequest : callRequests) {
+      OPEN62541_TRACE_REQUEST_DEQUEUE(endpointUrl.c_str(),
+        static_cast<int>(callRequest->type), statistics.getQueueDepth());
+      statistics.recordLatency(ConnectionStatistics::Latency::queue,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          dequeueTime - callRequest->enqueueTime).count());
+    }
+    if (probeDue && request->type != RequestType::read) {
+      probeServer();
     }
-    // While processing the requests, we have to hold a lock on the general
-    // mutex.
-    std::lock_guard<std::mutex> lock(mutex);
     switch (request->type) {
     case RequestType::addMonitoredItem: {
       AddMonitoredItemRequest &addMonitoredItemRequest =
@@ -708,13 +1513,30 @@ void ServerConnection::runConnectionThread() {
     case RequestType::read: {
       ReadRequest &readRequest = *(dynamic_cast<ReadRequest *>(
         request.get()));
-      UA_StatusCode status;
       UaVariant value;
-      try {
-        value = readInternal(readRequest.nodeId);
-        status = UA_STATUSCODE_GOOD;
-      } catch (UaException const &e) {
-        status = e.getStatusCode();
+      UA_StatusCode status = readInternal(readRequest.nodeId, value, probeDue);
+      statistics.increment(ConnectionStatistics::Counter::reads);
+      if (status != UA_STATUSCODE_GOOD) {
+        statistics.increment(ConnectionStatistics::Counter::readFailures);
+      }
+      if (status == UA_STATUSCODE_GOOD) {
+        // The size of the response is only known now, so we charge it to the
+        // request budget after the fact.
+        auto size =
+          UA_calcSizeBinary(&value.get(), &UA_TYPES[UA_TYPES_VARIANT]);
+        requestBudgetShare->charge(size);
+        // Looking up the node is only worth it while someone is looking at
+        // the per-node statistics.
+        if (nodeStatistics.isSampling()) {
+          NodeStatistics::Counters::add(
+            nodeStatistics.intern(readRequest.nodeId).bytes, size);
+        }
+      }
+      if (trafficRecorderSet.load(std::memory_order_relaxed)) {
+        auto recorder = getTrafficRecorder();
+        if (recorder) {
+          recorder->recordRead(readRequest.nodeId, value.get(), status);
+        }
       }
       try {
         if (status == UA_STATUSCODE_GOOD) {
@@ -725,8 +1547,7 @@ void ServerConnection::runConnectionThread() {
       } catch (...) {
         // We catch all exceptions because an exception in a callback should
         // never stop the connection thread.
-        errorExtendedPrintf(
-            "Exception from callback caught in connection thread.");
+        handleCallbackException();
       }
       break;
     }
@@ -742,12 +1563,24 @@ void ServerConnection::runConnectionThread() {
     case RequestType::write: {
       WriteRequest &writeRequest = *(dynamic_cast<WriteRequest *>(
         request.get()));
-      UA_StatusCode status;
-      try {
-        writeInternal(writeRequest.nodeId, writeRequest.value);
-        status = UA_STATUSCODE_GOOD;
-      } catch (UaException const &e) {
-        status = e.getStatusCode();
+      UA_StatusCode status = writeInternal(
+        writeRequest.nodeId, writeRequest.value);
+      statistics.increment(ConnectionStatistics::Counter::writes);
+      if (nodeStatistics.isSampling()) {
+        NodeStatistics::Counters::add(
+          nodeStatistics.intern(writeRequest.nodeId).bytes,
+          UA_calcSizeBinary(
+            &writeRequest.value.get(), &UA_TYPES[UA_TYPES_VARIANT]));
+      }
+      if (status != UA_STATUSCODE_GOOD) {
+        statistics.increment(ConnectionStatistics::Counter::writeFailures);
+      }
+      if (trafficRecorderSet.load(std::memory_order_relaxed)) {
+        auto recorder = getTrafficRecorder();
+        if (recorder) {
+          recorder->recordWrite(
+            writeRequest.nodeId, writeRequest.value.get(), status);
+        }
       }
       try {
         if (status == UA_STATUSCODE_GOOD) {
@@ -758,29 +1591,42 @@ void ServerConnection::runConnectionThread() {
       } catch (...) {
         // We catch all exceptions because an exception in a callback should
         // never stop the connection thread.
-        errorExtendedPrintf(
-            "Exception from callback caught in connection thread.");
+        handleCallbackException();
       }
       break;
     }
+    case RequestType::call: {
+      // The first call has been kept separately from the calls that were
+      // taken from the queue together with it, so it has to be put in front.
+      callRequests.insert(callRequests.begin(), std::move(request));
+      callInternal(callRequests);
+      callRequests.clear();
+      break;
+    }
     }
   }
 }
 
-void ServerConnection::writeInternal(const UaNodeId &nodeId,
+UA_StatusCode ServerConnection::writeInternal(const UaNodeId &nodeId,
     const UaVariant &value) {
   UA_StatusCode status;
+  OPEN62541_TRACE_SERVICE_START(endpointUrl.c_str(),
+    static_cast<int>(RequestType::write), &nodeId.get());
+  auto startTime = std::chrono::steady_clock::now();
   status = UA_Client_writeValueAttribute(client, nodeId.get(), &value.get());
-  if (status != UA_STATUSCODE_GOOD) {
-    if (maybeResetConnection(status)) {
-      status = UA_Client_writeValueAttribute(client, nodeId.get(), &value.get());
-      if (status != UA_STATUSCODE_GOOD) {
-        throw UaException(status);
-      }
-    } else {
-      throw UaException(status);
-    }
+  recordServiceCall(startTime);
+  OPEN62541_TRACE_SERVICE_END(endpointUrl.c_str(),
+    static_cast<int>(RequestType::write), &nodeId.get(), status);
+  if (status != UA_STATUSCODE_GOOD && maybeResetConnectionNoThrow(status)) {
+    OPEN62541_TRACE_SERVICE_START(endpointUrl.c_str(),
+      static_cast<int>(RequestType::write), &nodeId.get());
+    startTime = std::chrono::steady_clock::now();
+    status = UA_Client_writeValueAttribute(client, nodeId.get(), &value.get());
+    recordServiceCall(startTime);
+    OPEN62541_TRACE_SERVICE_END(endpointUrl.c_str(),
+      static_cast<int>(RequestType::write), &nodeId.get(), status);
   }
+  return status;
 }
 
 void ServerConnection::monitoredItemDataChangeNotificationCallback(
@@ -789,12 +1635,76 @@ void ServerConnection::monitoredItemDataChangeNotificationCallback(
     UA_DataValue *value) {
   MonitoredItem *monitoredItem =
     static_cast<MonitoredItem *>(monitoredItemContext);
+  ServerConnection *connection =
+    static_cast<ServerConnection *>(UA_Client_getContext(client));
+  Subscription *subscription = static_cast<Subscription *>(subscriptionContext);
+  OPEN62541_TRACE_NOTIFICATION(connection->endpointUrl.c_str(),
+    subscriptionId, monitoredItemId,
+    value->hasStatus ? value->status : UA_STATUSCODE_GOOD);
+  // The value is moved to the callback further down, so we have to record it
+  // before processing it.
+  if (connection->trafficRecorderSet.load(std::memory_order_relaxed)) {
+    auto recorder = connection->getTrafficRecorder();
+    if (recorder) {
+      recorder->recordNotification(monitoredItem->nodeId, *value);
+    }
+  }
+  // The source timestamp is generated by the server, so a negative delivery
+  // time can only be caused by clocks that are not synchronized (and an
+  // estimate of the clock offset that is not precise enough). We do not
+  // record such values because they would only distort the histogram.
+  if (value->hasSourceTimestamp) {
+    auto deliveryTime = UA_DateTime_now() - value->sourceTimestamp;
+    // If the offset of the server's clock is known, we correct the source
+    // timestamp. This assumes that the source timestamp has been generated
+    // using the server's clock.
+    double clockOffset, clockOffsetUncertainty;
+    if (connection->statistics.getClockOffset(
+        clockOffset, clockOffsetUncertainty)) {
+      deliveryTime += static_cast<UA_DateTime>(clockOffset * UA_DATETIME_SEC);
+    }
+    if (deliveryTime >= 0) {
+      subscription->statistics->notificationDeliveryLatency.record(
+        static_cast<std::uint64_t>(deliveryTime) * (1000 / UA_DATETIME_USEC));
+    }
+  }
+  // The lower 16 bits of the status code do not signal an error but carry
+  // additional information. For data values, they tell whether the queue of
+  // the monitored item on the server has overflowed (so values have been
+  // lost).
+  UA_StatusCode status = UA_STATUSCODE_GOOD;
+  if (value->hasStatus) {
+    status = value->status & 0xFFFF0000;
+    if ((value->status & 0x00000C00) == UA_STATUSCODE_INFOTYPE_DATAVALUE
+        && (value->status & UA_STATUSCODE_INFOBITS_OVERFLOW)) {
+      connection->statistics.increment(
+        ConnectionStatistics::Counter::overflows);
+      subscription->statistics->recordOverflow(monitoredItem->nodeId);
+      monitoredItem->callback->overflow(monitoredItem->nodeId);
+    }
+  }
   if (value->hasValue) {
+    auto &nodeCounters = *monitoredItem->nodeCounters;
+    NodeStatistics::Counters::add(nodeCounters.notifications, 1);
+    // Encoding the value just for counting its size is too expensive to be
+    // done all the time, so we only do it while sampling is active.
+    if (connection->nodeStatistics.isSampling()) {
+      NodeStatistics::Counters::add(nodeCounters.bytes,
+        UA_calcSizeBinary(&value->value, &UA_TYPES[UA_TYPES_VARIANT]));
+    }
+    connection->statistics.increment(
+      ConnectionStatistics::Counter::notifications);
+    subscription->statistics->notifications.fetch_add(
+      1, std::memory_order_relaxed);
     monitoredItem->callback->success(
       monitoredItem->nodeId, std::move(value->value));
   }
-  if (value->hasStatus && value->status != UA_STATUSCODE_GOOD) {
-    monitoredItem->callback->failure(monitoredItem->nodeId, value->status);
+  if (status != UA_STATUSCODE_GOOD) {
+    connection->statistics.increment(
+      ConnectionStatistics::Counter::notificationFailures);
+    subscription->statistics->notificationFailures.fetch_add(
+      1, std::memory_order_relaxed);
+    monitoredItem->callback->failure(monitoredItem->nodeId, status);
   }
 }
 
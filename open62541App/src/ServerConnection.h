@@ -38,6 +38,7 @@
 #endif
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <list>
@@ -47,8 +48,17 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "AllocationStatistics.h"
+#include "Connection.h"
+#include "ConnectionStatistics.h"
+#include "NodeStatistics.h"
+#include "RequestBudget.h"
+#include "ServerDiagnostics.h"
+#include "StartupProfiler.h"
+#include "TrafficRecorder.h"
 #include "UaNodeId.h"
 #include "UaVariant.h"
 
@@ -59,96 +69,19 @@ namespace epics {
  * Connection to an OPC UA server. This class hides the details of how the
  * connection is established (and reestablished if needed) and implements the
  * I/O logic. Its methods are safe for concurrent use by multiple threads.
+ *
+ * All communication with the server is handled by a dedicated connection
+ * thread, which is the only thread that uses the client and the state of the
+ * subscriptions. Methods that only access the configuration never wait for
+ * this thread, so they do not block while a network operation is in progress.
+ *
+ * This class implements the Connection interface that is used by the device
+ * support for records.
  */
-class ServerConnection {
+class ServerConnection : public Connection {
 
 public:
 
-  /**
-   * Interface for a read callback. Read callbacks allow reading from a node in
-   * an asynchronous way, so that the calling code does not have to wait until
-   * the operation finishes.
-   */
-  class ReadCallback {
-
-  public:
-
-    /**
-     * Called when the operation succeeds. The node ID passed is the node ID
-     * specified in the read request. The value passed is the value read from
-     * the server.
-     */
-    virtual void success(const UaNodeId &nodeId, const UaVariant &value) = 0;
-
-    /**
-     * Called when a read operation fails. The node ID passed is the node ID
-     * specified in the read request. The status code  gives information about
-     * the cause of the failure.
-     */
-    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
-
-    /**
-     * Default constructor.
-     */
-    ReadCallback() {
-    }
-
-    /**
-     * Destructor. Virtual classes should have a virtual destructor.
-     */
-    virtual ~ReadCallback() {
-    }
-
-    // We do not want to allow copy or move construction or assignment.
-    ReadCallback(const ReadCallback &) = delete;
-    ReadCallback(ReadCallback &&) = delete;
-    ReadCallback &operator=(const ReadCallback &) = delete;
-    ReadCallback &operator=(ReadCallback &&) = delete;
-
-  };
-
-  /**
-   * Interface for a monitored item callback. Monitored utem callbacks are
-   * called when a notification about a data change is received for a monitored
-   * item.
-   */
-  class MonitoredItemCallback {
-
-  public:
-
-    /**
-     * Called when a successful notification is received. The node ID passed is
-     * the node ID specified in the read request. The value passed is the value
-     * received from the server.
-     */
-    virtual void success(const UaNodeId &nodeId, const UaVariant &value) = 0;
-
-    /**
-     * Called when there is a problem with the subscription (e.g. the connection
-     * is interrupted or the subscription cannot be registered with the server).
-     */
-    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
-
-    /**
-     * Default constructor.
-     */
-    MonitoredItemCallback() {
-    }
-
-    /**
-     * Destructor. Virtual classes should have a virtual destructor.
-     */
-    virtual ~MonitoredItemCallback() {
-    }
-
-    // We do not want to allow copy or move construction or assignment.
-    MonitoredItemCallback(const MonitoredItemCallback &) = delete;
-    MonitoredItemCallback(MonitoredItemCallback &&) = delete;
-    MonitoredItemCallback &operator=(const MonitoredItemCallback &) = delete;
-    MonitoredItemCallback &operator=(MonitoredItemCallback &&) = delete;
-
-  };
-
   /**
    * Security mode used when connecting to a server.
    */
@@ -178,44 +111,25 @@ public:
   };
 
   /**
-   * Interface for a write callback. Write callbacks allow writing to a node
-   * in an asynchronous way, so that the calling code does not have to wait
-   * until the operation finishes.
+   * Scheduling policy used for the connection thread.
    */
-  class WriteCallback {
-
-  public:
+  enum class ThreadSchedulingPolicy {
 
     /**
-     * Called when the operation succeeds. The node ID passed is the node ID
-     * specified in the write request.
+     * Regular time-sharing scheduling (SCHED_OTHER). The priority is ignored
+     * for this policy.
      */
-    virtual void success(const UaNodeId &nodeId) = 0;
+    other,
 
     /**
-     * Called when a write operation fails. The node ID passed is the node ID
-     * specified in the read request. The status code  gives information about
-     * the cause of the failure.
+     * Real-time first-in, first-out scheduling (SCHED_FIFO).
      */
-    virtual void failure(const UaNodeId &nodeId, UA_StatusCode statusCode) =0;
+    fifo,
 
     /**
-     * Default constructor.
+     * Real-time round-robin scheduling (SCHED_RR).
      */
-    WriteCallback() {
-    }
-
-    /**
-     * Destructor. Virtual classes should have a virtual destructor.
-     */
-    virtual ~WriteCallback() {
-    }
-
-    // We do not want to allow copy or move construction or assignment.
-    WriteCallback(const WriteCallback &) = delete;
-    WriteCallback(WriteCallback &&) = delete;
-    WriteCallback &operator=(const WriteCallback &) = delete;
-    WriteCallback &operator=(WriteCallback &&) = delete;
+    roundRobin
 
   };
 
@@ -273,7 +187,7 @@ public:
   /**
    * Destructor.
    */
-  ~ServerConnection();
+  virtual ~ServerConnection();
 
   /**
    * Registers a monitored item with this server connection.
@@ -298,11 +212,107 @@ public:
    * Even if the sampling interval is very short, notifications will only be
    * sent according to the publishing interval of the associated subscription.
    */
-  void addMonitoredItem(const std::string &subscriptionName,
+  virtual void addMonitoredItem(const std::string &subscriptionName,
       const UaNodeId &nodeId,
       std::shared_ptr<MonitoredItemCallback> const &callback,
       double samplingInterval, std::uint32_t queueSize, bool discardOldest);
 
+  /**
+   * Calls a method asynchronously. The call is queued like a write request.
+   * When the connection thread takes a call from the queue, it also takes the
+   * calls that directly follow it in the queue (up to a limit) and sends all
+   * of them in a single Call service request, so that the calls only need a
+   * single round trip. Calls are never reordered with respect to other
+   * requests.
+   */
+  virtual void callAsync(const UaNodeId &objectId, const UaNodeId &methodId,
+      const std::vector<UaVariant> &inputArguments,
+      std::shared_ptr<CallCallback> callback);
+
+  /**
+   * Returns the statistics for all subscriptions of this connection, sorted by
+   * the subscription name. The statistics for a subscription are created when
+   * the subscription is first used or when they are first requested through
+   * {@link #getSubscriptionStatistics(const std::string &)}.
+   */
+  std::vector<std::pair<std::string, std::shared_ptr<SubscriptionStatistics>>>
+      getAllSubscriptionStatistics();
+
+  /**
+   * Returns the account for the allocations made by the connection thread.
+   */
+  inline AllocationStatistics::Account &getClientAllocations() {
+    return clientAllocations;
+  }
+
+  /**
+   * Returns the account for the allocations made while processing records that
+   * use this connection.
+   */
+  virtual AllocationStatistics::Account &getRecordAllocations() {
+    return recordAllocations;
+  }
+
+  /**
+   * Returns the URL of the endpoint to which this connection is made.
+   */
+  virtual const std::string &getEndpointUrl() const {
+    return endpointUrl;
+  }
+
+  /**
+   * Returns the startup statistics for this connection.
+   */
+  virtual StartupStatistics &getStartupStatistics() {
+    return startupStatistics;
+  }
+
+  /**
+   * Returns the diagnostics that have last been read from the server. If the
+   * diagnostics have never been read, the available flag is false.
+   */
+  ServerDiagnostics getServerDiagnostics() const;
+
+  /**
+   * Returns the interval (in seconds) at which the diagnostics are read from
+   * the server. Zero means that they are not read.
+   */
+  inline double getServerDiagnosticsInterval() const {
+    return serverDiagnosticsInterval.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the statistics for this connection.
+   */
+  virtual ConnectionStatistics &getStatistics() {
+    return statistics;
+  }
+
+  /**
+   * Returns the table of per-node counters for this connection.
+   */
+  virtual NodeStatistics &getNodeStatistics() {
+    return nodeStatistics;
+  }
+
+  /**
+   * Returns the interval (in seconds) at which the server's clock is probed.
+   * Zero means that probing is disabled.
+   */
+  inline double getProbeInterval() const {
+    return probeInterval.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the share of the IOC-wide request budget that is used by this
+   * connection. The share can be used for changing the weight of this
+   * connection and for retrieving statistics about the requests that have been
+   * sent.
+   */
+  inline RequestBudget::Share &getRequestBudgetShare() {
+    return *requestBudgetShare;
+  }
+
   /**
    * Returns the lifetime count for the specified subscription.
    *
@@ -338,12 +348,30 @@ public:
    * If the publishing interval has not been set explicitly, the default value
    * (500 ms) is returned.
    */
-  double getSubscriptionPublishingInterval(const std::string &name);
+  virtual double getSubscriptionPublishingInterval(const std::string &name);
+
+  /**
+   * Returns the statistics for the specified subscription. If there are no
+   * statistics for the subscription yet, they are created, even if the
+   * subscription is not used by any monitored items.
+   */
+  virtual std::shared_ptr<SubscriptionStatistics> getSubscriptionStatistics(
+      const std::string &name);
+
+  /**
+   * Returns the recorder that captures the traffic of this connection. If the
+   * traffic is not captured, a pointer to null is returned.
+   */
+  std::shared_ptr<TrafficRecorder> getTrafficRecorder();
 
   /**
    * Reads a node's value. Throws an UaException if there is a problem.
+   *
+   * The read operation is executed by the connection thread and this method
+   * blocks until it has finished. For this reason, this method must not be
+   * called from one of the callbacks.
    */
-  UaVariant read(const UaNodeId &nodeId);
+  virtual UaVariant read(const UaNodeId &nodeId);
 
   /**
    * Reads a node's value asynchronously. When the operation completes, the
@@ -351,7 +379,7 @@ public:
    * ID so that the passed node ID does not have to be kept alive after this
    * method returns.
    */
-  void readAsync(const UaNodeId &nodeId,
+  virtual void readAsync(const UaNodeId &nodeId,
       std::shared_ptr<ReadCallback> callback);
 
   /**
@@ -360,10 +388,75 @@ public:
    * If the specified callback has not been previously registered for the
    * specified subscription and node ID, this method does nothing.
    */
-  void removeMonitoredItem(const std::string &subscriptionName,
+  virtual void removeMonitoredItem(const std::string &subscriptionName,
       const UaNodeId &nodeId,
       std::shared_ptr<MonitoredItemCallback> const &callback);
 
+  /**
+   * Configures the thread that handles the communication with the server.
+   *
+   * The name is shown by tools like top or perf. On Linux, it is truncated to
+   * 15 characters. If empty, the name is not changed.
+   *
+   * The priority is only used for the real-time scheduling policies (fifo and
+   * roundRobin) and must be in the range allowed by the operating system for
+   * the respective policy (typically 1 to 99). Using a real-time policy
+   * usually requires the CAP_SYS_NICE capability.
+   *
+   * The CPU affinity is specified as a list of CPU numbers and ranges (e.g.
+   * "0,2-3"). If empty, the affinity of the thread is not changed.
+   *
+   * Throws an exception if the options are invalid or cannot be applied. In
+   * this case, the previous settings of the thread are restored. These
+   * options are only supported on Linux. On other platforms, this method
+   * always throws an std::logic_error.
+   */
+  void setConnectionThreadOptions(const std::string &name,
+      ThreadSchedulingPolicy schedulingPolicy, int priority,
+      const std::string &cpuAffinity);
+
+  /**
+   * Sets the interval (in seconds) at which the server's clock is probed.
+   *
+   * The probe reads the server's current time (ns=0;i=2258). When a read
+   * request is sent anyway, the probe is added to that request instead of
+   * being sent separately. The round-trip time of the probe is added to the
+   * "probe" latency histogram, and the server's time is used for estimating
+   * the offset between the server's clock and the local clock.
+   *
+   * The default interval is 10 seconds. Setting it to zero disables probing.
+   * Throws an std::invalid_argument if the interval is negative.
+   */
+  void setProbeInterval(double interval);
+
+  /**
+   * Sets the interval (in seconds) at which the diagnostics are read from the
+   * server.
+   *
+   * The SessionDiagnosticsArray (ns=0;i=3707) and SubscriptionDiagnosticsArray
+   * (ns=0;i=2290) are read with a single service call, and the entries
+   * belonging to this connection's session and subscriptions are kept. Many
+   * servers do not expose these variables (or only to privileged users), in
+   * which case the diagnostics are marked as not available.
+   *
+   * By default, the diagnostics are not read (the interval is zero). Throws an
+   * std::invalid_argument if the interval is negative.
+   */
+  void setServerDiagnosticsInterval(double interval);
+
+  /**
+   * Enables or disables requesting source timestamps for monitored items.
+   *
+   * The source timestamps are only used for the delivery latency of
+   * notifications, so they are not requested by default, which saves eight
+   * bytes per value and notification. The setting only affects monitored
+   * items that are created after calling this method, so it should be set
+   * before iocInit.
+   */
+  inline void setSourceTimestamps(bool enabled) {
+    sourceTimestamps.store(enabled, std::memory_order_relaxed);
+  }
+
   /**
    * Sets the lifetime count for the specified subscription.
    *
@@ -410,8 +503,22 @@ public:
   void setSubscriptionPublishingInterval(const std::string &name,
       double publishingInterval);
 
+  /**
+   * Sets the recorder that captures the traffic of this connection.
+   *
+   * The notifications received for monitored items and the results of read
+   * and write operations are passed to the recorder, so that they can be
+   * replayed later. Passing a pointer to null stops capturing the traffic.
+   * The recorder is not closed by this method.
+   */
+  void setTrafficRecorder(std::shared_ptr<TrafficRecorder> recorder);
+
   /**
    * Writes to a node's value. Throws an UaException if there is a problem.
+   *
+   * The write operation is executed by the connection thread and this method
+   * blocks until it has finished. For this reason, this method must not be
+   * called from one of the callbacks.
    */
   void write(const UaNodeId &nodeId, const UaVariant &value);
 
@@ -421,7 +528,7 @@ public:
    * ID and value so that the passed node ID and value do not have to be kept
    * alive after this method returns.
    */
-  void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
+  virtual void writeAsync(const UaNodeId &nodeId, const UaVariant &value,
       std::shared_ptr<WriteCallback> callback);
 
 private:
@@ -432,6 +539,9 @@ private:
     std::shared_ptr<MonitoredItemCallback> callback;
     bool discardOldest;
     std::uint32_t monitoredItemId;
+    // The counters are owned by the connection's node statistics and stay
+    // valid for the lifetime of the connection.
+    NodeStatistics::Counters *nodeCounters = nullptr;
     UaNodeId nodeId;
     std::uint32_t queueSize;
     double samplingInterval;
@@ -447,15 +557,19 @@ private:
 
   // Using std::variant would be much more elegant than using a common base
   // class and std::unique_ptr, but we want to avoid a dependency on C++ 17.
+  // The numeric values of the request types are passed to the tracepoints, so
+  // they must be kept in sync with the description in open62541Trace.h.
   enum class RequestType {
-    addMonitoredItem, read, removeMonitoredItem, write
+    addMonitoredItem, read, removeMonitoredItem, write, call
   };
 
   struct Request {
 
+    std::chrono::steady_clock::time_point enqueueTime;
     RequestType type;
 
-    Request(RequestType type) : type(type) {}
+    Request(RequestType type) : enqueueTime(std::chrono::steady_clock::now()),
+        type(type) {}
 
     // We want the base class to be virtual so that we can use dynamic_cast.
     // The easiest way for getting this is making the destructor virtual.
@@ -486,6 +600,26 @@ private:
 
   };
 
+  struct CallRequest : Request {
+
+    std::shared_ptr<CallCallback> callback;
+    std::vector<UaVariant> inputArguments;
+    UaNodeId methodId;
+    UaNodeId objectId;
+
+    inline CallRequest(std::shared_ptr<CallCallback> const &callback,
+        UaNodeId const &objectId, UaNodeId const &methodId,
+        std::vector<UaVariant> const &inputArguments)
+        : Request(RequestType::call), callback(callback),
+        inputArguments(inputArguments), methodId(methodId),
+        objectId(objectId) {
+      if (!callback) {
+        throw std::invalid_argument("The callback must not be null.");
+      }
+    }
+
+  };
+
   struct ReadRequest : Request {
 
     std::shared_ptr<ReadCallback> callback;
@@ -536,33 +670,81 @@ private:
 
   };
 
+  // The state of a subscription is owned by the connection thread. It must
+  // never be accessed by any other thread.
   struct Subscription {
 
     bool active = false;
+    std::unordered_map<UaNodeId, std::vector<MonitoredItem>> monitoredItems;
+    std::shared_ptr<SubscriptionStatistics> statistics;
+    std::uint32_t subscriptionId;
+
+  };
+
+  // Result of a single probe of the server's clock. Both values are in
+  // nanoseconds.
+  struct ClockSample {
+
+    std::int64_t offset;
+    std::uint64_t roundTripTime;
+
+  };
+
+  // The configuration of a subscription is kept separately from its state, so
+  // that it can be accessed by other threads without having to wait for the
+  // connection thread. It is protected by subscriptionConfigsMutex.
+  struct SubscriptionConfig {
+
     std::uint32_t lifetimeCount = 10000;
     std::uint32_t maxKeepAliveCount = 10;
-    std::unordered_map<UaNodeId, std::vector<MonitoredItem>> monitoredItems;
     double publishingInterval = 500.0;
-    std::uint32_t subscriptionId;
 
   };
 
   std::string applicationUri;
   UA_Client *client;
+  AllocationStatistics::Account clientAllocations;
   std::vector<char> clientCert;
+  // The clock samples are only accessed by the connection thread.
+  std::vector<ClockSample> clockSamples;
   std::vector<char> clientKey;
   std::thread connectionThread;
   std::string endpointUrl;
   std::string issuerListDirPath;
-  std::mutex mutex;
+  // The time of the next probe is only accessed by the connection thread.
+  std::chrono::steady_clock::time_point nextProbeTime;
+  // The time when the server diagnostics are read next is only accessed by
+  // the connection thread.
+  std::chrono::steady_clock::time_point nextServerDiagnosticsTime;
+  NodeStatistics nodeStatistics;
   std::string password;
+  std::atomic<double> probeInterval;
+  AllocationStatistics::Account recordAllocations;
+  std::shared_ptr<RequestBudget::Share> requestBudgetShare;
   std::list<std::unique_ptr<Request>> requestQueue;
   std::condition_variable requestQueueCv;
   std::mutex requestQueueMutex;
   SecurityMode securityMode;
   std::vector<char> serverCert;
+  ServerDiagnostics serverDiagnostics;
+  std::atomic<double> serverDiagnosticsInterval;
+  mutable std::mutex serverDiagnosticsMutex;
   std::atomic<bool> shutdownRequested;
+  std::atomic<bool> sourceTimestamps;
+  StartupStatistics startupStatistics;
+  ConnectionStatistics statistics;
+  std::unordered_map<std::string, SubscriptionConfig> subscriptionConfigs;
+  std::mutex subscriptionConfigsMutex;
   std::unordered_map<std::string, Subscription> subscriptions;
+  // The subscription statistics are protected by subscriptionConfigsMutex.
+  std::unordered_map<std::string, std::shared_ptr<SubscriptionStatistics>>
+    subscriptionStatistics;
+  // The traffic recorder is protected by trafficRecorderMutex. The flag tells
+  // whether a recorder is set, so that the connection thread does not have to
+  // lock the mutex when the traffic is not captured.
+  std::shared_ptr<TrafficRecorder> trafficRecorder;
+  std::atomic<bool> trafficRecorderSet;
+  std::mutex trafficRecorderMutex;
   bool useAuthentication;
   bool useEncryption;
   std::string username;
@@ -582,24 +764,38 @@ private:
 
   void activateMonitoredItem(Subscription &subscription,
       MonitoredItem &monitoredItem);
-  void activateSubscription(Subscription &subscription);
+  void activateSubscription(const std::string &subscriptionName,
+      Subscription &subscription);
   void addMonitoredItemInternal(const std::string &subscriptionName,
       const UaNodeId &nodeId,
       std::shared_ptr<MonitoredItemCallback> const &callback,
       double samplingInterval, std::uint32_t queueSize, bool discardOldest);
+  void callInternal(std::vector<std::unique_ptr<Request>> &requests);
   void configureClient();
   bool connect();
   void deactivateMonitoredItem(Subscription &subscription,
       MonitoredItem &monitoredItem);
   void deactivateSubscription(Subscription &subscription);
+  SubscriptionConfig getSubscriptionConfig(const std::string &name);
+  void handleCallbackException();
   bool maybeResetConnection(UA_StatusCode statusCode);
-  UaVariant readInternal(const UaNodeId &nodeId);
+  bool maybeResetConnectionNoThrow(UA_StatusCode statusCode);
+  void probeServer();
+  void processProbeResult(const UA_DataValue &result, UA_DateTime sendTime,
+      UA_DateTime receiveTime, std::uint64_t roundTripTime);
+  UA_StatusCode readInternal(const UaNodeId &nodeId, UaVariant &value,
+      bool probe);
+  void readServerDiagnostics();
+  UA_StatusCode readService(const UA_NodeId *nodeId, UaVariant *value,
+      bool probe);
+  void recordServiceCall(std::chrono::steady_clock::time_point startTime);
   void removeMonitoredItemInternal(const std::string &subscriptionName,
       const UaNodeId &nodeId,
       std::shared_ptr<MonitoredItemCallback> const &callback);
   void runConnectionThread();
-  void writeInternal(const UaNodeId &nodeId, const UaVariant &value);
+  UA_StatusCode writeInternal(const UaNodeId &nodeId, const UaVariant &value);
 
+  static std::size_t estimateRequestSize(const Request &request);
   static void monitoredItemDataChangeNotificationCallback(UA_Client *client,
       UA_UInt32 subscriptionId, void *subscriptionContext,
       UA_UInt32 monitoredItemId, void *monitoredItemContext,
@@ -9,6 +9,7 @@
  * s7nodave device support, Copyright 2012-2015 aquenos GmbH.
  */
 
+#include <algorithm>
 #include <stdexcept>
 
 #include "ServerConnectionRegistry.h"
@@ -16,29 +17,91 @@
 namespace open62541 {
 namespace epics {
 
-std::shared_ptr<ServerConnection> ServerConnectionRegistry::getServerConnection(
+std::shared_ptr<Connection> ServerConnectionRegistry::getConnection(
     const std::string &connectionId) {
   // We have to hold the mutex in order to protect the map from concurrent
   // access.
   std::lock_guard<std::recursive_mutex> lock(mutex);
   auto connection = connections.find(connectionId);
   if (connection == connections.end()) {
+    return std::shared_ptr<Connection>();
+  } else {
+    return connection->second;
+  }
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<Connection>>>
+    ServerConnectionRegistry::getConnections() {
+  std::vector<std::pair<std::string, std::shared_ptr<Connection>>> result;
+  {
+    // We have to hold the mutex in order to protect the map from concurrent
+    // access.
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    result.assign(connections.begin(), connections.end());
+  }
+  std::sort(result.begin(), result.end(),
+    [](
+      std::pair<std::string, std::shared_ptr<Connection>> const &a,
+      std::pair<std::string, std::shared_ptr<Connection>> const &b) {
+      return a.first < b.first;
+    });
+  return result;
+}
+
+std::shared_ptr<ServerConnection> ServerConnectionRegistry::getServerConnection(
+    const std::string &connectionId) {
+  // We have to hold the mutex in order to protect the map from concurrent
+  // access.
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  auto connection = serverConnections.find(connectionId);
+  if (connection == serverConnections.end()) {
     return std::shared_ptr<ServerConnection>();
   } else {
     return connection->second;
   }
 }
 
+std::vector<std::pair<std::string, std::shared_ptr<ServerConnection>>>
+    ServerConnectionRegistry::getServerConnections() {
+  std::vector<std::pair<std::string, std::shared_ptr<ServerConnection>>>
+    result;
+  {
+    // We have to hold the mutex in order to protect the map from concurrent
+    // access.
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    result.assign(serverConnections.begin(), serverConnections.end());
+  }
+  std::sort(result.begin(), result.end(),
+    [](
+      std::pair<std::string, std::shared_ptr<ServerConnection>> const &a,
+      std::pair<std::string, std::shared_ptr<ServerConnection>> const &b) {
+      return a.first < b.first;
+    });
+  return result;
+}
+
+void ServerConnectionRegistry::registerConnection(
+    const std::string &connectionId, std::shared_ptr<Connection> connection) {
+  // We have to hold the mutex in order to protect the map from concurrent
+  // access.
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  if (connections.count(connectionId)) {
+    throw std::runtime_error("Connection ID is already in use.");
+  }
+  connections.insert(std::make_pair(connectionId, connection));
+}
+
 void ServerConnectionRegistry::registerServerConnection(
     const std::string &connectionId,
     std::shared_ptr<ServerConnection> connection) {
-  // We have to hold the mutex in order to protect the map from concurrent
+  // We have to hold the mutex in order to protect the maps from concurrent
   // access.
   std::lock_guard<std::recursive_mutex> lock(mutex);
   if (connections.count(connectionId)) {
     throw std::runtime_error("Connection ID is already in use.");
   }
   connections.insert(std::make_pair(connectionId, connection));
+  serverConnections.insert(std::make_pair(connectionId, connection));
 }
 
 ServerConnectionRegistry ServerConnectionRegistry::instance;
@@ -39,6 +39,8 @@
 
 #include <mutex>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "ServerConnection.h"
 
@@ -48,7 +50,10 @@ namespace epics {
 /**
  * Registry holding server connections. Server connections are registered with
  * the registry during initialization and can then be retrieved for use by
- * different records.
+ * different records. Other implementations of the Connection interface (e.g.
+ * a mock connection used for benchmarks) can be registered as well. They can
+ * be used by records, but they are not returned by the methods that only deal
+ * with server connections.
  * This class implements the singleton pattern and the only instance is returned
  * by the {@link #getInstance()} function.
  */
@@ -64,12 +69,44 @@ public:
   }
 
   /**
-   * Returns the connection with the specified ID. If no connection with the ID
-   * has been registered, a pointer to null is returned.
+   * Returns the connection with the specified ID. In contrast to
+   * getServerConnection(const std::string &), this method also returns
+   * connections that have been registered through
+   * registerConnection(const std::string &, std::shared_ptr<Connection>). If
+   * no connection with the ID has been registered, a pointer to null is
+   * returned.
+   */
+  std::shared_ptr<Connection> getConnection(const std::string &connectionId);
+
+  /**
+   * Returns all registered connections (including the server connections)
+   * together with their IDs. The returned list is sorted by the connection ID.
+   */
+  std::vector<std::pair<std::string, std::shared_ptr<Connection>>>
+      getConnections();
+
+  /**
+   * Returns the server connection with the specified ID. If no server
+   * connection with the ID has been registered, a pointer to null is returned.
    */
   std::shared_ptr<ServerConnection> getServerConnection(
       const std::string &deviceId);
 
+  /**
+   * Returns all registered connections together with their IDs. The returned
+   * list is sorted by the connection ID.
+   */
+  std::vector<std::pair<std::string, std::shared_ptr<ServerConnection>>>
+      getServerConnections();
+
+  /**
+   * Registers a connection that is not a server connection under the specified
+   * ID. Throws an exception if the connection cannot be registered because the
+   * specified ID is already in use.
+   */
+  void registerConnection(const std::string &connectionId,
+      std::shared_ptr<Connection> connection);
+
   /**
    * Registers a connection under the specified ID. Throws an exception if the
    * connection cannot be registered because the specified ID is already in use.
@@ -87,8 +124,11 @@ private:
 
   static ServerConnectionRegistry instance;
 
-  std::unordered_map<std::string, std::shared_ptr<ServerConnection>> connections;
+  // All connections, including the server connections.
+  std::unordered_map<std::string, std::shared_ptr<Connection>> connections;
   std::recursive_mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<ServerConnection>>
+    serverConnections;
 
   ServerConnectionRegistry();
 
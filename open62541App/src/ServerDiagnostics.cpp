@@ -0,0 +1,245 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cstring>
+
+#include "ServerDiagnostics.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+/**
+ * Reads the fields of a structure in the OPC UA binary encoding. We cannot
+ * use UA_decodeBinary, because the client does not know the diagnostics data
+ * types and UA_decodeBinary cannot decode a single field at a given offset.
+ * Once an error has occurred, all further reads fail, so that the error only
+ * has to be checked at the end.
+ */
+class BinaryReader {
+
+public:
+
+  BinaryReader(const UA_ByteString &buffer)
+      : data(buffer.data), length(buffer.length), offset(0), valid(true) {
+  }
+
+  bool isValid() const {
+    return valid;
+  }
+
+  double readDouble() {
+    static_assert(sizeof(double) == sizeof(std::uint64_t),
+      "double must have 64 bits.");
+    std::uint64_t bits = readUInt64();
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  // The NodeId is returned in its binary encoding, which is sufficient for
+  // comparing it with other node IDs sent by the same server.
+  std::string readNodeId() {
+    std::size_t start = offset;
+    switch (readByte() & 0x3F) {
+    case 0:
+      skip(1);
+      break;
+    case 1:
+      skip(3);
+      break;
+    case 2:
+      skip(6);
+      break;
+    case 3:
+    case 5:
+      skip(2);
+      skipString();
+      break;
+    case 4:
+      skip(18);
+      break;
+    default:
+      valid = false;
+      break;
+    }
+    if (!valid) {
+      return std::string();
+    }
+    return std::string(reinterpret_cast<const char *>(data + start),
+      offset - start);
+  }
+
+  std::uint32_t readUInt32() {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      value |= static_cast<std::uint32_t>(readByte()) << (8 * i);
+    }
+    return value;
+  }
+
+  void skip(std::size_t bytes) {
+    if (!valid || length - offset < bytes) {
+      valid = false;
+      return;
+    }
+    offset += bytes;
+  }
+
+  void skipLocalizedText() {
+    auto mask = readByte();
+    if (mask & 0x01) {
+      skipString();
+    }
+    if (mask & 0x02) {
+      skipString();
+    }
+  }
+
+  void skipString() {
+    auto stringLength = static_cast<std::int32_t>(readUInt32());
+    // A negative length signals a null string.
+    if (stringLength > 0) {
+      skip(static_cast<std::size_t>(stringLength));
+    }
+  }
+
+  void skipStringArray() {
+    auto arrayLength = static_cast<std::int32_t>(readUInt32());
+    for (std::int32_t i = 0; valid && i < arrayLength; ++i) {
+      skipString();
+    }
+  }
+
+private:
+
+  const UA_Byte *data;
+  std::size_t length;
+  std::size_t offset;
+  bool valid;
+
+  UA_Byte readByte() {
+    if (!valid || offset >= length) {
+      valid = false;
+      return 0;
+    }
+    return data[offset++];
+  }
+
+  std::uint64_t readUInt64() {
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value |= static_cast<std::uint64_t>(readByte()) << (8 * i);
+    }
+    return value;
+  }
+
+};
+
+bool isEncodedStructure(const UA_ExtensionObject &extensionObject,
+    UA_UInt32 binaryEncodingId) {
+  return extensionObject.encoding == UA_EXTENSIONOBJECT_ENCODED_BYTESTRING
+    && extensionObject.content.encoded.typeId.namespaceIndex == 0
+    && extensionObject.content.encoded.typeId.identifierType
+      == UA_NODEIDTYPE_NUMERIC
+    && extensionObject.content.encoded.typeId.identifier.numeric
+      == binaryEncodingId;
+}
+
+} // anonymous namespace
+
+bool decodeSessionDiagnostics(const UA_ExtensionObject &extensionObject,
+    SessionServerDiagnostics &diagnostics) {
+  if (!isEncodedStructure(extensionObject,
+      UA_NS0ID_SESSIONDIAGNOSTICSDATATYPE_ENCODING_DEFAULTBINARY)) {
+    return false;
+  }
+  BinaryReader reader(extensionObject.content.encoded.body);
+  diagnostics.sessionId = reader.readNodeId();
+  // SessionName
+  reader.skipString();
+  // ClientDescription (an ApplicationDescription)
+  reader.skipString();
+  reader.skipString();
+  reader.skipLocalizedText();
+  reader.skip(4);
+  reader.skipString();
+  reader.skipString();
+  reader.skipStringArray();
+  // ServerUri, EndpointUrl, and LocaleIds
+  reader.skipString();
+  reader.skipString();
+  reader.skipStringArray();
+  // ActualSessionTimeout, MaxResponseMessageSize, ClientConnectionTime, and
+  // ClientLastContactTime
+  reader.skip(8 + 4 + 8 + 8);
+  diagnostics.currentSubscriptionsCount = reader.readUInt32();
+  diagnostics.currentMonitoredItemsCount = reader.readUInt32();
+  diagnostics.currentPublishRequestsInQueue = reader.readUInt32();
+  diagnostics.totalRequestCount = reader.readUInt32();
+  diagnostics.totalRequestErrorCount = reader.readUInt32();
+  diagnostics.unauthorizedRequestCount = reader.readUInt32();
+  return reader.isValid();
+}
+
+bool decodeSubscriptionDiagnostics(const UA_ExtensionObject &extensionObject,
+    SubscriptionServerDiagnostics &diagnostics) {
+  if (!isEncodedStructure(extensionObject,
+      UA_NS0ID_SUBSCRIPTIONDIAGNOSTICSDATATYPE_ENCODING_DEFAULTBINARY)) {
+    return false;
+  }
+  BinaryReader reader(extensionObject.content.encoded.body);
+  diagnostics.sessionId = reader.readNodeId();
+  diagnostics.subscriptionId = reader.readUInt32();
+  // Priority
+  reader.skip(1);
+  diagnostics.publishingInterval = reader.readDouble();
+  // MaxKeepAliveCount, MaxLifetimeCount, MaxNotificationsPerPublish,
+  // PublishingEnabled, ModifyCount, EnableCount, and DisableCount
+  reader.skip(4 + 4 + 4 + 1 + 4 + 4 + 4);
+  diagnostics.republishRequestCount = reader.readUInt32();
+  // RepublishMessageRequestCount, RepublishMessageCount,
+  // TransferRequestCount, TransferredToAltClientCount, and
+  // TransferredToSameClientCount
+  reader.skip(5 * 4);
+  diagnostics.publishRequestCount = reader.readUInt32();
+  diagnostics.dataChangeNotificationsCount = reader.readUInt32();
+  // EventNotificationsCount
+  reader.skip(4);
+  diagnostics.notificationsCount = reader.readUInt32();
+  diagnostics.latePublishRequestCount = reader.readUInt32();
+  // CurrentKeepAliveCount and CurrentLifetimeCount
+  reader.skip(4 + 4);
+  diagnostics.unacknowledgedMessageCount = reader.readUInt32();
+  diagnostics.discardedMessageCount = reader.readUInt32();
+  diagnostics.monitoredItemCount = reader.readUInt32();
+  // DisabledMonitoredItemCount
+  reader.skip(4);
+  diagnostics.monitoringQueueOverflowCount = reader.readUInt32();
+  return reader.isValid();
+}
+
+}
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_SERVER_DIAGNOSTICS_H
+#define OPEN62541_EPICS_SERVER_DIAGNOSTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+extern "C" {
+#include "open62541.h"
+}
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Counters that the server keeps for a session. This is a subset of the
+ * SessionDiagnosticsDataType defined in OPC UA part 5.
+ */
+struct SessionServerDiagnostics {
+
+  std::uint32_t currentMonitoredItemsCount = 0;
+  std::uint32_t currentPublishRequestsInQueue = 0;
+  std::uint32_t currentSubscriptionsCount = 0;
+  std::string sessionId;
+  std::uint32_t totalRequestCount = 0;
+  std::uint32_t totalRequestErrorCount = 0;
+  std::uint32_t unauthorizedRequestCount = 0;
+
+};
+
+/**
+ * Counters that the server keeps for a subscription. This is a subset of the
+ * SubscriptionDiagnosticsDataType defined in OPC UA part 5.
+ */
+struct SubscriptionServerDiagnostics {
+
+  std::uint32_t dataChangeNotificationsCount = 0;
+  std::uint32_t discardedMessageCount = 0;
+  std::uint32_t latePublishRequestCount = 0;
+  std::uint32_t monitoredItemCount = 0;
+  std::uint32_t monitoringQueueOverflowCount = 0;
+  std::uint32_t notificationsCount = 0;
+  std::uint32_t publishRequestCount = 0;
+  double publishingInterval = 0.0;
+  std::uint32_t republishRequestCount = 0;
+  std::string sessionId;
+  std::uint32_t subscriptionId = 0;
+  std::uint32_t unacknowledgedMessageCount = 0;
+
+};
+
+/**
+ * Diagnostics read from the server for a single connection.
+ *
+ * The session ID is kept in its binary encoding, because it is only needed
+ * for finding the entries that belong to the connection's session.
+ */
+struct ServerDiagnostics {
+
+  /**
+   * Tells whether diagnostics have been read successfully. If false, the
+   * error field contains the reason.
+   */
+  bool available = false;
+
+  /**
+   * Reason why the diagnostics are not available.
+   */
+  std::string error;
+
+  /**
+   * Time when the diagnostics were last read.
+   */
+  std::chrono::system_clock::time_point readTime;
+
+  /**
+   * Diagnostics for the session. Only valid if sessionAvailable is true.
+   */
+  SessionServerDiagnostics session;
+
+  /**
+   * Tells whether the server provided diagnostics for the session.
+   */
+  bool sessionAvailable = false;
+
+  /**
+   * Diagnostics for the subscriptions, indexed by the subscription name.
+   */
+  std::map<std::string, SubscriptionServerDiagnostics> subscriptions;
+
+};
+
+/**
+ * Decodes a SessionDiagnosticsDataType structure. The client does not know
+ * this type, so it is passed as an extension object in its binary encoding.
+ * Returns false if the extension object does not contain such a structure or
+ * if it cannot be decoded.
+ */
+bool decodeSessionDiagnostics(const UA_ExtensionObject &extensionObject,
+    SessionServerDiagnostics &diagnostics);
+
+/**
+ * Decodes a SubscriptionDiagnosticsDataType structure. The client does not
+ * know this type, so it is passed as an extension object in its binary
+ * encoding. Returns false if the extension object does not contain such a
+ * structure or if it cannot be decoded.
+ */
+bool decodeSubscriptionDiagnostics(const UA_ExtensionObject &extensionObject,
+    SubscriptionServerDiagnostics &diagnostics);
+
+}
+}
+
+#endif // OPEN62541_EPICS_SERVER_DIAGNOSTICS_H
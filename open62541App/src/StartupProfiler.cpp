@@ -0,0 +1,145 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cmath>
+
+#include "StartupProfiler.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// The order of the names must match the order of the elements in the Phase
+// enum.
+const char *const phaseNames[] = {
+  "connection_setup",
+  "connect",
+  "record_initialization",
+  "address_parsing",
+  "read_on_init",
+  "monitored_item_creation"
+};
+
+static_assert(
+  sizeof(phaseNames) / sizeof(phaseNames[0])
+  == static_cast<std::size_t>(StartupProfiler::Phase::numberOfPhases),
+  "The number of phase names does not match the number of phases.");
+
+} // anonymous namespace
+
+StartupProfiler StartupProfiler::instance;
+
+StartupProfiler::StartupProfiler() : iocInitEndTime(-1.0),
+    iocInitStartTime(-1.0),
+    phaseTimings(static_cast<std::size_t>(Phase::numberOfPhases),
+      PhaseTimings{0, 0.0, 0.0, 0.0}),
+    referenceTime(std::chrono::steady_clock::now()) {
+}
+
+const char *StartupProfiler::getPhaseName(Phase phase) {
+  return phaseNames[static_cast<std::size_t>(phase)];
+}
+
+void StartupProfiler::addPhaseTime(Phase phase,
+    std::chrono::steady_clock::time_point start,
+    std::chrono::steady_clock::time_point end) {
+  double startSeconds =
+    std::chrono::duration<double>(start - referenceTime).count();
+  double endSeconds =
+    std::chrono::duration<double>(end - referenceTime).count();
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &timings = phaseTimings[static_cast<std::size_t>(phase)];
+  if (timings.count == 0 || startSeconds < timings.firstStart) {
+    timings.firstStart = startSeconds;
+  }
+  if (endSeconds > timings.lastEnd) {
+    timings.lastEnd = endSeconds;
+  }
+  timings.totalTime += endSeconds - startSeconds;
+  ++timings.count;
+}
+
+double StartupProfiler::getElapsedTime() const {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - referenceTime).count();
+}
+
+StartupProfiler::PhaseTimings StartupProfiler::getPhaseTimings(Phase phase) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return phaseTimings[static_cast<std::size_t>(phase)];
+}
+
+void StartupProfiler::markIocInitEnd() {
+  iocInitEndTime.store(getElapsedTime(), std::memory_order_relaxed);
+}
+
+void StartupProfiler::markIocInitStart() {
+  iocInitStartTime.store(getElapsedTime(), std::memory_order_relaxed);
+}
+
+StartupStatistics::StartupStatistics() : connectTime(-1.0),
+    monitoredItemsCreated(0), monitoredItemsFailed(0), monitoredRecords(0),
+    recordsInitialized(0) {
+}
+
+bool StartupStatistics::getFirstNotificationTime(double fraction,
+    double &time) {
+  auto expected = getMonitoredRecords();
+  if (expected == 0) {
+    return false;
+  }
+  auto needed = static_cast<std::size_t>(std::ceil(fraction * expected));
+  if (needed == 0) {
+    needed = 1;
+  }
+  std::lock_guard<std::mutex> lock(firstNotificationTimesMutex);
+  if (firstNotificationTimes.size() < needed) {
+    return false;
+  }
+  time = firstNotificationTimes[needed - 1];
+  return true;
+}
+
+std::size_t StartupStatistics::getFirstNotificationCount() {
+  std::lock_guard<std::mutex> lock(firstNotificationTimesMutex);
+  return firstNotificationTimes.size();
+}
+
+void StartupStatistics::markConnected() {
+  double expected = -1.0;
+  connectTime.compare_exchange_strong(expected,
+    StartupProfiler::getInstance().getElapsedTime(),
+    std::memory_order_relaxed);
+}
+
+void StartupStatistics::markFirstNotification() {
+  // We get the time while holding the mutex, so that the list stays sorted.
+  std::lock_guard<std::mutex> lock(firstNotificationTimesMutex);
+  firstNotificationTimes.push_back(
+    StartupProfiler::getInstance().getElapsedTime());
+}
+
+}
+}
@@ -0,0 +1,310 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_STARTUP_PROFILER_H
+#define OPEN62541_EPICS_STARTUP_PROFILER_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <mutex>. The workaround for this is
+// defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Profiler for the phases of the IOC startup that are handled by this device
+ * support. For each phase, the profiler records how often it was entered, the
+ * total time spent in it, and the wall-clock span from the first time it was
+ * entered until the last time it was left. Phases may run in several threads
+ * at the same time, so the total time can be greater than the span.
+ *
+ * All times are measured relative to the time when the device support library
+ * was loaded.
+ *
+ * This class implements the singleton pattern and the only instance is
+ * returned by the {@link #getInstance()} function.
+ */
+class StartupProfiler {
+
+public:
+
+  /**
+   * Phases for which timings are recorded.
+   */
+  enum class Phase {
+    // Creating server connections (open62541ConnectionSetup).
+    connectionSetup,
+    // Establishing the first session with each server.
+    connect,
+    // Initializing records (including address parsing and read-on-init).
+    recordInitialization,
+    // Parsing record addresses.
+    addressParsing,
+    // Reading initial values of output records.
+    readOnInit,
+    // Creating monitored items on the server.
+    monitoredItemCreation,
+    // This must always be the last element.
+    numberOfPhases
+  };
+
+  /**
+   * Timings for a single phase. All times are in seconds.
+   */
+  struct PhaseTimings {
+    std::uint64_t count;
+    double firstStart;
+    double lastEnd;
+    double totalTime;
+  };
+
+  /**
+   * Adds the time between its construction and its destruction to a phase.
+   */
+  class PhaseTimer {
+
+  public:
+
+    inline PhaseTimer(Phase phase) : phase(phase),
+        startTime(std::chrono::steady_clock::now()) {
+    }
+
+    inline ~PhaseTimer() {
+      StartupProfiler::getInstance().addPhaseTime(
+        phase, startTime, std::chrono::steady_clock::now());
+    }
+
+  private:
+
+    // We do not want to allow copy or move construction or assignment.
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer(PhaseTimer &&) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(PhaseTimer &&) = delete;
+
+    Phase phase;
+    std::chrono::steady_clock::time_point startTime;
+
+  };
+
+  /**
+   * Returns the only instance of this class.
+   */
+  inline static StartupProfiler &getInstance() {
+    return instance;
+  }
+
+  /**
+   * Returns the name of a phase as used in reports.
+   */
+  static const char *getPhaseName(Phase phase);
+
+  /**
+   * Adds the time between the specified start and end time to a phase.
+   */
+  void addPhaseTime(Phase phase, std::chrono::steady_clock::time_point start,
+      std::chrono::steady_clock::time_point end);
+
+  /**
+   * Returns the time (in seconds) that has passed since the reference time.
+   */
+  double getElapsedTime() const;
+
+  /**
+   * Returns the time (in seconds, relative to the reference time) when iocInit
+   * finished. Returns a negative number if iocInit has not finished yet.
+   */
+  inline double getIocInitEndTime() const {
+    return iocInitEndTime.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the time (in seconds, relative to the reference time) when iocInit
+   * started. Returns a negative number if iocInit has not started yet.
+   */
+  inline double getIocInitStartTime() const {
+    return iocInitStartTime.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the timings for the specified phase.
+   */
+  PhaseTimings getPhaseTimings(Phase phase);
+
+  /**
+   * Records the current time as the time when iocInit finished.
+   */
+  void markIocInitEnd();
+
+  /**
+   * Records the current time as the time when iocInit started.
+   */
+  void markIocInitStart();
+
+private:
+
+  static StartupProfiler instance;
+
+  std::atomic<double> iocInitEndTime;
+  std::atomic<double> iocInitStartTime;
+  std::mutex mutex;
+  std::vector<PhaseTimings> phaseTimings;
+  std::chrono::steady_clock::time_point referenceTime;
+
+  StartupProfiler();
+
+  // We do not want to allow copy or move construction or assignment.
+  StartupProfiler(const StartupProfiler &) = delete;
+  StartupProfiler(StartupProfiler &&) = delete;
+  StartupProfiler &operator=(const StartupProfiler &) = delete;
+  StartupProfiler &operator=(StartupProfiler &&) = delete;
+
+};
+
+/**
+ * Startup statistics for a single server connection.
+ */
+class StartupStatistics {
+
+public:
+
+  /**
+   * Creates empty statistics.
+   */
+  StartupStatistics();
+
+  /**
+   * Counts a monitored item that has been created successfully.
+   */
+  inline void countMonitoredItemCreated() {
+    monitoredItemsCreated.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Counts a monitored item that could not be created.
+   */
+  inline void countMonitoredItemFailed() {
+    monitoredItemsFailed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Counts a record that has been initialized.
+   */
+  inline void countRecordInitialized() {
+    recordsInitialized.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Counts a record that uses a monitored item and thus waits for its first
+   * notification.
+   */
+  inline void countMonitoredRecord() {
+    monitoredRecords.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the time (in seconds, relative to the reference time of the
+   * StartupProfiler) when the first session with the server was established.
+   * Returns a negative number if no session has been established yet.
+   */
+  inline double getConnectTime() const {
+    return connectTime.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the time (in seconds, relative to the reference time of the
+   * StartupProfiler) by which the specified fraction (between 0 and 1) of the
+   * monitored records had received their first notification. Returns false if
+   * not enough records have received a notification yet.
+   */
+  bool getFirstNotificationTime(double fraction, double &time);
+
+  /**
+   * Returns the number of records that have received their first
+   * notification.
+   */
+  std::size_t getFirstNotificationCount();
+
+  inline std::uint64_t getMonitoredItemsCreated() const {
+    return monitoredItemsCreated.load(std::memory_order_relaxed);
+  }
+
+  inline std::uint64_t getMonitoredItemsFailed() const {
+    return monitoredItemsFailed.load(std::memory_order_relaxed);
+  }
+
+  inline std::uint64_t getMonitoredRecords() const {
+    return monitoredRecords.load(std::memory_order_relaxed);
+  }
+
+  inline std::uint64_t getRecordsInitialized() const {
+    return recordsInitialized.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Records the current time as the time when the first session was
+   * established. Later calls have no effect.
+   */
+  void markConnected();
+
+  /**
+   * Records the current time as the time when a monitored record received its
+   * first notification. This must be called at most once per record.
+   */
+  void markFirstNotification();
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  StartupStatistics(const StartupStatistics &) = delete;
+  StartupStatistics(StartupStatistics &&) = delete;
+  StartupStatistics &operator=(const StartupStatistics &) = delete;
+  StartupStatistics &operator=(StartupStatistics &&) = delete;
+
+  std::atomic<double> connectTime;
+  // The times are appended in the order in which the notifications arrive, so
+  // they are always sorted.
+  std::vector<double> firstNotificationTimes;
+  std::mutex firstNotificationTimesMutex;
+  std::atomic<std::uint64_t> monitoredItemsCreated;
+  std::atomic<std::uint64_t> monitoredItemsFailed;
+  std::atomic<std::uint64_t> monitoredRecords;
+  std::atomic<std::uint64_t> recordsInitialized;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_STARTUP_PROFILER_H
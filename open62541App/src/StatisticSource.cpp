@@ -0,0 +1,201 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#include <sstream>
+#include <stdexcept>
+
+#include "ServerConnectionRegistry.h"
+
+#include "StatisticSource.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+const std::string rateSuffix("_rate");
+
+} // anonymous namespace
+
+StatisticSource::StatisticSource(const std::string &addressString) :
+    lastCount(0), lastValid(false), rate(false) {
+  // The options string is optional, so we extract it first and then split the
+  // rest of the address into the connection ID and the statistic name.
+  std::string remainingAddress = addressString;
+  std::string subscriptionName;
+  auto optionsStart = remainingAddress.find('(');
+  if (optionsStart != std::string::npos) {
+    auto optionsEnd = remainingAddress.find(')', optionsStart);
+    if (optionsEnd == std::string::npos) {
+      throw std::invalid_argument(
+        "Unbalanced parentheses in options string of record address.");
+    }
+    std::string options = remainingAddress.substr(
+      optionsStart + 1, optionsEnd - optionsStart - 1);
+    remainingAddress.replace(
+      optionsStart, optionsEnd - optionsStart + 1, " ");
+    std::string const subscriptionOption("subscription=");
+    if (options.compare(0, subscriptionOption.size(), subscriptionOption)) {
+      throw std::invalid_argument(
+        std::string("Unrecognized token in options string of record address: ")
+        + options);
+    }
+    subscriptionName = options.substr(subscriptionOption.size());
+    if (subscriptionName.empty()) {
+      throw std::invalid_argument(
+        "The subscription name must not be empty.");
+    }
+  }
+  std::istringstream addressStream(remainingAddress);
+  std::string connectionId;
+  std::string statisticName;
+  std::string extraToken;
+  addressStream >> connectionId >> statisticName;
+  if (connectionId.empty()) {
+    throw std::invalid_argument(
+      "Could not find connection ID in record address.");
+  }
+  if (statisticName.empty()) {
+    throw std::invalid_argument(
+      "Could not find statistic name in record address.");
+  }
+  if (addressStream >> extraToken) {
+    throw std::invalid_argument(
+      std::string("Unexpected token in record address: ") + extraToken);
+  }
+  // The statistics are available for all kinds of connections (e.g. replay
+  // and PubSub connections), not just server connections.
+  connection = ServerConnectionRegistry::getInstance().getConnection(
+    connectionId);
+  if (!connection) {
+    throw std::runtime_error(
+      std::string("Could not find connection ") + connectionId + ".");
+  }
+  if (statisticName.size() > rateSuffix.size()
+      && !statisticName.compare(statisticName.size() - rateSuffix.size(),
+        rateSuffix.size(), rateSuffix)) {
+    rate = true;
+    statisticName.erase(statisticName.size() - rateSuffix.size());
+  }
+  if (!subscriptionName.empty()) {
+    // The statistics are kept alive by the shared pointer, so it is safe to
+    // capture the raw pointer in the lambda expressions.
+    subscriptionStatistics =
+      connection->getSubscriptionStatistics(subscriptionName);
+    SubscriptionStatistics *statistics = subscriptionStatistics.get();
+    if (statisticName == "notifications") {
+      counter = [statistics]() {
+        return statistics->notifications.load(std::memory_order_relaxed);
+      };
+    } else if (statisticName == "notification_failures") {
+      counter = [statistics]() {
+        return statistics->notificationFailures.load(
+          std::memory_order_relaxed);
+      };
+    } else if (statisticName == "overflows") {
+      counter = [statistics]() {
+        return statistics->overflows.load(std::memory_order_relaxed);
+      };
+    }
+  } else {
+    // The connection is kept alive by the shared pointer, so it is safe to
+    // capture a reference to its statistics.
+    ConnectionStatistics &statistics = connection->getStatistics();
+    ConnectionStatistics::Counter counterId;
+    if (ConnectionStatistics::findCounter(statisticName, counterId)) {
+      counter = [&statistics, counterId]() {
+        return statistics.get(counterId);
+      };
+    } else if (!rate) {
+      if (statisticName == "connected") {
+        gauge = [&statistics]() {
+          return statistics.isConnected() ? 1.0 : 0.0;
+        };
+      } else if (statisticName == "queue_depth") {
+        gauge = [&statistics]() {
+          return static_cast<double>(statistics.getQueueDepth());
+        };
+      } else if (statisticName == "rtt") {
+        gauge = [&statistics]() {
+          return statistics.getLastRoundTripTime();
+        };
+      } else if (statisticName == "rtt_avg") {
+        gauge = [&statistics]() {
+          return statistics.getAverageRoundTripTime();
+        };
+      } else if (statisticName == "clock_offset") {
+        gauge = [&statistics]() {
+          double offset, uncertainty;
+          return statistics.getClockOffset(offset, uncertainty) ? offset : 0.0;
+        };
+      } else if (statisticName == "clock_offset_uncertainty") {
+        gauge = [&statistics]() {
+          double offset, uncertainty;
+          return statistics.getClockOffset(offset, uncertainty)
+            ? uncertainty : 0.0;
+        };
+      } else if (statisticName == "probe_rtt_p50") {
+        gauge = [&statistics]() {
+          return statistics.getLatencyHistogram(
+            ConnectionStatistics::Latency::probe).getPercentile(0.5) * 1e-9;
+        };
+      } else if (statisticName == "probe_rtt_p99") {
+        gauge = [&statistics]() {
+          return statistics.getLatencyHistogram(
+            ConnectionStatistics::Latency::probe).getPercentile(0.99) * 1e-9;
+        };
+      }
+    }
+  }
+  if (!counter && !gauge) {
+    throw std::invalid_argument(
+      std::string("Unknown statistic in record address: ") + statisticName
+      + (rate ? rateSuffix : std::string()));
+  }
+}
+
+double StatisticSource::read() {
+  if (gauge) {
+    return gauge();
+  }
+  std::uint64_t count = counter();
+  if (!rate) {
+    return static_cast<double>(count);
+  }
+  auto now = std::chrono::steady_clock::now();
+  double value = 0.0;
+  if (lastValid) {
+    double elapsedSeconds =
+      std::chrono::duration<double>(now - lastTime).count();
+    if (elapsedSeconds > 0.0) {
+      value = (count - lastCount) / elapsedSeconds;
+    }
+  }
+  lastCount = count;
+  lastTime = now;
+  lastValid = true;
+  return value;
+}
+
+}
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_STATISTIC_SOURCE_H
+#define OPEN62541_EPICS_STATISTIC_SOURCE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "Connection.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Source for a single statistic value of a connection. This is used by the
+ * "open62541 stats" device support.
+ *
+ * The source is created from an address string of the form
+ * "<connection ID> [(subscription=<name>)] <statistic>". Counters can be
+ * suffixed with "_rate", in which case the change per second since the value
+ * was last read is returned instead of the counter's value.
+ */
+class StatisticSource {
+
+public:
+
+  /**
+   * Creates a statistic source for the specified address. Throws an
+   * std::invalid_argument if the address is invalid and an std::runtime_error
+   * if the specified connection does not exist.
+   */
+  StatisticSource(const std::string &addressString);
+
+  /**
+   * Returns the current value of the statistic. For rates, this is the change
+   * per second since this method was last called (zero when it is called for
+   * the first time). Instances of this class are not thread-safe, so this
+   * method must not be called concurrently.
+   */
+  double read();
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  StatisticSource(const StatisticSource &) = delete;
+  StatisticSource(StatisticSource &&) = delete;
+  StatisticSource &operator=(const StatisticSource &) = delete;
+  StatisticSource &operator=(StatisticSource &&) = delete;
+
+  std::shared_ptr<Connection> connection;
+  std::function<std::uint64_t()> counter;
+  std::function<double()> gauge;
+  std::uint64_t lastCount;
+  std::chrono::steady_clock::time_point lastTime;
+  bool lastValid;
+  bool rate;
+  std::shared_ptr<SubscriptionStatistics> subscriptionStatistics;
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_STATISTIC_SOURCE_H
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "open62541Error.h"
+
+#include "TrafficRecorder.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+// Number of buffered bytes that causes the writer thread to be woken up
+// before the flush interval has passed.
+constexpr std::size_t flushThreshold = 64 * 1024;
+
+// Max. time that records are kept in the buffer before they are written.
+constexpr std::chrono::milliseconds flushInterval(100);
+
+void putUInt32(unsigned char *dest, std::uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    dest[i] = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+void putUInt64(unsigned char *dest, std::uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    dest[i] = static_cast<unsigned char>(value >> (8 * i));
+  }
+}
+
+} // anonymous namespace
+
+constexpr std::size_t TrafficRecorder::fileHeaderSize;
+constexpr char const *TrafficRecorder::magic;
+constexpr std::size_t TrafficRecorder::recordHeaderSize;
+constexpr std::uint32_t TrafficRecorder::version;
+
+TrafficRecorder::TrafficRecorder(const std::string &fileName,
+    std::size_t maxBufferSize) : closed(false), droppedRecords(0),
+    fileName(fileName), maxBufferSize(maxBufferSize), records(0),
+    writtenBytes(0) {
+  file = std::fopen(fileName.c_str(), "wb");
+  if (!file) {
+    throw std::runtime_error(std::string("Could not open \"") + fileName
+      + "\": " + std::strerror(errno));
+  }
+  // The header is written by the writer thread, like all other data.
+  buffer.resize(fileHeaderSize);
+  std::memcpy(buffer.data(), magic, 8);
+  putUInt32(buffer.data() + 8, version);
+  startTime = std::chrono::steady_clock::now();
+  writerThread = std::thread([this]() {runWriterThread();});
+}
+
+TrafficRecorder::~TrafficRecorder() {
+  close();
+}
+
+void TrafficRecorder::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      return;
+    }
+    closed = true;
+  }
+  bufferCv.notify_all();
+  writerThread.join();
+  std::fclose(file);
+}
+
+void TrafficRecorder::recordNotification(const UaNodeId &nodeId,
+    const UA_DataValue &value) {
+  recordDataValue(RecordType::notification, nodeId, value);
+}
+
+void TrafficRecorder::recordRead(const UaNodeId &nodeId,
+    const UA_Variant &value, UA_StatusCode statusCode) {
+  // The data value only borrows the variant, so it must not be cleared.
+  UA_DataValue dataValue;
+  UA_DataValue_init(&dataValue);
+  if (statusCode == UA_STATUSCODE_GOOD) {
+    dataValue.value = value;
+    dataValue.hasValue = true;
+  } else {
+    dataValue.status = statusCode;
+    dataValue.hasStatus = true;
+  }
+  recordDataValue(RecordType::read, nodeId, dataValue);
+}
+
+void TrafficRecorder::recordWrite(const UaNodeId &nodeId,
+    const UA_Variant &value, UA_StatusCode statusCode) {
+  // The data value only borrows the variant, so it must not be cleared.
+  UA_DataValue dataValue;
+  UA_DataValue_init(&dataValue);
+  dataValue.value = value;
+  dataValue.hasValue = true;
+  if (statusCode != UA_STATUSCODE_GOOD) {
+    dataValue.status = statusCode;
+    dataValue.hasStatus = true;
+  }
+  recordDataValue(RecordType::write, nodeId, dataValue);
+}
+
+bool TrafficRecorder::appendRecord(RecordType type, std::uint32_t handle,
+    std::uint64_t time, const void *payload, const UA_DataType *payloadType) {
+  auto payloadSize = UA_calcSizeBinary(payload, payloadType);
+  auto offset = buffer.size();
+  if (!payloadSize || offset + recordHeaderSize + payloadSize > maxBufferSize
+      || payloadSize > UINT32_MAX) {
+    return false;
+  }
+  buffer.resize(offset + recordHeaderSize + payloadSize);
+  auto header = buffer.data() + offset;
+  header[0] = static_cast<unsigned char>(type);
+  putUInt32(header + 1, handle);
+  putUInt64(header + 5, time);
+  putUInt32(header + 13, static_cast<std::uint32_t>(payloadSize));
+  UA_ByteString encoded;
+  encoded.data = header + recordHeaderSize;
+  encoded.length = payloadSize;
+  if (UA_encodeBinary(payload, payloadType, &encoded) != UA_STATUSCODE_GOOD) {
+    buffer.resize(offset);
+    return false;
+  }
+  records.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void TrafficRecorder::recordDataValue(RecordType type, const UaNodeId &nodeId,
+    const UA_DataValue &value) {
+  bool wakeUpWriter;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) {
+      return;
+    }
+    // We take the time while holding the mutex, so that the times of the
+    // records in the file are monotonic even if several threads report
+    // events.
+    std::uint64_t time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - startTime).count();
+    std::uint32_t handle;
+    auto handleEntry = nodeHandles.find(nodeId);
+    if (handleEntry == nodeHandles.end()) {
+      handle = static_cast<std::uint32_t>(nodeHandles.size());
+      if (!appendRecord(RecordType::node, handle, time, &nodeId.get(),
+          &UA_TYPES[UA_TYPES_NODEID])) {
+        droppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      nodeHandles.emplace(nodeId, handle);
+    } else {
+      handle = handleEntry->second;
+    }
+    if (!appendRecord(type, handle, time, &value,
+        &UA_TYPES[UA_TYPES_DATAVALUE])) {
+      droppedRecords.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    wakeUpWriter = buffer.size() >= flushThreshold;
+  }
+  if (wakeUpWriter) {
+    bufferCv.notify_one();
+  }
+}
+
+void TrafficRecorder::runWriterThread() {
+  // We swap the buffers, so that the records can be written to the file
+  // without holding the mutex. Both buffers keep their capacity, so after
+  // some time, no more memory allocations are needed.
+  std::vector<unsigned char> pending;
+  bool writeFailed = false;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    bufferCv.wait_for(lock, flushInterval, [this]() {
+      return closed || buffer.size() >= flushThreshold;
+    });
+    bool done = closed;
+    pending.swap(buffer);
+    lock.unlock();
+    if (!pending.empty() && !writeFailed) {
+      if (std::fwrite(pending.data(), 1, pending.size(), file)
+          != pending.size() || std::fflush(file)) {
+        // There is no point in trying again, because the file would be
+        // corrupted anyway.
+        errorPrintf("Could not write to capture file \"%s\": %s",
+          fileName.c_str(), std::strerror(errno));
+        writeFailed = true;
+      } else {
+        writtenBytes.fetch_add(pending.size(), std::memory_order_relaxed);
+      }
+    }
+    pending.clear();
+    lock.lock();
+    // Once the recorder has been closed, no more records are added, so we
+    // are done when the last records have been written.
+    if (done) {
+      return;
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_TRAFFIC_RECORDER_H
+#define OPEN62541_EPICS_TRAFFIC_RECORDER_H
+
+// There is a bug in the C++ standard library of certain versions of the macOS
+// SDK that causes a problem when including <condition_variable>. The workaround
+// for this is defining the _DARWIN_C_SOURCE preprocessor macro.
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include "open62541.h"
+}
+
+#include "UaNodeId.h"
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Records the notifications and the results of read and write operations of a
+ * connection to a file, so that the traffic can later be fed back into the
+ * records by a ReplayConnection (without any server).
+ *
+ * The file starts with a header consisting of the magic string "O62541TC" and
+ * the format version (uint32). The header is followed by records, each
+ * consisting of the record type (uint8), the node handle (uint32), the time
+ * (uint64, in nanoseconds since the capture was started), the length of the
+ * payload (uint32), and the payload. All integers are stored in little-endian
+ * byte order. The first record for a node is a RecordType::node record that
+ * carries the binary encoded node ID. All other records carry a binary encoded
+ * DataValue.
+ *
+ * The records are encoded into a memory buffer by the thread that reports the
+ * event (usually the connection thread), and the buffer is written to the file
+ * by a separate thread, so that the connection thread never waits for the
+ * file system. When the buffer is full (because the file system cannot keep
+ * up), records are dropped and counted.
+ *
+ * This class is safe for concurrent use by multiple threads.
+ */
+class TrafficRecorder {
+
+public:
+
+  /**
+   * Type of a record in the capture file.
+   */
+  enum class RecordType : std::uint8_t {
+
+    /**
+     * Defines the node handle that is used by the following records. The
+     * payload is the binary encoded node ID.
+     */
+    node = 0,
+
+    /**
+     * Notification for a monitored item. The payload is the data value as it
+     * has been received from the server.
+     */
+    notification = 1,
+
+    /**
+     * Completed read operation. The payload is a data value that has the value
+     * that has been read or the status code of the failure.
+     */
+    read = 2,
+
+    /**
+     * Completed write operation. The payload is a data value that has the
+     * value that has been written and the status code of the operation.
+     */
+    write = 3
+
+  };
+
+  /**
+   * Size of the file header (in bytes).
+   */
+  static constexpr std::size_t fileHeaderSize = 12;
+
+  /**
+   * Magic string at the start of each capture file.
+   */
+  static constexpr char const *magic = "O62541TC";
+
+  /**
+   * Size of the header of each record (in bytes).
+   */
+  static constexpr std::size_t recordHeaderSize = 17;
+
+  /**
+   * Version of the file format written by this class.
+   */
+  static constexpr std::uint32_t version = 1;
+
+  /**
+   * Creates a recorder that writes to the specified file, replacing the file
+   * if it already exists. At most maxBufferSize bytes are buffered in memory.
+   * Throws an std::runtime_error if the file cannot be opened.
+   */
+  TrafficRecorder(const std::string &fileName,
+      std::size_t maxBufferSize = 16 * 1024 * 1024);
+
+  /**
+   * Destructor. Writes all buffered records and closes the file.
+   */
+  ~TrafficRecorder();
+
+  /**
+   * Writes all buffered records and closes the file. Records that are reported
+   * after calling this method are ignored. Calling this method more than once
+   * has no effect.
+   */
+  void close();
+
+  /**
+   * Returns the number of records that have been dropped because the buffer
+   * was full.
+   */
+  inline std::uint64_t getDroppedRecords() const {
+    return droppedRecords.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the name of the file to which the records are written.
+   */
+  inline const std::string &getFileName() const {
+    return fileName;
+  }
+
+  /**
+   * Returns the number of records (including node records) that have been
+   * added to the buffer.
+   */
+  inline std::uint64_t getRecords() const {
+    return records.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Returns the number of bytes that have been written to the file.
+   */
+  inline std::uint64_t getWrittenBytes() const {
+    return writtenBytes.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Records a notification that has been received for a monitored item.
+   */
+  void recordNotification(const UaNodeId &nodeId, const UA_DataValue &value);
+
+  /**
+   * Records a completed read operation. The value is only used when the status
+   * code signals success.
+   */
+  void recordRead(const UaNodeId &nodeId, const UA_Variant &value,
+      UA_StatusCode statusCode);
+
+  /**
+   * Records a completed write operation.
+   */
+  void recordWrite(const UaNodeId &nodeId, const UA_Variant &value,
+      UA_StatusCode statusCode);
+
+private:
+
+  // We do not want to allow copy or move construction or assignment.
+  TrafficRecorder(const TrafficRecorder &) = delete;
+  TrafficRecorder(TrafficRecorder &&) = delete;
+  TrafficRecorder &operator=(const TrafficRecorder &) = delete;
+  TrafficRecorder &operator=(TrafficRecorder &&) = delete;
+
+  // The buffer, the node handles, and the closed flag are protected by the
+  // mutex.
+  std::vector<unsigned char> buffer;
+  std::condition_variable bufferCv;
+  bool closed;
+  std::atomic<std::uint64_t> droppedRecords;
+  FILE *file;
+  std::string fileName;
+  std::size_t maxBufferSize;
+  std::mutex mutex;
+  std::unordered_map<UaNodeId, std::uint32_t> nodeHandles;
+  std::atomic<std::uint64_t> records;
+  std::chrono::steady_clock::time_point startTime;
+  std::atomic<std::uint64_t> writtenBytes;
+  std::thread writerThread;
+
+  bool appendRecord(RecordType type, std::uint32_t handle, std::uint64_t time,
+      const void *payload, const UA_DataType *payloadType);
+  void recordDataValue(RecordType type, const UaNodeId &nodeId,
+      const UA_DataValue &value);
+  void runWriterThread();
+
+};
+
+}
+}
+
+#endif // OPEN62541_EPICS_TRAFFIC_RECORDER_H
@@ -27,6 +27,7 @@
  * of the GNU LGPL version 3 or newer.
  */
 
+#include "AllocationStatistics.h"
 #include "UaNodeId.h"
 
 namespace open62541 {
@@ -34,6 +35,7 @@ namespace epics {
 
 UaNodeId::UaNodeId(UA_NodeId const &id) {
   UA_NodeId_init(&this->id);
+  AllocationStatistics::getInstance().countNodeIdCopy();
   auto status = UA_NodeId_copy(&id, &this->id);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
@@ -42,6 +44,7 @@ UaNodeId::UaNodeId(UA_NodeId const &id) {
 
 UaNodeId::UaNodeId(UaNodeId const &other) {
   UA_NodeId_init(&this->id);
+  AllocationStatistics::getInstance().countNodeIdCopy();
   auto status = UA_NodeId_copy(&other.id, &this->id);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
@@ -51,6 +54,7 @@ UaNodeId::UaNodeId(UaNodeId const &other) {
 UaNodeId &UaNodeId::operator=(UaNodeId const &other) {
   UA_NodeId tempId;
   UA_NodeId_init(&tempId);
+  AllocationStatistics::getInstance().countNodeIdCopy();
   auto status = UA_NodeId_copy(&other.id, &tempId);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
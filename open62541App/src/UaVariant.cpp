@@ -27,6 +27,7 @@
  * of the GNU LGPL version 3 or newer.
  */
 
+#include "AllocationStatistics.h"
 #include "UaVariant.h"
 
 namespace open62541 {
@@ -34,6 +35,7 @@ namespace epics {
 
 UaVariant::UaVariant(UA_Variant const &value) {
   UA_Variant_init(&this->value);
+  AllocationStatistics::getInstance().countVariantCopy();
   auto status = UA_Variant_copy(&value, &this->value);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
@@ -42,6 +44,7 @@ UaVariant::UaVariant(UA_Variant const &value) {
 
 UaVariant::UaVariant(UaVariant const &other) {
   UA_Variant_init(&this->value);
+  AllocationStatistics::getInstance().countVariantCopy();
   auto status = UA_Variant_copy(&other.value, &this->value);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
@@ -51,6 +54,7 @@ UaVariant::UaVariant(UaVariant const &other) {
 UaVariant &UaVariant::operator=(UaVariant const &other) {
   UA_Variant tempValue;
   UA_Variant_init(&tempValue);
+  AllocationStatistics::getInstance().countVariantCopy();
   auto status = UA_Variant_copy(&other.value, &tempValue);
   if (status != UA_STATUSCODE_GOOD) {
     throw UaException(status);
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#include <alarm.h>
+
+#include "open62541AlarmMapping.h"
+
+namespace open62541 {
+namespace epics {
+
+namespace {
+
+struct AlarmMappingEntry {
+  UA_StatusCode statusCode;
+  epicsEnum16 alarmStatus;
+  epicsEnum16 alarmSeverity;
+};
+
+// Status codes that are not listed here are mapped to READ_ALARM or
+// WRITE_ALARM (depending on the operation). Only the bits identifying the
+// status code are compared, so the info bits do not matter.
+const AlarmMappingEntry alarmMappingTable[] = {
+  // Problems with the connection to the server.
+  {UA_STATUSCODE_BADCOMMUNICATIONERROR, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADCONNECTIONCLOSED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADCONNECTIONREJECTED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADDISCONNECT, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADNOCOMMUNICATION, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADNOTCONNECTED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSECURECHANNELCLOSED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSERVERHALTED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSERVERNOTCONNECTED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSESSIONCLOSED, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSESSIONIDINVALID, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADSHUTDOWN, COMM_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADWAITINGFORINITIALDATA, COMM_ALARM, INVALID_ALARM},
+  // Timeouts.
+  {UA_STATUSCODE_BADREQUESTTIMEOUT, TIMEOUT_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADTIMEOUT, TIMEOUT_ALARM, INVALID_ALARM},
+  // Missing permissions.
+  {UA_STATUSCODE_BADNOTREADABLE, READ_ACCESS_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADNOTWRITABLE, WRITE_ACCESS_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADUSERACCESSDENIED, READ_ACCESS_ALARM, INVALID_ALARM},
+  // Problems with the record configuration.
+  {UA_STATUSCODE_BADATTRIBUTEIDINVALID, LINK_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADNODEIDINVALID, LINK_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADNODEIDUNKNOWN, LINK_ALARM, INVALID_ALARM},
+  {UA_STATUSCODE_BADTYPEMISMATCH, LINK_ALARM, INVALID_ALARM},
+  // The server rejected the value.
+  {UA_STATUSCODE_BADOUTOFRANGE, HW_LIMIT_ALARM, INVALID_ALARM},
+};
+
+} // anonymous namespace
+
+void alarmForStatusCode(UA_StatusCode statusCode, bool write,
+    epicsEnum16 &alarmStatus, epicsEnum16 &alarmSeverity) noexcept {
+  // The lower 16 bits only contain additional information (like the info
+  // bits), so we ignore them.
+  UA_StatusCode code = statusCode & 0xFFFF0000;
+  for (auto const &entry : alarmMappingTable) {
+    if (entry.statusCode == code) {
+      alarmStatus = entry.alarmStatus;
+      // The user access flag applies to both directions, so we have to use
+      // the alarm status that matches the operation.
+      if (alarmStatus == READ_ACCESS_ALARM && write) {
+        alarmStatus = WRITE_ACCESS_ALARM;
+      }
+      alarmSeverity = entry.alarmSeverity;
+      return;
+    }
+  }
+  alarmStatus = write ? WRITE_ALARM : READ_ALARM;
+  // An uncertain status code means that there is a value, but it might not be
+  // accurate. Everything else is treated as a complete failure.
+  alarmSeverity =
+    UA_StatusCode_isUncertain(statusCode) ? MINOR_ALARM : INVALID_ALARM;
+}
+
+}
+}
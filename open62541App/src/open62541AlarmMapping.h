@@ -0,0 +1,52 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+#ifndef OPEN62541_EPICS_ALARM_MAPPING_H
+#define OPEN62541_EPICS_ALARM_MAPPING_H
+
+#include <epicsTypes.h>
+
+extern "C" {
+#include "open62541.h"
+}
+
+namespace open62541 {
+namespace epics {
+
+/**
+ * Determines the EPICS alarm status and severity that shall be used when an
+ * operation fails with the specified OPC UA status code. The write flag
+ * specifies whether the failed operation was a write operation (true) or a
+ * read or monitoring operation (false). This only makes a difference for
+ * status codes that do not have a more specific mapping.
+ *
+ * This function uses a static table and never allocates memory, so it is
+ * safe to call it for every failed operation.
+ */
+void alarmForStatusCode(UA_StatusCode statusCode, bool write,
+    epicsEnum16 &alarmStatus, epicsEnum16 &alarmSeverity) noexcept;
+
+}
+}
+
+#endif // OPEN62541_EPICS_ALARM_MAPPING_H
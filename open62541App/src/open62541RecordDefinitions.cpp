@@ -62,6 +62,8 @@
 #include "Open62541MbbiRecord.h"
 #include "Open62541MbboDirectRecord.h"
 #include "Open62541MbboRecord.h"
+#include "Open62541StatsRecord.h"
+#include "StartupProfiler.h"
 #include "Open62541StringinRecord.h"
 #include "Open62541StringoutRecord.h"
 
@@ -104,6 +106,8 @@ long initRecord(void *recordVoid) {
     return -1;
   }
   dbCommon *record = static_cast<dbCommon *>(recordVoid);
+  StartupProfiler::PhaseTimer phaseTimer(
+    StartupProfiler::Phase::recordInitialization);
   RecordDeviceSupportType *deviceSupport;
   try {
     deviceSupport = new RecordDeviceSupportType(
@@ -143,6 +147,8 @@ long initRecord<Open62541AoRecord, ::aoRecord>(void *recordVoid) {
     return -1;
   }
   dbCommon *record = static_cast<dbCommon *>(recordVoid);
+  StartupProfiler::PhaseTimer phaseTimer(
+    StartupProfiler::Phase::recordInitialization);
   Open62541AoRecord *deviceSupport;
   try {
     deviceSupport = new Open62541AoRecord(
@@ -189,7 +195,11 @@ long processRecord(void *recordVoid) {
       throw std::runtime_error(
           "Pointer to device support data structure is null.");
     }
-    deviceSupport->processRecord();
+    // If processing fails because of an error reported by the server, the
+    // error has already been logged by the device support.
+    if (!deviceSupport->processRecord()) {
+      return -1;
+    }
   } catch (std::exception &e) {
     errorExtendedPrintf("%s Record processing failed: %s", record->name,
         e.what());
@@ -231,6 +241,33 @@ long processRecord<Open62541AiRecord>(void *recordVoid) {
   return returnValue;
 }
 
+template<typename RecordDeviceSupportType>
+long processStatsRecord(void *recordVoid) {
+  if (!recordVoid) {
+    errorExtendedPrintf(
+        "Record processing failed: Pointer to record structure is null.");
+    return -1;
+  }
+  dbCommon *record = static_cast<dbCommon *>(recordVoid);
+  try {
+    RecordDeviceSupportType *deviceSupport =
+        static_cast<RecordDeviceSupportType *>(record->dpvt);
+    if (!deviceSupport) {
+      throw std::runtime_error(
+          "Pointer to device support data structure is null.");
+    }
+    return deviceSupport->processStatsRecord();
+  } catch (std::exception &e) {
+    errorExtendedPrintf("%s Record processing failed: %s", record->name,
+        e.what());
+    return -1;
+  } catch (...) {
+    errorExtendedPrintf("%s Record processing failed: Unknown error.",
+        record->name);
+    return -1;
+  }
+}
+
 }
 
 extern "C" {
@@ -326,6 +363,28 @@ struct {
 };
 epicsExportAddress(dset, devAoOpen62541);
 
+/**
+ * ai record type (connection statistics).
+ */
+struct {
+  long numberOfFunctionPointers;
+  DEVSUPFUN report;
+  DEVSUPFUN init;
+  DEVSUPFUN init_record;
+  DEVSUPFUN_GET_IOINT_INFO get_ioint_info;
+  DEVSUPFUN read;
+  DEVSUPFUN special_linconv;
+} devAiOpen62541Stats = {
+  6,
+  nullptr,
+  nullptr,
+  initRecord<Open62541StatsRecord<::aiRecord>, ::aiRecord>,
+  nullptr,
+  processStatsRecord<Open62541StatsRecord<::aiRecord>>,
+  nullptr
+};
+epicsExportAddress(dset, devAiOpen62541Stats);
+
 /**
  * bi record type.
  */
@@ -430,6 +489,26 @@ struct {
 };
 epicsExportAddress(dset, devLonginOpen62541);
 
+/**
+ * longin record type (connection statistics).
+ */
+struct {
+  long numberOfFunctionPointers;
+  DEVSUPFUN report;
+  DEVSUPFUN init;
+  DEVSUPFUN init_record;
+  DEVSUPFUN_GET_IOINT_INFO get_ioint_info;
+  DEVSUPFUN read;
+} devLonginOpen62541Stats = {
+  5,
+  nullptr,
+  nullptr,
+  initRecord<Open62541StatsRecord<::longinRecord>, ::longinRecord>,
+  nullptr,
+  processStatsRecord<Open62541StatsRecord<::longinRecord>>
+};
+epicsExportAddress(dset, devLonginOpen62541Stats);
+
 /**
  * longout record type.
  */
@@ -27,17 +27,43 @@
  * of the GNU LGPL version 3 or newer.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
 #include <cstring>
 #include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include <drvSup.h>
+#include <epicsExit.h>
 #include <epicsExport.h>
+#include <initHooks.h>
 #include <iocsh.h>
 
+#include "AllocationStatistics.h"
+#include "ConnectionStatistics.h"
+#include "ErrorLogAggregator.h"
+#include "LoopbackServer.h"
 #include "open62541DumpServerCertificates.h"
 #include "open62541Error.h"
+#include "PubSubConnection.h"
+#include "ReplayConnection.h"
+#include "RequestBudget.h"
 #include "ServerConnectionRegistry.h"
+#include "StartupProfiler.h"
+#include "TrafficRecorder.h"
 #include "UaException.h"
 
+// epicsStdio.h redefines printf, which breaks the format attributes used in
+// open62541.h, so it has to be included after all headers that include
+// open62541.h.
+#include <epicsStdio.h>
+
 using namespace open62541::epics;
 
 extern "C" {
@@ -59,7 +85,9 @@ static const iocshFuncDef iocshOpen62541ConnectionSetupFuncDef = {
 
 /**
  * Implementation of the iocsh open62541ConnectionSetup function. This function
- * creates a connection to an OPC UA server.
+ * creates a connection to an OPC UA server. An endpoint URL of the form
+ * "loopback://<name>" creates a connection to the loopback server with the
+ * specified name, starting this server if necessary.
  */
 static void iocshOpen62541ConnectionSetupFunc(const iocshArgBuf *args)
     noexcept {
@@ -90,17 +118,26 @@ static void iocshOpen62541ConnectionSetupFunc(const iocshArgBuf *args)
   }
   std::shared_ptr<ServerConnection> connection;
   try {
+    // A loopback server is started on demand, and the connection simply uses
+    // the actual endpoint URL of this server.
+    std::string resolvedEndpointUrl(endpointUrl);
+    std::string loopbackServerName;
+    if (LoopbackServer::parseLoopbackUrl(endpointUrl, loopbackServerName)) {
+      resolvedEndpointUrl =
+        LoopbackServer::getInstance(loopbackServerName)->getEndpointUrl();
+    }
     if (username && std::strlen(username)) {
-      connection = std::make_shared<ServerConnection>(endpointUrl, username,
-          password ? password : "");
+      connection = std::make_shared<ServerConnection>(resolvedEndpointUrl,
+          username, password ? password : "");
     } else {
-      connection = std::make_shared<ServerConnection>(endpointUrl);
+      connection = std::make_shared<ServerConnection>(resolvedEndpointUrl);
     }
   } catch (const UaException &e) {
     errorPrintf("Could not setup the connection: %s", e.what());
     return;
   } catch (const std::exception &e) {
     errorPrintf("Could not setup the connection: %s", e.what());
+    return;
   }
   ServerConnectionRegistry::getInstance().registerServerConnection(connectionId,
       connection);
@@ -253,6 +290,7 @@ static void iocshOpen62541ConnectionSetupEncryptedFunc(const iocshArgBuf *args)
     return;
   } catch (const std::exception &e) {
     errorPrintf("Could not setup the connection: %s", e.what());
+    return;
   }
   ServerConnectionRegistry::getInstance().registerServerConnection(connectionId,
       connection);
@@ -309,232 +347,1839 @@ static void iocshOpen62541DumpServerCertificatesFunc(const iocshArgBuf *args)
   }
 }
 
-// Data structures needed for the iocsh open62541SetSubscriptionLifetimeCount
+// Data structures needed for the iocsh open62541SetConnectionThreadOptions
 // function.
-static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg0 = {
+static const iocshArg iocshOpen62541SetConnectionThreadOptionsArg0 = {
   "connection ID", iocshArgString
 };
-static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg1 = {
-  "subscription ID", iocshArgString
+static const iocshArg iocshOpen62541SetConnectionThreadOptionsArg1 = {
+  "thread name", iocshArgString
 };
-static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg2 = {
-  "lifetime count", iocshArgInt
+static const iocshArg iocshOpen62541SetConnectionThreadOptionsArg2 = {
+  "scheduling policy", iocshArgString
+};
+static const iocshArg iocshOpen62541SetConnectionThreadOptionsArg3 = {
+  "priority", iocshArgInt
+};
+static const iocshArg iocshOpen62541SetConnectionThreadOptionsArg4 = {
+  "CPU affinity", iocshArgString
 };
 
-static const iocshArg * const iocshOpen62541SetSubscriptionLifetimeCountArgs[] = {
-  &iocshOpen62541SetSubscriptionLifetimeCountArg0,
-  &iocshOpen62541SetSubscriptionLifetimeCountArg1,
-  &iocshOpen62541SetSubscriptionLifetimeCountArg2
+static const iocshArg * const iocshOpen62541SetConnectionThreadOptionsArgs[] = {
+  &iocshOpen62541SetConnectionThreadOptionsArg0,
+  &iocshOpen62541SetConnectionThreadOptionsArg1,
+  &iocshOpen62541SetConnectionThreadOptionsArg2,
+  &iocshOpen62541SetConnectionThreadOptionsArg3,
+  &iocshOpen62541SetConnectionThreadOptionsArg4
 };
-static const iocshFuncDef iocshOpen62541SetSubscriptionLifetimeCountFuncDef = {
-  "open62541SetSubscriptionLifetimeCount", 3,
-  iocshOpen62541SetSubscriptionLifetimeCountArgs
+static const iocshFuncDef iocshOpen62541SetConnectionThreadOptionsFuncDef = {
+  "open62541SetConnectionThreadOptions", 5,
+  iocshOpen62541SetConnectionThreadOptionsArgs
 };
 
 /**
- * Implementation of the iocsh open62541SetSubscriptionLifetimeCount function.
- * This function sets the requested lifetime count for a specific subscription
- * associated with a specific connection.
+ * Implementation of the iocsh open62541SetConnectionThreadOptions function.
+ * This function sets the name, scheduling policy, priority, and CPU affinity
+ * of the thread handling the communication for a specific connection.
  */
-static void iocshOpen62541SetSubscriptionLifetimeCountFunc(
+static void iocshOpen62541SetConnectionThreadOptionsFunc(
     const iocshArgBuf *args) noexcept {
-  char *connectionId = args[0].sval;
-  char *subscriptionId = args[1].sval;
-  int lifetimeCount = args[2].ival;
+  char const *connectionId = args[0].sval;
+  char const *threadName = args[1].sval;
+  char const *schedulingPolicyString = args[2].sval;
+  int priority = args[3].ival;
+  char const *cpuAffinity = args[4].sval;
   // Verify and convert the parameters.
   if (!connectionId) {
     errorPrintf(
-      "Could not set the subscription lifetime count: Connection ID must be specified.");
+      "Could not set the connection thread options: Connection ID must be specified.");
     return;
   }
   if (!std::strlen(connectionId)) {
     errorPrintf(
-      "Could not set the subscription lifetime count: Connection ID must not be empty.");
+      "Could not set the connection thread options: Connection ID must not be empty.");
     return;
   }
-  if (!subscriptionId) {
-    errorPrintf(
-      "Could not set the subscription lifetime count: Subscription ID must be specified.");
-    return;
+  if (!threadName) {
+    threadName = "";
   }
-  if (!std::strlen(subscriptionId)) {
-    errorPrintf(
-      "Could not set the subscription lifetime count: Subscription ID must not be empty.");
-    return;
+  if (!schedulingPolicyString || !strlen(schedulingPolicyString)) {
+    schedulingPolicyString = "other";
   }
-  if (lifetimeCount < 0) {
+  ServerConnection::ThreadSchedulingPolicy schedulingPolicy;
+  if (!strcasecmp(schedulingPolicyString, "other")) {
+    schedulingPolicy = ServerConnection::ThreadSchedulingPolicy::other;
+  } else if (!strcasecmp(schedulingPolicyString, "fifo")) {
+    schedulingPolicy = ServerConnection::ThreadSchedulingPolicy::fifo;
+  } else if (!strcasecmp(schedulingPolicyString, "rr")) {
+    schedulingPolicy = ServerConnection::ThreadSchedulingPolicy::roundRobin;
+  } else {
     errorPrintf(
-      "Could not set the subscription lifetime count: The lifetime count cannot be negative.");
+      "Could not set the connection thread options: The scheduling policy must be one of \"other\", \"fifo\", or \"rr\".");
     return;
   }
+  if (!cpuAffinity) {
+    cpuAffinity = "";
+  }
   std::shared_ptr<ServerConnection> connection =
     ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
   if (!connection) {
     errorPrintf(
-      "Could not set the subscription lifetime count: The connection with the ID \"%s\" does not exist.",
+      "Could not set the connection thread options: The connection with the ID \"%s\" does not exist.",
       connectionId);
     return;
   }
-  connection->setSubscriptionLifetimeCount(subscriptionId, lifetimeCount);
+  try {
+    connection->setConnectionThreadOptions(
+      threadName, schedulingPolicy, priority, cpuAffinity);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the connection thread options: %s", e.what());
+  }
 }
 
-// Data structures needed for the iocsh
-// open62541SetSubscriptionMaxKeepAliveCount function.
-static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg0 = {
-  "connection ID", iocshArgString
+// Data structures needed for the iocsh open62541SetErrorLogOptions function.
+static const iocshArg iocshOpen62541SetErrorLogOptionsArg0 = {
+  "summary interval (in s)", iocshArgDouble
 };
-static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg1 = {
-  "subscription ID", iocshArgString
+static const iocshArg iocshOpen62541SetErrorLogOptionsArg1 = {
+  "max. messages per interval", iocshArgInt
 };
-static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg2 = {
-  "max. keep alive count", iocshArgInt
+
+static const iocshArg * const iocshOpen62541SetErrorLogOptionsArgs[] = {
+  &iocshOpen62541SetErrorLogOptionsArg0,
+  &iocshOpen62541SetErrorLogOptionsArg1
+};
+static const iocshFuncDef iocshOpen62541SetErrorLogOptionsFuncDef = {
+  "open62541SetErrorLogOptions", 2, iocshOpen62541SetErrorLogOptionsArgs
 };
 
-static const iocshArg * const iocshOpen62541SetSubscriptionMaxKeepAliveCountArgs[] = {
-  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg0,
-  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg1,
-  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg2
+/**
+ * Implementation of the iocsh open62541SetErrorLogOptions function. This
+ * function sets the interval in which summaries of repeated error messages are
+ * printed and the max. number of lines that are printed for each connection
+ * within this interval.
+ */
+static void iocshOpen62541SetErrorLogOptionsFunc(
+    const iocshArgBuf *args) noexcept {
+  double summaryInterval = args[0].dval;
+  int maxMessagesPerInterval = args[1].ival;
+  if (maxMessagesPerInterval <= 0) {
+    errorPrintf(
+      "Could not set the error log options: The max. number of messages per interval must be positive.");
+    return;
+  }
+  try {
+    ErrorLogAggregator::getInstance().setOptions(
+      summaryInterval, static_cast<std::uint32_t>(maxMessagesPerInterval));
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the error log options: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541SetRequestBudget function.
+static const iocshArg iocshOpen62541SetRequestBudgetArg0 = {
+  "requests per second", iocshArgDouble
 };
-static const iocshFuncDef iocshOpen62541SetSubscriptionMaxKeepAliveCountFuncDef = {
-  "open62541SetSubscriptionMaxKeepAliveCount", 3,
-  iocshOpen62541SetSubscriptionMaxKeepAliveCountArgs
+static const iocshArg iocshOpen62541SetRequestBudgetArg1 = {
+  "bytes per second", iocshArgDouble
+};
+
+static const iocshArg * const iocshOpen62541SetRequestBudgetArgs[] = {
+  &iocshOpen62541SetRequestBudgetArg0,
+  &iocshOpen62541SetRequestBudgetArg1
+};
+static const iocshFuncDef iocshOpen62541SetRequestBudgetFuncDef = {
+  "open62541SetRequestBudget", 2, iocshOpen62541SetRequestBudgetArgs
 };
 
 /**
- * Implementation of the iocsh open62541SetSubscriptionMaxKeepAliveCount
- * function. This function sets the requested max. keep alive count for a
- * specific subscription associated with a specific connection.
+ * Implementation of the iocsh open62541SetRequestBudget function. This
+ * function sets the max. number of requests and bytes per second that may be
+ * sent by all connections together. A limit of zero means that the respective
+ * quantity is not limited.
  */
-static void iocshOpen62541SetSubscriptionMaxKeepAliveCountFunc(
+static void iocshOpen62541SetRequestBudgetFunc(
     const iocshArgBuf *args) noexcept {
-  char *connectionId = args[0].sval;
-  char *subscriptionId = args[1].sval;
-  int maxKeepAliveCount = args[2].ival;
+  double requestsPerSecond = args[0].dval;
+  double bytesPerSecond = args[1].dval;
+  try {
+    RequestBudget::getInstance().setLimits(requestsPerSecond, bytesPerSecond);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the request budget: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541SetRequestBudgetWeight
+// function.
+static const iocshArg iocshOpen62541SetRequestBudgetWeightArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetRequestBudgetWeightArg1 = {
+  "weight", iocshArgDouble
+};
+
+static const iocshArg * const iocshOpen62541SetRequestBudgetWeightArgs[] = {
+  &iocshOpen62541SetRequestBudgetWeightArg0,
+  &iocshOpen62541SetRequestBudgetWeightArg1
+};
+static const iocshFuncDef iocshOpen62541SetRequestBudgetWeightFuncDef = {
+  "open62541SetRequestBudgetWeight", 2,
+  iocshOpen62541SetRequestBudgetWeightArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetRequestBudgetWeight function. This
+ * function sets the weight that a specific connection has when the request
+ * budget is distributed between the connections.
+ */
+static void iocshOpen62541SetRequestBudgetWeightFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  double weight = args[1].dval;
   // Verify and convert the parameters.
   if (!connectionId) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: Connection ID must be specified.");
+      "Could not set the request budget weight: Connection ID must be specified.");
     return;
   }
   if (!std::strlen(connectionId)) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: Connection ID must not be empty.");
+      "Could not set the request budget weight: Connection ID must not be empty.");
     return;
   }
-  if (!subscriptionId) {
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: Subscription ID must be specified.");
+      "Could not set the request budget weight: The connection with the ID \"%s\" does not exist.",
+      connectionId);
     return;
   }
-  if (!std::strlen(subscriptionId)) {
+  try {
+    connection->getRequestBudgetShare().setWeight(weight);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the request budget weight: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541SetProbeInterval function.
+static const iocshArg iocshOpen62541SetProbeIntervalArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetProbeIntervalArg1 = {
+  "interval", iocshArgDouble
+};
+
+static const iocshArg * const iocshOpen62541SetProbeIntervalArgs[] = {
+  &iocshOpen62541SetProbeIntervalArg0,
+  &iocshOpen62541SetProbeIntervalArg1
+};
+static const iocshFuncDef iocshOpen62541SetProbeIntervalFuncDef = {
+  "open62541SetProbeInterval", 2, iocshOpen62541SetProbeIntervalArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetProbeInterval function. This
+ * function sets the interval (in seconds) in which a connection probes the
+ * round-trip time and the clock offset of the server. An interval of zero
+ * disables the probe.
+ */
+static void iocshOpen62541SetProbeIntervalFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  double interval = args[1].dval;
+  // Verify and convert the parameters.
+  if (!connectionId) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: Subscription ID must not be empty.");
+      "Could not set the probe interval: Connection ID must be specified.");
     return;
   }
-  if (maxKeepAliveCount < 0) {
+  if (!std::strlen(connectionId)) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: The MaxKeepAlive count cannot be negative.");
+      "Could not set the probe interval: Connection ID must not be empty.");
     return;
   }
   std::shared_ptr<ServerConnection> connection =
     ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
   if (!connection) {
     errorPrintf(
-      "Could not set the subscription max. keep alive count: The connection with the ID \"%s\" does not exist.",
+      "Could not set the probe interval: The connection with the ID \"%s\" does not exist.",
       connectionId);
     return;
   }
-  connection->setSubscriptionMaxKeepAliveCount(subscriptionId, maxKeepAliveCount);
+  try {
+    connection->setProbeInterval(interval);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the probe interval: %s", e.what());
+  }
 }
 
-// Data structures needed for the iocsh
-// open62541SetSubscriptionPublishingInterval function.
-static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg0 = {
+// Data structures needed for the iocsh open62541SetServerDiagnosticsInterval
+// function.
+static const iocshArg iocshOpen62541SetServerDiagnosticsIntervalArg0 = {
   "connection ID", iocshArgString
 };
-static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg1 = {
-  "subscription ID", iocshArgString
-};
-static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg2 = {
-  "publishing interval (in ms)", iocshArgDouble
+static const iocshArg iocshOpen62541SetServerDiagnosticsIntervalArg1 = {
+  "interval", iocshArgDouble
 };
 
-static const iocshArg * const iocshOpen62541SetSubscriptionPublishingIntervalArgs[] = {
-  &iocshOpen62541SetSubscriptionPublishingIntervalArg0,
-  &iocshOpen62541SetSubscriptionPublishingIntervalArg1,
-  &iocshOpen62541SetSubscriptionPublishingIntervalArg2
+static const iocshArg * const iocshOpen62541SetServerDiagnosticsIntervalArgs[] = {
+  &iocshOpen62541SetServerDiagnosticsIntervalArg0,
+  &iocshOpen62541SetServerDiagnosticsIntervalArg1
 };
-static const iocshFuncDef iocshOpen62541SetSubscriptionPublishingIntervalFuncDef = {
-  "open62541SetSubscriptionPublishingInterval", 3,
-  iocshOpen62541SetSubscriptionPublishingIntervalArgs
+static const iocshFuncDef iocshOpen62541SetServerDiagnosticsIntervalFuncDef = {
+  "open62541SetServerDiagnosticsInterval", 2,
+  iocshOpen62541SetServerDiagnosticsIntervalArgs
 };
 
 /**
- * Implementation of the iocsh open62541SetSubscriptionPublishingInterval function.
- * This function sets the requested publishing interval for a specific subscription
- * associated with a specific connection.
+ * Implementation of the iocsh open62541SetServerDiagnosticsInterval function.
+ * This function sets the interval (in seconds) in which a connection reads
+ * the session and subscription diagnostics from the server. An interval of
+ * zero disables reading the diagnostics.
  */
-static void iocshOpen62541SetSubscriptionPublishingIntervalFunc(
+static void iocshOpen62541SetServerDiagnosticsIntervalFunc(
     const iocshArgBuf *args) noexcept {
-  char *connectionId = args[0].sval;
-  char *subscriptionId = args[1].sval;
-  double publishingInterval = args[2].dval;
+  char const *connectionId = args[0].sval;
+  double interval = args[1].dval;
   // Verify and convert the parameters.
   if (!connectionId) {
     errorPrintf(
-      "Could not set the subscription publishing interval: Connection ID must be specified.");
+      "Could not set the server diagnostics interval: Connection ID must be specified.");
     return;
   }
   if (!std::strlen(connectionId)) {
     errorPrintf(
-      "Could not set the subscription publishing interval: Connection ID must not be empty.");
+      "Could not set the server diagnostics interval: Connection ID must not be empty.");
     return;
   }
-  if (!subscriptionId) {
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
     errorPrintf(
-      "Could not set the subscription publishing interval: Subscription ID must be specified.");
+      "Could not set the server diagnostics interval: The connection with the ID \"%s\" does not exist.",
+      connectionId);
     return;
   }
-  if (!std::strlen(subscriptionId)) {
+  try {
+    connection->setServerDiagnosticsInterval(interval);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not set the server diagnostics interval: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541SetSourceTimestamps function.
+static const iocshArg iocshOpen62541SetSourceTimestampsArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSourceTimestampsArg1 = {
+  "enabled", iocshArgInt
+};
+
+static const iocshArg * const iocshOpen62541SetSourceTimestampsArgs[] = {
+  &iocshOpen62541SetSourceTimestampsArg0,
+  &iocshOpen62541SetSourceTimestampsArg1
+};
+static const iocshFuncDef iocshOpen62541SetSourceTimestampsFuncDef = {
+  "open62541SetSourceTimestamps", 2, iocshOpen62541SetSourceTimestampsArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetSourceTimestamps function. This
+ * function enables or disables requesting source timestamps for the monitored
+ * items of a connection. They are needed for the delivery latency histogram.
+ */
+static void iocshOpen62541SetSourceTimestampsFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  bool enabled = args[1].ival != 0;
+  // Verify and convert the parameters.
+  if (!connectionId) {
     errorPrintf(
-      "Could not set the subscription publishing interval: Subscription ID must not be empty.");
+      "Could not set the source timestamps option: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not set the source timestamps option: Connection ID must not be empty.");
     return;
   }
   std::shared_ptr<ServerConnection> connection =
     ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
   if (!connection) {
     errorPrintf(
-      "Could not set the subscription publishing interval: The connection with the ID \"%s\" does not exist.",
+      "Could not set the source timestamps option: The connection with the ID \"%s\" does not exist.",
       connectionId);
     return;
   }
-  connection->setSubscriptionPublishingInterval(subscriptionId, publishingInterval);
+  connection->setSourceTimestamps(enabled);
 }
 
+// Data structures needed for the iocsh open62541RequestBudgetReport function.
+static const iocshFuncDef iocshOpen62541RequestBudgetReportFuncDef = {
+  "open62541RequestBudgetReport", 0, nullptr
+};
+
 /**
- * Registrar that registers the iocsh commands.
+ * Implementation of the iocsh open62541RequestBudgetReport function. This
+ * function prints the limits of the request budget and, for each connection,
+ * its weight, the total number of requests and bytes, and the rates observed
+ * since the last time this function was called.
  */
-static void open62541Registrar() {
-  ::iocshRegister(
-    &iocshOpen62541ConnectionSetupFuncDef,
-    iocshOpen62541ConnectionSetupFunc);
-  ::iocshRegister(
-    &iocshOpen62541ConnectionSetupEncryptedFuncDef,
-    iocshOpen62541ConnectionSetupEncryptedFunc);
-  ::iocshRegister(
-    &iocshOpen62541DumpServerCertificatesFuncDef,
-    iocshOpen62541DumpServerCertificatesFunc);
-  ::iocshRegister(
-    &iocshOpen62541SetSubscriptionLifetimeCountFuncDef,
-    iocshOpen62541SetSubscriptionLifetimeCountFunc);
-  ::iocshRegister(
-    &iocshOpen62541SetSubscriptionMaxKeepAliveCountFuncDef,
-    iocshOpen62541SetSubscriptionMaxKeepAliveCountFunc);
-  ::iocshRegister(
-    &iocshOpen62541SetSubscriptionPublishingIntervalFuncDef,
-    iocshOpen62541SetSubscriptionPublishingIntervalFunc);
+static void iocshOpen62541RequestBudgetReportFunc(
+    const iocshArgBuf *) noexcept {
+  struct Totals {
+    std::uint64_t bytes;
+    std::uint64_t requests;
+    std::chrono::steady_clock::time_point time;
+  };
+  // The totals from the last call are needed for calculating the rates. The
+  // iocsh does not call functions concurrently, so we do not need a mutex.
+  static std::map<std::string, Totals> lastTotals;
+  auto &budget = RequestBudget::getInstance();
+  auto requestsPerSecond = budget.getRequestsPerSecond();
+  auto bytesPerSecond = budget.getBytesPerSecond();
+  if (requestsPerSecond > 0.0) {
+    printf("Requests per second limit: %g\n", requestsPerSecond);
+  } else {
+    printf("Requests per second limit: unlimited\n");
+  }
+  if (bytesPerSecond > 0.0) {
+    printf("Bytes per second limit:    %g\n", bytesPerSecond);
+  } else {
+    printf("Bytes per second limit:    unlimited\n");
+  }
+  auto now = std::chrono::steady_clock::now();
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getServerConnections()) {
+    auto &share = entry.second->getRequestBudgetShare();
+    Totals totals{share.getTotalBytes(), share.getTotalRequests(), now};
+    printf("%s: weight %g, %" PRIu64 " requests, %" PRIu64 " bytes",
+      entry.first.c_str(), share.getWeight(), totals.requests, totals.bytes);
+    auto last = lastTotals.find(entry.first);
+    if (last != lastTotals.end()) {
+      double seconds = std::chrono::duration<double>(
+        now - last->second.time).count();
+      if (seconds > 0.0) {
+        printf(", %.1f requests/s, %.1f bytes/s",
+          (totals.requests - last->second.requests) / seconds,
+          (totals.bytes - last->second.bytes) / seconds);
+      }
+    }
+    printf("\n");
+    lastTotals[entry.first] = totals;
+  }
 }
 
-epicsExportRegistrar(open62541Registrar);
+/**
+ * Prints the statistics for all connections. At level 0, only the connection
+ * state and the queue depth are printed. At level 1, the counters, the
+ * round-trip times, and the session diagnostics read from the server are
+ * printed as well. At level 2, the statistics for each subscription (together
+ * with the server's diagnostics for it) are printed in addition to that.
+ */
+static void printStatisticsReport(int level) {
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getServerConnections()) {
+    auto &connection = *entry.second;
+    auto &statistics = connection.getStatistics();
+    printf("%s (%s): %s, queue depth %zu\n", entry.first.c_str(),
+      connection.getEndpointUrl().c_str(),
+      statistics.isConnected() ? "connected" : "disconnected",
+      statistics.getQueueDepth());
+    if (level < 1) {
+      continue;
+    }
+    for (std::size_t i = 0;
+        i < static_cast<std::size_t>(
+          ConnectionStatistics::Counter::numberOfCounters);
+        ++i) {
+      auto counter = static_cast<ConnectionStatistics::Counter>(i);
+      printf("  %-22s %" PRIu64 "\n",
+        ConnectionStatistics::getCounterName(counter),
+        statistics.get(counter));
+    }
+    printf("  %-22s %.3f ms\n", "rtt",
+      statistics.getLastRoundTripTime() * 1e3);
+    printf("  %-22s %.3f ms\n", "rtt_avg",
+      statistics.getAverageRoundTripTime() * 1e3);
+    double clockOffset, clockOffsetUncertainty;
+    if (statistics.getClockOffset(clockOffset, clockOffsetUncertainty)) {
+      printf("  %-22s %.3f ms (+/- %.3f ms)\n", "clock_offset",
+        clockOffset * 1e3, clockOffsetUncertainty * 1e3);
+    } else {
+      printf("  %-22s unknown\n", "clock_offset");
+    }
+    auto &probeHistogram = statistics.getLatencyHistogram(
+      ConnectionStatistics::Latency::probe);
+    printf("  %-22s %.3f ms\n", "probe_rtt_p50",
+      probeHistogram.getPercentile(0.5) * 1e-6);
+    printf("  %-22s %.3f ms\n", "probe_rtt_p99",
+      probeHistogram.getPercentile(0.99) * 1e-6);
+    // The server diagnostics are only printed if reading them has been
+    // enabled, so that the report is not cluttered otherwise.
+    auto serverDiagnostics = connection.getServerDiagnostics();
+    bool printServerDiagnostics =
+      connection.getServerDiagnosticsInterval() > 0.0;
+    if (printServerDiagnostics && !serverDiagnostics.available) {
+      printf("  Server diagnostics not available%s%s\n",
+        serverDiagnostics.error.empty() ? "" : ": ",
+        serverDiagnostics.error.c_str());
+    } else if (printServerDiagnostics && serverDiagnostics.sessionAvailable) {
+      auto &session = serverDiagnostics.session;
+      printf("  Server session: %" PRIu32 " publish requests queued, %" PRIu32
+        " subscriptions, %" PRIu32 " monitored items, %" PRIu32
+        " requests (%" PRIu32 " failed, %" PRIu32 " unauthorized)\n",
+        session.currentPublishRequestsInQueue,
+        session.currentSubscriptionsCount, session.currentMonitoredItemsCount,
+        session.totalRequestCount, session.totalRequestErrorCount,
+        session.unauthorizedRequestCount);
+    } else if (printServerDiagnostics) {
+      printf("  Server session: not available\n");
+    }
+    if (level < 2) {
+      continue;
+    }
+    for (auto &subscription : connection.getAllSubscriptionStatistics()) {
+      printf("  Subscription %s: %" PRIu64 " notifications, %" PRIu64
+        " notification failures, %" PRIu64 " overflows\n",
+        subscription.first.c_str(),
+        subscription.second->notifications.load(std::memory_order_relaxed),
+        subscription.second->notificationFailures.load(
+          std::memory_order_relaxed),
+        subscription.second->overflows.load(std::memory_order_relaxed));
+      auto serverSubscription =
+        serverDiagnostics.subscriptions.find(subscription.first);
+      if (printServerDiagnostics && serverSubscription
+          != serverDiagnostics.subscriptions.end()) {
+        auto &server = serverSubscription->second;
+        printf("    Server: ID %" PRIu32 ", publishing interval %.1f ms, %"
+          PRIu32 " monitored items, %" PRIu32 " notifications, %" PRIu32
+          " data changes, %" PRIu32 " publish requests (%" PRIu32
+          " late), %" PRIu32 " unacknowledged, %" PRIu32 " discarded, %"
+          PRIu32 " republished, %" PRIu32 " queue overflows\n",
+          server.subscriptionId, server.publishingInterval,
+          server.monitoredItemCount, server.notificationsCount,
+          server.dataChangeNotificationsCount, server.publishRequestCount,
+          server.latePublishRequestCount, server.unacknowledgedMessageCount,
+          server.discardedMessageCount, server.republishRequestCount,
+          server.monitoringQueueOverflowCount);
+      }
+    }
+  }
+  // Replay connections do not talk to a server, but their counters show what
+  // the records did with the replayed events.
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getConnections()) {
+    auto replayConnection =
+      std::dynamic_pointer_cast<ReplayConnection>(entry.second);
+    if (!replayConnection) {
+      continue;
+    }
+    printf("%s (%s): replaying %zu events for %zu nodes, %" PRIu64
+      " events replayed, %" PRIu64 " passes completed\n",
+      entry.first.c_str(), replayConnection->getEndpointUrl().c_str(),
+      replayConnection->getEvents(), replayConnection->getNodes(),
+      replayConnection->getReplayedEvents(),
+      replayConnection->getReplayPasses());
+    if (level < 1) {
+      continue;
+    }
+    auto &statistics = replayConnection->getStatistics();
+    for (std::size_t i = 0;
+        i < static_cast<std::size_t>(
+          ConnectionStatistics::Counter::numberOfCounters);
+        ++i) {
+      auto counter = static_cast<ConnectionStatistics::Counter>(i);
+      printf("  %-22s %" PRIu64 "\n",
+        ConnectionStatistics::getCounterName(counter),
+        statistics.get(counter));
+    }
+  }
+  // PubSub connections do not have a session or subscriptions, but their
+  // receive statistics help with diagnosing lost or undecodable messages.
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getConnections()) {
+    auto pubSubConnection =
+      std::dynamic_pointer_cast<PubSubConnection>(entry.second);
+    if (!pubSubConnection) {
+      continue;
+    }
+    printf("%s (%s): %" PRIu64 " messages (%" PRIu64 " bytes) received\n",
+      entry.first.c_str(), pubSubConnection->getEndpointUrl().c_str(),
+      pubSubConnection->getReceivedMessages(),
+      pubSubConnection->getReceivedBytes());
+    if (level < 1) {
+      continue;
+    }
+    printf("  %-22s %" PRIu64 "\n", "data_set_messages",
+      pubSubConnection->getReceivedDataSetMessages());
+    printf("  %-22s %" PRIu64 "\n", "ignored_messages",
+      pubSubConnection->getIgnoredMessages());
+    printf("  %-22s %" PRIu64 "\n", "decoding_errors",
+      pubSubConnection->getDecodingErrors());
+    auto &statistics = pubSubConnection->getStatistics();
+    for (auto counter : {ConnectionStatistics::Counter::notifications,
+        ConnectionStatistics::Counter::notificationFailures,
+        ConnectionStatistics::Counter::callbackExceptions}) {
+      printf("  %-22s %" PRIu64 "\n",
+        ConnectionStatistics::getCounterName(counter),
+        statistics.get(counter));
+    }
+    auto publishingInterval =
+      pubSubConnection->getWriterGroupPublishingInterval();
+    if (publishingInterval <= 0.0) {
+      continue;
+    }
+    printf("  writer group (%.3f ms): %" PRIu64 " messages (%" PRIu64
+      " bytes) sent\n", publishingInterval,
+      pubSubConnection->getSentMessages(), pubSubConnection->getSentBytes());
+    printf("  %-22s %" PRIu64 "\n", "send_errors",
+      pubSubConnection->getSendErrors());
+    printf("  %-22s %" PRIu64 "\n", "missed_cycles",
+      pubSubConnection->getMissedCycles());
+    for (auto histogram : {
+        std::make_pair("cycle_time",
+          &pubSubConnection->getCycleTimeHistogram()),
+        std::make_pair("cycle_lateness",
+          &pubSubConnection->getCycleLatenessHistogram())}) {
+      auto summary = histogram.second->getSummary();
+      printf("  %-22s p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        histogram.first, summary.p50 * 1e3, summary.p99 * 1e3,
+        summary.max * 1e3);
+    }
+  }
+}
+
+/**
+ * Prints a single line with the summary of a latency histogram.
+ */
+static void printLatencySummary(const char *name,
+    const LatencyHistogram &histogram) {
+  auto summary = histogram.getSummary();
+  printf("  %-24s %10" PRIu64 " %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+    name, summary.count, summary.mean * 1e3, summary.p50 * 1e3,
+    summary.p90 * 1e3, summary.p99 * 1e3, summary.p999 * 1e3,
+    summary.max * 1e3);
+}
+
+/**
+ * Calls the specified function for the connection with the specified ID or
+ * for all connections if the ID is null or empty. Returns false if a
+ * connection ID has been specified, but no such connection exists.
+ */
+static bool forEachConnection(const char *connectionId,
+    std::function<void(const std::string &, ServerConnection &)> function) {
+  if (connectionId && std::strlen(connectionId)) {
+    auto connection = ServerConnectionRegistry::getInstance()
+      .getServerConnection(connectionId);
+    if (!connection) {
+      return false;
+    }
+    function(std::string(connectionId), *connection);
+    return true;
+  }
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getServerConnections()) {
+    function(entry.first, *entry.second);
+  }
+  return true;
+}
+
+// Data structures needed for the iocsh open62541AllocationReport function.
+static const iocshFuncDef iocshOpen62541AllocationReportFuncDef = {
+  "open62541AllocationReport", 0, nullptr
+};
+
+/**
+ * Implementation of the iocsh open62541AllocationReport function. This
+ * function prints, for each allocation account, the number of allocations and
+ * frees, the net and peak number of bytes, and the allocation rates observed
+ * since the last time this function was called. It also prints how often
+ * node IDs and variants have been copied.
+ */
+static void iocshOpen62541AllocationReportFunc(
+    const iocshArgBuf *) noexcept {
+  struct Totals {
+    std::uint64_t allocatedBytes;
+    std::uint64_t allocations;
+    std::chrono::steady_clock::time_point time;
+  };
+  // The totals from the last call are needed for calculating the rates. The
+  // iocsh does not call functions concurrently, so we do not need a mutex.
+  // Accounts are never destroyed while the IOC is running, so we can use
+  // their addresses as keys.
+  static std::map<const AllocationStatistics::Account *, Totals> lastTotals;
+  auto &allocationStatistics = AllocationStatistics::getInstance();
+  auto now = std::chrono::steady_clock::now();
+  auto printAccount = [&now](const std::string &label,
+      const AllocationStatistics::Account &account) {
+    Totals totals{account.allocatedBytes.load(std::memory_order_relaxed),
+      account.allocations.load(std::memory_order_relaxed), now};
+    printf("%-24s %" PRIu64 " allocations, %" PRIu64 " frees, %" PRId64
+      " net bytes, %" PRId64 " peak net bytes", label.c_str(),
+      totals.allocations, account.frees.load(std::memory_order_relaxed),
+      account.netBytes.load(std::memory_order_relaxed),
+      account.peakNetBytes.load(std::memory_order_relaxed));
+    auto last = lastTotals.find(&account);
+    if (last != lastTotals.end()) {
+      double seconds = std::chrono::duration<double>(
+        now - last->second.time).count();
+      if (seconds > 0.0) {
+        printf(", %.1f allocations/s, %.1f bytes/s",
+          (totals.allocations - last->second.allocations) / seconds,
+          (totals.allocatedBytes - last->second.allocatedBytes) / seconds);
+      }
+    }
+    printf("\n");
+    lastTotals[&account] = totals;
+  };
+  try {
+    printf("Node ID copies: %" PRIu64 "\n",
+      allocationStatistics.getNodeIdCopies());
+    printf("Variant copies: %" PRIu64 "\n",
+      allocationStatistics.getVariantCopies());
+    if (!AllocationStatistics::isEnabled()) {
+      printf("Allocation hooks are not available. Set USE_ALLOCATION_STATS to YES in configure/CONFIG_SITE.local and recompile the device support to enable them.\n");
+      return;
+    }
+    for (auto &entry : ServerConnectionRegistry::getInstance()
+        .getServerConnections()) {
+      printAccount(entry.first + " client",
+        entry.second->getClientAllocations());
+      printAccount(entry.first + " records",
+        entry.second->getRecordAllocations());
+    }
+    printAccount("other", allocationStatistics.getOtherAccount());
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the allocation report: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541LatencyReport function.
+static const iocshArg iocshOpen62541LatencyReportArg0 = {
+  "connection ID", iocshArgString};
+static const iocshArg * const iocshOpen62541LatencyReportArgs[] = {
+  &iocshOpen62541LatencyReportArg0};
+static const iocshFuncDef iocshOpen62541LatencyReportFuncDef = {
+  "open62541LatencyReport", 1, iocshOpen62541LatencyReportArgs
+};
+
+/**
+ * Implementation of the iocsh open62541LatencyReport function. This function
+ * prints the count, mean, percentiles, and maximum of the latency histograms
+ * for the specified connection (or all connections if no connection ID is
+ * specified) and their subscriptions. All times are in milliseconds.
+ */
+static void iocshOpen62541LatencyReportFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  try {
+    auto found = forEachConnection(connectionId,
+      [](const std::string &id, ServerConnection &connection) {
+        printf("%s (%s), times in ms:\n", id.c_str(),
+          connection.getEndpointUrl().c_str());
+        printf("  %-24s %10s %10s %10s %10s %10s %10s %10s\n", "stage",
+          "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+        auto &statistics = connection.getStatistics();
+        for (std::size_t i = 0;
+            i < static_cast<std::size_t>(
+              ConnectionStatistics::Latency::numberOfLatencies);
+            ++i) {
+          auto latency = static_cast<ConnectionStatistics::Latency>(i);
+          printLatencySummary(ConnectionStatistics::getLatencyName(latency),
+            statistics.getLatencyHistogram(latency));
+        }
+        for (auto &subscription : connection.getAllSubscriptionStatistics()) {
+          printLatencySummary(
+            (subscription.first + " delivery").c_str(),
+            subscription.second->notificationDeliveryLatency);
+          printLatencySummary(
+            (subscription.first + " processing").c_str(),
+            subscription.second->notificationProcessingLatency);
+        }
+      });
+    if (!found) {
+      errorPrintf(
+        "Could not print the latency report: The connection with the ID \"%s\" does not exist.",
+        connectionId);
+    }
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the latency report: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541OverflowReport function.
+static const iocshArg iocshOpen62541OverflowReportArg0 = {
+  "connection ID", iocshArgString};
+static const iocshArg iocshOpen62541OverflowReportArg1 = {
+  "number of nodes", iocshArgInt};
+static const iocshArg * const iocshOpen62541OverflowReportArgs[] = {
+  &iocshOpen62541OverflowReportArg0,
+  &iocshOpen62541OverflowReportArg1};
+static const iocshFuncDef iocshOpen62541OverflowReportFuncDef = {
+  "open62541OverflowReport", 2, iocshOpen62541OverflowReportArgs
+};
+
+/**
+ * Implementation of the iocsh open62541OverflowReport function. This function
+ * prints the nodes for which the queue of the monitored item on the server
+ * overflowed most often, sorted by the number of overflows. Only the nodes of
+ * the specified connection (or all connections if no connection ID is
+ * specified) are considered. If the number of nodes is not positive, ten
+ * nodes are printed.
+ */
+static void iocshOpen62541OverflowReportFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  int numberOfNodes = args[1].ival;
+  if (numberOfNodes <= 0) {
+    numberOfNodes = 10;
+  }
+  struct Entry {
+    std::string connectionId;
+    std::string subscription;
+    std::string nodeId;
+    std::uint64_t overflows;
+  };
+  try {
+    std::vector<Entry> entries;
+    auto found = forEachConnection(connectionId,
+      [&entries](const std::string &id, ServerConnection &connection) {
+        for (auto &subscription : connection.getAllSubscriptionStatistics()) {
+          for (auto &node : subscription.second->getNodeOverflows()) {
+            entries.push_back(Entry{id, subscription.first,
+              node.first.toString(), node.second});
+          }
+        }
+      });
+    if (!found) {
+      errorPrintf(
+        "Could not print the overflow report: The connection with the ID \"%s\" does not exist.",
+        connectionId);
+      return;
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+      [](const Entry &a, const Entry &b) {
+        return a.overflows > b.overflows;
+      });
+    if (entries.size() > static_cast<std::size_t>(numberOfNodes)) {
+      entries.resize(numberOfNodes);
+    }
+    if (entries.empty()) {
+      printf("No overflows have been reported.\n");
+      return;
+    }
+    printf("%10s %-16s %-16s %s\n", "overflows", "connection",
+      "subscription", "node");
+    for (auto &entry : entries) {
+      printf("%10" PRIu64 " %-16s %-16s %s\n", entry.overflows,
+        entry.connectionId.c_str(), entry.subscription.c_str(),
+        entry.nodeId.c_str());
+    }
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the overflow report: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541Top function.
+static const iocshArg iocshOpen62541TopArg0 = {
+  "connection ID", iocshArgString};
+static const iocshArg iocshOpen62541TopArg1 = {
+  "number of nodes", iocshArgInt};
+static const iocshArg iocshOpen62541TopArg2 = {
+  "seconds", iocshArgDouble};
+static const iocshArg * const iocshOpen62541TopArgs[] = {
+  &iocshOpen62541TopArg0,
+  &iocshOpen62541TopArg1,
+  &iocshOpen62541TopArg2};
+static const iocshFuncDef iocshOpen62541TopFuncDef = {
+  "open62541Top", 3, iocshOpen62541TopArgs
+};
+
+/**
+ * Implementation of the iocsh open62541Top function. This function samples
+ * the per-node counters of the specified connection (or all connections if no
+ * connection ID is specified) over the specified number of seconds and then
+ * prints the nodes with the highest rates of notifications, reads, writes,
+ * and bytes and with the most processing time. If the number of nodes is not
+ * positive, ten nodes are printed. If the number of seconds is not positive,
+ * the counters are sampled for five seconds.
+ */
+static void iocshOpen62541TopFunc(const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  int numberOfNodes = args[1].ival;
+  double seconds = args[2].dval;
+  if (numberOfNodes <= 0) {
+    numberOfNodes = 10;
+  }
+  if (!(seconds > 0.0)) {
+    seconds = 5.0;
+  }
+  struct Entry {
+    std::string connectionId;
+    std::string nodeId;
+    NodeStatistics::Snapshot delta;
+  };
+  try {
+    std::vector<std::pair<std::string, std::shared_ptr<ServerConnection>>>
+      connections;
+    for (auto &entry : ServerConnectionRegistry::getInstance()
+        .getServerConnections()) {
+      if (!connectionId || !std::strlen(connectionId)
+          || entry.first == connectionId) {
+        connections.push_back(entry);
+      }
+    }
+    if (connectionId && std::strlen(connectionId) && connections.empty()) {
+      errorPrintf(
+        "Could not print the top nodes: The connection with the ID \"%s\" does not exist.",
+        connectionId);
+      return;
+    }
+    std::vector<std::vector<std::pair<UaNodeId, NodeStatistics::Snapshot>>>
+      before;
+    for (auto &connection : connections) {
+      connection.second->getNodeStatistics().startSampling();
+      before.push_back(connection.second->getNodeStatistics().getSnapshot());
+    }
+    auto startTime = std::chrono::steady_clock::now();
+    printf("Sampling for %.1f seconds...\n", seconds);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - startTime).count();
+    std::vector<Entry> entries;
+    for (std::size_t i = 0; i < connections.size(); ++i) {
+      auto &nodeStatistics = connections[i].second->getNodeStatistics();
+      auto after = nodeStatistics.getSnapshot();
+      nodeStatistics.stopSampling();
+      std::unordered_map<UaNodeId, NodeStatistics::Snapshot> previous(
+        before[i].begin(), before[i].end());
+      for (auto &node : after) {
+        NodeStatistics::Snapshot delta = node.second;
+        auto previousNode = previous.find(node.first);
+        if (previousNode != previous.end()) {
+          delta.bytes -= previousNode->second.bytes;
+          delta.notifications -= previousNode->second.notifications;
+          delta.processingTime -= previousNode->second.processingTime;
+          delta.reads -= previousNode->second.reads;
+          delta.writes -= previousNode->second.writes;
+        }
+        entries.push_back(Entry{connections[i].first, node.first.toString(),
+          delta});
+      }
+    }
+    auto printTop = [&entries, elapsed, numberOfNodes](const char *title,
+        const char *unit, double scale,
+        std::function<std::uint64_t(const NodeStatistics::Snapshot &)> get) {
+      std::stable_sort(entries.begin(), entries.end(),
+        [&get](const Entry &a, const Entry &b) {
+          return get(a.delta) > get(b.delta);
+        });
+      printf("%s:\n", title);
+      int printed = 0;
+      for (auto &entry : entries) {
+        if (printed >= numberOfNodes || !get(entry.delta)) {
+          break;
+        }
+        printf("  %12.1f %-6s %-16s %s\n",
+          get(entry.delta) * scale / elapsed, unit,
+          entry.connectionId.c_str(), entry.nodeId.c_str());
+        ++printed;
+      }
+      if (!printed) {
+        printf("  (none)\n");
+      }
+    };
+    printTop("Notifications", "1/s", 1.0,
+      [](const NodeStatistics::Snapshot &s) { return s.notifications; });
+    printTop("Reads", "1/s", 1.0,
+      [](const NodeStatistics::Snapshot &s) { return s.reads; });
+    printTop("Writes", "1/s", 1.0,
+      [](const NodeStatistics::Snapshot &s) { return s.writes; });
+    printTop("Bytes", "B/s", 1.0,
+      [](const NodeStatistics::Snapshot &s) { return s.bytes; });
+    printTop("Record processing time", "ms/s", 1e-6,
+      [](const NodeStatistics::Snapshot &s) { return s.processingTime; });
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the top nodes: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541ResetLatencyHistograms
+// function.
+static const iocshArg iocshOpen62541ResetLatencyHistogramsArg0 = {
+  "connection ID", iocshArgString};
+static const iocshArg * const iocshOpen62541ResetLatencyHistogramsArgs[] = {
+  &iocshOpen62541ResetLatencyHistogramsArg0};
+static const iocshFuncDef iocshOpen62541ResetLatencyHistogramsFuncDef = {
+  "open62541ResetLatencyHistograms", 1,
+  iocshOpen62541ResetLatencyHistogramsArgs
+};
+
+/**
+ * Implementation of the iocsh open62541ResetLatencyHistograms function. This
+ * function removes all values from the latency histograms of the specified
+ * connection (or all connections if no connection ID is specified) and their
+ * subscriptions.
+ */
+static void iocshOpen62541ResetLatencyHistogramsFunc(
+    const iocshArgBuf *args) noexcept {
+  char const *connectionId = args[0].sval;
+  try {
+    auto found = forEachConnection(connectionId,
+      [](const std::string &, ServerConnection &connection) {
+        connection.getStatistics().resetLatencyHistograms();
+        for (auto &subscription : connection.getAllSubscriptionStatistics()) {
+          subscription.second->resetLatencyHistograms();
+        }
+      });
+    if (!found) {
+      errorPrintf(
+        "Could not reset the latency histograms: The connection with the ID \"%s\" does not exist.",
+        connectionId);
+    }
+  } catch (const std::exception &e) {
+    errorPrintf("Could not reset the latency histograms: %s", e.what());
+  }
+}
+
+/**
+ * Prints the startup profile: the timings of iocInit and of each startup
+ * phase and, for each connection, the startup statistics.
+ */
+static void printStartupReport() {
+  auto &profiler = StartupProfiler::getInstance();
+  printf("open62541 startup profile (times in seconds since the library was loaded):\n");
+  auto iocInitStart = profiler.getIocInitStartTime();
+  auto iocInitEnd = profiler.getIocInitEndTime();
+  if (iocInitStart >= 0.0) {
+    printf("  iocInit started at %.3f", iocInitStart);
+    if (iocInitEnd >= 0.0) {
+      printf(", finished at %.3f (%.3f)", iocInitEnd,
+        iocInitEnd - iocInitStart);
+    }
+    printf("\n");
+  }
+  printf("  %-24s %8s %10s %10s %10s\n", "phase", "count", "total",
+    "first", "last");
+  for (std::size_t i = 0;
+      i < static_cast<std::size_t>(StartupProfiler::Phase::numberOfPhases);
+      ++i) {
+    auto phase = static_cast<StartupProfiler::Phase>(i);
+    auto timings = profiler.getPhaseTimings(phase);
+    if (timings.count == 0) {
+      printf("  %-24s %8d %10s %10s %10s\n",
+        StartupProfiler::getPhaseName(phase), 0, "-", "-", "-");
+      continue;
+    }
+    printf("  %-24s %8" PRIu64 " %10.3f %10.3f %10.3f\n",
+      StartupProfiler::getPhaseName(phase), timings.count, timings.totalTime,
+      timings.firstStart, timings.lastEnd);
+  }
+  for (auto &entry : ServerConnectionRegistry::getInstance()
+      .getServerConnections()) {
+    auto &startup = entry.second->getStartupStatistics();
+    printf("  %s: %" PRIu64 " records initialized, %" PRIu64
+      " monitored item creations (%" PRIu64 " failed)", entry.first.c_str(),
+      startup.getRecordsInitialized(), startup.getMonitoredItemsCreated(),
+      startup.getMonitoredItemsFailed());
+    auto connectTime = startup.getConnectTime();
+    if (connectTime >= 0.0) {
+      printf(", connected at %.3f\n", connectTime);
+    } else {
+      printf(", not connected yet\n");
+    }
+    auto monitoredRecords = startup.getMonitoredRecords();
+    if (!monitoredRecords) {
+      continue;
+    }
+    printf("    first notification for %zu of %" PRIu64 " monitored records",
+      startup.getFirstNotificationCount(), monitoredRecords);
+    const double fractions[] = {0.5, 0.9, 1.0};
+    const char *const labels[] = {"50%", "90%", "100%"};
+    for (std::size_t i = 0; i < 3; ++i) {
+      double time;
+      if (startup.getFirstNotificationTime(fractions[i], time)) {
+        printf(", %s at %.3f", labels[i], time);
+      } else {
+        printf(", %s pending", labels[i]);
+      }
+    }
+    printf("\n");
+  }
+}
+
+/**
+ * Hook that is called by iocInit. It records the start and end of iocInit
+ * and prints the startup profile when the IOC is running.
+ */
+static void open62541InitHook(initHookState state) {
+  try {
+    switch (state) {
+    case initHookAtBeginning:
+      StartupProfiler::getInstance().markIocInitStart();
+      break;
+    case initHookAfterIocRunning:
+      StartupProfiler::getInstance().markIocInitEnd();
+      // The records have registered their monitored items now, so replay
+      // connections can start sending notifications.
+      for (auto &entry
+          : ServerConnectionRegistry::getInstance().getConnections()) {
+        auto replayConnection =
+          std::dynamic_pointer_cast<ReplayConnection>(entry.second);
+        if (replayConnection) {
+          replayConnection->start();
+        }
+      }
+      // There is no point in printing the profile if the device support is
+      // not used by this IOC.
+      if (!ServerConnectionRegistry::getInstance()
+          .getServerConnections().empty()) {
+        printStartupReport();
+      }
+      break;
+    default:
+      break;
+    }
+  } catch (const std::exception &e) {
+    errorPrintf("Could not record the startup profile: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541StartupReport function.
+static const iocshFuncDef iocshOpen62541StartupReportFuncDef = {
+  "open62541StartupReport", 0, nullptr
+};
+
+/**
+ * Implementation of the iocsh open62541StartupReport function. This function
+ * prints the same startup profile that is printed at the end of iocInit, but
+ * with updated information about the first notifications.
+ */
+static void iocshOpen62541StartupReportFunc(const iocshArgBuf *) noexcept {
+  try {
+    printStartupReport();
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the startup report: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541Report function.
+static const iocshArg iocshOpen62541ReportArg0 = {
+  "level", iocshArgInt};
+static const iocshArg * const iocshOpen62541ReportArgs[] = {
+  &iocshOpen62541ReportArg0};
+static const iocshFuncDef iocshOpen62541ReportFuncDef = {
+  "open62541Report", 1, iocshOpen62541ReportArgs
+};
+
+/**
+ * Implementation of the iocsh open62541Report function. This function prints
+ * the statistics for all connections. The amount of detail depends on the
+ * specified level (0 to 2).
+ */
+static void iocshOpen62541ReportFunc(const iocshArgBuf *args) noexcept {
+  try {
+    printStatisticsReport(args[0].ival);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the report: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541SetSubscriptionLifetimeCount
+// function.
+static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg1 = {
+  "subscription ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionLifetimeCountArg2 = {
+  "lifetime count", iocshArgInt
+};
+
+static const iocshArg * const iocshOpen62541SetSubscriptionLifetimeCountArgs[] = {
+  &iocshOpen62541SetSubscriptionLifetimeCountArg0,
+  &iocshOpen62541SetSubscriptionLifetimeCountArg1,
+  &iocshOpen62541SetSubscriptionLifetimeCountArg2
+};
+static const iocshFuncDef iocshOpen62541SetSubscriptionLifetimeCountFuncDef = {
+  "open62541SetSubscriptionLifetimeCount", 3,
+  iocshOpen62541SetSubscriptionLifetimeCountArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetSubscriptionLifetimeCount function.
+ * This function sets the requested lifetime count for a specific subscription
+ * associated with a specific connection.
+ */
+static void iocshOpen62541SetSubscriptionLifetimeCountFunc(
+    const iocshArgBuf *args) noexcept {
+  char *connectionId = args[0].sval;
+  char *subscriptionId = args[1].sval;
+  int lifetimeCount = args[2].ival;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: Connection ID must not be empty.");
+    return;
+  }
+  if (!subscriptionId) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: Subscription ID must be specified.");
+    return;
+  }
+  if (!std::strlen(subscriptionId)) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: Subscription ID must not be empty.");
+    return;
+  }
+  if (lifetimeCount < 0) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: The lifetime count cannot be negative.");
+    return;
+  }
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
+    errorPrintf(
+      "Could not set the subscription lifetime count: The connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  connection->setSubscriptionLifetimeCount(subscriptionId, lifetimeCount);
+}
+
+// Data structures needed for the iocsh
+// open62541SetSubscriptionMaxKeepAliveCount function.
+static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg1 = {
+  "subscription ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionMaxKeepAliveCountArg2 = {
+  "max. keep alive count", iocshArgInt
+};
+
+static const iocshArg * const iocshOpen62541SetSubscriptionMaxKeepAliveCountArgs[] = {
+  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg0,
+  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg1,
+  &iocshOpen62541SetSubscriptionMaxKeepAliveCountArg2
+};
+static const iocshFuncDef iocshOpen62541SetSubscriptionMaxKeepAliveCountFuncDef = {
+  "open62541SetSubscriptionMaxKeepAliveCount", 3,
+  iocshOpen62541SetSubscriptionMaxKeepAliveCountArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetSubscriptionMaxKeepAliveCount
+ * function. This function sets the requested max. keep alive count for a
+ * specific subscription associated with a specific connection.
+ */
+static void iocshOpen62541SetSubscriptionMaxKeepAliveCountFunc(
+    const iocshArgBuf *args) noexcept {
+  char *connectionId = args[0].sval;
+  char *subscriptionId = args[1].sval;
+  int maxKeepAliveCount = args[2].ival;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: Connection ID must not be empty.");
+    return;
+  }
+  if (!subscriptionId) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: Subscription ID must be specified.");
+    return;
+  }
+  if (!std::strlen(subscriptionId)) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: Subscription ID must not be empty.");
+    return;
+  }
+  if (maxKeepAliveCount < 0) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: The MaxKeepAlive count cannot be negative.");
+    return;
+  }
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
+    errorPrintf(
+      "Could not set the subscription max. keep alive count: The connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  connection->setSubscriptionMaxKeepAliveCount(subscriptionId, maxKeepAliveCount);
+}
+
+// Data structures needed for the iocsh
+// open62541SetSubscriptionPublishingInterval function.
+static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg1 = {
+  "subscription ID", iocshArgString
+};
+static const iocshArg iocshOpen62541SetSubscriptionPublishingIntervalArg2 = {
+  "publishing interval (in ms)", iocshArgDouble
+};
+
+static const iocshArg * const iocshOpen62541SetSubscriptionPublishingIntervalArgs[] = {
+  &iocshOpen62541SetSubscriptionPublishingIntervalArg0,
+  &iocshOpen62541SetSubscriptionPublishingIntervalArg1,
+  &iocshOpen62541SetSubscriptionPublishingIntervalArg2
+};
+static const iocshFuncDef iocshOpen62541SetSubscriptionPublishingIntervalFuncDef = {
+  "open62541SetSubscriptionPublishingInterval", 3,
+  iocshOpen62541SetSubscriptionPublishingIntervalArgs
+};
+
+/**
+ * Implementation of the iocsh open62541SetSubscriptionPublishingInterval function.
+ * This function sets the requested publishing interval for a specific subscription
+ * associated with a specific connection.
+ */
+static void iocshOpen62541SetSubscriptionPublishingIntervalFunc(
+    const iocshArgBuf *args) noexcept {
+  char *connectionId = args[0].sval;
+  char *subscriptionId = args[1].sval;
+  double publishingInterval = args[2].dval;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not set the subscription publishing interval: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not set the subscription publishing interval: Connection ID must not be empty.");
+    return;
+  }
+  if (!subscriptionId) {
+    errorPrintf(
+      "Could not set the subscription publishing interval: Subscription ID must be specified.");
+    return;
+  }
+  if (!std::strlen(subscriptionId)) {
+    errorPrintf(
+      "Could not set the subscription publishing interval: Subscription ID must not be empty.");
+    return;
+  }
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
+    errorPrintf(
+      "Could not set the subscription publishing interval: The connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  connection->setSubscriptionPublishingInterval(subscriptionId, publishingInterval);
+}
+
+// Data structures needed for the iocsh open62541StartTrafficCapture function.
+static const iocshArg iocshOpen62541StartTrafficCaptureArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541StartTrafficCaptureArg1 = {
+  "file name", iocshArgString
+};
+static const iocshArg * const iocshOpen62541StartTrafficCaptureArgs[] = {
+  &iocshOpen62541StartTrafficCaptureArg0,
+  &iocshOpen62541StartTrafficCaptureArg1
+};
+static const iocshFuncDef iocshOpen62541StartTrafficCaptureFuncDef = {
+  "open62541StartTrafficCapture", 2, iocshOpen62541StartTrafficCaptureArgs
+};
+
+/**
+ * Exit hook that closes a traffic recorder, so that the buffered records are
+ * written to the file when the IOC shuts down.
+ */
+static void closeTrafficRecorderAtExit(void *arg) {
+  auto recorderPtr = static_cast<std::weak_ptr<TrafficRecorder> *>(arg);
+  auto recorder = recorderPtr->lock();
+  delete recorderPtr;
+  if (recorder) {
+    recorder->close();
+  }
+}
+
+/**
+ * Implementation of the iocsh open62541StartTrafficCapture function. This
+ * function starts writing the notifications and the results of read and write
+ * operations of a connection to a file. If the traffic of the connection is
+ * already being captured, the old file is closed.
+ */
+static void iocshOpen62541StartTrafficCaptureFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *connectionId = args[0].sval;
+  char const *fileName = args[1].sval;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not start the traffic capture: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not start the traffic capture: Connection ID must not be empty.");
+    return;
+  }
+  if (!fileName || !std::strlen(fileName)) {
+    errorPrintf(
+      "Could not start the traffic capture: File name must be specified.");
+    return;
+  }
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
+    errorPrintf(
+      "Could not start the traffic capture: The connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  try {
+    auto recorder = std::make_shared<TrafficRecorder>(fileName);
+    auto oldRecorder = connection->getTrafficRecorder();
+    connection->setTrafficRecorder(recorder);
+    if (oldRecorder) {
+      oldRecorder->close();
+    }
+    ::epicsAtExit(closeTrafficRecorderAtExit,
+      new std::weak_ptr<TrafficRecorder>(recorder));
+  } catch (const std::exception &e) {
+    errorPrintf("Could not start the traffic capture: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541StopTrafficCapture function.
+static const iocshArg iocshOpen62541StopTrafficCaptureArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg * const iocshOpen62541StopTrafficCaptureArgs[] = {
+  &iocshOpen62541StopTrafficCaptureArg0
+};
+static const iocshFuncDef iocshOpen62541StopTrafficCaptureFuncDef = {
+  "open62541StopTrafficCapture", 1, iocshOpen62541StopTrafficCaptureArgs
+};
+
+/**
+ * Implementation of the iocsh open62541StopTrafficCapture function. This
+ * function stops capturing the traffic of a connection, closes the file, and
+ * prints how many records have been captured.
+ */
+static void iocshOpen62541StopTrafficCaptureFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *connectionId = args[0].sval;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not stop the traffic capture: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not stop the traffic capture: Connection ID must not be empty.");
+    return;
+  }
+  std::shared_ptr<ServerConnection> connection =
+    ServerConnectionRegistry::getInstance().getServerConnection(connectionId);
+  if (!connection) {
+    errorPrintf(
+      "Could not stop the traffic capture: The connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  auto recorder = connection->getTrafficRecorder();
+  if (!recorder) {
+    errorPrintf(
+      "Could not stop the traffic capture: The traffic of the connection with the ID \"%s\" is not being captured.",
+      connectionId);
+    return;
+  }
+  connection->setTrafficRecorder(nullptr);
+  recorder->close();
+  printf("%s: %" PRIu64 " records (%" PRIu64 " bytes) written to \"%s\", %"
+    PRIu64 " records dropped\n", connectionId, recorder->getRecords(),
+    recorder->getWrittenBytes(), recorder->getFileName().c_str(),
+    recorder->getDroppedRecords());
+}
+
+// Data structures needed for the iocsh open62541ReplayConnectionSetup
+// function.
+static const iocshArg iocshOpen62541ReplayConnectionSetupArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541ReplayConnectionSetupArg1 = {
+  "file name", iocshArgString
+};
+static const iocshArg iocshOpen62541ReplayConnectionSetupArg2 = {
+  "speed", iocshArgDouble
+};
+static const iocshArg iocshOpen62541ReplayConnectionSetupArg3 = {
+  "loop", iocshArgInt
+};
+static const iocshArg * const iocshOpen62541ReplayConnectionSetupArgs[] = {
+  &iocshOpen62541ReplayConnectionSetupArg0,
+  &iocshOpen62541ReplayConnectionSetupArg1,
+  &iocshOpen62541ReplayConnectionSetupArg2,
+  &iocshOpen62541ReplayConnectionSetupArg3
+};
+static const iocshFuncDef iocshOpen62541ReplayConnectionSetupFuncDef = {
+  "open62541ReplayConnectionSetup", 4, iocshOpen62541ReplayConnectionSetupArgs
+};
+
+/**
+ * Implementation of the iocsh open62541ReplayConnectionSetup function. This
+ * function creates a connection that replays a file written by
+ * open62541StartTrafficCapture instead of connecting to a server. The replay
+ * starts when iocInit has finished.
+ */
+static void iocshOpen62541ReplayConnectionSetupFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *connectionId = args[0].sval;
+  char const *fileName = args[1].sval;
+  double speed = args[2].dval;
+  bool loop = args[3].ival != 0;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not setup the connection: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not setup the connection: Connection ID must not be empty.");
+    return;
+  }
+  if (!fileName || !std::strlen(fileName)) {
+    errorPrintf(
+      "Could not setup the connection: File name must be specified.");
+    return;
+  }
+  try {
+    auto connection = std::make_shared<ReplayConnection>(
+      fileName, speed, loop);
+    ServerConnectionRegistry::getInstance().registerConnection(
+      connectionId, connection);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not setup the connection: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541LoopbackServerSetup function.
+static const iocshArg iocshOpen62541LoopbackServerSetupArg0 = {
+  "server name", iocshArgString
+};
+static const iocshArg iocshOpen62541LoopbackServerSetupArg1 = {
+  "configuration file", iocshArgString
+};
+static const iocshArg iocshOpen62541LoopbackServerSetupArg2 = {
+  "update rate", iocshArgDouble
+};
+static const iocshArg * const iocshOpen62541LoopbackServerSetupArgs[] = {
+  &iocshOpen62541LoopbackServerSetupArg0,
+  &iocshOpen62541LoopbackServerSetupArg1,
+  &iocshOpen62541LoopbackServerSetupArg2
+};
+static const iocshFuncDef iocshOpen62541LoopbackServerSetupFuncDef = {
+  "open62541LoopbackServerSetup", 3, iocshOpen62541LoopbackServerSetupArgs
+};
+
+/**
+ * Implementation of the iocsh open62541LoopbackServerSetup function. This
+ * function starts an OPC UA server inside the IOC, creating the nodes defined
+ * in the configuration file. Connections can use this server through the
+ * endpoint URL "loopback://<name>". This function has to be called before
+ * open62541ConnectionSetup, because that function starts a loopback server
+ * without a configuration file if it does not exist yet.
+ */
+static void iocshOpen62541LoopbackServerSetupFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *serverName = args[0].sval;
+  char const *configFile = args[1].sval;
+  double updateRate = args[2].dval;
+  // Verify and convert the parameters.
+  if (!serverName || !std::strlen(serverName)) {
+    errorPrintf(
+      "Could not setup the loopback server: Server name must be specified.");
+    return;
+  }
+  if (!(updateRate >= 0.0)) {
+    errorPrintf(
+      "Could not setup the loopback server: Update rate must not be negative.");
+    return;
+  }
+  try {
+    auto server = LoopbackServer::create(serverName,
+      configFile ? configFile : "", updateRate);
+    printf("Loopback server \"%s\" listening on %s with %zu nodes\n",
+      serverName, server->getEndpointUrl().c_str(), server->getNodeCount());
+  } catch (const std::exception &e) {
+    errorPrintf("Could not setup the loopback server: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541PubSubConnectionSetup
+// function.
+static const iocshArg iocshOpen62541PubSubConnectionSetupArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541PubSubConnectionSetupArg1 = {
+  "endpoint URL", iocshArgString
+};
+static const iocshArg iocshOpen62541PubSubConnectionSetupArg2 = {
+  "network interface", iocshArgString
+};
+static const iocshArg iocshOpen62541PubSubConnectionSetupArg3 = {
+  "publisher ID", iocshArgString
+};
+static const iocshArg * const iocshOpen62541PubSubConnectionSetupArgs[] = {
+  &iocshOpen62541PubSubConnectionSetupArg0,
+  &iocshOpen62541PubSubConnectionSetupArg1,
+  &iocshOpen62541PubSubConnectionSetupArg2,
+  &iocshOpen62541PubSubConnectionSetupArg3
+};
+static const iocshFuncDef iocshOpen62541PubSubConnectionSetupFuncDef = {
+  "open62541PubSubConnectionSetup", 4, iocshOpen62541PubSubConnectionSetupArgs
+};
+
+/**
+ * Implementation of the iocsh open62541PubSubConnectionSetup function. This
+ * function creates a connection that receives OPC UA PubSub network messages
+ * (UADP over UDP) instead of connecting to a server.
+ */
+static void iocshOpen62541PubSubConnectionSetupFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *connectionId = args[0].sval;
+  char const *endpointUrl = args[1].sval;
+  char const *networkInterface = args[2].sval;
+  char const *publisherId = args[3].sval;
+  // Verify and convert the parameters.
+  if (!connectionId) {
+    errorPrintf(
+      "Could not setup the connection: Connection ID must be specified.");
+    return;
+  }
+  if (!std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not setup the connection: Connection ID must not be empty.");
+    return;
+  }
+  if (!endpointUrl || !std::strlen(endpointUrl)) {
+    errorPrintf(
+      "Could not setup the connection: Endpoint URL must be specified.");
+    return;
+  }
+  try {
+    auto connection = std::make_shared<PubSubConnection>(endpointUrl,
+      networkInterface ? networkInterface : "",
+      publisherId ? publisherId : "");
+    ServerConnectionRegistry::getInstance().registerConnection(
+      connectionId, connection);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not setup the connection: %s", e.what());
+  }
+}
+
+// Data structures needed for the iocsh open62541PubSubWriterGroupSetup
+// function.
+static const iocshArg iocshOpen62541PubSubWriterGroupSetupArg0 = {
+  "connection ID", iocshArgString
+};
+static const iocshArg iocshOpen62541PubSubWriterGroupSetupArg1 = {
+  "publisher ID", iocshArgInt
+};
+static const iocshArg iocshOpen62541PubSubWriterGroupSetupArg2 = {
+  "writer group ID", iocshArgInt
+};
+static const iocshArg iocshOpen62541PubSubWriterGroupSetupArg3 = {
+  "publishing interval (in ms)", iocshArgDouble
+};
+static const iocshArg * const iocshOpen62541PubSubWriterGroupSetupArgs[] = {
+  &iocshOpen62541PubSubWriterGroupSetupArg0,
+  &iocshOpen62541PubSubWriterGroupSetupArg1,
+  &iocshOpen62541PubSubWriterGroupSetupArg2,
+  &iocshOpen62541PubSubWriterGroupSetupArg3
+};
+static const iocshFuncDef iocshOpen62541PubSubWriterGroupSetupFuncDef = {
+  "open62541PubSubWriterGroupSetup", 4,
+  iocshOpen62541PubSubWriterGroupSetupArgs
+};
+
+/**
+ * Implementation of the iocsh open62541PubSubWriterGroupSetup function. This
+ * function sets up the writer group of a PubSub connection, so that output
+ * records can publish their values.
+ */
+static void iocshOpen62541PubSubWriterGroupSetupFunc(const iocshArgBuf *args)
+    noexcept {
+  char const *connectionId = args[0].sval;
+  int publisherId = args[1].ival;
+  int writerGroupId = args[2].ival;
+  double publishingInterval = args[3].dval;
+  // Verify and convert the parameters.
+  if (!connectionId || !std::strlen(connectionId)) {
+    errorPrintf(
+      "Could not setup the writer group: Connection ID must be specified.");
+    return;
+  }
+  if (publisherId < 1 || publisherId > 0xFFFF) {
+    errorPrintf(
+      "Could not setup the writer group: Publisher ID must be between 1 and 65535.");
+    return;
+  }
+  if (writerGroupId < 1 || writerGroupId > 0xFFFF) {
+    errorPrintf(
+      "Could not setup the writer group: Writer group ID must be between 1 and 65535.");
+    return;
+  }
+  if (!(publishingInterval > 0.0)) {
+    errorPrintf(
+      "Could not setup the writer group: Publishing interval must be positive.");
+    return;
+  }
+  auto connection = std::dynamic_pointer_cast<PubSubConnection>(
+    ServerConnectionRegistry::getInstance().getConnection(connectionId));
+  if (!connection) {
+    errorPrintf(
+      "Could not setup the writer group: The PubSub connection with the ID \"%s\" does not exist.",
+      connectionId);
+    return;
+  }
+  try {
+    connection->setupWriterGroup(static_cast<UA_UInt16>(publisherId),
+      static_cast<UA_UInt16>(writerGroupId), publishingInterval);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not setup the writer group: %s", e.what());
+  }
+}
+
+/**
+ * Registrar that registers the iocsh commands and the init hook.
+ */
+static void open62541Registrar() {
+  ::iocshRegister(
+    &iocshOpen62541AllocationReportFuncDef,
+    iocshOpen62541AllocationReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541ConnectionSetupFuncDef,
+    iocshOpen62541ConnectionSetupFunc);
+  ::iocshRegister(
+    &iocshOpen62541ConnectionSetupEncryptedFuncDef,
+    iocshOpen62541ConnectionSetupEncryptedFunc);
+  ::iocshRegister(
+    &iocshOpen62541DumpServerCertificatesFuncDef,
+    iocshOpen62541DumpServerCertificatesFunc);
+  ::iocshRegister(
+    &iocshOpen62541StartupReportFuncDef,
+    iocshOpen62541StartupReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetConnectionThreadOptionsFuncDef,
+    iocshOpen62541SetConnectionThreadOptionsFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetErrorLogOptionsFuncDef,
+    iocshOpen62541SetErrorLogOptionsFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetRequestBudgetFuncDef,
+    iocshOpen62541SetRequestBudgetFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetRequestBudgetWeightFuncDef,
+    iocshOpen62541SetRequestBudgetWeightFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetProbeIntervalFuncDef,
+    iocshOpen62541SetProbeIntervalFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetServerDiagnosticsIntervalFuncDef,
+    iocshOpen62541SetServerDiagnosticsIntervalFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetSourceTimestampsFuncDef,
+    iocshOpen62541SetSourceTimestampsFunc);
+  ::iocshRegister(
+    &iocshOpen62541OverflowReportFuncDef,
+    iocshOpen62541OverflowReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541TopFuncDef,
+    iocshOpen62541TopFunc);
+  ::iocshRegister(
+    &iocshOpen62541LatencyReportFuncDef,
+    iocshOpen62541LatencyReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541ResetLatencyHistogramsFuncDef,
+    iocshOpen62541ResetLatencyHistogramsFunc);
+  ::iocshRegister(
+    &iocshOpen62541ReplayConnectionSetupFuncDef,
+    iocshOpen62541ReplayConnectionSetupFunc);
+  ::iocshRegister(
+    &iocshOpen62541LoopbackServerSetupFuncDef,
+    iocshOpen62541LoopbackServerSetupFunc);
+  ::iocshRegister(
+    &iocshOpen62541PubSubConnectionSetupFuncDef,
+    iocshOpen62541PubSubConnectionSetupFunc);
+  ::iocshRegister(
+    &iocshOpen62541PubSubWriterGroupSetupFuncDef,
+    iocshOpen62541PubSubWriterGroupSetupFunc);
+  ::iocshRegister(
+    &iocshOpen62541ReportFuncDef,
+    iocshOpen62541ReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541RequestBudgetReportFuncDef,
+    iocshOpen62541RequestBudgetReportFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetSubscriptionLifetimeCountFuncDef,
+    iocshOpen62541SetSubscriptionLifetimeCountFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetSubscriptionMaxKeepAliveCountFuncDef,
+    iocshOpen62541SetSubscriptionMaxKeepAliveCountFunc);
+  ::iocshRegister(
+    &iocshOpen62541SetSubscriptionPublishingIntervalFuncDef,
+    iocshOpen62541SetSubscriptionPublishingIntervalFunc);
+  ::iocshRegister(
+    &iocshOpen62541StartTrafficCaptureFuncDef,
+    iocshOpen62541StartTrafficCaptureFunc);
+  ::iocshRegister(
+    &iocshOpen62541StopTrafficCaptureFuncDef,
+    iocshOpen62541StopTrafficCaptureFunc);
+  ::initHookRegister(open62541InitHook);
+}
+
+epicsExportRegistrar(open62541Registrar);
+
+/**
+ * Report function of the driver support. This function is called by dbior and
+ * prints the same information as the iocsh open62541Report function.
+ */
+static long drvOpen62541Report(int level) {
+  try {
+    printStatisticsReport(level);
+  } catch (const std::exception &e) {
+    errorPrintf("Could not print the report: %s", e.what());
+  }
+  return 0;
+}
+
+/**
+ * Driver support entry table. This only exists so that the connection
+ * statistics are included in the output of dbior.
+ */
+drvet drvOpen62541 = {
+  2,
+  reinterpret_cast<DRVSUPFUN>(drvOpen62541Report),
+  nullptr
+};
+epicsExportAddress(drvet, drvOpen62541);
 
 } // extern "C"
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 aquenos GmbH.
+ * Copyright 2024 Karlsruhe Institute of Technology.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * This software has been developed by aquenos GmbH on behalf of the
+ * Karlsruhe Institute of Technology's Institute for Beam Physics and
+ * Technology.
+ */
+
+
+#ifndef OPEN62541_EPICS_TRACE_H
+#define OPEN62541_EPICS_TRACE_H
+
+/*
+ * Static tracepoints for the hot paths of the device support.
+ *
+ * When OPEN62541_EPICS_USE_USDT is defined (see USE_USDT in
+ * configure/CONFIG_SITE), the macros in this file expand to USDT probes in the
+ * "open62541" provider. These probes are a single no-op instruction while no
+ * tracer is attached, and they can be enabled at runtime by tools like
+ * bpftrace, perf, or SystemTap. When OPEN62541_EPICS_USE_USDT is not defined,
+ * the macros expand to nothing, and their arguments are not evaluated.
+ *
+ * The following probes are defined (all strings are null-terminated C
+ * strings):
+ *
+ * request_dequeue(const char *endpointUrl, int requestType, size_t queueDepth)
+ *   A request has been taken from the queue of a connection. The request type
+ *   is 0 for adding a monitored item, 1 for a read, 2 for removing a monitored
+ *   item, 3 for a write, and 4 for a method call.
+ *
+ * service_start(const char *endpointUrl, int requestType,
+ *     const UA_NodeId *nodeId)
+ *   A read, write, or call service call is about to be sent to the server.
+ *   For a call service call, which may contain several method calls, the node
+ *   ID is the one of the first method.
+ *
+ * service_end(const char *endpointUrl, int requestType,
+ *     const UA_NodeId *nodeId, uint32_t statusCode)
+ *   A read, write, or call service call has finished.
+ *
+ * notification(const char *endpointUrl, uint32_t subscriptionId,
+ *     uint32_t monitoredItemId, uint32_t statusCode)
+ *   A data-change notification for a monitored item has been received.
+ *
+ * schedule_processing(const char *recordName, int success)
+ *   Asynchronous processing of a record has been requested.
+ *
+ * process_start(const char *recordName, int pact)
+ *   A record is about to be processed by the device support.
+ *
+ * process_end(const char *recordName, int pact, int success)
+ *   The device support has finished processing a record. The pact argument
+ *   is the value of the PACT field after processing, so it is 1 when an
+ *   asynchronous request has been started.
+ */
+
+#ifdef OPEN62541_EPICS_USE_USDT
+
+#include <sys/sdt.h>
+
+#define OPEN62541_TRACE_REQUEST_DEQUEUE(endpointUrl, requestType, queueDepth) \
+  DTRACE_PROBE3(open62541, request_dequeue, endpointUrl, requestType, \
+    queueDepth)
+#define OPEN62541_TRACE_SERVICE_START(endpointUrl, requestType, nodeId) \
+  DTRACE_PROBE3(open62541, service_start, endpointUrl, requestType, nodeId)
+#define OPEN62541_TRACE_SERVICE_END(endpointUrl, requestType, nodeId, \
+    statusCode) \
+  DTRACE_PROBE4(open62541, service_end, endpointUrl, requestType, nodeId, \
+    statusCode)
+#define OPEN62541_TRACE_NOTIFICATION(endpointUrl, subscriptionId, \
+    monitoredItemId, statusCode) \
+  DTRACE_PROBE4(open62541, notification, endpointUrl, subscriptionId, \
+    monitoredItemId, statusCode)
+#define OPEN62541_TRACE_SCHEDULE_PROCESSING(recordName, success) \
+  DTRACE_PROBE2(open62541, schedule_processing, recordName, success)
+#define OPEN62541_TRACE_PROCESS_START(recordName, pact) \
+  DTRACE_PROBE2(open62541, process_start, recordName, pact)
+#define OPEN62541_TRACE_PROCESS_END(recordName, pact, success) \
+  DTRACE_PROBE3(open62541, process_end, recordName, pact, success)
+
+#else // OPEN62541_EPICS_USE_USDT
+
+#define OPEN62541_TRACE_REQUEST_DEQUEUE(endpointUrl, requestType, queueDepth)
+#define OPEN62541_TRACE_SERVICE_START(endpointUrl, requestType, nodeId)
+#define OPEN62541_TRACE_SERVICE_END(endpointUrl, requestType, nodeId, \
+    statusCode)
+#define OPEN62541_TRACE_NOTIFICATION(endpointUrl, subscriptionId, \
+    monitoredItemId, statusCode)
+#define OPEN62541_TRACE_SCHEDULE_PROCESSING(recordName, success)
+#define OPEN62541_TRACE_PROCESS_START(recordName, pact)
+#define OPEN62541_TRACE_PROCESS_END(recordName, pact, success)
+
+#endif // OPEN62541_EPICS_USE_USDT
+
+#endif // OPEN62541_EPICS_TRACE_H